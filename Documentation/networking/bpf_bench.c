@@ -0,0 +1,345 @@
+/*
+ * bpf_bench: measure the per packet cost of socket filters, interpreted
+ * and, where the kernel has it, compiled by the BPF JIT.
+ *
+ * A number of PF_PACKET sockets are bound to the loopback device with
+ * the filter under test attached, and UDP packets are bounced through
+ * loopback to ourselves.  The packets are picked so that the filters
+ * reject them, which makes every tap run its filter and nothing else.
+ * Each packet passes the taps twice, once on transmit and once on
+ * receive, so the cost of one filter run is
+ *
+ *   (time per packet with taps - time per packet without) / (2 * taps)
+ *
+ * The JIT is switched on and off through /proc/sys/net/core/bpf_jit_enable
+ * and only applies to filters attached after the switch; the original
+ * setting is restored on exit.  Needs CAP_NET_RAW and, for the JIT
+ * comparison, write access to the sysctl.
+ *
+ * Besides the built in filters, programs captured with "tcpdump -ddd"
+ * can be loaded with -f; the traffic is UDP to 127.0.0.1 port 9999.
+ *
+ * Usage: bpf_bench [-n packets] [-t taps] [-l payload] [-f file]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#define JIT_SYSCTL	"/proc/sys/net/core/bpf_jit_enable"
+#define BENCH_PORT	9999
+#define MAX_FILTERS	16
+#define MAX_TAPS	64
+
+struct filter {
+	const char *name;
+	struct sock_filter *insns;
+	unsigned short len;
+};
+
+/* ip src net 10.0.0.0/8 */
+static struct sock_filter ip_src_net[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x0800, 0, 4),
+	BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 26),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xff000000),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x0a000000, 0, 1),
+	BPF_STMT(BPF_RET|BPF_K, 65535),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+};
+
+/* tcp dst port 80 */
+static struct sock_filter tcp_dst_port[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x86dd, 0, 4),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 6, 0, 11),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 56),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 80, 8, 9),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x0800, 0, 8),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 6, 0, 6),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 4, 0),
+	BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 80, 0, 1),
+	BPF_STMT(BPF_RET|BPF_K, 65535),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+};
+
+/* udp port 53 */
+static struct sock_filter udp_port[] = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x86dd, 0, 6),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 17, 0, 15),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 54),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 53, 12, 0),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 56),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 53, 10, 11),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x0800, 0, 10),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 17, 0, 8),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 6, 0),
+	BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 14),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 53, 2, 0),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 53, 0, 1),
+	BPF_STMT(BPF_RET|BPF_K, 262144),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+};
+
+#define FILTER(name, insns) \
+	{ name, insns, sizeof(insns) / sizeof(insns[0]) }
+
+static struct filter filters[MAX_FILTERS] = {
+	FILTER("ip src net 10.0.0.0/8", ip_src_net),
+	FILTER("tcp dst port 80", tcp_dst_port),
+	FILTER("udp port 53", udp_port),
+};
+static int nr_filters = 3;
+static int builtin_filters = 1;
+
+static int opt_packets = 200000;
+static int opt_taps = 8;
+static int opt_payload = 64;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int read_jit(void)
+{
+	FILE *f = fopen(JIT_SYSCTL, "r");
+	int val = -1;
+
+	if (f) {
+		if (fscanf(f, "%d", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static int write_jit(int val)
+{
+	FILE *f = fopen(JIT_SYSCTL, "w");
+
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", val);
+	return fclose(f);
+}
+
+/* Load a program in the decimal format printed by tcpdump -ddd */
+static void load_filter(const char *path)
+{
+	struct filter *fl;
+	unsigned int code, jt, jf, k;
+	int i, len;
+	FILE *f;
+
+	if (builtin_filters) {
+		nr_filters = 0;
+		builtin_filters = 0;
+	}
+	if (nr_filters == MAX_FILTERS) {
+		fprintf(stderr, "too many filters\n");
+		exit(1);
+	}
+
+	f = fopen(path, "r");
+	if (!f)
+		fatal(path);
+	if (fscanf(f, "%d", &len) != 1 || len <= 0 || len > BPF_MAXINSNS) {
+		fprintf(stderr, "%s: bad instruction count\n", path);
+		exit(1);
+	}
+
+	fl = &filters[nr_filters++];
+	fl->name = path;
+	fl->len = len;
+	fl->insns = calloc(len, sizeof(*fl->insns));
+	if (!fl->insns)
+		fatal("calloc");
+	for (i = 0; i < len; i++) {
+		if (fscanf(f, "%u %u %u %u", &code, &jt, &jf, &k) != 4) {
+			fprintf(stderr, "%s: truncated program\n", path);
+			exit(1);
+		}
+		fl->insns[i].code = code;
+		fl->insns[i].jt = jt;
+		fl->insns[i].jf = jf;
+		fl->insns[i].k = k;
+	}
+	fclose(f);
+}
+
+static int open_tap(struct filter *fl, int ifindex)
+{
+	struct sock_fprog prog = { .len = fl->len, .filter = fl->insns };
+	struct sockaddr_ll sll;
+	int fd;
+
+	fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (fd < 0)
+		fatal("socket(PF_PACKET)");
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)))
+		fatal("SO_ATTACH_FILTER");
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)))
+		fatal("bind(PF_PACKET)");
+	return fd;
+}
+
+/* Bounce packets through loopback, returning ns per packet */
+static double run_traffic(int fd)
+{
+	char buf[65536];
+	double start;
+	int i;
+
+	memset(buf, 0x5a, opt_payload);
+	start = now();
+	for (i = 0; i < opt_packets; i++) {
+		if (send(fd, buf, opt_payload, 0) != opt_payload)
+			fatal("send");
+		if (recv(fd, buf, sizeof(buf), 0) != opt_payload)
+			fatal("recv");
+	}
+	return (now() - start) * 1e9 / opt_packets;
+}
+
+static double run_filter(struct filter *fl, int udp_fd, int ifindex)
+{
+	int taps[MAX_TAPS];
+	double ns;
+	int i;
+
+	for (i = 0; i < opt_taps; i++)
+		taps[i] = open_tap(fl, ifindex);
+	ns = run_traffic(udp_fd);
+	for (i = 0; i < opt_taps; i++)
+		close(taps[i]);
+	return ns;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n packets] [-t taps] [-l payload] [-f file]...\n"
+		"  -n  packets sent per measurement (default 200000)\n"
+		"  -t  PF_PACKET sockets running the filter (default 8, max %d)\n"
+		"  -l  UDP payload size (default 64)\n"
+		"  -f  load a \"tcpdump -ddd\" program instead of the built in\n"
+		"      ones, may be given several times\n", prog, MAX_TAPS);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	double base, interp, jit;
+	int jit_orig, ifindex;
+	int udp_fd, c, i;
+
+	while ((c = getopt(argc, argv, "n:t:l:f:h")) != -1) {
+		switch (c) {
+		case 'n':
+			opt_packets = atoi(optarg);
+			break;
+		case 't':
+			opt_taps = atoi(optarg);
+			break;
+		case 'l':
+			opt_payload = atoi(optarg);
+			break;
+		case 'f':
+			load_filter(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (opt_packets <= 0 || opt_taps <= 0 || opt_taps > MAX_TAPS ||
+	    opt_payload <= 0 || opt_payload > 1400)
+		usage(argv[0]);
+
+	ifindex = if_nametoindex("lo");
+	if (!ifindex)
+		fatal("if_nametoindex(lo)");
+
+	udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp_fd < 0)
+		fatal("socket(AF_INET)");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(BENCH_PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(udp_fd, (struct sockaddr *)&sin, sizeof(sin)))
+		fatal("bind(AF_INET)");
+	if (connect(udp_fd, (struct sockaddr *)&sin, sizeof(sin)))
+		fatal("connect");
+
+	jit_orig = read_jit();
+	if (jit_orig < 0)
+		printf("no %s, interpreter only\n", JIT_SYSCTL);
+
+	/* warm up, then the cost of loopback itself */
+	run_traffic(udp_fd);
+	base = run_traffic(udp_fd);
+	printf("%d packets, %d taps, %d byte payload: %.0f ns/packet without taps\n\n",
+	       opt_packets, opt_taps, opt_payload, base);
+	printf("%-28s %5s %12s %12s %8s\n",
+	       "filter", "insns", "interp ns", "jit ns", "speedup");
+
+	for (i = 0; i < nr_filters; i++) {
+		struct filter *fl = &filters[i];
+		int runs = 2 * opt_taps;
+
+		if (jit_orig >= 0 && write_jit(0))
+			fatal("write " JIT_SYSCTL);
+		interp = (run_filter(fl, udp_fd, ifindex) - base) / runs;
+
+		printf("%-28s %5d %12.1f", fl->name, fl->len, interp);
+		if (jit_orig >= 0) {
+			if (write_jit(1))
+				fatal("write " JIT_SYSCTL);
+			jit = (run_filter(fl, udp_fd, ifindex) - base) / runs;
+			printf(" %12.1f %7.2fx", jit, jit > 0 ? interp / jit : 0);
+		}
+		printf("\n");
+	}
+
+	if (jit_orig >= 0)
+		write_jit(jit_orig);
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * fault_bench: measure anonymous page fault throughput of a multithreaded
+ * process while other threads keep changing its address space.
+ *
+ * Each fault thread owns a private anonymous region which it touches page
+ * by page, then discards with MADV_DONTNEED (or, with -u, munmap and mmap
+ * again) and starts over.  Meanwhile the mmap threads map, touch and unmap
+ * small regions in a tight loop, taking mmap_sem for write each time.
+ *
+ * The number of faults handled without mmap_sem is taken from the
+ * pgfault_speculative line of /proc/vmstat, where the kernel has one.
+ *
+ * Usage: fault_bench [-t fault threads] [-m mmap threads] [-s size[k|m]]
+ *                    [-d seconds] [-u]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static int opt_fault_threads = 4;
+static int opt_mmap_threads = 1;
+static size_t opt_size = 16 << 20;
+static int opt_seconds = 5;
+static int opt_unmap;
+
+static volatile int stop;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	unsigned long count;
+};
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	size_t size = strtoul(arg, &end, 0);
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		size <<= 10;
+		break;
+	case 'm':
+	case 'M':
+		size <<= 20;
+		break;
+	}
+	return size;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static long vmstat(const char *name)
+{
+	char line[128];
+	size_t len = strlen(name);
+	long val = -1;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = atol(line + len + 1);
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+static char *map_region(size_t size)
+{
+	char *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED)
+		fatal("mmap");
+	return p;
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *region = map_region(opt_size);
+	size_t off;
+
+	while (!stop) {
+		for (off = 0; off < opt_size && !stop; off += page_size) {
+			region[off] = 1;
+			w->count++;
+		}
+		if (opt_unmap) {
+			munmap(region, opt_size);
+			region = map_region(opt_size);
+		} else if (madvise(region, opt_size, MADV_DONTNEED))
+			fatal("madvise");
+	}
+	munmap(region, opt_size);
+	return NULL;
+}
+
+static void *mmap_thread(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = 16 * page_size;
+
+	while (!stop) {
+		char *p = map_region(size);
+
+		p[0] = 1;
+		munmap(p, size);
+		w->count++;
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t threads] [-m threads] [-s size[k|m]] [-d secs] [-u]\n"
+		"  -t  fault threads (default 4)\n"
+		"  -m  mmap/munmap threads (default 1)\n"
+		"  -s  region faulted by each fault thread (default 16m)\n"
+		"  -d  duration in seconds (default 5)\n"
+		"  -u  fault threads munmap their region instead of MADV_DONTNEED\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *faulters, *mappers;
+	unsigned long faults = 0, maps = 0;
+	long spec_start, spec_end;
+	double start, elapsed;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "t:m:s:d:uh")) != -1) {
+		switch (c) {
+		case 't':
+			opt_fault_threads = atoi(optarg);
+			break;
+		case 'm':
+			opt_mmap_threads = atoi(optarg);
+			break;
+		case 's':
+			opt_size = parse_size(optarg);
+			break;
+		case 'd':
+			opt_seconds = atoi(optarg);
+			break;
+		case 'u':
+			opt_unmap = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (opt_fault_threads <= 0 || opt_mmap_threads < 0 ||
+	    !opt_size || opt_seconds <= 0)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	faulters = calloc(opt_fault_threads, sizeof(*faulters));
+	mappers = calloc(opt_mmap_threads + 1, sizeof(*mappers));
+	if (!faulters || !mappers)
+		fatal("calloc");
+
+	spec_start = vmstat("pgfault_speculative");
+	start = now();
+	for (i = 0; i < opt_fault_threads; i++)
+		if (pthread_create(&faulters[i].thread, NULL, fault_thread,
+				   &faulters[i]))
+			fatal("pthread_create");
+	for (i = 0; i < opt_mmap_threads; i++)
+		if (pthread_create(&mappers[i].thread, NULL, mmap_thread,
+				   &mappers[i]))
+			fatal("pthread_create");
+
+	sleep(opt_seconds);
+	stop = 1;
+
+	for (i = 0; i < opt_fault_threads; i++) {
+		pthread_join(faulters[i].thread, NULL);
+		faults += faulters[i].count;
+	}
+	for (i = 0; i < opt_mmap_threads; i++) {
+		pthread_join(mappers[i].thread, NULL);
+		maps += mappers[i].count;
+	}
+	elapsed = now() - start;
+	spec_end = vmstat("pgfault_speculative");
+
+	printf("%d fault threads, %d mmap threads, %zu KB regions, %s\n",
+	       opt_fault_threads, opt_mmap_threads, opt_size >> 10,
+	       opt_unmap ? "munmap" : "MADV_DONTNEED");
+	printf("faults:          %12.0f/s  (%.0f/s per thread)\n",
+	       faults / elapsed, faults / elapsed / opt_fault_threads);
+	printf("mmap+munmap:     %12.0f/s\n", maps / elapsed);
+	if (spec_start >= 0 && spec_end >= 0)
+		printf("speculative:     %12.1f%% of faults\n",
+		       faults ? 100.0 * (spec_end - spec_start) / faults : 0.0);
+	else
+		printf("speculative:     not reported by this kernel\n");
+	return 0;
+}
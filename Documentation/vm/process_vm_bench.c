@@ -0,0 +1,287 @@
+/*
+ * process_vm_bench: compare the bandwidth of moving a buffer from one
+ * process to another through a pipe, through a shared memory bounce
+ * buffer and with process_vm_readv().
+ *
+ * The child process owns the source buffer; the parent copies it into
+ * its own destination buffer with each method in turn.
+ *
+ * Usage: process_vm_bench [-s size[k|m]] [-c chunk[k|m]] [-n loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+/* syscall numbers as assigned by this kernel */
+#if defined(__x86_64__)
+#define PVM_NR_readv	299
+#elif defined(__i386__)
+#define PVM_NR_readv	337
+#else
+#error "process_vm_readv is not wired up on this architecture"
+#endif
+
+static size_t opt_size = 64 << 20;
+static size_t opt_chunk = 64 << 10;
+static int opt_loops = 10;
+
+static char *src, *dst;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	size_t size = strtoul(arg, &end, 0);
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		size <<= 10;
+		break;
+	case 'm':
+	case 'M':
+		size <<= 20;
+		break;
+	}
+	return size;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *name, double elapsed)
+{
+	double mb = (double)opt_size * opt_loops / (1 << 20);
+
+	printf("%-16s %10.1f MB/s  (%.3f s)\n", name, mb / elapsed, elapsed);
+}
+
+static void read_full(int fd, void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret <= 0)
+			fatal("read");
+		buf = (char *)buf + ret;
+		len -= ret;
+	}
+}
+
+static void write_full(int fd, const void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret <= 0)
+			fatal("write");
+		buf = (const char *)buf + ret;
+		len -= ret;
+	}
+}
+
+/* Two copies: child -> pipe buffer -> parent */
+static void bench_pipe(void)
+{
+	int fds[2];
+	double start;
+	pid_t pid;
+	int i;
+
+	if (pipe(fds))
+		fatal("pipe");
+
+	pid = fork();
+	if (pid < 0)
+		fatal("fork");
+	if (!pid) {
+		close(fds[0]);
+		for (i = 0; i < opt_loops; i++)
+			write_full(fds[1], src, opt_size);
+		exit(0);
+	}
+
+	close(fds[1]);
+	start = now();
+	for (i = 0; i < opt_loops; i++)
+		read_full(fds[0], dst, opt_size);
+	report("pipe", now() - start);
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+}
+
+/*
+ * Two copies: child -> shared bounce buffer -> parent.  A pair of pipes
+ * is used to hand the two halves of the bounce buffer back and forth.
+ */
+static void bench_shm(void)
+{
+	int full[2], empty[2];
+	char *shm;
+	double start;
+	size_t off;
+	pid_t pid;
+	int i, half = 0;
+	char token = 0;
+
+	shm = mmap(NULL, 2 * opt_chunk, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED)
+		fatal("mmap");
+	if (pipe(full) || pipe(empty))
+		fatal("pipe");
+
+	pid = fork();
+	if (pid < 0)
+		fatal("fork");
+	if (!pid) {
+		/* both halves start out empty */
+		int credits = 2;
+
+		for (i = 0; i < opt_loops; i++) {
+			for (off = 0; off < opt_size; off += opt_chunk) {
+				size_t len = opt_size - off < opt_chunk ?
+					     opt_size - off : opt_chunk;
+
+				if (credits)
+					credits--;
+				else
+					read_full(empty[0], &token, 1);
+				memcpy(shm + half * opt_chunk, src + off, len);
+				write_full(full[1], &token, 1);
+				half ^= 1;
+			}
+		}
+		exit(0);
+	}
+
+	start = now();
+	for (i = 0; i < opt_loops; i++) {
+		for (off = 0; off < opt_size; off += opt_chunk) {
+			size_t len = opt_size - off < opt_chunk ?
+				     opt_size - off : opt_chunk;
+
+			read_full(full[0], &token, 1);
+			memcpy(dst + off, shm + half * opt_chunk, len);
+			write_full(empty[1], &token, 1);
+			half ^= 1;
+		}
+	}
+	report("shared memory", now() - start);
+	waitpid(pid, NULL, 0);
+	munmap(shm, 2 * opt_chunk);
+}
+
+/* One copy: straight from the child's buffer into ours */
+static void bench_cma(void)
+{
+	struct iovec local, remote;
+	int ready[2];
+	double start;
+	pid_t pid;
+	char token;
+	int i;
+
+	if (pipe(ready))
+		fatal("pipe");
+
+	pid = fork();
+	if (pid < 0)
+		fatal("fork");
+	if (!pid) {
+		/* fault the buffer in, then wait to be killed */
+		memset(src, 0x5a, opt_size);
+		write_full(ready[1], &token, 1);
+		pause();
+		exit(0);
+	}
+	read_full(ready[0], &token, 1);
+
+	/* the child's copy of src is at the same address as ours */
+	local.iov_base = dst;
+	local.iov_len = opt_size;
+	remote.iov_base = src;
+	remote.iov_len = opt_size;
+
+	start = now();
+	for (i = 0; i < opt_loops; i++) {
+		long ret = syscall(PVM_NR_readv, pid, &local, 1UL,
+				   &remote, 1UL, 0UL);
+
+		if (ret != (long)opt_size)
+			fatal("process_vm_readv");
+	}
+	report("process_vm_readv", now() - start);
+
+	if (dst[0] != 0x5a || dst[opt_size - 1] != 0x5a)
+		fprintf(stderr, "process_vm_readv: data mismatch\n");
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s size[k|m]] [-c chunk[k|m]] [-n loops]\n"
+		"  -s  bytes moved per loop (default 64m)\n"
+		"  -c  shared memory bounce buffer chunk (default 64k)\n"
+		"  -n  number of loops (default 10)\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:c:n:h")) != -1) {
+		switch (c) {
+		case 's':
+			opt_size = parse_size(optarg);
+			break;
+		case 'c':
+			opt_chunk = parse_size(optarg);
+			break;
+		case 'n':
+			opt_loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!opt_size || !opt_chunk || opt_loops <= 0)
+		usage(argv[0]);
+
+	src = malloc(opt_size);
+	dst = malloc(opt_size);
+	if (!src || !dst)
+		fatal("malloc");
+	memset(src, 0x5a, opt_size);
+	memset(dst, 0, opt_size);
+
+	printf("%zu bytes x %d loops\n", opt_size, opt_loops);
+	bench_pipe();
+	bench_shm();
+	bench_cma();
+	return 0;
+}
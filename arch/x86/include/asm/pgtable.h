@@ -330,6 +330,31 @@ static inline int pte_hidden(pte_t pte)
 	return pte_flags(pte) & _PAGE_HIDDEN;
 }
 
+/*
+ * NUMA hinting ptes still map their page, but are not present to the
+ * hardware: the next access faults, see do_numa_page().  They look like
+ * the ptes of a PROT_NONE mapping, so pte_present() stays true and the
+ * rest of the mm handles them as mapped pages.
+ */
+#define __HAVE_ARCH_PTE_NUMA
+static inline int pte_numa(pte_t pte)
+{
+	return (pte_flags(pte) & (_PAGE_PROTNONE | _PAGE_PRESENT)) ==
+		_PAGE_PROTNONE;
+}
+
+static inline pte_t pte_mknuma(pte_t pte)
+{
+	pte = pte_set_flags(pte, _PAGE_PROTNONE);
+	return pte_clear_flags(pte, _PAGE_PRESENT);
+}
+
+static inline pte_t pte_mknonnuma(pte_t pte)
+{
+	pte = pte_clear_flags(pte, _PAGE_PROTNONE);
+	return pte_set_flags(pte, _PAGE_PRESENT);
+}
+
 static inline int pmd_present(pmd_t pmd)
 {
 	return pmd_flags(pmd) & _PAGE_PRESENT;
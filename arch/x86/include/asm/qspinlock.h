@@ -0,0 +1,25 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+
+#if !defined(CONFIG_X86_OOSTORE) && !defined(CONFIG_X86_PPRO_FENCE)
+#define	queued_spin_unlock queued_spin_unlock
+/**
+ * queued_spin_unlock - release a queued spinlock
+ * @lock : Pointer to queued spinlock structure
+ *
+ * Clears the owner byte only. x86 does not reorder stores with older
+ * loads and stores, so a compiler barrier is all the ordering this
+ * release needs.
+ */
+static inline void queued_spin_unlock(raw_spinlock_t *lock)
+{
+	barrier();
+	ACCESS_ONCE(lock->locked) = 0;
+}
+#endif
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* _ASM_X86_QSPINLOCK_H */
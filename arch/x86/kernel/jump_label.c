@@ -0,0 +1,54 @@
+/*
+ * jump label x86 support
+ *
+ * Sites are 5 byte instructions: a nop when the key is disabled, a
+ * jmp rel32 to the out of line code when it is enabled.
+ */
+#include <linux/jump_label.h>
+#include <linux/memory.h>
+#include <linux/cpu.h>
+#include <asm/alternative.h>
+
+#ifdef HAVE_JUMP_LABEL
+
+union jump_code_union {
+	char code[JUMP_LABEL_NOP_SIZE];
+	struct {
+		char jump;
+		int offset;
+	} __attribute__((packed));
+};
+
+void arch_jump_label_transform(struct jump_entry *entry,
+			       enum jump_label_type type)
+{
+	union jump_code_union code;
+
+	if (type == JUMP_LABEL_ENABLE) {
+		code.jump = 0xe9;
+		code.offset = entry->target -
+				(entry->code + JUMP_LABEL_NOP_SIZE);
+	} else
+		add_nops(code.code, JUMP_LABEL_NOP_SIZE);
+	get_online_cpus();
+	mutex_lock(&text_mutex);
+	text_poke_smp((void *)entry->code, &code, JUMP_LABEL_NOP_SIZE);
+	mutex_unlock(&text_mutex);
+	put_online_cpus();
+}
+
+/*
+ * Used on sites no CPU can be executing yet: the core kernel's during
+ * boot, and those of a module before its init function runs.
+ */
+void arch_jump_label_text_poke_early(jump_label_t addr)
+{
+	char nop[JUMP_LABEL_NOP_SIZE];
+
+	add_nops(nop, JUMP_LABEL_NOP_SIZE);
+	mutex_lock(&text_mutex);
+	text_poke((void *)addr, nop, JUMP_LABEL_NOP_SIZE);
+	mutex_unlock(&text_mutex);
+}
+
+#endif /* HAVE_JUMP_LABEL */
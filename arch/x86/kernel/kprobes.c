@@ -48,12 +48,16 @@
 #include <linux/preempt.h>
 #include <linux/module.h>
 #include <linux/kdebug.h>
+#include <linux/kallsyms.h>
+#include <linux/ftrace.h>
+#include <linux/jump_label.h>
 
 #include <asm/cacheflush.h>
 #include <asm/desc.h>
 #include <asm/pgtable.h>
 #include <asm/uaccess.h>
 #include <asm/alternative.h>
+#include <asm/nops.h>
 
 void jprobe_return_end(void);
 
@@ -132,17 +136,17 @@ static const u32 twobyte_has_modrm[256 / 32] = {
 	/*      0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f          */
 	/*      -----------------------------------------------         */
 	W(0x00, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1) | /* 0f */
-	W(0x10, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0) , /* 1f */
+	W(0x10, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) , /* 1f */
 	W(0x20, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1) | /* 2f */
 	W(0x30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) , /* 3f */
 	W(0x40, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) | /* 4f */
 	W(0x50, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) , /* 5f */
 	W(0x60, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) | /* 6f */
-	W(0x70, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 1, 1, 1, 1) , /* 7f */
+	W(0x70, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 0, 1, 1, 1, 1) , /* 7f */
 	W(0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) | /* 8f */
 	W(0x90, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) , /* 9f */
 	W(0xa0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1) | /* af */
-	W(0xb0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1) , /* bf */
+	W(0xb0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) , /* bf */
 	W(0xc0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0) | /* cf */
 	W(0xd0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) , /* df */
 	W(0xe0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1) | /* ef */
@@ -159,16 +163,22 @@ struct kretprobe_blackpoint kretprobe_blacklist[] = {
 };
 const int kretprobe_blacklist_size = ARRAY_SIZE(kretprobe_blacklist);
 
-/* Insert a jump instruction at address 'from', which jumps to address 'to'.*/
-static void __kprobes set_jmp_op(void *from, void *to)
+static void __kprobes __synthesize_relative_insn(void *from, void *to, u8 op)
 {
-	struct __arch_jmp_op {
-		char op;
+	struct __arch_relative_insn {
+		u8 op;
 		s32 raddr;
-	} __attribute__((packed)) * jop;
-	jop = (struct __arch_jmp_op *)from;
-	jop->raddr = (s32)((long)(to) - ((long)(from) + 5));
-	jop->op = RELATIVEJUMP_INSTRUCTION;
+	} __attribute__((packed)) *insn;
+
+	insn = (struct __arch_relative_insn *)from;
+	insn->raddr = (s32)((long)(to) - ((long)(from) + 5));
+	insn->op = op;
+}
+
+/* Insert a jump instruction at address 'from', which jumps to address 'to'.*/
+static void __kprobes synthesize_reljump(void *from, void *to)
+{
+	__synthesize_relative_insn(from, to, RELATIVEJUMP_INSTRUCTION);
 }
 
 /*
@@ -446,9 +456,19 @@ void __kprobes arch_prepare_kretprobe(struct kretprobe_instance *ri,
 	*sara = (unsigned long) &kretprobe_trampoline;
 }
 
+#ifdef CONFIG_OPTPROBES
+static int __kprobes setup_detour_execution(struct kprobe *p,
+					    struct pt_regs *regs);
+#else
+#define setup_detour_execution(p, regs)	(0)
+#endif
+
 static void __kprobes setup_singlestep(struct kprobe *p, struct pt_regs *regs,
 				       struct kprobe_ctlblk *kcb)
 {
+	if (setup_detour_execution(p, regs))
+		return;
+
 #if !defined(CONFIG_PREEMPT) || defined(CONFIG_FREEZER)
 	if (p->ainsn.boostable == 1 && !p->post_handler) {
 		/* Boost up -- we can execute copied instructions directly */
@@ -580,6 +600,69 @@ static int __kprobes kprobe_handler(struct pt_regs *regs)
 	return 0;
 }
 
+#ifdef CONFIG_X86_64
+#define SAVE_REGS_STRING		\
+	/* Skip cs, ip, orig_ax. */	\
+	"	subq $24, %rsp\n"	\
+	"	pushq %rdi\n"		\
+	"	pushq %rsi\n"		\
+	"	pushq %rdx\n"		\
+	"	pushq %rcx\n"		\
+	"	pushq %rax\n"		\
+	"	pushq %r8\n"		\
+	"	pushq %r9\n"		\
+	"	pushq %r10\n"		\
+	"	pushq %r11\n"		\
+	"	pushq %rbx\n"		\
+	"	pushq %rbp\n"		\
+	"	pushq %r12\n"		\
+	"	pushq %r13\n"		\
+	"	pushq %r14\n"		\
+	"	pushq %r15\n"
+#define RESTORE_REGS_STRING		\
+	"	popq %r15\n"		\
+	"	popq %r14\n"		\
+	"	popq %r13\n"		\
+	"	popq %r12\n"		\
+	"	popq %rbp\n"		\
+	"	popq %rbx\n"		\
+	"	popq %r11\n"		\
+	"	popq %r10\n"		\
+	"	popq %r9\n"		\
+	"	popq %r8\n"		\
+	"	popq %rax\n"		\
+	"	popq %rcx\n"		\
+	"	popq %rdx\n"		\
+	"	popq %rsi\n"		\
+	"	popq %rdi\n"		\
+	/* Skip orig_ax, ip, cs */	\
+	"	addq $24, %rsp\n"
+#else
+#define SAVE_REGS_STRING			\
+	/* Skip cs, ip, orig_ax and gs. */	\
+	"	subl $16, %esp\n"		\
+	"	pushl %fs\n"			\
+	"	pushl %es\n"			\
+	"	pushl %ds\n"			\
+	"	pushl %eax\n"			\
+	"	pushl %ebp\n"			\
+	"	pushl %edi\n"			\
+	"	pushl %esi\n"			\
+	"	pushl %edx\n"			\
+	"	pushl %ecx\n"			\
+	"	pushl %ebx\n"
+#define RESTORE_REGS_STRING			\
+	"	popl %ebx\n"			\
+	"	popl %ecx\n"			\
+	"	popl %edx\n"			\
+	"	popl %esi\n"			\
+	"	popl %edi\n"			\
+	"	popl %ebp\n"			\
+	"	popl %eax\n"			\
+	/* Skip ds, es, fs, gs, orig_ax, and ip. Note: don't pop cs here*/\
+	"	addl $24, %esp\n"
+#endif
+
 /*
  * When a retprobed function returns, this code saves registers and
  * calls trampoline_handler() runs, which calls the kretprobe's handler.
@@ -593,65 +676,18 @@ static void __used __kprobes kretprobe_trampoline_holder(void)
 			/* We don't bother saving the ss register */
 			"	pushq %rsp\n"
 			"	pushfq\n"
-			/*
-			 * Skip cs, ip, orig_ax.
-			 * trampoline_handler() will plug in these values
-			 */
-			"	subq $24, %rsp\n"
-			"	pushq %rdi\n"
-			"	pushq %rsi\n"
-			"	pushq %rdx\n"
-			"	pushq %rcx\n"
-			"	pushq %rax\n"
-			"	pushq %r8\n"
-			"	pushq %r9\n"
-			"	pushq %r10\n"
-			"	pushq %r11\n"
-			"	pushq %rbx\n"
-			"	pushq %rbp\n"
-			"	pushq %r12\n"
-			"	pushq %r13\n"
-			"	pushq %r14\n"
-			"	pushq %r15\n"
+			/* trampoline_handler() will plug in cs, ip, orig_ax */
+			SAVE_REGS_STRING
 			"	movq %rsp, %rdi\n"
 			"	call trampoline_handler\n"
 			/* Replace saved sp with true return address. */
 			"	movq %rax, 152(%rsp)\n"
-			"	popq %r15\n"
-			"	popq %r14\n"
-			"	popq %r13\n"
-			"	popq %r12\n"
-			"	popq %rbp\n"
-			"	popq %rbx\n"
-			"	popq %r11\n"
-			"	popq %r10\n"
-			"	popq %r9\n"
-			"	popq %r8\n"
-			"	popq %rax\n"
-			"	popq %rcx\n"
-			"	popq %rdx\n"
-			"	popq %rsi\n"
-			"	popq %rdi\n"
-			/* Skip orig_ax, ip, cs */
-			"	addq $24, %rsp\n"
+			RESTORE_REGS_STRING
 			"	popfq\n"
 #else
 			"	pushf\n"
-			/*
-			 * Skip cs, ip, orig_ax and gs.
-			 * trampoline_handler() will plug in these values
-			 */
-			"	subl $16, %esp\n"
-			"	pushl %fs\n"
-			"	pushl %es\n"
-			"	pushl %ds\n"
-			"	pushl %eax\n"
-			"	pushl %ebp\n"
-			"	pushl %edi\n"
-			"	pushl %esi\n"
-			"	pushl %edx\n"
-			"	pushl %ecx\n"
-			"	pushl %ebx\n"
+			/* trampoline_handler() will plug in cs, ip, orig_ax, gs */
+			SAVE_REGS_STRING
 			"	movl %esp, %eax\n"
 			"	call trampoline_handler\n"
 			/* Move flags to cs */
@@ -659,15 +695,7 @@ static void __used __kprobes kretprobe_trampoline_holder(void)
 			"	movl %edx, 52(%esp)\n"
 			/* Replace saved flags with true return address. */
 			"	movl %eax, 56(%esp)\n"
-			"	popl %ebx\n"
-			"	popl %ecx\n"
-			"	popl %edx\n"
-			"	popl %esi\n"
-			"	popl %edi\n"
-			"	popl %ebp\n"
-			"	popl %eax\n"
-			/* Skip ds, es, fs, gs, orig_ax and ip */
-			"	addl $24, %esp\n"
+			RESTORE_REGS_STRING
 			"	popf\n"
 #endif
 			"	ret\n");
@@ -835,8 +863,8 @@ static void __kprobes resume_execution(struct kprobe *p,
 			 * These instructions can be executed directly if it
 			 * jumps back to correct address.
 			 */
-			set_jmp_op((void *)regs->ip,
-				   (void *)orig_ip + (regs->ip - copy_ip));
+			synthesize_reljump((void *)regs->ip,
+				(void *)orig_ip + (regs->ip - copy_ip));
 			p->ainsn.boostable = 1;
 		} else {
 			p->ainsn.boostable = -1;
@@ -1057,6 +1085,587 @@ int __kprobes longjmp_break_handler(struct kprobe *p, struct pt_regs *regs)
 	return 0;
 }
 
+#ifdef CONFIG_OPTPROBES
+
+/*
+ * What decode_insn() found out about an instruction. The optimizer
+ * only needs lengths, branch targets and %rip-relative operands.
+ */
+struct kprobe_insn {
+	int length;		/* length of the whole instruction */
+	int jump;		/* 1: relative jump, -1: indirect jump */
+	long disp;		/* displacement of a relative jump */
+	int riprel;		/* offset of the %rip-relative disp32, or 0 */
+};
+
+/*
+ * Decode the instruction in buf. This is not a full x86 decoder: it
+ * knows the encodings the kernel is built from and rejects the rest,
+ * which just leaves the probe on the breakpoint path.
+ */
+static int __kprobes decode_insn(struct kprobe_insn *ki, kprobe_opcode_t *buf)
+{
+	kprobe_opcode_t *p = buf;
+	kprobe_opcode_t opcode;
+	int opnd16 = 0, addr_prefix = 0, rex_w = 0, twobyte = 0;
+	int has_modrm, imm = 0, immz, relz, reg = 0;
+
+	memset(ki, 0, sizeof(*ki));
+
+	/* Skip legacy instruction prefixes. */
+	for (;; p++) {
+		if (p - buf >= MAX_INSN_SIZE - 1)
+			return -EINVAL;
+		switch (*p) {
+		case 0x66:
+			opnd16 = 1;
+			continue;
+		case 0x67:
+			addr_prefix = 1;
+			continue;
+		case 0x26: case 0x2e: case 0x36: case 0x3e:
+		case 0x64: case 0x65: case 0xf0: case 0xf2: case 0xf3:
+			continue;
+		}
+		break;
+	}
+#ifdef CONFIG_X86_64
+	relz = 4;
+#else
+	/* 16-bit addressing uses a different ModRM encoding */
+	if (addr_prefix)
+		return -EINVAL;
+	relz = opnd16 ? 2 : 4;
+#endif
+	immz = opnd16 ? 2 : 4;
+
+	if (is_REX_prefix(p)) {
+		rex_w = *p & 0x08;
+		p++;
+	}
+
+	opcode = *p++;
+	if (opcode == 0x0f) {
+		twobyte = 1;
+		opcode = *p++;
+		switch (opcode) {
+		case 0x0f:		/* 3DNow! */
+			return -EINVAL;
+		case 0x38:		/* three-byte opcodes */
+		case 0x3a:
+			if (opcode == 0x3a)
+				imm = 1;
+			p++;
+			has_modrm = 1;
+			break;
+		default:
+			has_modrm = test_bit(opcode,
+					(unsigned long *)twobyte_has_modrm);
+			if ((opcode & 0xf0) == 0x80) {
+				/* jcc rel16/32 */
+				imm = relz;
+				ki->jump = 1;
+			} else if ((opcode >= 0x70 && opcode <= 0x73) ||
+				   opcode == 0xa4 || opcode == 0xac ||
+				   opcode == 0xba || opcode == 0xc2 ||
+				   (opcode >= 0xc4 && opcode <= 0xc6))
+				imm = 1;
+		}
+	} else {
+#ifdef CONFIG_X86_64
+		switch (opcode) {
+		case 0x06: case 0x07: case 0x0e: case 0x16: case 0x17:
+		case 0x1e: case 0x1f: case 0x27: case 0x2f: case 0x37:
+		case 0x3f: case 0x40 ... 0x4f: case 0x60: case 0x61:
+		case 0x62: case 0x82: case 0xc4: case 0xc5: case 0xce:
+		case 0xd4: case 0xd5: case 0xd6:
+			/* Invalid in 64-bit mode, or VEX prefixes */
+			return -EINVAL;
+		}
+#endif
+		has_modrm = test_bit(opcode,
+				     (unsigned long *)onebyte_has_modrm);
+		switch (opcode) {
+		case 0x04: case 0x0c: case 0x14: case 0x1c:
+		case 0x24: case 0x2c: case 0x34: case 0x3c:
+		case 0x6a: case 0x6b: case 0x80: case 0x82: case 0x83:
+		case 0xa8: case 0xb0 ... 0xb7: case 0xc0: case 0xc1:
+		case 0xc6: case 0xcd: case 0xd4: case 0xd5:
+		case 0xe4 ... 0xe7:
+			imm = 1;
+			break;
+		case 0x05: case 0x0d: case 0x15: case 0x1d:
+		case 0x25: case 0x2d: case 0x35: case 0x3d:
+		case 0x68: case 0x69: case 0x81: case 0xa9: case 0xc7:
+			imm = immz;
+			break;
+		case 0xb8 ... 0xbf:
+			imm = rex_w ? 8 : immz;
+			break;
+		case 0xa0 ... 0xa3:	/* mov with a memory offset */
+#ifdef CONFIG_X86_64
+			imm = addr_prefix ? 4 : 8;
+#else
+			imm = 4;
+#endif
+			break;
+		case 0xc2: case 0xca:
+			imm = 2;
+			break;
+		case 0xc8:
+			imm = 3;
+			break;
+		case 0x70 ... 0x7f:	/* jcc rel8 */
+		case 0xe0 ... 0xe3:	/* loop, jcxz */
+		case 0xeb:		/* jmp rel8 */
+			imm = 1;
+			ki->jump = 1;
+			break;
+		case 0xe9:		/* jmp rel16/32 */
+			imm = relz;
+			ki->jump = 1;
+			break;
+		case 0xe8:		/* call rel16/32 */
+			imm = relz;
+			break;
+		case 0x9a:		/* far call/jmp to an absolute address */
+		case 0xea:
+			return -EINVAL;
+		}
+	}
+
+	if (has_modrm) {
+		kprobe_opcode_t modrm = *p++;
+		int mod = modrm >> 6, rm = modrm & 7;
+
+		reg = (modrm >> 3) & 7;
+		if (mod != 3) {
+			if (rm == 4) {
+				/* SIB byte, maybe followed by a disp32 */
+				if (mod == 0 && (*p & 7) == 5)
+					p += 4;
+				p++;
+			} else if (mod == 0 && rm == 5) {
+#ifdef CONFIG_X86_64
+				ki->riprel = p - buf;
+#endif
+				p += 4;
+			}
+			if (mod == 1)
+				p += 1;
+			else if (mod == 2)
+				p += 4;
+		}
+	}
+
+	if (!twobyte) {
+		if (opcode == 0xf6 && reg < 2)		/* test imm8 */
+			imm = 1;
+		else if (opcode == 0xf7 && reg < 2)	/* test immz */
+			imm = immz;
+		else if (opcode == 0xff && (reg == 4 || reg == 5))
+			ki->jump = -1;			/* indirect jmp */
+	}
+
+	p += imm;
+	ki->length = p - buf;
+	if (ki->length > MAX_INSN_SIZE)
+		return -EINVAL;
+
+	if (ki->jump > 0) {
+		if (imm == 1)
+			ki->disp = *(s8 *)(p - 1);
+		else if (imm == 4)
+			ki->disp = *(s32 *)(p - 4);
+		else
+			return -EINVAL;	/* %ip truncation is not handled */
+	}
+	return 0;
+}
+
+/*
+ * Copy len bytes of the original text at addr into buf. Breakpoints
+ * and jumps that other kprobes wrote there are replaced with the bytes
+ * they hide. Called with kprobe_mutex held.
+ */
+static void __kprobes recover_probed_instruction(kprobe_opcode_t *buf,
+						 unsigned long addr, int len)
+{
+	struct optimized_kprobe *op;
+	struct kprobe *kp;
+	int i, j;
+
+	memset(buf, 0, MAX_INSN_SIZE);
+	memcpy(buf, (void *)addr, len);
+	for (i = -RELATIVE_ADDR_SIZE; i < len; i++) {
+		kp = get_kprobe((void *)(addr + i));
+		if (!kp)
+			continue;
+		if (i >= 0)
+			buf[i] = kp->opcode;
+		if (!kprobe_optimized(kp) ||
+		    *kp->addr != RELATIVEJUMP_INSTRUCTION)
+			continue;
+		/* The jump has been written; its address covers i+1.. */
+		op = container_of(kp, struct optimized_kprobe, kp);
+		for (j = 0; j < RELATIVE_ADDR_SIZE; j++)
+			if (i + 1 + j >= 0 && i + 1 + j < len)
+				buf[i + 1 + j] = op->optinsn.copied_insn[j];
+	}
+}
+
+/* Decode whole function to ensure any instructions don't jump into target */
+static int __kprobes can_optimize(unsigned long paddr)
+{
+	struct kprobe_insn ki;
+	kprobe_opcode_t buf[MAX_INSN_SIZE];
+	unsigned long addr, end, target, size = 0, offset = 0;
+	/* Dummy buffer for kallsyms_lookup, protected by kprobe_mutex */
+	static char __dummy_buf[KSYM_NAME_LEN];
+	int boundary = 0;
+
+	/* Lookup symbol including addr */
+	if (!kallsyms_lookup(paddr, &size, &offset, NULL, __dummy_buf))
+		return 0;
+
+	/* Check there is enough space for a relative jump. */
+	if (size - offset < RELATIVEJUMP_SIZE)
+		return 0;
+
+	addr = paddr - offset;
+	end = addr + size;
+	while (addr < end) {
+		if (search_exception_tables(addr))
+			/*
+			 * Since some fixup code will jumps into this function,
+			 * we can't optimize kprobe in this function.
+			 */
+			return 0;
+		recover_probed_instruction(buf, addr,
+				min_t(unsigned long, end - addr, MAX_INSN_SIZE));
+		if (decode_insn(&ki, buf) < 0)
+			return 0;
+		/* Trailing padding may not decode up to the end */
+		if (ki.length > end - addr)
+			break;
+		/* An indirect jump may land anywhere */
+		if (ki.jump < 0)
+			return 0;
+		if (ki.jump > 0) {
+			target = addr + ki.length + ki.disp;
+			if (paddr < target &&
+			    target < paddr + RELATIVEJUMP_SIZE)
+				return 0;
+		}
+		if (addr == paddr)
+			boundary = 1;
+		addr += ki.length;
+	}
+
+	/* paddr must start an instruction */
+	return boundary;
+}
+
+/*
+ * Copy the instructions replaced by the jump at src to dest, adjusting
+ * %rip-relative operands. Return the number of bytes copied.
+ */
+static int __kprobes copy_optimized_instructions(u8 *dest, u8 *src)
+{
+	struct kprobe_insn ki;
+	kprobe_opcode_t buf[MAX_INSN_SIZE];
+	int len = 0;
+	s64 disp;
+
+	while (len < RELATIVEJUMP_SIZE) {
+		recover_probed_instruction(buf, (unsigned long)src + len,
+					   MAX_INSN_SIZE);
+		/* Relative jumps and calls are not boostable */
+		if (decode_insn(&ki, buf) < 0 || ki.jump || !can_boost(buf))
+			return -EINVAL;
+		memcpy(dest + len, buf, ki.length);
+		if (ki.riprel) {
+			/* Make the operand address relative to the copy */
+			disp = (s64)*(s32 *)(buf + ki.riprel) +
+			       (long)src - (long)dest;
+			if ((s64)(s32)disp != disp)
+				return -ERANGE;
+			*(s32 *)(dest + len + ki.riprel) = (s32)disp;
+		}
+		len += ki.length;
+	}
+
+	/* Check whether the address range is reserved */
+	if (ftrace_text_reserved(src, src + len - 1) ||
+	    alternatives_text_reserved(src, src + len - 1) ||
+	    jump_label_text_reserved(src, src + len - 1))
+		return -EBUSY;
+
+	return len;
+}
+
+/* Insert a call instruction at address 'from', which calls address 'to'.*/
+static void __kprobes synthesize_relcall(void *from, void *to)
+{
+	__synthesize_relative_insn(from, to, RELATIVECALL_INSTRUCTION);
+}
+
+/* Insert a move instruction which sets a pointer to eax/rdi (1st arg). */
+static void __kprobes synthesize_set_arg1(kprobe_opcode_t *addr,
+					  unsigned long val)
+{
+#ifdef CONFIG_X86_64
+	*addr++ = 0x48;
+	*addr++ = 0xbf;
+#else
+	*addr++ = 0xb8;
+#endif
+	*(unsigned long *)addr = val;
+}
+
+/*
+ * The detour buffer starts with a copy of this template. It saves the
+ * registers in pt_regs layout and calls optimized_callback(); the
+ * replaced instructions and a jump back are appended after it.
+ */
+static void __used __kprobes kprobes_optinsn_template_holder(void)
+{
+	asm volatile (
+			".global optprobe_template_entry\n"
+			"optprobe_template_entry: \n"
+#ifdef CONFIG_X86_64
+			/* We don't bother saving the ss register */
+			"	pushq %rsp\n"
+			"	pushfq\n"
+			SAVE_REGS_STRING
+			"	movq %rsp, %rsi\n"
+			".global optprobe_template_val\n"
+			"optprobe_template_val: \n"
+			ASM_NOP5
+			ASM_NOP5
+			".global optprobe_template_call\n"
+			"optprobe_template_call: \n"
+			ASM_NOP5
+			/* Move flags to rsp */
+			"	movq 144(%rsp), %rdx\n"
+			"	movq %rdx, 152(%rsp)\n"
+			RESTORE_REGS_STRING
+			/* Skip flags entry */
+			"	addq $8, %rsp\n"
+			"	popfq\n"
+#else /* CONFIG_X86_32 */
+			"	pushf\n"
+			SAVE_REGS_STRING
+			"	movl %esp, %edx\n"
+			".global optprobe_template_val\n"
+			"optprobe_template_val: \n"
+			ASM_NOP5
+			".global optprobe_template_call\n"
+			"optprobe_template_call: \n"
+			ASM_NOP5
+			RESTORE_REGS_STRING
+			"	addl $4, %esp\n"	/* skip cs */
+			"	popf\n"
+#endif
+			".global optprobe_template_end\n"
+			"optprobe_template_end: \n");
+}
+
+#define TMPL_MOVE_IDX \
+	((long)&optprobe_template_val - (long)&optprobe_template_entry)
+#define TMPL_CALL_IDX \
+	((long)&optprobe_template_call - (long)&optprobe_template_entry)
+#define TMPL_END_IDX \
+	((long)&optprobe_template_end - (long)&optprobe_template_entry)
+
+/* Optimized kprobe call back function: called from optinsn */
+static void __kprobes optimized_callback(struct optimized_kprobe *op,
+					 struct pt_regs *regs)
+{
+	struct kprobe_ctlblk *kcb;
+	unsigned long flags;
+
+	/* This is possible if op is under delayed unoptimizing */
+	if (kprobe_disabled(&op->kp))
+		return;
+
+	local_irq_save(flags);
+	kcb = get_kprobe_ctlblk();
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(&op->kp);
+	} else {
+		/* Save skipped registers */
+#ifdef CONFIG_X86_64
+		regs->cs = __KERNEL_CS;
+#else
+		regs->cs = __KERNEL_CS | get_kernel_rpl();
+		regs->gs = 0;
+#endif
+		regs->ip = (unsigned long)op->kp.addr + 1;
+		regs->orig_ax = ~0UL;
+
+		__get_cpu_var(current_kprobe) = &op->kp;
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(&op->kp, regs);
+		__get_cpu_var(current_kprobe) = NULL;
+	}
+	local_irq_restore(flags);
+}
+
+/* Check optimized_kprobe can actually be optimized. */
+int __kprobes arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	int i;
+	struct kprobe *p;
+
+	for (i = 1; i < op->optinsn.size; i++) {
+		p = get_kprobe(op->kp.addr + i);
+		if (p && !kprobe_disabled(p))
+			return -EEXIST;
+	}
+
+	return 0;
+}
+
+/* Check the addr is within the optimized instructions. */
+int __kprobes arch_within_optimized_kprobe(struct optimized_kprobe *op,
+					   unsigned long addr)
+{
+	return ((unsigned long)op->kp.addr <= addr &&
+		(unsigned long)op->kp.addr + op->optinsn.size > addr);
+}
+
+/* Free optimized instruction slot */
+static __kprobes
+void __arch_remove_optimized_kprobe(struct optimized_kprobe *op, int dirty)
+{
+	if (op->optinsn.insn) {
+		free_optinsn_slot(op->optinsn.insn, dirty);
+		op->optinsn.insn = NULL;
+		op->optinsn.size = 0;
+	}
+}
+
+void __kprobes arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	__arch_remove_optimized_kprobe(op, 1);
+}
+
+/*
+ * Copy replacing target instructions
+ * Target instructions MUST be relocatable (checked inside)
+ */
+int __kprobes arch_prepare_optimized_kprobe(struct optimized_kprobe *op)
+{
+	u8 *buf;
+	int ret;
+	long rel;
+
+	if (!can_optimize((unsigned long)op->kp.addr))
+		return -EILSEQ;
+
+	op->optinsn.insn = get_optinsn_slot();
+	if (!op->optinsn.insn)
+		return -ENOMEM;
+
+	/*
+	 * Verify if the address gap is in 2GB range, because this uses
+	 * a relative jump.
+	 */
+	rel = (long)op->optinsn.insn - (long)op->kp.addr + RELATIVEJUMP_SIZE;
+	if (abs(rel) > 0x7fffffff) {
+		__arch_remove_optimized_kprobe(op, 0);
+		return -ERANGE;
+	}
+
+	buf = (u8 *)op->optinsn.insn;
+
+	/* Copy instructions into the out-of-line buffer */
+	ret = copy_optimized_instructions(buf + TMPL_END_IDX, op->kp.addr);
+	if (ret < 0) {
+		__arch_remove_optimized_kprobe(op, 0);
+		return ret;
+	}
+	op->optinsn.size = ret;
+
+	/* Copy arch-dep-instance from template */
+	memcpy(buf, &optprobe_template_entry, TMPL_END_IDX);
+
+	/* Set probe information */
+	synthesize_set_arg1(buf + TMPL_MOVE_IDX, (unsigned long)op);
+
+	/* Set probe function call */
+	synthesize_relcall(buf + TMPL_CALL_IDX, optimized_callback);
+
+	/* Set returning jmp instruction at the tail of out-of-line buffer */
+	synthesize_reljump(buf + TMPL_END_IDX + op->optinsn.size,
+			   (u8 *)op->kp.addr + op->optinsn.size);
+
+	flush_icache_range((unsigned long) buf,
+			   (unsigned long) buf + TMPL_END_IDX +
+			   op->optinsn.size + RELATIVEJUMP_SIZE);
+	return 0;
+}
+
+/*
+ * Replace the breakpoint with a jump to the detour buffer. Called with
+ * get_online_cpus() and text_mutex held.
+ */
+int __kprobes arch_optimize_kprobe(struct optimized_kprobe *op)
+{
+	unsigned char jmp_code[RELATIVEJUMP_SIZE];
+	s32 rel = (s32)((long)op->optinsn.insn -
+			((long)op->kp.addr + RELATIVEJUMP_SIZE));
+
+	/* Backup instructions which will be replaced by jump address */
+	memcpy(op->optinsn.copied_insn, op->kp.addr + 1, RELATIVE_ADDR_SIZE);
+
+	jmp_code[0] = RELATIVEJUMP_INSTRUCTION;
+	*(s32 *)(&jmp_code[1]) = rel;
+
+	/*
+	 * text_poke_smp doesn't support NMI/MCE code modifying.
+	 * However, since kprobes itself also doesn't support NMI/MCE
+	 * code probing, it's not a problem.
+	 */
+	text_poke_smp(op->kp.addr, jmp_code, RELATIVEJUMP_SIZE);
+	return 0;
+}
+
+/* Replace a relative jump with a breakpoint (int3). */
+void __kprobes arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	u8 buf[RELATIVEJUMP_SIZE];
+
+	/* Set int3 to first byte for kprobes */
+	buf[0] = BREAKPOINT_INSTRUCTION;
+	memcpy(buf + 1, op->optinsn.copied_insn, RELATIVE_ADDR_SIZE);
+	text_poke_smp(op->kp.addr, buf, RELATIVEJUMP_SIZE);
+}
+
+/*
+ * The breakpoint of a probe waiting for the optimizer was hit. Its
+ * handlers have run, so skip single-stepping and run the replaced
+ * instructions from the detour buffer instead.
+ */
+static int __kprobes setup_detour_execution(struct kprobe *p,
+					    struct pt_regs *regs)
+{
+	struct optimized_kprobe *op;
+
+	if (p->flags & KPROBE_FLAG_OPTIMIZED) {
+		/* This kprobe is really able to run optimized path. */
+		op = container_of(p, struct optimized_kprobe, kp);
+		/* Detour through copied instructions */
+		regs->ip = (unsigned long)op->optinsn.insn + TMPL_END_IDX;
+		reset_current_kprobe();
+		preempt_enable_no_resched();
+		return 1;
+	}
+	return 0;
+}
+#endif /* CONFIG_OPTPROBES */
+
 int __init arch_init_kprobes(void)
 {
 	return 0;
@@ -1037,6 +1037,25 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	write = error_code & PF_WRITE;
+
+	/*
+	 * Try the common case of a not-present anonymous page first,
+	 * without taking mmap_sem at all; not if the fault was taken with
+	 * interrupts off, as it may sleep and toggles the interrupt state:
+	 */
+	if (!(error_code & (PF_PROT | PF_INSTR)) &&
+	    (regs->flags & X86_EFLAGS_IF)) {
+		fault = handle_speculative_fault(mm, address,
+					write ? FAULT_FLAG_WRITE : 0);
+		if (!(fault & VM_FAULT_RETRY)) {
+			tsk->min_flt++;
+			perf_swcounter_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
+					     regs, address);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1102,8 +1121,6 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 	 * we can handle it..
 	 */
 good_area:
-	write = error_code & PF_WRITE;
-
 	if (unlikely(access_error(error_code, write, vma))) {
 		bad_area_access_error(regs, error_code, address);
 		return;
@@ -0,0 +1,644 @@
+/*
+ * bpf_jit_comp.c: BPF JIT compiler for x86_64
+ *
+ * Translates a socket filter, once it has passed sk_chk_filter(), into
+ * native code that is called in place of sk_run_filter().
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+#include <linux/moduleloader.h>
+#include <linux/workqueue.h>
+#include <linux/netdevice.h>
+#include <linux/filter.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <asm/cacheflush.h>
+
+/*
+ * 0: filters are interpreted by sk_run_filter()
+ * 1: filters attached from now on are compiled
+ * 2: as 1, and the generated code is dumped to the kernel log
+ */
+int bpf_jit_enable __read_mostly;
+
+/*
+ * Packet load helpers from bpf_jit.S, which have their own calling
+ * convention; see the comment at the top of that file.
+ */
+extern u8 sk_load_word[], sk_load_half[], sk_load_byte[], sk_load_byte_msh[];
+extern u8 sk_load_word_positive_offset[], sk_load_half_positive_offset[];
+extern u8 sk_load_byte_positive_offset[], sk_load_byte_msh_positive_offset[];
+extern u8 sk_load_word_negative_offset[], sk_load_half_negative_offset[];
+extern u8 sk_load_byte_negative_offset[], sk_load_byte_msh_negative_offset[];
+
+/*
+ * Register and stack usage of the generated code:
+ *
+ *   %eax	A
+ *   %ebx	X, callee saved so it is spilled to -8(%rbp)
+ *   %rdi	skb
+ *   %r8	skb->data
+ *   %r9d	skb_headlen(skb)
+ *   -12(%rbp)	bounce buffer for the slow paths in bpf_jit.S
+ *   below that	the BPF_MEMWORDS scratch memory words
+ */
+#define BPF_FRAME_SIZE	80
+#define BPF_MEM_OFF(k)	(-12 - 4 * BPF_MEMWORDS + 4 * (int)(k))
+
+/* Largest code sequence emitted for a single BPF instruction */
+#define BPF_MAX_INSN_SIZE	64
+
+/* Length of the epilogue: mov -8(%rbp),%rbx; leaveq; ret */
+#define BPF_EPILOGUE_SIZE	6
+
+#define REG_EAX		0
+#define REG_EBX		3
+#define REG_EBP		5
+#define REG_EDI		7
+
+#define X86_JB		0x72
+#define X86_JAE		0x73
+#define X86_JE		0x74
+#define X86_JNE		0x75
+#define X86_JBE		0x76
+#define X86_JA		0x77
+
+#define is_imm8(x)	((int)(x) <= 127 && (int)(x) >= -128)
+#define is_near(off)	is_imm8(off)
+
+static inline u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
+{
+	while (len--) {
+		*ptr++ = bytes;
+		bytes >>= 8;
+	}
+	return ptr;
+}
+
+#define EMIT(bytes, len)	do { prog = emit_code(prog, bytes, len); } while (0)
+
+#define EMIT1(b1)		EMIT(b1, 1)
+#define EMIT2(b1, b2)		EMIT((b1) + ((b2) << 8), 2)
+#define EMIT3(b1, b2, b3)	EMIT((b1) + ((b2) << 8) + ((b3) << 16), 3)
+#define EMIT4(b1, b2, b3, b4)	EMIT((b1) + ((b2) << 8) + ((b3) << 16) + ((b4) << 24), 4)
+#define EMIT1_off32(b1, off)	do { EMIT1(b1); EMIT(off, 4); } while (0)
+
+/* op with a 32bit immediate, using the sign extended imm8 form if possible */
+#define EMIT_ALU_IMM(modrm, imm32op, k)					\
+do {									\
+	if (is_imm8((int)(k)))						\
+		EMIT3(0x83, modrm, k);					\
+	else								\
+		EMIT1_off32(imm32op, k);				\
+} while (0)
+
+/* ModRM byte and displacement for off(%base), reg being the other operand */
+#define EMIT_MODRM_DISP(reg, base, off)					\
+do {									\
+	if (is_imm8(off)) {						\
+		EMIT2(0x40 | ((reg) << 3) | (base), (off) & 0xff);	\
+	} else {							\
+		EMIT1(0x80 | ((reg) << 3) | (base));			\
+		EMIT(off, 4);						\
+	}								\
+} while (0)
+
+#define MODRM_DISP_SIZE(off)	(is_imm8(off) ? 2 : 5)
+
+#define EMIT_JMP(offset)						\
+do {									\
+	if (offset) {							\
+		if (is_near(offset))					\
+			EMIT2(0xeb, (offset) & 0xff);			\
+		else							\
+			EMIT1_off32(0xe9, offset);			\
+	}								\
+} while (0)
+
+#define EMIT_COND_JMP(op, offset)					\
+do {									\
+	if (is_near(offset))						\
+		EMIT2(op, (offset) & 0xff);				\
+	else {								\
+		EMIT2(0x0f, (op) + 0x10);				\
+		EMIT(offset, 4);					\
+	}								\
+} while (0)
+
+/* call to a bpf_jit.S helper, which must end the current instruction */
+#define EMIT_CALL(func)							\
+	EMIT1_off32(0xe8, (u8 *)(func) - (image + addrs[i]))
+
+/*
+ * Slow path of the helpers for offsets in the SKF_NET_OFF and SKF_LL_OFF
+ * ranges, like __load_pointer() in net/core/filter.c.  Indexed loads
+ * that land in the ancillary area find nothing here, so they make the
+ * filter return 0.
+ */
+void *bpf_jit_load_pointer_neg(const struct sk_buff *skb, int k,
+			       unsigned int size)
+{
+	u8 *ptr = NULL;
+
+	if (k >= SKF_AD_OFF)
+		return NULL;
+	if (k >= SKF_NET_OFF)
+		ptr = skb_network_header(skb) + k - SKF_NET_OFF;
+	else if (k >= SKF_LL_OFF)
+		ptr = skb_mac_header(skb) + k - SKF_LL_OFF;
+
+	if (ptr >= skb->head && ptr + size <= skb_tail_pointer(skb))
+		return ptr;
+	return NULL;
+}
+
+/*
+ * Check that every instruction can be translated.  The ancillary loads
+ * that need more than a field of the skb are left to the interpreter.
+ */
+static int bpf_jit_supported(const struct sock_filter *filter, int flen,
+			     int *dataref)
+{
+	int i;
+
+	*dataref = 0;
+	for (i = 0; i < flen; i++) {
+		int k = filter[i].k;
+
+		switch (filter[i].code) {
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+			if (k < 0 && k >= SKF_AD_OFF) {
+				switch (k - SKF_AD_OFF) {
+				case SKF_AD_PKTTYPE:
+				case SKF_AD_NLATTR:
+				case SKF_AD_NLATTR_NEST:
+					return 0;
+				}
+				break;
+			}
+			*dataref = 1;
+			break;
+		case BPF_LD|BPF_W|BPF_IND:
+		case BPF_LD|BPF_H|BPF_IND:
+		case BPF_LD|BPF_B|BPF_IND:
+		case BPF_LDX|BPF_B|BPF_MSH:
+			*dataref = 1;
+			break;
+		}
+	}
+	return 1;
+}
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	const struct sock_filter *filter = fp->insns;
+	int flen = fp->len;
+	u8 temp[BPF_MAX_INSN_SIZE];
+	u8 *prog, *image = NULL;
+	unsigned int *addrs;
+	unsigned int proglen, oldproglen = 0;
+	unsigned int cleanup_addr, ret0_addr;
+	int dataref, pass, i;
+
+	BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
+	BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, data_len) != 4);
+	BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, protocol) != 2);
+	BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
+	BUILD_BUG_ON(BPF_MEM_OFF(0) + BPF_FRAME_SIZE < 0);
+
+	if (!bpf_jit_enable)
+		return;
+	if (!bpf_jit_supported(filter, flen, &dataref))
+		return;
+
+	addrs = kmalloc(flen * sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return;
+
+	/*
+	 * addrs[i] is the offset of the end of the code for instruction i,
+	 * which is where the code for instruction i + 1 starts.  Start from
+	 * a pessimistic guess: every pass can only shrink the jumps, and
+	 * once the length stops changing one more pass writes the image.
+	 */
+	for (proglen = 0, i = 0; i < flen; i++) {
+		proglen += BPF_MAX_INSN_SIZE;
+		addrs[i] = proglen;
+	}
+	cleanup_addr = proglen;
+
+	for (pass = 0; pass < 10; pass++) {
+		ret0_addr = cleanup_addr + BPF_EPILOGUE_SIZE;
+
+		/* prologue */
+		prog = temp;
+		EMIT1(0x55);				/* push %rbp */
+		EMIT3(0x48, 0x89, 0xe5);		/* mov %rsp,%rbp */
+		EMIT4(0x48, 0x83, 0xec, BPF_FRAME_SIZE); /* sub $FRAME,%rsp */
+		EMIT4(0x48, 0x89, 0x5d, 0xf8);		/* mov %rbx,-8(%rbp) */
+		if (dataref) {
+			/* mov off(%rdi),%r9d; sub off(%rdi),%r9d */
+			EMIT1(0x44);
+			EMIT1(0x8b);
+			EMIT_MODRM_DISP(1, REG_EDI,
+					offsetof(struct sk_buff, len));
+			EMIT1(0x44);
+			EMIT1(0x2b);
+			EMIT_MODRM_DISP(1, REG_EDI,
+					offsetof(struct sk_buff, data_len));
+			/* mov off(%rdi),%r8 */
+			EMIT1(0x4c);
+			EMIT1(0x8b);
+			EMIT_MODRM_DISP(0, REG_EDI,
+					offsetof(struct sk_buff, data));
+		}
+		EMIT2(0x31, 0xc0);			/* xor %eax,%eax */
+		EMIT2(0x31, 0xdb);			/* xor %ebx,%ebx */
+
+		proglen = prog - temp;
+		if (image)
+			memcpy(image, temp, proglen);
+
+		for (i = 0; i < flen; i++) {
+			unsigned int K = filter[i].k;
+			int t_offset, f_offset;
+			u8 t_op, f_op;
+			u8 *func;
+			int ilen;
+
+			prog = temp;
+			switch (filter[i].code) {
+			case BPF_ALU|BPF_ADD|BPF_X:	/* A += X */
+				EMIT2(0x01, 0xd8);
+				break;
+			case BPF_ALU|BPF_ADD|BPF_K:	/* A += K */
+				if (K)
+					EMIT_ALU_IMM(0xc0, 0x05, K);
+				break;
+			case BPF_ALU|BPF_SUB|BPF_X:	/* A -= X */
+				EMIT2(0x29, 0xd8);
+				break;
+			case BPF_ALU|BPF_SUB|BPF_K:	/* A -= K */
+				if (K)
+					EMIT_ALU_IMM(0xe8, 0x2d, K);
+				break;
+			case BPF_ALU|BPF_MUL|BPF_X:	/* A *= X */
+				EMIT3(0x0f, 0xaf, 0xc3);
+				break;
+			case BPF_ALU|BPF_MUL|BPF_K:	/* A *= K */
+				if (is_imm8((int)K)) {
+					EMIT3(0x6b, 0xc0, K);
+				} else {
+					EMIT2(0x69, 0xc0);
+					EMIT(K, 4);
+				}
+				break;
+			case BPF_ALU|BPF_DIV|BPF_X:	/* A /= X */
+				EMIT2(0x85, 0xdb);	/* test %ebx,%ebx */
+				/* je ret0, skipping the 4 bytes below */
+				EMIT_COND_JMP(X86_JE, ret0_addr - addrs[i] + 4);
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT2(0xf7, 0xf3);	/* div %ebx */
+				break;
+			case BPF_ALU|BPF_DIV|BPF_K:	/* A /= K, K != 0 */
+				if (K == 1)
+					break;
+				if (is_power_of_2(K)) {
+					EMIT3(0xc1, 0xe8, ilog2(K)); /* shr */
+					break;
+				}
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT1_off32(0xb9, K);	/* mov $K,%ecx */
+				EMIT2(0xf7, 0xf1);	/* div %ecx */
+				break;
+			case BPF_ALU|BPF_AND|BPF_X:	/* A &= X */
+				EMIT2(0x21, 0xd8);
+				break;
+			case BPF_ALU|BPF_AND|BPF_K:	/* A &= K */
+				EMIT_ALU_IMM(0xe0, 0x25, K);
+				break;
+			case BPF_ALU|BPF_OR|BPF_X:	/* A |= X */
+				EMIT2(0x09, 0xd8);
+				break;
+			case BPF_ALU|BPF_OR|BPF_K:	/* A |= K */
+				if (K)
+					EMIT_ALU_IMM(0xc8, 0x0d, K);
+				break;
+			case BPF_ALU|BPF_LSH|BPF_X:	/* A <<= X */
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe0);	/* shl %cl,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_K:	/* A <<= K */
+				if (K)
+					EMIT3(0xc1, 0xe0, K);
+				break;
+			case BPF_ALU|BPF_RSH|BPF_X:	/* A >>= X */
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe8);	/* shr %cl,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_K:	/* A >>= K */
+				if (K)
+					EMIT3(0xc1, 0xe8, K);
+				break;
+			case BPF_ALU|BPF_NEG:		/* A = -A */
+				EMIT2(0xf7, 0xd8);
+				break;
+			case BPF_RET|BPF_K:
+				if (K)
+					EMIT1_off32(0xb8, K); /* mov $K,%eax */
+				else
+					EMIT2(0x31, 0xc0);
+				/* fall through */
+			case BPF_RET|BPF_A:
+				EMIT_JMP(cleanup_addr - addrs[i]);
+				break;
+			case BPF_MISC|BPF_TAX:		/* X = A */
+				EMIT2(0x89, 0xc3);
+				break;
+			case BPF_MISC|BPF_TXA:		/* A = X */
+				EMIT2(0x89, 0xd8);
+				break;
+			case BPF_LD|BPF_IMM:		/* A = K */
+				if (K)
+					EMIT1_off32(0xb8, K);
+				else
+					EMIT2(0x31, 0xc0);
+				break;
+			case BPF_LDX|BPF_IMM:		/* X = K */
+				if (K)
+					EMIT1_off32(0xbb, K);
+				else
+					EMIT2(0x31, 0xdb);
+				break;
+			case BPF_LD|BPF_MEM:		/* A = mem[K] */
+				EMIT1(0x8b);
+				EMIT_MODRM_DISP(REG_EAX, REG_EBP, BPF_MEM_OFF(K));
+				break;
+			case BPF_LDX|BPF_MEM:		/* X = mem[K] */
+				EMIT1(0x8b);
+				EMIT_MODRM_DISP(REG_EBX, REG_EBP, BPF_MEM_OFF(K));
+				break;
+			case BPF_ST:			/* mem[K] = A */
+				EMIT1(0x89);
+				EMIT_MODRM_DISP(REG_EAX, REG_EBP, BPF_MEM_OFF(K));
+				break;
+			case BPF_STX:			/* mem[K] = X */
+				EMIT1(0x89);
+				EMIT_MODRM_DISP(REG_EBX, REG_EBP, BPF_MEM_OFF(K));
+				break;
+			case BPF_LD|BPF_W|BPF_LEN:	/* A = skb->len */
+				EMIT1(0x8b);
+				EMIT_MODRM_DISP(REG_EAX, REG_EDI,
+						offsetof(struct sk_buff, len));
+				break;
+			case BPF_LDX|BPF_W|BPF_LEN:	/* X = skb->len */
+				EMIT1(0x8b);
+				EMIT_MODRM_DISP(REG_EBX, REG_EDI,
+						offsetof(struct sk_buff, len));
+				break;
+
+			case BPF_LD|BPF_W|BPF_ABS:
+				func = sk_load_word_positive_offset;
+				if ((int)K < 0)
+					func = sk_load_word_negative_offset;
+				goto common_load_abs;
+			case BPF_LD|BPF_H|BPF_ABS:
+				func = sk_load_half_positive_offset;
+				if ((int)K < 0)
+					func = sk_load_half_negative_offset;
+				goto common_load_abs;
+			case BPF_LD|BPF_B|BPF_ABS:
+				func = sk_load_byte_positive_offset;
+				if ((int)K < 0)
+					func = sk_load_byte_negative_offset;
+common_load_abs:
+				if ((int)K < 0 && (int)K >= SKF_AD_OFF)
+					goto ancillary;
+				if ((int)K < SKF_LL_OFF) {
+					EMIT_JMP(ret0_addr - addrs[i]);
+					break;
+				}
+				EMIT1_off32(0xbe, K);	/* mov $K,%esi */
+				EMIT_CALL(func);
+				break;
+ancillary:
+				switch ((int)K - SKF_AD_OFF) {
+				case SKF_AD_PROTOCOL:
+					/* movzwl protocol(%rdi),%eax */
+					EMIT2(0x0f, 0xb7);
+					EMIT_MODRM_DISP(REG_EAX, REG_EDI,
+						offsetof(struct sk_buff, protocol));
+					/* ntohs(): rol $8,%ax */
+					EMIT4(0x66, 0xc1, 0xc0, 0x08);
+					break;
+				case SKF_AD_IFINDEX: {
+					int off = offsetof(struct net_device,
+							   ifindex);
+
+					/* mov dev(%rdi),%rax */
+					EMIT2(0x48, 0x8b);
+					EMIT_MODRM_DISP(REG_EAX, REG_EDI,
+						offsetof(struct sk_buff, dev));
+					EMIT3(0x48, 0x85, 0xc0); /* test %rax,%rax */
+					EMIT_COND_JMP(X86_JE, ret0_addr - addrs[i] +
+						      1 + MODRM_DISP_SIZE(off));
+					/* mov ifindex(%rax),%eax */
+					EMIT1(0x8b);
+					EMIT_MODRM_DISP(REG_EAX, REG_EAX, off);
+					break;
+				}
+				default:
+					EMIT_JMP(ret0_addr - addrs[i]);
+					break;
+				}
+				break;
+
+			case BPF_LD|BPF_W|BPF_IND:
+				func = sk_load_word;
+				goto common_load_ind;
+			case BPF_LD|BPF_H|BPF_IND:
+				func = sk_load_half;
+				goto common_load_ind;
+			case BPF_LD|BPF_B|BPF_IND:
+				func = sk_load_byte;
+common_load_ind:
+				EMIT2(0x89, 0xde);	/* mov %ebx,%esi */
+				if (is_imm8((int)K)) {	/* add $K,%esi */
+					if (K)
+						EMIT3(0x83, 0xc6, K);
+				} else {
+					EMIT2(0x81, 0xc6);
+					EMIT(K, 4);
+				}
+				EMIT_CALL(func);
+				break;
+
+			case BPF_LDX|BPF_B|BPF_MSH:	/* X = 4 * (P[K] & 0xf) */
+				if ((int)K >= 0) {
+					func = sk_load_byte_msh_positive_offset;
+				} else if ((int)K < SKF_AD_OFF &&
+					   (int)K >= SKF_LL_OFF) {
+					func = sk_load_byte_msh_negative_offset;
+				} else {
+					EMIT_JMP(ret0_addr - addrs[i]);
+					break;
+				}
+				EMIT1_off32(0xbe, K);	/* mov $K,%esi */
+				EMIT_CALL(func);
+				break;
+
+			case BPF_JMP|BPF_JA:
+				EMIT_JMP(addrs[i + K] - addrs[i]);
+				break;
+			case BPF_JMP|BPF_JGT|BPF_K:
+			case BPF_JMP|BPF_JGT|BPF_X:
+				t_op = X86_JA;
+				f_op = X86_JBE;
+				goto cond_branch;
+			case BPF_JMP|BPF_JGE|BPF_K:
+			case BPF_JMP|BPF_JGE|BPF_X:
+				t_op = X86_JAE;
+				f_op = X86_JB;
+				goto cond_branch;
+			case BPF_JMP|BPF_JEQ|BPF_K:
+			case BPF_JMP|BPF_JEQ|BPF_X:
+				t_op = X86_JE;
+				f_op = X86_JNE;
+				goto cond_branch;
+			case BPF_JMP|BPF_JSET|BPF_K:
+			case BPF_JMP|BPF_JSET|BPF_X:
+				t_op = X86_JNE;
+				f_op = X86_JE;
+cond_branch:
+				t_offset = addrs[i + filter[i].jt] - addrs[i];
+				f_offset = addrs[i + filter[i].jf] - addrs[i];
+
+				/* both ways lead to the same place: no test */
+				if (filter[i].jt == filter[i].jf) {
+					EMIT_JMP(t_offset);
+					break;
+				}
+
+				switch (filter[i].code) {
+				case BPF_JMP|BPF_JGT|BPF_X:
+				case BPF_JMP|BPF_JGE|BPF_X:
+				case BPF_JMP|BPF_JEQ|BPF_X:
+					EMIT2(0x39, 0xd8); /* cmp %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_X:
+					EMIT2(0x85, 0xd8); /* test %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_K:
+					if (K <= 0xff)	/* test $K,%al */
+						EMIT2(0xa8, K);
+					else		/* test $K,%eax */
+						EMIT1_off32(0xa9, K);
+					break;
+				default:		/* cmp $K,%eax */
+					EMIT_ALU_IMM(0xf8, 0x3d, K);
+					break;
+				}
+
+				if (filter[i].jt) {
+					/* the jump to the false target follows */
+					if (filter[i].jf && f_offset)
+						t_offset += is_near(f_offset) ? 2 : 5;
+					EMIT_COND_JMP(t_op, t_offset);
+					if (filter[i].jf)
+						EMIT_JMP(f_offset);
+					break;
+				}
+				EMIT_COND_JMP(f_op, f_offset);
+				break;
+			default:
+				/* sk_chk_filter() let something new through */
+				WARN_ON_ONCE(1);
+				goto out;
+			}
+
+			ilen = prog - temp;
+			if (image) {
+				if (unlikely(proglen + ilen > oldproglen)) {
+					pr_err("bpf_jit_compile fatal error\n");
+					module_free(NULL, image);
+					image = NULL;
+					goto out;
+				}
+				memcpy(image + proglen, temp, ilen);
+			}
+			proglen += ilen;
+			addrs[i] = proglen;
+		}
+
+		/* epilogue, then the same with A cleared for ret0 */
+		cleanup_addr = proglen;
+		prog = temp;
+		EMIT4(0x48, 0x8b, 0x5d, 0xf8);		/* mov -8(%rbp),%rbx */
+		EMIT1(0xc9);				/* leaveq */
+		EMIT1(0xc3);				/* ret */
+		EMIT2(0x31, 0xc0);			/* xor %eax,%eax */
+		EMIT4(0x48, 0x8b, 0x5d, 0xf8);
+		EMIT1(0xc9);
+		EMIT1(0xc3);
+		if (image)
+			memcpy(image + proglen, temp, prog - temp);
+		proglen += prog - temp;
+
+		if (image) {
+			if (proglen != oldproglen)
+				pr_err("bpf_jit: proglen=%u != oldproglen=%u\n",
+				       proglen, oldproglen);
+			break;
+		}
+		if (proglen == oldproglen) {
+			/* the image doubles as the work_struct that frees it */
+			image = module_alloc(max_t(unsigned int, proglen,
+						   sizeof(struct work_struct)));
+			if (!image)
+				goto out;
+		}
+		oldproglen = proglen;
+	}
+
+	if (bpf_jit_enable > 1)
+		pr_info("flen=%d proglen=%u pass=%d image=%p\n",
+			flen, proglen, pass, image);
+
+	if (image) {
+		if (bpf_jit_enable > 1)
+			print_hex_dump(KERN_ERR, "JIT code: ", DUMP_PREFIX_ADDRESS,
+				       16, 1, image, proglen, false);
+
+		flush_icache_range((unsigned long)image,
+				   (unsigned long)image + proglen);
+		fp->bpf_func = (void *)image;
+	}
+out:
+	kfree(addrs);
+}
+
+static void jit_free_defer(struct work_struct *arg)
+{
+	module_free(NULL, arg);
+}
+
+/*
+ * Filters are released from RCU callbacks, where module_free() must not
+ * be called, so the image is handed to a work item living in the image
+ * itself.
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	if (fp->bpf_func != sk_run_filter) {
+		struct work_struct *work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, jit_free_defer);
+		schedule_work(work);
+	}
+}
@@ -1079,42 +1079,35 @@ out:
 }
 #endif /* ! __ARCH_OMIT_COMPAT_SYS_GETDENTS64 */
 
-static ssize_t compat_do_readv_writev(int type, struct file *file,
-			       const struct compat_iovec __user *uvector,
-			       unsigned long nr_segs, loff_t *pos)
+ssize_t compat_rw_copy_check_uvector(int type,
+		const struct compat_iovec __user *uvector, unsigned long nr_segs,
+		unsigned long fast_segs, struct iovec *fast_pointer,
+		struct iovec **ret_pointer)
 {
 	compat_ssize_t tot_len;
-	struct iovec iovstack[UIO_FASTIOV];
-	struct iovec *iov=iovstack, *vector;
-	ssize_t ret;
+	struct iovec *iov = *ret_pointer = fast_pointer;
+	ssize_t ret = 0;
 	int seg;
-	io_fn_t fn;
-	iov_fn_t fnv;
 
 	/*
 	 * SuS says "The readv() function *may* fail if the iovcnt argument
 	 * was less than or equal to 0, or greater than {IOV_MAX}.  Linux has
 	 * traditionally returned zero for zero segments, so...
 	 */
-	ret = 0;
 	if (nr_segs == 0)
 		goto out;
 
-	/*
-	 * First get the "struct iovec" from user memory and
-	 * verify all the pointers
-	 */
 	ret = -EINVAL;
-	if ((nr_segs > UIO_MAXIOV) || (nr_segs <= 0))
-		goto out;
-	if (!file->f_op)
+	if (nr_segs > UIO_MAXIOV)
 		goto out;
-	if (nr_segs > UIO_FASTIOV) {
+	if (nr_segs > fast_segs) {
 		ret = -ENOMEM;
 		iov = kmalloc(nr_segs*sizeof(struct iovec), GFP_KERNEL);
-		if (!iov)
+		if (iov == NULL)
 			goto out;
 	}
+	*ret_pointer = iov;
+
 	ret = -EFAULT;
 	if (!access_ok(VERIFY_READ, uvector, nr_segs*sizeof(*uvector)))
 		goto out;
@@ -1127,32 +1120,60 @@ static ssize_t compat_do_readv_writev(int type, struct file *file,
 	 * Be careful here because iov_len is a size_t not an ssize_t
 	 */
 	tot_len = 0;
-	vector = iov;
 	ret = -EINVAL;
-	for (seg = 0 ; seg < nr_segs; seg++) {
+	for (seg = 0; seg < nr_segs; seg++) {
 		compat_ssize_t tmp = tot_len;
-		compat_ssize_t len;
 		compat_uptr_t buf;
+		compat_ssize_t len;
 
 		if (__get_user(len, &uvector->iov_len) ||
-		    __get_user(buf, &uvector->iov_base)) {
+		   __get_user(buf, &uvector->iov_base)) {
 			ret = -EFAULT;
 			goto out;
 		}
-		if (len < 0)	/* size_t not fitting an compat_ssize_t .. */
+		if (len < 0)	/* size_t not fitting in compat_ssize_t .. */
 			goto out;
 		tot_len += len;
 		if (tot_len < tmp) /* maths overflow on the compat_ssize_t */
 			goto out;
-		vector->iov_base = compat_ptr(buf);
-		vector->iov_len = (compat_size_t) len;
+		if (type >= 0 &&
+		    !access_ok(type == READ ? VERIFY_WRITE : VERIFY_READ,
+			       compat_ptr(buf), len)) {
+			ret = -EFAULT;
+			goto out;
+		}
+		iov->iov_base = compat_ptr(buf);
+		iov->iov_len = (compat_size_t) len;
 		uvector++;
-		vector++;
+		iov++;
 	}
-	if (tot_len == 0) {
-		ret = 0;
+	ret = tot_len;
+
+out:
+	return ret;
+}
+
+static ssize_t compat_do_readv_writev(int type, struct file *file,
+			       const struct compat_iovec __user *uvector,
+			       unsigned long nr_segs, loff_t *pos)
+{
+	compat_ssize_t tot_len;
+	struct iovec iovstack[UIO_FASTIOV];
+	struct iovec *iov = iovstack;
+	ssize_t ret;
+	io_fn_t fn;
+	iov_fn_t fnv;
+
+	ret = -EINVAL;
+	if (!file->f_op)
 		goto out;
-	}
+
+	ret = compat_rw_copy_check_uvector(type, uvector, nr_segs,
+					   UIO_FASTIOV, iovstack, &iov);
+	if (ret <= 0)
+		goto out;
+
+	tot_len = ret;
 
 	ret = rw_verify_area(type, file, pos, tot_len);
 	if (ret < 0)
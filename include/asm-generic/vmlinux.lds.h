@@ -139,6 +139,12 @@
 #endif
 
 /* .data section */
+#define JUMP_TABLE_DATA							\
+	. = ALIGN(8);							\
+	VMLINUX_SYMBOL(__start___jump_table) = .;			\
+	*(__jump_table)							\
+	VMLINUX_SYMBOL(__stop___jump_table) = .;
+
 #define DATA_DATA							\
 	*(.data)							\
 	*(.ref.data)							\
@@ -156,6 +162,7 @@
 	VMLINUX_SYMBOL(__start___tracepoints) = .;			\
 	*(__tracepoints)						\
 	VMLINUX_SYMBOL(__stop___tracepoints) = .;			\
+	JUMP_TABLE_DATA							\
 	/* implement dynamic printk debug */				\
 	. = ALIGN(8);							\
 	VMLINUX_SYMBOL(__start___verbose) = .;                          \
@@ -620,6 +620,8 @@ struct address_space {
 	spinlock_t		i_mmap_lock;	/* protect tree, count, list */
 	unsigned int		truncate_count;	/* Cover race condition with truncate */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
+	struct list_head	shadow_list;	/* mappings with shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -1543,6 +1545,12 @@ struct inode_operations {
 
 struct seq_file;
 
+/*
+ * Passed as @type to rw_copy_check_uvector(): copy and length check the
+ * iovecs, but do not access_ok() them - they belong to another mm.
+ */
+#define CHECK_IOVEC_ONLY -1
+
 ssize_t rw_copy_check_uvector(int type, const struct iovec __user * uvector,
 				unsigned long nr_segs, unsigned long fast_segs,
 				struct iovec *fast_pointer,
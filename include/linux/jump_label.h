@@ -0,0 +1,87 @@
+#ifndef _LINUX_JUMP_LABEL_H
+#define _LINUX_JUMP_LABEL_H
+
+/*
+ * Jump labels: branches patched at runtime.
+ *
+ *	JUMP_LABEL(key, label);
+ *
+ * branches to @label when the flag @key points to is enabled, and falls
+ * through otherwise.  Where the architecture and compiler allow it, the
+ * site is emitted as a nop on the fall-through path, with no load or
+ * test of @key, and jump_label_enable()/jump_label_disable() rewrite
+ * every site using @key into a jump to its label and back.
+ *
+ * This suits flags that are tested in hot paths and changed very rarely,
+ * such as whether a tracepoint has probes: changing a key patches kernel
+ * text under stop_machine() and is therefore expensive.  The flag itself
+ * is kept up to date as well, so it may still be read directly.  Keys may
+ * only be changed from process context.
+ *
+ * Without 'asm goto' support, JUMP_LABEL() falls back to testing the flag.
+ */
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+
+#if defined(CC_HAVE_ASM_GOTO) && defined(CONFIG_HAVE_ARCH_JUMP_LABEL)
+# include <asm/jump_label.h>
+# define HAVE_JUMP_LABEL
+#endif
+
+enum jump_label_type {
+	JUMP_LABEL_ENABLE,
+	JUMP_LABEL_DISABLE
+};
+
+struct module;
+
+#ifdef HAVE_JUMP_LABEL
+
+extern struct jump_entry __start___jump_table[];
+extern struct jump_entry __stop___jump_table[];
+
+extern void arch_jump_label_transform(struct jump_entry *entry,
+				      enum jump_label_type type);
+extern void arch_jump_label_text_poke_early(jump_label_t addr);
+extern void jump_label_update(unsigned long key, enum jump_label_type type);
+extern int jump_label_text_reserved(void *start, void *end);
+
+#define jump_label_enable(key)						\
+	do {								\
+		*(key) = 1;						\
+		jump_label_update((unsigned long)(key), JUMP_LABEL_ENABLE); \
+	} while (0)
+
+#define jump_label_disable(key)						\
+	do {								\
+		jump_label_update((unsigned long)(key), JUMP_LABEL_DISABLE); \
+		*(key) = 0;						\
+	} while (0)
+
+#else /* !HAVE_JUMP_LABEL */
+
+#define JUMP_LABEL(key, label)						\
+	do {								\
+		if (unlikely(*(key)))					\
+			goto label;					\
+	} while (0)
+
+#define jump_label_enable(key)						\
+	do {								\
+		*(key) = 1;						\
+	} while (0)
+
+#define jump_label_disable(key)						\
+	do {								\
+		*(key) = 0;						\
+	} while (0)
+
+static inline int jump_label_text_reserved(void *start, void *end)
+{
+	return 0;
+}
+
+#endif /* HAVE_JUMP_LABEL */
+
+#endif /* _LINUX_JUMP_LABEL_H */
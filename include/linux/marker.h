@@ -14,6 +14,7 @@
 
 #include <stdarg.h>
 #include <linux/types.h>
+#include <linux/jump_label.h>
 
 struct module;
 struct marker;
@@ -80,13 +81,19 @@ struct marker {
  *
  * The "generic" argument controls which marker enabling mechanism must be used.
  * If generic is true, a variable read is used.
- * If generic is false, immediate values are used.
+ * If generic is false, a jump label on the marker state is used.
  */
 #define __trace_mark(generic, name, call_private, format, args...)	\
 	do {								\
+		__label__ __mark_call;					\
 		DEFINE_MARKER(name, format);				\
 		__mark_check_format(format, ## args);			\
-		if (unlikely(__mark_##name.state)) {			\
+		if (!(generic))						\
+			JUMP_LABEL(&__mark_##name.state, __mark_call);	\
+		else if (unlikely(__mark_##name.state))			\
+			goto __mark_call;				\
+		if (0) {						\
+__mark_call:								\
 			(*__mark_##name.call)				\
 				(&__mark_##name, call_private, ## args);\
 		}							\
@@ -0,0 +1,82 @@
+/*
+ * MCS lock defines
+ *
+ * This file contains the main data structure and API definitions of MCS lock.
+ *
+ * The MCS lock (proposed by Mellor-Crummey and Scott) is a simple spin-lock
+ * with the desirable properties of being fair, and with each cpu trying
+ * to acquire the lock spinning on a local variable.
+ * It avoids expensive cache bouncings that common test-and-set spin-lock
+ * implementations incur.
+ *
+ * The lock is a pointer to the tail of the queue of waiters; each waiter
+ * brings its own node, which must stay valid until it has released the
+ * lock again. Waiters must not sleep while queued.
+ */
+#ifndef _LINUX_MCS_SPINLOCK_H
+#define _LINUX_MCS_SPINLOCK_H
+
+#include <linux/compiler.h>
+#include <asm/system.h>
+#include <asm/processor.h>
+
+struct mcs_spinlock {
+	struct mcs_spinlock *next;
+	int locked; /* 1 if lock acquired */
+	int count;  /* nesting count, see qspinlock.c */
+};
+
+/*
+ * Queue @node at the tail of @lock and spin until it is our turn.
+ */
+static inline
+void mcs_spin_lock(struct mcs_spinlock **lock, struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *prev;
+
+	/* Init node */
+	node->locked = 0;
+	node->next   = NULL;
+
+	/* xchg() provides a full memory barrier */
+	prev = xchg(lock, node);
+	if (likely(prev == NULL)) {
+		/* Lock acquired */
+		return;
+	}
+	ACCESS_ONCE(prev->next) = node;
+
+	/* Wait until the lock holder passes the lock down. */
+	while (!ACCESS_ONCE(node->locked))
+		cpu_relax();
+
+	/* Make sure the critical section is not observed before the handoff */
+	smp_mb();
+}
+
+/*
+ * Releases the lock. The caller should pass in the corresponding node that
+ * was used to acquire the lock.
+ */
+static inline
+void mcs_spin_unlock(struct mcs_spinlock **lock, struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = ACCESS_ONCE(node->next);
+
+	if (likely(!next)) {
+		/*
+		 * Release the lock by setting it to NULL
+		 */
+		if (likely(cmpxchg(lock, node, NULL) == node))
+			return;
+		/* Wait until the next pointer is set */
+		while (!(next = ACCESS_ONCE(node->next)))
+			cpu_relax();
+	}
+
+	/* Pass lock to next waiter, after the critical section is done. */
+	smp_mb();
+	ACCESS_ONCE(next->locked) = 1;
+}
+
+#endif /* _LINUX_MCS_SPINLOCK_H */
@@ -0,0 +1,32 @@
+#ifndef _LINUX_PERCPU_RWSEM_H
+#define _LINUX_PERCPU_RWSEM_H
+/*
+ * A reader-writer semaphore for read-mostly global locks: readers only
+ * touch a per-cpu counter, so they never share a cache line with each
+ * other. Writers are very expensive, they wait for an RCU-sched grace
+ * period on both lock and unlock.
+ */
+
+#include <linux/rwsem.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <asm/atomic.h>
+
+struct percpu_rw_semaphore {
+	unsigned int		*fast_read_ctr;
+	atomic_t		write_ctr;
+	struct rw_semaphore	rw_sem;
+	atomic_t		slow_read_ctr;
+	wait_queue_head_t	write_waitq;
+};
+
+extern void percpu_down_read(struct percpu_rw_semaphore *);
+extern void percpu_up_read(struct percpu_rw_semaphore *);
+
+extern void percpu_down_write(struct percpu_rw_semaphore *);
+extern void percpu_up_write(struct percpu_rw_semaphore *);
+
+extern int percpu_init_rwsem(struct percpu_rw_semaphore *);
+extern void percpu_free_rwsem(struct percpu_rw_semaphore *);
+
+#endif /* _LINUX_PERCPU_RWSEM_H */
@@ -122,8 +122,19 @@ enum perf_counter_sample_format {
 	PERF_SAMPLE_PERIOD			= 1U << 8,
 	PERF_SAMPLE_STREAM_ID			= 1U << 9,
 	PERF_SAMPLE_RAW				= 1U << 10,
+	PERF_SAMPLE_REGS_USER			= 1U << 11,
+	PERF_SAMPLE_STACK_USER			= 1U << 12,
 
-	PERF_SAMPLE_MAX = 1U << 11,		/* non-ABI */
+	PERF_SAMPLE_MAX = 1U << 13,		/* non-ABI */
+};
+
+/*
+ * Values to determine ABI of the registers dump.
+ */
+enum perf_sample_regs_abi {
+	PERF_SAMPLE_REGS_ABI_NONE		= 0,
+	PERF_SAMPLE_REGS_ABI_32			= 1,
+	PERF_SAMPLE_REGS_ABI_64			= 2,
 };
 
 /*
@@ -203,9 +214,18 @@ struct perf_counter_attr {
 				__reserved_1   : 50;
 
 	__u32			wakeup_events;	/* wakeup every n events */
-	__u32			__reserved_2;
 
-	__u64			__reserved_3;
+	/*
+	 * Size of the user stack to dump with PERF_SAMPLE_STACK_USER,
+	 * a multiple of sizeof(u64).
+	 */
+	__u32			sample_stack_user;
+
+	/*
+	 * Registers to dump with PERF_SAMPLE_REGS_USER, as a bitmask of
+	 * the arch specific register numbers (asm/perf_regs.h).
+	 */
+	__u64			sample_regs_user;
 };
 
 /*
@@ -396,7 +416,22 @@ enum perf_event_type {
 	 *
 	 *	{ u32			size;
 	 *	  char                  data[size];}&& PERF_SAMPLE_RAW
+	 *
+	 *	{ u64			abi; # enum perf_sample_regs_abi
+	 *	  u64			regs[weight(mask)]; } && PERF_SAMPLE_REGS_USER
+	 *
+	 *	{ u64			size;
+	 *	  char			data[size];
+	 *	  u64			dyn_size; } && PERF_SAMPLE_STACK_USER
 	 * };
+	 *
+	 * The user registers are those of the interrupted user context,
+	 * in ascending order of their bit in attr.sample_regs_user; abi
+	 * is NONE and the registers are left out for kernel threads.
+	 * The user stack is copied from the user stack pointer on, size
+	 * is the space reserved for it (0 when there is no user context,
+	 * then data and dyn_size are left out) and dyn_size the number of
+	 * bytes that could actually be read.
 	 */
 	PERF_EVENT_SAMPLE		= 9,
 
@@ -755,6 +790,8 @@ extern void perf_counter_comm(struct task_struct *tsk);
 extern void perf_counter_fork(struct task_struct *tsk);
 
 extern struct perf_callchain_entry *perf_callchain(struct pt_regs *regs);
+extern unsigned long
+copy_from_user_nmi(void *to, const void __user *from, unsigned long n);
 
 extern int sysctl_perf_counter_paranoid;
 extern int sysctl_perf_counter_mlock;
@@ -166,6 +166,10 @@ extern void rcu_restart_cpu(int cpu);
 extern long rcu_batches_completed(void);
 extern long rcu_batches_completed_bh(void);
 
+/* A context switch is a quiescent state for both flavors. */
+#define synchronize_rcu_expedited()	synchronize_sched_expedited()
+#define synchronize_rcu_bh_expedited()	synchronize_sched_expedited()
+
 #define rcu_enter_nohz()	do { } while (0)
 #define rcu_exit_nohz()		do { } while (0)
 
@@ -54,6 +54,18 @@ struct rcu_head {
 /* Internal to kernel, but needed by rcupreempt.h. */
 extern int rcu_scheduler_active;
 
+/*
+ * synchronize_sched_expedited - brute-force synchronize_sched()
+ *
+ * Forces a context switch on every online CPU instead of waiting for
+ * them to pass through a quiescent state by themselves, so it returns
+ * within a few scheduling latencies rather than a few ticks.  This is
+ * costly for the whole system: reserve it to rare updates that are
+ * latency sensitive, like module unload.  Also provided as
+ * synchronize_rcu_expedited() and synchronize_rcu_bh_expedited().
+ */
+extern void synchronize_sched_expedited(void);
+
 #if defined(CONFIG_CLASSIC_RCU)
 #include <linux/rcuclassic.h>
 #elif defined(CONFIG_TREE_RCU)
@@ -89,6 +89,13 @@ static inline long rcu_batches_completed_bh(void)
 	return rcu_batches_completed();
 }
 
+/*
+ * Preempted readers do not stop a context switch from happening, so
+ * only the bh flavor can be expedited.
+ */
+#define synchronize_rcu_expedited()	synchronize_rcu()
+#define synchronize_rcu_bh_expedited()	synchronize_sched_expedited()
+
 #ifdef CONFIG_RCU_TRACE
 struct rcupreempt_trace;
 extern long *rcupreempt_flipctr(int cpu);
@@ -161,7 +161,18 @@ struct rcu_data {
 	unsigned long offline_fqs;	/* Kicked due to being offline. */
 	unsigned long resched_ipi;	/* Sent a resched IPI. */
 
-	/* 5) __rcu_pending() statistics. */
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 5) callbacks offloaded to the rcuo kthread (rcu_nocbs=). */
+	struct rcu_head *nocb_head;	/* CBs waiting for the kthread. */
+	struct rcu_head **nocb_tail;
+	long nocb_qlen;			/* # of CBs waiting for the kthread. */
+	spinlock_t nocb_lock;		/* Guards the above. */
+	struct task_struct *nocb_kthread;
+					/* Non-NULL if CBs are offloaded. */
+	struct rcu_state *nocb_rsp;	/* Flavor the kthread waits for. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+	/* 6) __rcu_pending() statistics. */
 	long n_rcu_pending;		/* rcu_pending() calls since boot. */
 	long n_rp_qs_pending;
 	long n_rp_cb_ready;
@@ -297,6 +308,17 @@ extern void rcu_restart_cpu(int cpu);
 extern long rcu_batches_completed(void);
 extern long rcu_batches_completed_bh(void);
 
+/* A context switch is a quiescent state for both flavors. */
+static inline void synchronize_rcu_expedited(void)
+{
+	synchronize_sched_expedited();
+}
+
+static inline void synchronize_rcu_bh_expedited(void)
+{
+	synchronize_sched_expedited();
+}
+
 #ifdef CONFIG_NO_HZ
 void rcu_enter_nohz(void);
 void rcu_exit_nohz(void);
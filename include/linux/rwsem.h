@@ -22,6 +22,14 @@ struct rw_semaphore;
 #include <asm/rwsem.h> /* use an arch-specific implementation */
 #endif
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Value of sem->owner while readers hold the semaphore: there is no
+ * single owner which writers could spin on.
+ */
+#define RWSEM_READER_OWNED	((struct thread_info *)1UL)
+#endif
+
 /*
  * lock for reading
  */
@@ -7,6 +7,7 @@
 #define _LINUX_TICK_H
 
 #include <linux/clockchips.h>
+#include <linux/smp.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -43,6 +44,10 @@ enum tick_nohz_mode {
  * @idle_exittime:	Time when the idle state was left
  * @idle_sleeptime:	Sum of the time slept in idle with sched tick stopped
  * @sleep_length:	Duration of the current idle sleep
+ * @full_stopped:	Indicator that the tick has been stopped on a busy
+ *			full dynticks CPU
+ * @full_jiffies:	jiffies when the busy tick was stopped, for cputime
+ *			accounting
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -64,6 +69,10 @@ struct tick_sched {
 	unsigned long			last_jiffies;
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stopped;
+	unsigned long			full_jiffies;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -131,4 +140,42 @@ static inline ktime_t tick_nohz_get_sleep_length(void)
 static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern int tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline int tick_nohz_full_enabled(void)
+{
+	return tick_nohz_full_running;
+}
+
+static inline int tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return 0;
+
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void __tick_nohz_full_check(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_kick_all(void);
+
+/*
+ * Re-evaluate whether the tick of the current CPU must run again, from
+ * irq exit and context switch.
+ */
+static inline void tick_nohz_full_check(void)
+{
+	if (tick_nohz_full_cpu(smp_processor_id()))
+		__tick_nohz_full_check();
+}
+# else
+static inline int tick_nohz_full_enabled(void) { return 0; }
+static inline int tick_nohz_full_cpu(int cpu) { return 0; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_kick_all(void) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
@@ -21,15 +21,8 @@ struct syscall_metadata {
 #ifdef CONFIG_FTRACE_SYSCALLS
 extern void arch_init_ftrace_syscalls(void);
 extern struct syscall_metadata *syscall_nr_to_meta(int nr);
-extern void start_ftrace_syscalls(void);
-extern void stop_ftrace_syscalls(void);
-extern void ftrace_syscall_enter(struct pt_regs *regs);
-extern void ftrace_syscall_exit(struct pt_regs *regs);
-#else
-static inline void start_ftrace_syscalls(void)			{ }
-static inline void stop_ftrace_syscalls(void)			{ }
-static inline void ftrace_syscall_enter(struct pt_regs *regs)	{ }
-static inline void ftrace_syscall_exit(struct pt_regs *regs)	{ }
+extern void ftrace_syscall_enter(struct pt_regs *regs, long id);
+extern void ftrace_syscall_exit(struct pt_regs *regs, long ret);
 #endif
 
 #endif /* _TRACE_SYSCALL_H */
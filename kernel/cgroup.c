@@ -48,6 +48,7 @@
 #include <linux/namei.h>
 #include <linux/smp_lock.h>
 #include <linux/pid_namespace.h>
+#include <linux/percpu-rwsem.h>
 
 #include <asm/atomic.h>
 
@@ -254,6 +255,17 @@ static struct hlist_head *css_set_hash(struct cgroup_subsys_state *css[])
  * compiled into their kernel but not actually in use */
 static int use_task_css_set_links __read_mostly;
 
+/*
+ * Held for reading by every fork from cgroup_fork() until the child is
+ * on its css_set (cgroup_post_fork()), and for writing while a task is
+ * moved through the "tasks" file. Otherwise a task forking while it is
+ * being moved can leave a child, invisible when the mover scanned the
+ * old cgroup, behind in it. Forks are far more frequent than moves, so
+ * this is a percpu_rw_semaphore: readers don't share a cache line.
+ * Nests outside cgroup_mutex.
+ */
+static struct percpu_rw_semaphore cgroup_fork_rwsem;
+
 /* When we create or destroy a css_set, the operation simply
  * takes/releases a reference count on all the cgroups referenced
  * by subsystems in this css_set. This can end up multiple-counting
@@ -1415,10 +1427,16 @@ static int attach_task_by_pid(struct cgroup *cgrp, u64 pid)
 static int cgroup_tasks_write(struct cgroup *cgrp, struct cftype *cft, u64 pid)
 {
 	int ret;
-	if (!cgroup_lock_live_group(cgrp))
-		return -ENODEV;
+
+	percpu_down_write(&cgroup_fork_rwsem);
+	if (!cgroup_lock_live_group(cgrp)) {
+		ret = -ENODEV;
+		goto out;
+	}
 	ret = attach_task_by_pid(cgrp, pid);
 	cgroup_unlock();
+out:
+	percpu_up_write(&cgroup_fork_rwsem);
 	return ret;
 }
 
@@ -2917,6 +2935,8 @@ int __init cgroup_init(void)
 	int i;
 	struct hlist_head *hhead;
 
+	BUG_ON(percpu_init_rwsem(&cgroup_fork_rwsem));
+
 	err = bdi_init(&cgroup_backing_dev_info);
 	if (err)
 		return err;
@@ -3077,6 +3097,23 @@ void cgroup_fork(struct task_struct *child)
 	INIT_LIST_HEAD(&child->cg_list);
 }
 
+/**
+ * cgroup_fork_lock - keep tasks from being moved between cgroups
+ *
+ * Taken by copy_process() around cgroup_fork() .. cgroup_post_fork(),
+ * and released with cgroup_fork_unlock(). May sleep; nests outside
+ * cgroup_mutex.
+ */
+void cgroup_fork_lock(void)
+{
+	percpu_down_read(&cgroup_fork_rwsem);
+}
+
+void cgroup_fork_unlock(void)
+{
+	percpu_up_read(&cgroup_fork_rwsem);
+}
+
 /**
  * cgroup_fork_callbacks - run fork callbacks
  * @child: the new task
@@ -435,6 +435,12 @@ static int validate_change(const struct cpuset *cur, const struct cpuset *trial)
 		}
 	}
 
+	/* The admitted SCHED_DEADLINE bandwidth must still fit */
+	if (is_cpu_exclusive(cur) &&
+	    !cpuset_cpumask_can_shrink(cur->cpus_allowed,
+				       trial->cpus_allowed))
+		return -EBUSY;
+
 	return 0;
 }
 
@@ -0,0 +1,312 @@
+/*
+ * jump label support
+ *
+ * Keeps every JUMP_LABEL() site, in the kernel and in loaded modules,
+ * pointing the way its key says: a nop while the key is disabled, a
+ * jump to the label while it is enabled.  See include/linux/jump_label.h.
+ */
+#include <linux/jump_label.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+
+#ifdef HAVE_JUMP_LABEL
+
+#define JUMP_LABEL_HASH_BITS 6
+#define JUMP_LABEL_TABLE_SIZE (1 << JUMP_LABEL_HASH_BITS)
+
+/* Protects the enabled key table, the module list and the sites. */
+static DEFINE_MUTEX(jump_label_mutex);
+
+/*
+ * Keys that are currently enabled.  Sites of modules loaded later are
+ * turned into jumps from this, and it also covers keys enabled while
+ * their module is still being set up.
+ */
+static struct hlist_head jump_label_table[JUMP_LABEL_TABLE_SIZE];
+
+struct jump_label_key {
+	struct hlist_node hlist;
+	jump_label_t key;
+};
+
+#ifdef CONFIG_MODULES
+/* Loaded modules that have JUMP_LABEL() sites. */
+static LIST_HEAD(jump_label_modules);
+
+struct jump_label_module {
+	struct list_head list;
+	struct module *mod;
+};
+#endif
+
+static struct hlist_head *jump_label_bucket(jump_label_t key)
+{
+	u32 hash = jhash((void *)&key, sizeof(jump_label_t), 0);
+
+	return &jump_label_table[hash & (JUMP_LABEL_TABLE_SIZE - 1)];
+}
+
+static struct jump_label_key *get_jump_label_key(jump_label_t key)
+{
+	struct hlist_head *head = jump_label_bucket(key);
+	struct hlist_node *node;
+	struct jump_label_key *e;
+
+	hlist_for_each_entry(e, node, head, hlist) {
+		if (e->key == key)
+			return e;
+	}
+	return NULL;
+}
+
+static void remove_jump_label_key(struct jump_label_key *e)
+{
+	hlist_del(&e->hlist);
+	kfree(e);
+}
+
+/*
+ * Remember whether @key is enabled.  Returns -ENOMEM if it could not be
+ * recorded; the sites are still patched, only modules loaded later would
+ * miss it.
+ */
+static int record_jump_label_key(jump_label_t key, enum jump_label_type type)
+{
+	struct jump_label_key *e = get_jump_label_key(key);
+
+	if (type == JUMP_LABEL_DISABLE) {
+		if (e)
+			remove_jump_label_key(e);
+		return 0;
+	}
+	if (e)
+		return 0;
+	e = kmalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+	e->key = key;
+	hlist_add_head(&e->hlist, jump_label_bucket(key));
+	return 0;
+}
+
+static void update_jump_label_range(struct jump_entry *start,
+				    struct jump_entry *stop,
+				    jump_label_t key, enum jump_label_type type)
+{
+	struct jump_entry *iter;
+
+	for (iter = start; iter < stop; iter++) {
+		if (iter->key != key || !iter->code)
+			continue;
+		/* Skip sites in init text that has been freed */
+		if (!kernel_text_address(iter->code))
+			continue;
+		arch_jump_label_transform(iter, type);
+	}
+}
+
+/**
+ * jump_label_update - enable or disable all the sites of a key
+ * @key: address of the key
+ * @type: JUMP_LABEL_ENABLE or JUMP_LABEL_DISABLE
+ *
+ * Use jump_label_enable() and jump_label_disable() rather than calling
+ * this directly.  May sleep.
+ */
+void jump_label_update(unsigned long key, enum jump_label_type type)
+{
+#ifdef CONFIG_MODULES
+	struct jump_label_module *jlm;
+#endif
+
+	mutex_lock(&jump_label_mutex);
+	WARN_ON_ONCE(record_jump_label_key(key, type));
+	update_jump_label_range(__start___jump_table, __stop___jump_table,
+				key, type);
+#ifdef CONFIG_MODULES
+	list_for_each_entry(jlm, &jump_label_modules, list)
+		update_jump_label_range(jlm->mod->jump_entries,
+			jlm->mod->jump_entries + jlm->mod->num_jump_entries,
+			key, type);
+#endif
+	mutex_unlock(&jump_label_mutex);
+}
+EXPORT_SYMBOL_GPL(jump_label_update);
+
+static int addr_conflict(struct jump_entry *entry, void *start, void *end)
+{
+	return entry->code <= (unsigned long)end &&
+		entry->code + JUMP_LABEL_NOP_SIZE > (unsigned long)start;
+}
+
+static int range_reserved(struct jump_entry *first, struct jump_entry *last,
+			  void *start, void *end)
+{
+	struct jump_entry *iter;
+
+	for (iter = first; iter < last; iter++) {
+		if (iter->code && addr_conflict(iter, start, end))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * jump_label_text_reserved - check if addr range is reserved
+ * @start: start text addr
+ * @end: end text addr
+ *
+ * Checks if the text addr located between @start and @end overlaps
+ * with any jump label site, which may be rewritten at any time and so
+ * must not be modified by anyone else (kprobes, for instance).
+ *
+ * Returns 1 if there is an overlap, 0 otherwise.
+ */
+int jump_label_text_reserved(void *start, void *end)
+{
+#ifdef CONFIG_MODULES
+	struct jump_label_module *jlm;
+#endif
+	int ret;
+
+	mutex_lock(&jump_label_mutex);
+	ret = range_reserved(__start___jump_table, __stop___jump_table,
+			     start, end);
+#ifdef CONFIG_MODULES
+	list_for_each_entry(jlm, &jump_label_modules, list) {
+		if (ret)
+			break;
+		ret = range_reserved(jlm->mod->jump_entries,
+			jlm->mod->jump_entries + jlm->mod->num_jump_entries,
+			start, end);
+	}
+#endif
+	mutex_unlock(&jump_label_mutex);
+	return ret;
+}
+
+/*
+ * The compiler emits every site as a jump to the next instruction;
+ * turn them into real nops before anything can enable a key.
+ */
+static __init int jump_label_init(void)
+{
+	struct jump_entry *iter;
+
+	mutex_lock(&jump_label_mutex);
+	for (iter = __start___jump_table; iter < __stop___jump_table; iter++) {
+		arch_jump_label_text_poke_early(iter->code);
+		if (get_jump_label_key(iter->key))
+			arch_jump_label_transform(iter, JUMP_LABEL_ENABLE);
+	}
+	mutex_unlock(&jump_label_mutex);
+	return 0;
+}
+early_initcall(jump_label_init);
+
+#ifdef CONFIG_MODULES
+
+static int jump_label_add_module(struct module *mod)
+{
+	struct jump_entry *iter, *stop;
+	struct jump_label_module *jlm;
+
+	if (!mod->num_jump_entries)
+		return 0;
+
+	jlm = kmalloc(sizeof(*jlm), GFP_KERNEL);
+	if (!jlm)
+		return -ENOMEM;
+	jlm->mod = mod;
+
+	stop = mod->jump_entries + mod->num_jump_entries;
+	for (iter = mod->jump_entries; iter < stop; iter++) {
+		arch_jump_label_text_poke_early(iter->code);
+		if (get_jump_label_key(iter->key))
+			arch_jump_label_transform(iter, JUMP_LABEL_ENABLE);
+	}
+	list_add(&jlm->list, &jump_label_modules);
+	return 0;
+}
+
+static void jump_label_remove_module(struct module *mod)
+{
+	struct jump_label_module *jlm, *tmp;
+	struct jump_label_key *e;
+	struct hlist_node *node, *n;
+	int i;
+
+	list_for_each_entry_safe(jlm, tmp, &jump_label_modules, list) {
+		if (jlm->mod == mod) {
+			list_del(&jlm->list);
+			kfree(jlm);
+		}
+	}
+	/* Forget keys that go away with the module's data */
+	for (i = 0; i < JUMP_LABEL_TABLE_SIZE; i++)
+		hlist_for_each_entry_safe(e, node, n, &jump_label_table[i],
+					  hlist)
+			if (within_module_core(e->key, mod))
+				remove_jump_label_key(e);
+}
+
+/* The module's init text is about to be freed: stop patching it. */
+static void jump_label_remove_module_init(struct module *mod)
+{
+	struct jump_entry *iter, *stop;
+
+	stop = mod->jump_entries + mod->num_jump_entries;
+	for (iter = mod->jump_entries; iter < stop; iter++) {
+		if (within_module_init(iter->code, mod))
+			iter->code = 0;
+	}
+}
+
+static int jump_label_module_notify(struct notifier_block *self,
+				    unsigned long val, void *data)
+{
+	struct module *mod = data;
+	int ret = 0;
+
+	mutex_lock(&jump_label_mutex);
+	switch (val) {
+	case MODULE_STATE_COMING:
+		ret = jump_label_add_module(mod);
+		if (ret)
+			WARN(1, "%s: unable to add jump label sites\n",
+			     mod->name);
+		break;
+	case MODULE_STATE_GOING:
+		jump_label_remove_module(mod);
+		break;
+	case MODULE_STATE_LIVE:
+		jump_label_remove_module_init(mod);
+		break;
+	}
+	mutex_unlock(&jump_label_mutex);
+
+	return notifier_from_errno(ret);
+}
+
+/*
+ * Run before the tracepoint and marker notifiers, so the sites of a
+ * coming module are known by the time its tracepoints are set up.
+ */
+static struct notifier_block jump_label_module_nb = {
+	.notifier_call = jump_label_module_notify,
+	.priority = 1,
+};
+
+static __init int init_jump_label_module(void)
+{
+	return register_module_notifier(&jump_label_module_nb);
+}
+early_initcall(init_jump_label_module);
+
+#endif /* CONFIG_MODULES */
+
+#endif /* HAVE_JUMP_LABEL */
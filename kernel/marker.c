@@ -562,7 +562,10 @@ static int set_marker(struct marker_entry *entry, struct marker *elem,
 				(unsigned long)elem->tp_cb));
 		}
 	}
-	elem->state = active;
+	if (active && !elem->state)
+		jump_label_enable(&elem->state);
+	else if (!active && elem->state)
+		jump_label_disable(&elem->state);
 
 	return ret;
 }
@@ -593,7 +596,8 @@ static void disable_marker(struct marker *elem)
 		 */
 		module_put(__module_text_address((unsigned long)elem->tp_cb));
 	}
-	elem->state = 0;
+	if (elem->state)
+		jump_label_disable(&elem->state);
 	elem->single.func = __mark_empty_function;
 	/* Update the function before setting the ptype */
 	smp_wmb();
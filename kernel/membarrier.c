@@ -0,0 +1,121 @@
+/*
+ * membarrier system call
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/syscalls.h>
+#include <linux/membarrier.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+
+/*
+ * Bitmask made from a "or" of all commands within enum membarrier_cmd,
+ * except MEMBARRIER_CMD_QUERY.
+ */
+#define MEMBARRIER_CMD_BITMASK	\
+	(MEMBARRIER_CMD_SHARED | MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+
+static void ipi_mb(void *info)
+{
+	smp_mb();	/* IPIs should be serializing but paranoid. */
+}
+
+/*
+ * Only the cpus in mm_cpumask() can be running a thread of this mm: on
+ * x86 switch_mm() sets the bit with a locked instruction before the
+ * next task returns to user-space, so a cpu whose bit we see clear here
+ * will see every store the caller made before its smp_mb().
+ */
+static void membarrier_private_expedited(void)
+{
+	struct mm_struct *mm = current->mm;
+	cpumask_var_t tmpmask;
+	int cpu, this_cpu;
+
+	if (num_online_cpus() == 1 || atomic_read(&mm->mm_users) == 1)
+		return;
+
+	/*
+	 * Matches memory barriers around mm_cpumask() modification in
+	 * switch_mm(), orders the caller's accesses before the ipis.
+	 */
+	smp_mb();
+
+	/*
+	 * smp_call_function_many() wants a mask which does not change
+	 * under it; mm_cpumask() does, so work on a copy.
+	 */
+	if (alloc_cpumask_var(&tmpmask, GFP_KERNEL)) {
+		preempt_disable();
+		cpumask_copy(tmpmask, mm_cpumask(mm));
+		smp_call_function_many(tmpmask, ipi_mb, NULL, 1);
+		preempt_enable();
+		free_cpumask_var(tmpmask);
+	} else {
+		this_cpu = get_cpu();
+		for_each_cpu(cpu, mm_cpumask(mm)) {
+			if (cpu == this_cpu)
+				continue;
+			smp_call_function_single(cpu, ipi_mb, NULL, 1);
+		}
+		put_cpu();
+	}
+
+	/* Orders the ipis before the caller's following accesses. */
+	smp_mb();
+}
+
+/**
+ * sys_membarrier - issue memory barriers on a set of threads
+ * @cmd:   Takes command values defined in enum membarrier_cmd.
+ * @flags: Currently needs to be 0. For future extensions.
+ *
+ * If this system call is not implemented, -ENOSYS is returned. If the
+ * command specified does not exist, or if the command argument is invalid,
+ * this system call returns -EINVAL. For a given command, with flags argument
+ * set to 0, this system call is guaranteed to always return the same value
+ * until reboot.
+ *
+ * All memory accesses performed in program order from each targeted thread
+ * is guaranteed to be ordered with respect to sys_membarrier(). If we use
+ * the semantic "barrier()" to represent a compiler barrier forcing memory
+ * accesses to be performed in program order across the barrier, and
+ * smp_mb() to represent explicit memory barriers forcing full memory
+ * ordering across the barrier, we have the following ordering table for
+ * each pair of barrier(), sys_membarrier() and smp_mb():
+ *
+ * The pair ordering is detailed as (O: ordered, X: not ordered):
+ *
+ *                        barrier()   smp_mb() sys_membarrier()
+ *        barrier()          X           X            O
+ *        smp_mb()           X           O            O
+ *        sys_membarrier()   O           O            O
+ */
+SYSCALL_DEFINE2(membarrier, int, cmd, int, flags)
+{
+	if (unlikely(flags))
+		return -EINVAL;
+	switch (cmd) {
+	case MEMBARRIER_CMD_QUERY:
+		return MEMBARRIER_CMD_BITMASK;
+	case MEMBARRIER_CMD_SHARED:
+		if (num_online_cpus() > 1)
+			synchronize_sched();
+		return 0;
+	case MEMBARRIER_CMD_PRIVATE_EXPEDITED:
+		membarrier_private_expedited();
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
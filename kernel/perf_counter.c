@@ -27,6 +27,7 @@
 #include <linux/anon_inodes.h>
 #include <linux/kernel_stat.h>
 #include <linux/perf_counter.h>
+#include <linux/perf_regs.h>
 
 #include <asm/irq_regs.h>
 
@@ -2463,6 +2464,23 @@ __weak struct perf_callchain_entry *perf_callchain(struct pt_regs *regs)
 	return NULL;
 }
 
+/*
+ * Best effort copy from user space, from any context; returns the number
+ * of bytes copied.  Architectures that can take the counter interrupt as
+ * an NMI provide their own.
+ */
+unsigned long __weak
+copy_from_user_nmi(void *to, const void __user *from, unsigned long n)
+{
+	unsigned long ret;
+
+	pagefault_disable();
+	ret = __copy_from_user_inatomic(to, from, n);
+	pagefault_enable();
+
+	return n - ret;
+}
+
 /*
  * Output
  */
@@ -2634,6 +2652,56 @@ static void perf_output_copy(struct perf_output_handle *handle,
 #define perf_output_put(handle, x) \
 	perf_output_copy((handle), &(x), sizeof(x))
 
+/*
+ * Like perf_output_copy(), but from user space.  What cannot be read is
+ * zero filled, so that the full @len is always consumed; returns the
+ * number of bytes that were read before the first fault.
+ */
+static unsigned int perf_output_copy_user(struct perf_output_handle *handle,
+					  const void __user *buf,
+					  unsigned int len)
+{
+	unsigned int pages_mask;
+	unsigned int offset;
+	unsigned int size;
+	unsigned int copied = 0;
+	int fault = 0;
+	void **pages;
+
+	offset		= handle->offset;
+	pages_mask	= handle->data->nr_pages - 1;
+	pages		= handle->data->data_pages;
+
+	do {
+		unsigned int page_offset;
+		unsigned long ret = 0;
+		int nr;
+
+		nr	    = (offset >> PAGE_SHIFT) & pages_mask;
+		page_offset = offset & (PAGE_SIZE - 1);
+		size	    = min_t(unsigned int, PAGE_SIZE - page_offset, len);
+
+		if (!fault)
+			ret = copy_from_user_nmi(pages[nr] + page_offset,
+						 buf, size);
+		if (ret < size) {
+			memset(pages[nr] + page_offset + ret, 0, size - ret);
+			fault = 1;
+		}
+		copied	    += ret;
+
+		len	    -= size;
+		buf	    += size;
+		offset	    += size;
+	} while (len);
+
+	handle->offset = offset;
+
+	WARN_ON_ONCE(((long)(handle->head - handle->offset)) < 0);
+
+	return copied;
+}
+
 static int perf_output_begin(struct perf_output_handle *handle,
 			     struct perf_counter *counter, unsigned int size,
 			     int nmi, int sample)
@@ -2820,6 +2888,73 @@ static void perf_output_read(struct perf_output_handle *handle,
 		perf_output_read_one(handle, counter);
 }
 
+/*
+ * The user context of the sample: the interrupted registers if the
+ * counter fired in user mode, the registers saved on kernel entry
+ * otherwise, and none for kernel threads.
+ */
+static struct pt_regs *perf_sample_regs_user(struct pt_regs *regs)
+{
+	if (user_mode(regs))
+		return regs;
+
+	if (current->mm)
+		return task_pt_regs(current);
+
+	return NULL;
+}
+
+static void perf_output_sample_regs(struct perf_output_handle *handle,
+				    struct pt_regs *regs, u64 mask)
+{
+	int bit;
+
+	for (bit = 0; bit < 64; bit++) {
+		u64 val;
+
+		if (!(mask & (1ULL << bit)))
+			continue;
+
+		val = perf_reg_value(regs, bit);
+		perf_output_put(handle, val);
+	}
+}
+
+/*
+ * The stack dump has to fit into the sample, whose size is a u16,
+ * together with its size and dyn_size fields.
+ */
+static u16 perf_sample_ustack_size(u32 stack_size, u16 header_size,
+				   struct pt_regs *regs)
+{
+	unsigned int used = header_size + 2 * sizeof(u64);
+
+	if (!regs || used >= USHORT_MAX)
+		return 0;
+
+	stack_size = min_t(unsigned int, stack_size, USHORT_MAX - used);
+
+	return stack_size & ~(sizeof(u64) - 1);
+}
+
+static void perf_output_sample_ustack(struct perf_output_handle *handle,
+				      u64 dump_size, struct pt_regs *regs)
+{
+	perf_output_put(handle, dump_size);
+
+#ifdef CONFIG_HAVE_PERF_REGS
+	if (dump_size) {
+		const void __user *sp;
+		u64 dyn_size;
+
+		sp = (const void __user *)user_stack_pointer(regs);
+		dyn_size = perf_output_copy_user(handle, sp, dump_size);
+
+		perf_output_put(handle, dyn_size);
+	}
+#endif
+}
+
 void perf_counter_output(struct perf_counter *counter, int nmi,
 				struct perf_sample_data *data)
 {
@@ -2837,6 +2972,8 @@ void perf_counter_output(struct perf_counter *counter, int nmi,
 	struct {
 		u32 cpu, reserved;
 	} cpu_entry;
+	struct pt_regs *uregs = NULL;
+	u16 stack_size = 0;
 
 	header.type = PERF_EVENT_SAMPLE;
 	header.size = sizeof(header);
@@ -2910,6 +3047,28 @@ void perf_counter_output(struct perf_counter *counter, int nmi,
 		header.size += size;
 	}
 
+	if (sample_type & (PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER))
+		uregs = perf_sample_regs_user(data->regs);
+
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		header.size += sizeof(u64);
+		if (uregs) {
+			u64 mask = counter->attr.sample_regs_user;
+
+			header.size += hweight64(mask) * sizeof(u64);
+		}
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER) {
+		stack_size = perf_sample_ustack_size(
+				counter->attr.sample_stack_user,
+				header.size, uregs);
+
+		header.size += sizeof(u64);
+		if (stack_size)
+			header.size += stack_size + sizeof(u64);
+	}
+
 	ret = perf_output_begin(&handle, counter, header.size, nmi, 1);
 	if (ret)
 		return;
@@ -2971,6 +3130,22 @@ void perf_counter_output(struct perf_counter *counter, int nmi,
 		}
 	}
 
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		u64 abi = PERF_SAMPLE_REGS_ABI_NONE;
+
+		if (uregs)
+			abi = perf_reg_abi(current);
+
+		perf_output_put(&handle, abi);
+
+		if (uregs)
+			perf_output_sample_regs(&handle, uregs,
+					counter->attr.sample_regs_user);
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER)
+		perf_output_sample_ustack(&handle, stack_size, uregs);
+
 	perf_output_end(&handle);
 }
 
@@ -4183,12 +4358,32 @@ static int perf_copy_attr(struct perf_counter_attr __user *uattr,
 	if (attr->type >= PERF_TYPE_MAX)
 		return -EINVAL;
 
-	if (attr->__reserved_1 || attr->__reserved_2 || attr->__reserved_3)
+	if (attr->__reserved_1)
 		return -EINVAL;
 
 	if (attr->sample_type & ~(PERF_SAMPLE_MAX-1))
 		return -EINVAL;
 
+	if (attr->sample_type & PERF_SAMPLE_REGS_USER) {
+		ret = perf_reg_validate(attr->sample_regs_user);
+		if (ret)
+			return ret;
+	}
+
+	if (attr->sample_type & PERF_SAMPLE_STACK_USER) {
+		/*
+		 * The dump goes into a sample, whose size is a u16; it
+		 * gets trimmed further when the sample is written.
+		 */
+		if (!attr->sample_stack_user ||
+		    attr->sample_stack_user > USHORT_MAX ||
+		    attr->sample_stack_user & (sizeof(u64) - 1))
+			return -EINVAL;
+#ifndef CONFIG_HAVE_PERF_REGS
+		return -ENOSYS;
+#endif
+	}
+
 	if (attr->read_format & ~(PERF_FORMAT_MAX-1))
 		return -EINVAL;
 
@@ -6,6 +6,7 @@
 #include <linux/posix-timers.h>
 #include <linux/errno.h>
 #include <linux/math64.h>
+#include <linux/tick.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
 
@@ -648,6 +649,12 @@ static void arm_timer(struct k_itimer *timer, union cpu_time_count now)
 				break;
 			}
 		}
+
+		/* The tick of a full dynticks CPU has to check it */
+		if (CPUCLOCK_PERTHREAD(timer->it_clock))
+			tick_nohz_full_kick_cpu(task_cpu(p));
+		else
+			tick_nohz_full_kick_all();
 	}
 
 	spin_unlock(&p->sighand->siglock);
@@ -1309,6 +1316,27 @@ static inline int task_cputime_zero(const struct task_cputime *cputime)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - check for cpu timers needing the tick
+ *
+ * @tsk:	The task running on the full dynticks CPU.
+ *
+ * The cpu timers are checked from the tick, so it can only be stopped
+ * when neither @tsk nor its thread group have one armed.
+ */
+int posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return 0;
+
+	if (tsk->signal && !task_cputime_zero(&tsk->signal->cputime_expires))
+		return 0;
+
+	return 1;
+}
+#endif
+
 /**
  * task_cputime_expired - Compare two task_cputime entities.
  *
@@ -1493,6 +1521,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 			break;
 		}
+
+		tick_nohz_full_kick_all();
 	}
 }
 
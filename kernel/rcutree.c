@@ -45,6 +45,9 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/tick.h>
+#include <linux/kthread.h>
+#include <linux/bootmem.h>
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 static struct lock_class_key rcu_lock_key;
@@ -181,10 +184,17 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
-	/* The CPU is online, so send it a reschedule IPI. */
-	if (rdp->cpu != smp_processor_id())
-		smp_send_reschedule(rdp->cpu);
-	else
+	/*
+	 * The CPU is online, so send it a reschedule IPI.  A full dynticks
+	 * CPU gets its tick back instead, which reports the quiescent state
+	 * if it interrupts user mode.
+	 */
+	if (rdp->cpu != smp_processor_id()) {
+		if (tick_nohz_full_cpu(rdp->cpu))
+			tick_nohz_full_kick_cpu(rdp->cpu);
+		else
+			smp_send_reschedule(rdp->cpu);
+	} else
 		set_need_resched();
 	rdp->resched_ipi++;
 	return 0;
@@ -1181,9 +1191,15 @@ static void rcu_process_callbacks(struct softirq_action *unused)
 	smp_mb(); /* See above block comment. */
 }
 
+static bool rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head);
+
+/*
+ * @offload is zero to queue the callback on this CPU even if its
+ * callbacks are handed to an rcuo kthread.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, int offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1201,6 +1217,10 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	 */
 	local_irq_save(flags);
 	rdp = rsp->rda[smp_processor_id()];
+	if (offload && rcu_nocb_enqueue(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
 	rcu_process_gp_end(rsp, rdp);
 	check_for_new_grace_period(rsp, rdp);
 
@@ -1226,12 +1246,185 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_restore(flags);
 }
 
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Callback offloading: the callbacks queued on the CPUs of rcu_nocb_mask
+ * are not invoked from their RCU_SOFTIRQ, but handed to a per-CPU (and
+ * per-flavor) kthread, which waits for a grace period and invokes them.
+ * The kthreads are not bound, so they can be moved to housekeeping CPUs.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/*
+ * Queue the callback for the rcuo kthread if this CPU's callbacks are
+ * offloaded, returning true if so.  Interrupts must be disabled.
+ */
+static bool rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	struct task_struct *t = ACCESS_ONCE(rdp->nocb_kthread);
+	bool wake;
+
+	if (!t)
+		return false;
+
+	spin_lock(&rdp->nocb_lock);
+	wake = !rdp->nocb_head;
+	*rdp->nocb_tail = head;
+	rdp->nocb_tail = &head->next;
+	rdp->nocb_qlen++;
+	spin_unlock(&rdp->nocb_lock);
+
+	if (wake)
+		wake_up_process(t);
+	return true;
+}
+
+/*
+ * Wait for a grace period from an rcuo kthread.  The callback must not
+ * be offloaded itself, or the kthreads could end up waiting on each
+ * other: it goes to the list of whatever CPU we run on.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_synchronize rcu;
+
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rsp, 0);
+	wait_for_completion(&rcu.completion);
+}
+
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list, *next;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!ACCESS_ONCE(rdp->nocb_head)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		/* Later callbacks will wait for the next grace period. */
+		spin_lock_irq(&rdp->nocb_lock);
+		list = rdp->nocb_head;
+		rdp->nocb_head = NULL;
+		rdp->nocb_tail = &rdp->nocb_head;
+		rdp->nocb_qlen = 0;
+		spin_unlock_irq(&rdp->nocb_lock);
+
+		rcu_nocb_wait_gp(rdp->nocb_rsp);
+
+		while (list) {
+			next = list->next;
+			local_bh_disable();
+			list->func(list);
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
+static void __init rcu_init_nocb(struct rcu_state *rsp)
+{
+	struct rcu_data *rdp;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		rdp = rsp->rda[cpu];
+		spin_lock_init(&rdp->nocb_lock);
+		rdp->nocb_head = NULL;
+		rdp->nocb_tail = &rdp->nocb_head;
+		rdp->nocb_rsp = rsp;
+	}
+}
+
+static void __init rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu,
+					      const char *name)
+{
+	struct rcu_data *rdp = rsp->rda[cpu];
+	struct task_struct *t;
+
+	t = kthread_run(rcu_nocb_kthread, rdp, "%s/%d", name, cpu);
+	if (IS_ERR(t)) {
+		printk(KERN_ERR "RCU: cannot offload the callbacks of CPU %d\n",
+		       cpu);
+		return;
+	}
+	/* From now on, call_rcu() on this CPU hands callbacks to t. */
+	smp_mb();
+	rdp->nocb_kthread = t;
+}
+
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	char buf[80];
+	int cpu;
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* Full dynticks CPUs do not want to run callbacks either. */
+	if (tick_nohz_full_enabled()) {
+		if (!have_rcu_nocb_mask) {
+			if (!alloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL))
+				return -ENOMEM;
+			cpumask_clear(rcu_nocb_mask);
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	if (cpumask_empty(rcu_nocb_mask))
+		return 0;
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "RCU: offloading callbacks of CPUs %s.\n", buf);
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rcu_spawn_one_nocb_kthread(&rcu_state, cpu, "rcuo");
+		rcu_spawn_one_nocb_kthread(&rcu_bh_state, cpu, "rcuob");
+	}
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	return false;
+}
+
+static void __init rcu_init_nocb(struct rcu_state *rsp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
+
 /*
  * Queue an RCU callback for invocation after a grace period.
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_state);
+	__call_rcu(head, func, &rcu_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -1240,7 +1433,7 @@ EXPORT_SYMBOL_GPL(call_rcu);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1539,8 +1732,10 @@ void __init __rcu_init(void)
 #endif /* #ifdef CONFIG_RCU_CPU_STALL_DETECTOR */
 	rcu_init_one(&rcu_state);
 	RCU_DATA_PTR_INIT(&rcu_state, rcu_data);
+	rcu_init_nocb(&rcu_state);
 	rcu_init_one(&rcu_bh_state);
 	RCU_DATA_PTR_INIT(&rcu_bh_state, rcu_bh_data);
+	rcu_init_nocb(&rcu_bh_state);
 
 	for_each_online_cpu(i)
 		rcu_cpu_notify(&rcu_nb, CPU_UP_PREPARE, (void *)(long)i);
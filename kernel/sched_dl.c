@@ -0,0 +1,1129 @@
+/*
+ * Deadline Scheduling Class (mapped to the SCHED_DEADLINE policy)
+ *
+ * Earliest Deadline First, with each task running inside a Constant
+ * Bandwidth Server: a task gets dl_runtime nanoseconds of CPU time every
+ * dl_period, and is throttled until its next period once it has used
+ * them.  The tasks of a root domain are globally scheduled by deadline:
+ * like for the RT class, they are pushed to or pulled from the other
+ * CPUs of the domain when they cannot run where they are queued.
+ *
+ * Admission control, in __sched_setscheduler(), keeps the bandwidth of
+ * all the tasks of a root domain within the share of its CPUs granted to
+ * the realtime tasks by sched_rt_runtime_us/sched_rt_period_us.
+ */
+
+#define DL_ENQUEUE_WAKEUP	1
+#define DL_ENQUEUE_REPLENISH	2
+
+static inline struct task_struct *dl_task_of(struct sched_dl_entity *dl_se)
+{
+	return container_of(dl_se, struct task_struct, dl);
+}
+
+static inline struct rq *rq_of_dl_rq(struct dl_rq *dl_rq)
+{
+	return container_of(dl_rq, struct rq, dl);
+}
+
+static inline struct dl_rq *dl_rq_of_se(struct sched_dl_entity *dl_se)
+{
+	return &task_rq(dl_task_of(dl_se))->dl;
+}
+
+static inline int on_dl_rq(struct sched_dl_entity *dl_se)
+{
+	return !RB_EMPTY_NODE(&dl_se->rb_node);
+}
+
+/* Wraparound-safe comparison of two absolute deadlines. */
+static inline int dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+static inline int
+dl_entity_preempt(struct sched_dl_entity *a, struct sched_dl_entity *b)
+{
+	return dl_time_before(a->deadline, b->deadline);
+}
+
+static inline int is_leftmost(struct task_struct *p, struct dl_rq *dl_rq)
+{
+	return dl_rq->rb_leftmost == &p->dl.rb_node;
+}
+
+#ifdef CONFIG_SMP
+
+static inline int dl_overloaded(struct rq *rq)
+{
+	return atomic_read(&rq->rd->dlo_count);
+}
+
+static inline void dl_set_overload(struct rq *rq)
+{
+	if (!rq->online)
+		return;
+
+	cpumask_set_cpu(rq->cpu, rq->rd->dlo_mask);
+	/*
+	 * Must be visible before the overload count is
+	 * set (as in sched_rt.c).
+	 */
+	wmb();
+	atomic_inc(&rq->rd->dlo_count);
+}
+
+static inline void dl_clear_overload(struct rq *rq)
+{
+	if (!rq->online)
+		return;
+
+	atomic_dec(&rq->rd->dlo_count);
+	cpumask_clear_cpu(rq->cpu, rq->rd->dlo_mask);
+}
+
+static void update_dl_migration(struct dl_rq *dl_rq)
+{
+	if (dl_rq->dl_nr_migratory && dl_rq->dl_nr_running > 1) {
+		if (!dl_rq->overloaded) {
+			dl_set_overload(rq_of_dl_rq(dl_rq));
+			dl_rq->overloaded = 1;
+		}
+	} else if (dl_rq->overloaded) {
+		dl_clear_overload(rq_of_dl_rq(dl_rq));
+		dl_rq->overloaded = 0;
+	}
+}
+
+static void inc_dl_migration(struct sched_dl_entity *dl_se, struct dl_rq *dl_rq)
+{
+	if (dl_task_of(dl_se)->rt.nr_cpus_allowed > 1)
+		dl_rq->dl_nr_migratory++;
+
+	update_dl_migration(dl_rq);
+}
+
+static void dec_dl_migration(struct sched_dl_entity *dl_se, struct dl_rq *dl_rq)
+{
+	if (dl_task_of(dl_se)->rt.nr_cpus_allowed > 1)
+		dl_rq->dl_nr_migratory--;
+
+	update_dl_migration(dl_rq);
+}
+
+/*
+ * Cache the deadlines of the first two queued tasks, for the other CPUs
+ * to look at without our lock.
+ */
+static void update_dl_earliest(struct dl_rq *dl_rq)
+{
+	struct rb_node *left = dl_rq->rb_leftmost;
+	struct rb_node *next;
+
+	dl_rq->earliest_dl.curr = dl_rq->earliest_dl.next = 0;
+	if (!left)
+		return;
+
+	dl_rq->earliest_dl.curr =
+		rb_entry(left, struct sched_dl_entity, rb_node)->deadline;
+	next = rb_next(left);
+	if (next)
+		dl_rq->earliest_dl.next =
+			rb_entry(next, struct sched_dl_entity, rb_node)->deadline;
+}
+
+/*
+ * The pushable tasks are kept ordered by deadline too, the running
+ * task is never among them.
+ */
+static void dequeue_pushable_dl_task(struct rq *rq, struct task_struct *p)
+{
+	struct dl_rq *dl_rq = &rq->dl;
+	struct rb_node *node = &p->pushable_dl_tasks;
+
+	if (RB_EMPTY_NODE(node))
+		return;
+
+	if (dl_rq->pushable_dl_tasks_leftmost == node)
+		dl_rq->pushable_dl_tasks_leftmost = rb_next(node);
+
+	rb_erase(node, &dl_rq->pushable_dl_tasks_root);
+	RB_CLEAR_NODE(node);
+}
+
+static void enqueue_pushable_dl_task(struct rq *rq, struct task_struct *p)
+{
+	struct dl_rq *dl_rq = &rq->dl;
+	struct rb_node **link = &dl_rq->pushable_dl_tasks_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct task_struct *entry;
+	int leftmost = 1;
+
+	dequeue_pushable_dl_task(rq, p);
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct task_struct,
+				 pushable_dl_tasks);
+		if (dl_entity_preempt(&p->dl, &entry->dl)) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		dl_rq->pushable_dl_tasks_leftmost = &p->pushable_dl_tasks;
+
+	rb_link_node(&p->pushable_dl_tasks, parent, link);
+	rb_insert_color(&p->pushable_dl_tasks, &dl_rq->pushable_dl_tasks_root);
+}
+
+static inline int has_pushable_dl_tasks(struct rq *rq)
+{
+	return !RB_EMPTY_ROOT(&rq->dl.pushable_dl_tasks_root);
+}
+
+static int push_dl_task(struct rq *rq);
+
+#else
+
+static inline
+void inc_dl_migration(struct sched_dl_entity *dl_se, struct dl_rq *dl_rq)
+{
+}
+
+static inline
+void dec_dl_migration(struct sched_dl_entity *dl_se, struct dl_rq *dl_rq)
+{
+}
+
+static inline void update_dl_earliest(struct dl_rq *dl_rq)
+{
+}
+
+static inline
+void enqueue_pushable_dl_task(struct rq *rq, struct task_struct *p)
+{
+}
+
+static inline
+void dequeue_pushable_dl_task(struct rq *rq, struct task_struct *p)
+{
+}
+
+#endif /* CONFIG_SMP */
+
+/*
+ * A new instance of the server: full runtime, deadline relative to now.
+ */
+static void setup_new_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct rq *rq = rq_of_dl_rq(dl_rq_of_se(dl_se));
+
+	dl_se->deadline = rq->clock + dl_se->dl_deadline;
+	dl_se->runtime = dl_se->dl_runtime;
+	dl_se->dl_new = 0;
+}
+
+/*
+ * The runtime is exhausted: postpone the deadline by as many periods as
+ * needed to cover the overrun.  If the task lagged so far behind that
+ * the deadline is still in the past, start a new instance instead.
+ */
+static void replenish_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct rq *rq = rq_of_dl_rq(dl_rq_of_se(dl_se));
+
+	while (dl_se->runtime <= 0) {
+		dl_se->deadline += dl_se->dl_period;
+		dl_se->runtime += dl_se->dl_runtime;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+/*
+ * Whether running the remaining runtime before the current deadline, from
+ * @t, would exceed the reserved bandwidth:
+ *
+ *   runtime / (deadline - t) > dl_runtime / dl_period
+ *
+ * The operands are scaled down to keep the products from overflowing.
+ */
+static int dl_entity_overflow(struct sched_dl_entity *dl_se, u64 t)
+{
+	u64 left, right;
+
+	left = (dl_se->dl_period >> 10) * ((u64)dl_se->runtime >> 10);
+	right = ((dl_se->deadline - t) >> 10) * (dl_se->dl_runtime >> 10);
+
+	return dl_time_before(right, left);
+}
+
+/*
+ * On wakeup, the current instance is kept if its deadline is ahead and
+ * what is left of its runtime would not make the task use more than its
+ * bandwidth.  Otherwise a new instance is started: a task cannot save
+ * runtime while asleep to get more than its share later.
+ */
+static void update_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct rq *rq = rq_of_dl_rq(dl_rq_of_se(dl_se));
+
+	if (dl_se->dl_new) {
+		setup_new_dl_entity(dl_se);
+		return;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock) ||
+	    dl_entity_overflow(dl_se, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+/*
+ * Arm the replenishment timer of a throttled task at its deadline.  The
+ * deadline is on the rq clock, the timer is programmed at the same
+ * distance from now.  Returns 0 if the deadline has already passed.
+ */
+static int start_dl_timer(struct sched_dl_entity *dl_se)
+{
+	struct rq *rq = rq_of_dl_rq(dl_rq_of_se(dl_se));
+	s64 delta = dl_se->deadline - rq->clock;
+	ktime_t act;
+
+	if (delta <= 0)
+		return 0;
+
+	act = ktime_add_ns(hrtimer_cb_get_time(&dl_se->dl_timer), delta);
+	__hrtimer_start_range_ns(&dl_se->dl_timer, act, 0,
+				 HRTIMER_MODE_ABS, 0);
+
+	return hrtimer_active(&dl_se->dl_timer);
+}
+
+static void __enqueue_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct dl_rq *dl_rq = dl_rq_of_se(dl_se);
+	struct rq *rq = rq_of_dl_rq(dl_rq);
+	struct rb_node **link = &dl_rq->rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct sched_dl_entity *entry;
+	int leftmost = 1;
+
+	BUG_ON(on_dl_rq(dl_se));
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct sched_dl_entity, rb_node);
+		if (dl_time_before(dl_se->deadline, entry->deadline)) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		dl_rq->rb_leftmost = &dl_se->rb_node;
+
+	rb_link_node(&dl_se->rb_node, parent, link);
+	rb_insert_color(&dl_se->rb_node, &dl_rq->rb_root);
+
+	dl_rq->dl_nr_running++;
+	inc_dl_migration(dl_se, dl_rq);
+	update_dl_earliest(dl_rq);
+
+	inc_cpu_load(rq, dl_task_of(dl_se)->se.load.weight);
+	inc_nr_running(rq);
+}
+
+static void __dequeue_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct dl_rq *dl_rq = dl_rq_of_se(dl_se);
+	struct rq *rq = rq_of_dl_rq(dl_rq);
+
+	if (!on_dl_rq(dl_se))
+		return;
+
+	if (dl_rq->rb_leftmost == &dl_se->rb_node)
+		dl_rq->rb_leftmost = rb_next(&dl_se->rb_node);
+
+	rb_erase(&dl_se->rb_node, &dl_rq->rb_root);
+	RB_CLEAR_NODE(&dl_se->rb_node);
+
+	dl_rq->dl_nr_running--;
+	dec_dl_migration(dl_se, dl_rq);
+	update_dl_earliest(dl_rq);
+
+	dec_cpu_load(rq, dl_task_of(dl_se)->se.load.weight);
+	dec_nr_running(rq);
+}
+
+static void enqueue_dl_entity(struct sched_dl_entity *dl_se, int flags)
+{
+	if (dl_se->dl_new || (flags & DL_ENQUEUE_WAKEUP))
+		update_dl_entity(dl_se);
+	else if (flags & DL_ENQUEUE_REPLENISH)
+		replenish_dl_entity(dl_se);
+
+	__enqueue_dl_entity(dl_se);
+}
+
+/*
+ * @flags is the wakeup argument of the enqueue_task method, possibly
+ * with DL_ENQUEUE_REPLENISH.
+ */
+static void enqueue_task_dl(struct rq *rq, struct task_struct *p, int flags)
+{
+	/* A throttled task is put back by its replenishment timer. */
+	if (p->dl.dl_throttled)
+		return;
+
+	enqueue_dl_entity(&p->dl, flags);
+
+	if (!task_current(rq, p) && p->rt.nr_cpus_allowed > 1)
+		enqueue_pushable_dl_task(rq, p);
+}
+
+static void __dequeue_task_dl(struct rq *rq, struct task_struct *p)
+{
+	__dequeue_dl_entity(&p->dl);
+	dequeue_pushable_dl_task(rq, p);
+}
+
+/*
+ * Charge the running task for the time it ran, and throttle it until its
+ * deadline once its runtime is exhausted.
+ */
+static void update_curr_dl(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	struct sched_dl_entity *dl_se = &curr->dl;
+	u64 delta_exec;
+
+	if (!dl_task(curr) || !on_dl_rq(dl_se))
+		return;
+
+	delta_exec = rq->clock - curr->se.exec_start;
+	if (unlikely((s64)delta_exec < 0))
+		delta_exec = 0;
+
+	schedstat_set(curr->se.exec_max, max(curr->se.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+
+	curr->se.exec_start = rq->clock;
+	cpuacct_charge(curr, delta_exec);
+
+	dl_se->runtime -= delta_exec;
+	if (dl_se->runtime > 0)
+		return;
+
+	__dequeue_task_dl(rq, curr);
+	if (likely(start_dl_timer(dl_se)))
+		dl_se->dl_throttled = 1;
+	else
+		enqueue_task_dl(rq, curr, DL_ENQUEUE_REPLENISH);
+
+	if (!is_leftmost(curr, &rq->dl))
+		resched_task(curr);
+}
+
+static void check_preempt_curr_dl(struct rq *rq, struct task_struct *p, int sync)
+{
+	if (dl_task(p) && dl_entity_preempt(&p->dl, &rq->curr->dl))
+		resched_task(rq->curr);
+}
+
+/*
+ * The end of a throttling: replenish the runtime and queue the task
+ * again, if it is still runnable and still wants this reservation.
+ */
+static enum hrtimer_restart dl_task_timer(struct hrtimer *timer)
+{
+	struct sched_dl_entity *dl_se = container_of(timer,
+						     struct sched_dl_entity,
+						     dl_timer);
+	struct task_struct *p = dl_task_of(dl_se);
+	struct rq *rq;
+
+	rq = __task_rq_lock(p);
+
+	if (!task_has_dl_policy(p) || dl_se->dl_new || !dl_se->dl_throttled)
+		goto unlock;
+
+	dl_se->dl_throttled = 0;
+	if (p->se.on_rq) {
+		update_rq_clock(rq);
+		enqueue_task_dl(rq, p, DL_ENQUEUE_REPLENISH);
+		if (dl_task(rq->curr))
+			check_preempt_curr_dl(rq, p, 0);
+		else
+			resched_task(rq->curr);
+#ifdef CONFIG_SMP
+		if (has_pushable_dl_tasks(rq))
+			push_dl_task(rq);
+#endif
+	}
+unlock:
+	__task_rq_unlock(rq);
+
+	return HRTIMER_NORESTART;
+}
+
+static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int sleep)
+{
+	update_curr_dl(rq);
+	__dequeue_task_dl(rq, p);
+}
+
+/*
+ * Yielding gives up the rest of the runtime of the current instance: the
+ * task is throttled until its deadline, then starts the next one.
+ */
+static void yield_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	if (p->dl.runtime > 0)
+		p->dl.runtime = 0;
+	update_curr_dl(rq);
+}
+
+#ifdef CONFIG_SCHED_HRTICK
+static void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+	hrtick_start(rq, max_t(s64, 10000LL, p->dl.runtime));
+}
+#else
+static inline void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+}
+#endif
+
+static struct task_struct *pick_next_task_dl(struct rq *rq)
+{
+	struct dl_rq *dl_rq = &rq->dl;
+	struct sched_dl_entity *dl_se;
+	struct task_struct *p;
+
+	if (unlikely(!dl_rq->dl_nr_running))
+		return NULL;
+
+	dl_se = rb_entry(dl_rq->rb_leftmost, struct sched_dl_entity, rb_node);
+	p = dl_task_of(dl_se);
+	p->se.exec_start = rq->clock;
+
+	/* The running task is never eligible for pushing */
+	dequeue_pushable_dl_task(rq, p);
+
+	if (hrtick_enabled(rq))
+		start_hrtick_dl(rq, p);
+
+	return p;
+}
+
+static void put_prev_task_dl(struct rq *rq, struct task_struct *p)
+{
+	update_curr_dl(rq);
+	p->se.exec_start = 0;
+
+	if (on_dl_rq(&p->dl) && p->rt.nr_cpus_allowed > 1)
+		enqueue_pushable_dl_task(rq, p);
+}
+
+static void task_tick_dl(struct rq *rq, struct task_struct *p, int queued)
+{
+	update_curr_dl(rq);
+
+	if (hrtick_enabled(rq) && queued && p->dl.runtime > 0)
+		start_hrtick_dl(rq, p);
+}
+
+static void set_curr_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	p->se.exec_start = rq->clock;
+
+	/* The running task is never eligible for pushing */
+	dequeue_pushable_dl_task(rq, p);
+}
+
+/*
+ * The task is gone: release its bandwidth.  It is TASK_DEAD, so it
+ * cannot have left the root domain in the meantime.
+ */
+static void task_dead_dl(struct task_struct *p)
+{
+	struct dl_bw *dl_b = dl_bw_of(task_cpu(p));
+
+	spin_lock_irq(&dl_b->lock);
+	__dl_clear(dl_b, p->dl.dl_bw);
+	spin_unlock_irq(&dl_b->lock);
+
+	hrtimer_cancel(&p->dl.dl_timer);
+}
+
+#ifdef CONFIG_SMP
+
+/* Only try algorithms three times */
+#define DL_MAX_TRIES 3
+
+static DEFINE_PER_CPU(cpumask_var_t, local_cpu_mask_dl);
+
+/*
+ * Find a CPU where @task would run right away: an idle one (for this
+ * class), cache-hot if possible, or else the one running the latest
+ * deadline, if that is later than the deadline of @task.
+ */
+static int find_later_rq(struct task_struct *task)
+{
+	struct cpumask *later_mask = __get_cpu_var(local_cpu_mask_dl);
+	struct sched_domain *sd;
+	int this_cpu = smp_processor_id();
+	int cpu = task_cpu(task);
+	u64 latest = task->dl.deadline;
+	int best_cpu = -1;
+	int i;
+
+	if (task->rt.nr_cpus_allowed == 1)
+		return -1;
+
+	cpumask_clear(later_mask);
+	for_each_cpu_and(i, &task->cpus_allowed, task_rq(task)->rd->span) {
+		struct dl_rq *dl_rq = &cpu_rq(i)->dl;
+
+		if (!cpu_active(i))
+			continue;
+
+		if (!dl_rq->dl_nr_running) {
+			cpumask_set_cpu(i, later_mask);
+		} else if (dl_time_before(latest, dl_rq->earliest_dl.curr)) {
+			latest = dl_rq->earliest_dl.curr;
+			best_cpu = i;
+		}
+	}
+
+	if (cpumask_empty(later_mask))
+		return best_cpu;
+
+	if (cpumask_test_cpu(cpu, later_mask))
+		return cpu;
+
+	if (this_cpu == cpu)
+		this_cpu = -1; /* Skip this_cpu opt if the same */
+
+	for_each_domain(cpu, sd) {
+		if (sd->flags & SD_WAKE_AFFINE) {
+			if ((this_cpu != -1) &&
+			    cpumask_test_cpu(this_cpu, later_mask) &&
+			    cpumask_test_cpu(this_cpu, sched_domain_span(sd)))
+				return this_cpu;
+
+			best_cpu = cpumask_first_and(later_mask,
+						     sched_domain_span(sd));
+			if (best_cpu < nr_cpu_ids)
+				return best_cpu;
+		}
+	}
+
+	return pick_optimal_cpu(this_cpu, later_mask);
+}
+
+/* Will lock the rq it finds */
+static struct rq *find_lock_later_rq(struct task_struct *task, struct rq *rq)
+{
+	struct rq *later_rq = NULL;
+	int tries;
+	int cpu;
+
+	for (tries = 0; tries < DL_MAX_TRIES; tries++) {
+		cpu = find_later_rq(task);
+
+		if ((cpu == -1) || (cpu == rq->cpu))
+			break;
+
+		later_rq = cpu_rq(cpu);
+
+		/* if the deadlines of this runqueue changed, try again */
+		if (double_lock_balance(rq, later_rq)) {
+			if (unlikely(task_rq(task) != rq ||
+				     !cpumask_test_cpu(later_rq->cpu,
+						       &task->cpus_allowed) ||
+				     task_running(rq, task) ||
+				     !on_dl_rq(&task->dl))) {
+				spin_unlock(&later_rq->lock);
+				later_rq = NULL;
+				break;
+			}
+		}
+
+		/* If this rq is still suitable use it. */
+		if (!later_rq->dl.dl_nr_running ||
+		    dl_time_before(task->dl.deadline,
+				   later_rq->dl.earliest_dl.curr))
+			break;
+
+		/* try again */
+		double_unlock_balance(rq, later_rq);
+		later_rq = NULL;
+	}
+
+	return later_rq;
+}
+
+static struct task_struct *pick_next_pushable_dl_task(struct rq *rq)
+{
+	struct task_struct *p;
+
+	if (!has_pushable_dl_tasks(rq))
+		return NULL;
+
+	p = rb_entry(rq->dl.pushable_dl_tasks_leftmost,
+		     struct task_struct, pushable_dl_tasks);
+
+	BUG_ON(rq->cpu != task_cpu(p));
+	BUG_ON(task_current(rq, p));
+	BUG_ON(p->rt.nr_cpus_allowed <= 1);
+
+	BUG_ON(!p->se.on_rq);
+	BUG_ON(!dl_task(p));
+
+	return p;
+}
+
+/*
+ * If the current CPU has more than one -deadline task, see if the non
+ * running one with the earliest deadline can run right away on a CPU
+ * running a later deadline.
+ */
+static int push_dl_task(struct rq *rq)
+{
+	struct task_struct *next_task;
+	struct rq *later_rq;
+
+	if (!rq->dl.overloaded)
+		return 0;
+
+	next_task = pick_next_pushable_dl_task(rq);
+	if (!next_task)
+		return 0;
+
+retry:
+	if (unlikely(next_task == rq->curr)) {
+		WARN_ON(1);
+		return 0;
+	}
+
+	/*
+	 * If next_task preempts rq->curr, it is going to run here:
+	 * just reschedule, the tasks left behind are pushed then.
+	 */
+	if (!dl_task(rq->curr) ||
+	    dl_entity_preempt(&next_task->dl, &rq->curr->dl)) {
+		resched_task(rq->curr);
+		return 0;
+	}
+
+	/* We might release rq lock */
+	get_task_struct(next_task);
+
+	/* Will lock the rq it'll find */
+	later_rq = find_lock_later_rq(next_task, rq);
+	if (!later_rq) {
+		struct task_struct *task;
+
+		/*
+		 * We must check all this again, since
+		 * find_lock_later_rq releases rq->lock and it is
+		 * then possible that next_task has migrated.
+		 */
+		task = pick_next_pushable_dl_task(rq);
+		if (task_cpu(next_task) == rq->cpu && task == next_task) {
+			/*
+			 * The task is still there, but could not be
+			 * pushed: the other CPUs will pull it when ready.
+			 */
+			dequeue_pushable_dl_task(rq, next_task);
+			goto out;
+		}
+
+		if (!task)
+			/* No more tasks */
+			goto out;
+
+		put_task_struct(next_task);
+		next_task = task;
+		goto retry;
+	}
+
+	deactivate_task(rq, next_task, 0);
+	set_task_cpu(next_task, later_rq->cpu);
+	activate_task(later_rq, next_task, 0);
+
+	resched_task(later_rq->curr);
+
+	double_unlock_balance(rq, later_rq);
+
+out:
+	put_task_struct(next_task);
+
+	return 1;
+}
+
+static void push_dl_tasks(struct rq *rq)
+{
+	/* push_dl_task will return true if it moved a -deadline task */
+	while (push_dl_task(rq))
+		;
+}
+
+static int pick_dl_task(struct rq *rq, struct task_struct *p, int cpu)
+{
+	if (!task_running(rq, p) &&
+	    (cpu < 0 || cpumask_test_cpu(cpu, &p->cpus_allowed)) &&
+	    (p->rt.nr_cpus_allowed > 1))
+		return 1;
+	return 0;
+}
+
+/* Return the earliest queued task that is not running and may run on cpu */
+static struct task_struct *pick_next_earliest_dl_task(struct rq *rq, int cpu)
+{
+	struct rb_node *next_node = rq->dl.rb_leftmost;
+	struct sched_dl_entity *dl_se;
+	struct task_struct *p;
+
+	while (next_node) {
+		dl_se = rb_entry(next_node, struct sched_dl_entity, rb_node);
+		p = dl_task_of(dl_se);
+		if (pick_dl_task(rq, p, cpu))
+			return p;
+		next_node = rb_next(next_node);
+	}
+
+	return NULL;
+}
+
+static int pull_dl_task(struct rq *this_rq)
+{
+	int this_cpu = this_rq->cpu, ret = 0, cpu;
+	struct task_struct *p;
+	struct rq *src_rq;
+
+	if (likely(!dl_overloaded(this_rq)))
+		return 0;
+
+	for_each_cpu(cpu, this_rq->rd->dlo_mask) {
+		if (this_cpu == cpu)
+			continue;
+
+		src_rq = cpu_rq(cpu);
+
+		/*
+		 * Don't bother taking the src_rq->lock if its second
+		 * earliest task would not run before our earliest one:
+		 * racy, but the src_rq will push what we miss.
+		 */
+		if (this_rq->dl.dl_nr_running &&
+		    !dl_time_before(src_rq->dl.earliest_dl.next,
+				    this_rq->dl.earliest_dl.curr))
+			continue;
+
+		/* Might drop this_rq->lock */
+		double_lock_balance(this_rq, src_rq);
+
+		if (src_rq->dl.dl_nr_running <= 1)
+			goto skip;
+
+		p = pick_next_earliest_dl_task(src_rq, this_cpu);
+
+		/*
+		 * Pull it if it runs before anything we have, unless it
+		 * is about to preempt the running task of src_rq.
+		 */
+		if (p && (!this_rq->dl.dl_nr_running ||
+			  dl_time_before(p->dl.deadline,
+					 this_rq->dl.earliest_dl.curr))) {
+			WARN_ON(p == src_rq->curr);
+			WARN_ON(!p->se.on_rq);
+
+			if (dl_task(src_rq->curr) &&
+			    dl_time_before(p->dl.deadline,
+					   src_rq->curr->dl.deadline))
+				goto skip;
+
+			ret = 1;
+
+			deactivate_task(src_rq, p, 0);
+			set_task_cpu(p, this_cpu);
+			activate_task(this_rq, p, 0);
+		}
+skip:
+		double_unlock_balance(this_rq, src_rq);
+	}
+
+	return ret;
+}
+
+static int select_task_rq_dl(struct task_struct *p, int sync)
+{
+	struct rq *rq = task_rq(p);
+	struct task_struct *curr = rq->curr;
+
+	/*
+	 * If the running task is -deadline and would not be preempted,
+	 * or cannot move away, look for a CPU where p runs at once.
+	 */
+	if (unlikely(dl_task(curr)) && p->rt.nr_cpus_allowed > 1 &&
+	    (curr->rt.nr_cpus_allowed < 2 ||
+	     !dl_entity_preempt(&p->dl, &curr->dl))) {
+		int cpu = find_later_rq(p);
+
+		return (cpu == -1) ? task_cpu(p) : cpu;
+	}
+
+	return task_cpu(p);
+}
+
+static void pre_schedule_dl(struct rq *rq, struct task_struct *prev)
+{
+	/* Try to pull -deadline tasks here if prev blocks or is throttled */
+	if (!on_dl_rq(&prev->dl))
+		pull_dl_task(rq);
+}
+
+/*
+ * assumes rq->lock is held
+ */
+static int needs_post_schedule_dl(struct rq *rq)
+{
+	return has_pushable_dl_tasks(rq);
+}
+
+static void post_schedule_dl(struct rq *rq)
+{
+	spin_lock_irq(&rq->lock);
+	push_dl_tasks(rq);
+	spin_unlock_irq(&rq->lock);
+}
+
+/*
+ * If we are not running and we are not going to reschedule soon, we
+ * should try to push tasks away now
+ */
+static void task_wake_up_dl(struct rq *rq, struct task_struct *p)
+{
+	if (!task_running(rq, p) &&
+	    !test_tsk_need_resched(rq->curr) &&
+	    has_pushable_dl_tasks(rq) &&
+	    p->rt.nr_cpus_allowed > 1 &&
+	    dl_task(rq->curr) &&
+	    (rq->curr->rt.nr_cpus_allowed < 2 ||
+	     dl_entity_preempt(&rq->curr->dl, &p->dl)))
+		push_dl_tasks(rq);
+}
+
+static unsigned long
+load_balance_dl(struct rq *this_rq, int this_cpu, struct rq *busiest,
+		unsigned long max_load_move,
+		struct sched_domain *sd, enum cpu_idle_type idle,
+		int *all_pinned, int *this_best_prio)
+{
+	/* -deadline tasks are only moved by push/pull */
+	return 0;
+}
+
+static int
+move_one_task_dl(struct rq *this_rq, int this_cpu, struct rq *busiest,
+		 struct sched_domain *sd, enum cpu_idle_type idle)
+{
+	/* -deadline tasks are only moved by push/pull */
+	return 0;
+}
+
+static void set_cpus_allowed_dl(struct task_struct *p,
+				const struct cpumask *new_mask)
+{
+	int weight = cpumask_weight(new_mask);
+
+	BUG_ON(!dl_task(p));
+
+	/*
+	 * Leaving the root domain for another one (an exclusive cpuset):
+	 * move the reserved bandwidth along with the task.
+	 */
+	if (!cpumask_intersects(task_rq(p)->rd->span, new_mask)) {
+		struct dl_bw *src_dl_b = dl_bw_of(task_cpu(p));
+		struct dl_bw *dst_dl_b;
+		int dest_cpu = cpumask_any_and(cpu_online_mask, new_mask);
+
+		if (dest_cpu < nr_cpu_ids) {
+			dst_dl_b = dl_bw_of(dest_cpu);
+
+			spin_lock(&src_dl_b->lock);
+			__dl_clear(src_dl_b, p->dl.dl_bw);
+			spin_unlock(&src_dl_b->lock);
+
+			spin_lock(&dst_dl_b->lock);
+			__dl_add(dst_dl_b, p->dl.dl_bw);
+			spin_unlock(&dst_dl_b->lock);
+		}
+	}
+
+	/*
+	 * Update the migration status of the rq if the task is queued
+	 * and changing its weight value.
+	 */
+	if (on_dl_rq(&p->dl) && (weight != p->rt.nr_cpus_allowed)) {
+		struct rq *rq = task_rq(p);
+
+		if (!task_current(rq, p)) {
+			dequeue_pushable_dl_task(rq, p);
+			if (weight > 1)
+				enqueue_pushable_dl_task(rq, p);
+		}
+
+		if ((p->rt.nr_cpus_allowed <= 1) && (weight > 1)) {
+			rq->dl.dl_nr_migratory++;
+		} else if ((p->rt.nr_cpus_allowed > 1) && (weight <= 1)) {
+			BUG_ON(!rq->dl.dl_nr_migratory);
+			rq->dl.dl_nr_migratory--;
+		}
+
+		update_dl_migration(&rq->dl);
+	}
+
+	cpumask_copy(&p->cpus_allowed, new_mask);
+	p->rt.nr_cpus_allowed = weight;
+}
+
+/* Assumes rq->lock is held */
+static void rq_online_dl(struct rq *rq)
+{
+	if (rq->dl.overloaded)
+		dl_set_overload(rq);
+}
+
+/* Assumes rq->lock is held */
+static void rq_offline_dl(struct rq *rq)
+{
+	if (rq->dl.overloaded)
+		dl_clear_overload(rq);
+}
+
+static inline void init_sched_dl_class(void)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i)
+		zalloc_cpumask_var_node(&per_cpu(local_cpu_mask_dl, i),
+					GFP_KERNEL, cpu_to_node(i));
+}
+#endif /* CONFIG_SMP */
+
+static void switched_from_dl(struct rq *rq, struct task_struct *p,
+			     int running)
+{
+	hrtimer_try_to_cancel(&p->dl.dl_timer);
+	p->dl.dl_throttled = 0;
+
+#ifdef CONFIG_SMP
+	/*
+	 * If we were the last -deadline task here, pull the ones that
+	 * wait elsewhere.
+	 */
+	if (!rq->dl.dl_nr_running)
+		pull_dl_task(rq);
+#endif
+}
+
+static void switched_to_dl(struct rq *rq, struct task_struct *p,
+			   int running)
+{
+	if (running)
+		return;
+
+#ifdef CONFIG_SMP
+	if (rq->dl.overloaded && push_dl_task(rq) &&
+	    /* Don't resched if we changed runqueues */
+	    rq != task_rq(p))
+		return;
+#endif
+	if (dl_task(rq->curr))
+		check_preempt_curr_dl(rq, p, 0);
+	else
+		resched_task(rq->curr);
+}
+
+/*
+ * The reservation of the task changed, and its server was restarted with
+ * a new deadline.
+ */
+static void prio_changed_dl(struct rq *rq, struct task_struct *p,
+			    int oldprio, int running)
+{
+	if (running) {
+#ifdef CONFIG_SMP
+		/* Our deadline may be later now: see if others are earlier */
+		pull_dl_task(rq);
+#endif
+		if (rq->curr == p && !is_leftmost(p, &rq->dl))
+			resched_task(p);
+	} else {
+		switched_to_dl(rq, p, running);
+	}
+}
+
+static const struct sched_class dl_sched_class = {
+	.next			= &rt_sched_class,
+	.enqueue_task		= enqueue_task_dl,
+	.dequeue_task		= dequeue_task_dl,
+	.yield_task		= yield_task_dl,
+
+	.check_preempt_curr	= check_preempt_curr_dl,
+
+	.pick_next_task		= pick_next_task_dl,
+	.put_prev_task		= put_prev_task_dl,
+
+#ifdef CONFIG_SMP
+	.select_task_rq		= select_task_rq_dl,
+
+	.load_balance		= load_balance_dl,
+	.move_one_task		= move_one_task_dl,
+	.set_cpus_allowed       = set_cpus_allowed_dl,
+	.rq_online              = rq_online_dl,
+	.rq_offline             = rq_offline_dl,
+	.pre_schedule		= pre_schedule_dl,
+	.needs_post_schedule	= needs_post_schedule_dl,
+	.post_schedule		= post_schedule_dl,
+	.task_wake_up		= task_wake_up_dl,
+#endif
+
+	.set_curr_task          = set_curr_task_dl,
+	.task_tick		= task_tick_dl,
+	.task_dead		= task_dead_dl,
+
+	.prio_changed		= prio_changed_dl,
+	.switched_from		= switched_from_dl,
+	.switched_to		= switched_to_dl,
+};
+
+#ifdef CONFIG_SCHED_DEBUG
+extern void print_dl_rq(struct seq_file *m, int cpu, struct dl_rq *dl_rq);
+
+static void print_dl_stats(struct seq_file *m, int cpu)
+{
+	print_dl_rq(m, cpu, &cpu_rq(cpu)->dl);
+}
+#endif /* CONFIG_SCHED_DEBUG */
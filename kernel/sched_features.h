@@ -15,3 +15,11 @@ SCHED_FEAT(ASYM_EFF_LOAD, 1)
 SCHED_FEAT(WAKEUP_OVERLAP, 0)
 SCHED_FEAT(LAST_BUDDY, 1)
 SCHED_FEAT(OWNER_SPIN, 1)
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Let the load balancer move tasks to their preferred node even when
+ * cache hot, and resist moving them away from it.
+ */
+SCHED_FEAT(NUMA_FAVOUR_HIGHER, 1)
+SCHED_FEAT(NUMA_RESIST_LOWER, 1)
+#endif
@@ -308,6 +308,9 @@ void irq_exit(void)
 	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
 		tick_nohz_stop_sched_tick(0);
 #endif
+	/* The interrupt may have made a busy full dynticks CPU need its tick */
+	if (!in_interrupt())
+		tick_nohz_full_check();
 	preempt_enable_no_resched();
 }
 
@@ -178,3 +178,12 @@ cond_syscall(sys_eventfd2);
 
 /* performance counters: */
 cond_syscall(sys_perf_counter_open);
+
+/* memory barriers on other threads' cpus */
+cond_syscall(sys_membarrier);
+
+/* cross memory attach, only with an MMU */
+cond_syscall(sys_process_vm_readv);
+cond_syscall(sys_process_vm_writev);
+cond_syscall(compat_sys_process_vm_readv);
+cond_syscall(compat_sys_process_vm_writev);
@@ -11,12 +11,14 @@
  *
  *  Distribute under GPLv2.
  */
+#include <linux/bootmem.h>
 #include <linux/cpu.h>
 #include <linux/err.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
@@ -203,6 +205,10 @@ u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_idle_time_us);
 
+#ifdef CONFIG_NO_HZ_FULL
+static void tick_nohz_full_restart(struct tick_sched *ts);
+#endif
+
 /**
  * tick_nohz_stop_sched_tick - stop the idle tick from the idle task
  *
@@ -231,6 +237,12 @@ void tick_nohz_stop_sched_tick(int inidle)
 	if (!inidle && !ts->inidle)
 		goto end;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/* Let idle stop the tick its own way */
+	if (ts->full_stopped)
+		tick_nohz_full_restart(ts);
+#endif
+
 	now = tick_nohz_start_idle(ts);
 
 	/*
@@ -253,6 +265,13 @@ void tick_nohz_stop_sched_tick(int inidle)
 	if (need_resched())
 		goto end;
 
+	/*
+	 * The full dynticks CPUs rely on the CPU doing the jiffies update
+	 * to keep ticking, even when it is idle.
+	 */
+	if (tick_nohz_full_enabled() && cpu == tick_do_timer_cpu)
+		goto end;
+
 	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
 		static int ratelimit;
 
@@ -500,7 +519,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -603,6 +623,211 @@ static void tick_nohz_kick_tick(int cpu)
 #endif
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: the CPUs in tick_nohz_full_mask also stop their tick
+ * while they run a single task.  The tick is then only taken when the
+ * next timer wheel timer expires, and at least once a second for the
+ * scheduler.  Timekeeping stays with the boot CPU and the CPUs which
+ * are not in the mask.
+ */
+int tick_nohz_full_running __read_mostly;
+cpumask_var_t tick_nohz_full_mask;
+
+static DEFINE_PER_CPU(struct call_single_data, nohz_full_kick_csd);
+static DEFINE_PER_CPU(unsigned long, nohz_full_kick_pending);
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	if (!cpumask_empty(tick_nohz_full_mask))
+		tick_nohz_full_running = 1;
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+/*
+ * Account the ticks a busy CPU did not take to the current task.
+ * Without the tick we do not know where the time was spent, so it is
+ * all accounted to where the task was found when the tick came back.
+ */
+static void tick_nohz_full_account(unsigned long ticks, int user,
+				   int hardirq_offset)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	struct task_struct *p = current;
+	cputime_t cputime;
+
+	/* We might be one off. Do not randomly account a huge number of ticks! */
+	if (!ticks || ticks >= LONG_MAX)
+		return;
+
+	cputime = jiffies_to_cputime(ticks);
+	if (user)
+		account_user_time(p, cputime, cputime_to_scaled(cputime));
+	else
+		account_system_time(p, hardirq_offset, cputime,
+				    cputime_to_scaled(cputime));
+#endif
+}
+
+static int tick_nohz_full_can_stop(int cpu)
+{
+	if (!sched_can_stop_tick())
+		return 0;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return 0;
+
+	if (rcu_needs_cpu(cpu) || rcu_pending(cpu) || printk_needs_cpu(cpu))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Called from the tick on a busy CPU: instead of forwarding the tick
+ * timer by one period, push it out to the next timer wheel event when
+ * nothing else needs the tick.  Returns 1 when the tick was stopped.
+ */
+static int tick_nohz_full_stop_tick(struct tick_sched *ts, ktime_t now)
+{
+	unsigned long seq, last_jiffies, delta_jiffies;
+	int cpu = smp_processor_id();
+	ktime_t last_update, expires;
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle ||
+	    ts->nohz_mode != NOHZ_MODE_HIGHRES || cpu == tick_do_timer_cpu)
+		return 0;
+
+	/*
+	 * Tell tick_nohz_full_kick_cpu() before looking at the conditions:
+	 * whoever changes them after we looked sends us a kick.
+	 */
+	ts->full_stopped = 1;
+	smp_mb();
+
+	if (!tick_nohz_full_can_stop(cpu))
+		goto restart;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	delta_jiffies = get_next_timer_interrupt(last_jiffies) - last_jiffies;
+	/* The scheduler still wants to hear from us once a second */
+	if ((long)delta_jiffies > HZ)
+		delta_jiffies = HZ;
+	if ((long)delta_jiffies <= 1)
+		goto restart;
+
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+	if (expires.tv64 <= now.tv64)
+		goto restart;
+
+	ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+	ts->full_jiffies = last_jiffies;
+	hrtimer_set_expires(&ts->sched_timer, expires);
+	return 1;
+
+restart:
+	ts->full_stopped = 0;
+	return 0;
+}
+
+/*
+ * Restart the tick of a busy CPU, interrupts disabled.
+ */
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ts->full_stopped = 0;
+	tick_nohz_full_account(jiffies - ts->full_jiffies, 0, 0);
+	tick_nohz_restart(ts, ktime_get());
+}
+
+void __tick_nohz_full_check(void)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->full_stopped && !ts->inidle &&
+	    !tick_nohz_full_can_stop(smp_processor_id()))
+		tick_nohz_full_restart(ts);
+	local_irq_restore(flags);
+}
+
+static void tick_nohz_full_kick_func(void *info)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	clear_bit(0, &__get_cpu_var(nohz_full_kick_pending));
+
+	/*
+	 * Take the tick again, the next one re-evaluates whether it can
+	 * be stopped, with the new timers taken into account.
+	 */
+	if (ts->full_stopped && !ts->inidle)
+		tick_nohz_full_restart(ts);
+}
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks CPU re-evaluate its tick
+ * @cpu:	the CPU to kick
+ *
+ * To be called after changing a condition which may need the tick back,
+ * such as a second task being queued, a timer or a cpu timer being
+ * armed.  Safe with interrupts disabled.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	struct call_single_data *csd;
+
+	if (!tick_nohz_full_cpu(cpu) || !cpu_online(cpu))
+		return;
+
+	/* Pairs with the barrier in tick_nohz_full_stop_tick() */
+	smp_mb();
+	if (!per_cpu(tick_cpu_sched, cpu).full_stopped)
+		return;
+
+	if (test_and_set_bit(0, &per_cpu(nohz_full_kick_pending, cpu)))
+		return;
+
+	csd = &per_cpu(nohz_full_kick_csd, cpu);
+	csd->func = tick_nohz_full_kick_func;
+	__smp_call_function_single(cpu, csd, 0);
+}
+
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	for_each_cpu(cpu, tick_nohz_full_mask)
+		tick_nohz_full_kick_cpu(cpu);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 #else
 
 static inline void tick_nohz_switch_to_nohz(void) { }
@@ -644,9 +869,11 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * concurrency: This happens only when the cpu in charge went
 	 * into a long sleep. If two cpus happen to assign themself to
 	 * this duty, then the jiffies update is still serialized by
-	 * xtime_lock.
+	 * xtime_lock.  A full dynticks CPU must not take the duty, as it
+	 * may not tick for a second.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -671,10 +898,21 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+#ifdef CONFIG_NO_HZ_FULL
+		if (ts->full_stopped) {
+			ts->full_stopped = 0;
+			tick_nohz_full_account(jiffies - ts->full_jiffies - 1,
+					       user_mode(regs), HARDIRQ_OFFSET);
+		}
+#endif
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 	}
 
+#ifdef CONFIG_NO_HZ_FULL
+	if (regs && tick_nohz_full_stop_tick(ts, now))
+		return HRTIMER_RESTART;
+#endif
 	hrtimer_forward(timer, now, tick_period);
 
 	return HRTIMER_RESTART;
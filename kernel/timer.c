@@ -51,32 +51,71 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * per-CPU timer wheel definitions:
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each. The
+ * granularity of level n is LVL_CLK_DIV^n jiffies, so the first level
+ * is jiffy accurate and every further level is 8 times coarser.
+ * Timers are never cascaded from an outer level into an inner one:
+ * a timer is queued once, in the level whose range covers its timeout,
+ * and its expiry is rounded up to that level's granularity. The worst
+ * case slack is therefore bounded to about 12% of the timeout, which
+ * is fine for the timeouts the wheel is used for - most of them are
+ * cancelled long before they expire anyway.
+ *
+ * HZ 1000 (9 levels):
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         63 ms
+ *  1     64         8 ms               64 ms -        511 ms
+ *  2    128        64 ms              512 ms -       4095 ms (512ms - ~4s)
+ *  3    192       512 ms             4096 ms -      32767 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32768 ms -     262143 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    262144 ms -    2097151 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2097152 ms -   16777215 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16777216 ms -  134217727 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  134217728 ms - 1073741823 ms (~1d - ~12d)
+ *
+ * Timeouts beyond the last level are clamped to WHEEL_TIMEOUT_MAX.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/* Start of level n, i.e. the first timeout which is queued in it */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+/*
+ * Every base has two wheels: the first one holds the normal timers,
+ * the second one the deferrable timers. Only the first one has to be
+ * looked at when computing the next event for NO_HZ.
+ */
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+#define WHEEL_DEFERRABLE	WHEEL_SIZE
+#define WHEEL_SLOTS	(2 * WHEEL_SIZE)
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
-	unsigned long timer_jiffies;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	unsigned long clk;
+	int cpu;
+	DECLARE_BITMAP(pending_map, WHEEL_SLOTS);
+	struct list_head vectors[WHEEL_SLOTS];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -323,46 +362,63 @@ static inline void set_running_timer(struct tvec_base *base,
 #endif
 }
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket of level @lvl for @expires. The expiry is rounded up to the
+ * granularity of the level so that the timer never fires early.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
-		/*
-		 * Can happen if you add a timer with expires == jiffies,
-		 * or you set a timer to go off in the past
-		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
-		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	/*
+	 * Can happen if you add a timer with expires == jiffies,
+	 * or you set a timer to go off in the past
+	 */
+	if ((long) delta < 0)
+		return clk & LVL_MASK;
+
+	/* Clamp timeouts beyond the last level to the maximum timeout: */
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		delta = WHEEL_TIMEOUT_MAX;
+		expires = clk + delta;
+	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
 	}
+	return calc_index(expires, lvl);
+}
+
+static void forward_timer_base(struct tvec_base *base, unsigned long now);
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned int idx;
+
+	/*
+	 * The clock of a base whose cpu was idle lags behind jiffies, a
+	 * timer bucketed against it would land in a coarser level than its
+	 * timeout calls for and fire late by up to that level's granularity.
+	 */
+	if (time_after(jiffies, base->clk))
+		forward_timer_base(base, jiffies);
+
+	idx = calc_wheel_index(timer->expires, base->clk);
+	if (tbase_get_deferrable(timer->base))
+		idx += WHEEL_DEFERRABLE;
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -575,13 +631,32 @@ static inline void detach_timer(struct timer_list *timer,
 	entry->prev = LIST_POISON2;
 }
 
+/*
+ * Remove a pending timer from the wheel of @base and clear the pending
+ * bit of its bucket when it was the last timer in there. A timer which
+ * __run_timers() has already moved to its private expiry list is not
+ * in any bucket, so only heads inside the wheel are considered.
+ */
+static inline void detach_wheel_timer(struct tvec_base *base,
+				      struct timer_list *timer,
+				      int clear_pending)
+{
+	struct list_head *head = timer->entry.next;
+
+	if (head == timer->entry.prev && head >= base->vectors &&
+	    head < base->vectors + WHEEL_SLOTS)
+		__clear_bit(head - base->vectors, base->pending_map);
+
+	detach_timer(timer, clear_pending);
+}
+
 /*
  * We are using hashed locking: holding per_cpu(tvec_bases).lock
  * means that all timers which are tied to this base via timer->base are
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found in the ->vectors buckets.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -621,7 +696,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	base = lock_timer_base(timer, &flags);
 
 	if (timer_pending(timer)) {
-		detach_timer(timer, 0);
+		detach_wheel_timer(base, timer, 0);
 		ret = 1;
 	} else {
 		if (pending_only)
@@ -664,6 +739,13 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	timer->expires = expires;
 	internal_add_timer(base, timer);
+	/*
+	 * A full dynticks CPU with its tick stopped only looked at the
+	 * timers which were queued at that time.  Kick the owner of the
+	 * base the timer really went to: a running timer stays on its
+	 * old base whatever cpu was picked above.
+	 */
+	tick_nohz_full_kick_cpu(base->cpu);
 
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
@@ -791,6 +873,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -816,7 +899,7 @@ int del_timer(struct timer_list *timer)
 	if (timer_pending(timer)) {
 		base = lock_timer_base(timer, &flags);
 		if (timer_pending(timer)) {
-			detach_timer(timer, 1);
+			detach_wheel_timer(base, timer, 1);
 			ret = 1;
 		}
 		spin_unlock_irqrestore(&base->lock, flags);
@@ -849,7 +932,7 @@ int try_to_del_timer_sync(struct timer_list *timer)
 
 	ret = 0;
 	if (timer_pending(timer)) {
-		detach_timer(timer, 1);
+		detach_wheel_timer(base, timer, 1);
 		ret = 1;
 	}
 out:
@@ -897,55 +980,131 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
+/*
+ * Move the buckets which expire at base->clk onto @head. A bucket of
+ * level n is due whenever the low n * LVL_CLK_SHIFT bits of the clock
+ * are zero, so at most LVL_DEPTH buckets of each wheel are looked at
+ * per jiffy and nothing is ever requeued.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
 {
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
+	unsigned long clk = base->clk;
+	unsigned int lvl, idx;
 
-	list_replace_init(tv->vec + index, &tv_list);
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
 
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_splice_tail_init(base->vectors + idx, head);
+		idx += WHEEL_DEFERRABLE;
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_splice_tail_init(base->vectors + idx, head);
+
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
 	}
+}
+
+/*
+ * Search the LVL_SIZE buckets of one level, starting at @clk, for the
+ * first pending one and return its distance from @clk, or -1.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
+
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
 
-	return index;
+/*
+ * Return the jiffy at which the first pending bucket of the wheel at
+ * @wheel (0 or WHEEL_DEFERRABLE) is due, or base->clk +
+ * NEXT_TIMER_MAX_DELTA when the wheel is empty.
+ */
+static unsigned long next_wheel_expiry(struct tvec_base *base,
+				       unsigned int wheel)
+{
+	unsigned long clk = base->clk;
+	unsigned long next = clk + NEXT_TIMER_MAX_DELTA;
+	unsigned int lvl, offset = wheel;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+
+		if (pos >= 0) {
+			unsigned long tmp = (clk + pos) << LVL_SHIFT(lvl);
+
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * Clock of the next level: when the low bits of this level
+		 * are not zero, the bucket at the next level's current index
+		 * has already been expired, so its next due bucket is the
+		 * following one.
+		 */
+		if (clk & LVL_CLK_MASK)
+			clk = (clk >> LVL_CLK_SHIFT) + 1;
+		else
+			clk >>= LVL_CLK_SHIFT;
+	}
+	return next;
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * After the tick was stopped for a while the base clock lags behind
+ * jiffies. Instead of walking every single jiffy, jump straight to the
+ * first bucket which has timers queued (or to jiffies, if none is due
+ * yet) and expire everything in between in one go. Also done before
+ * queueing a timer on a lagging base, so that it is bucketed against
+ * the current time.
+ */
+static void forward_timer_base(struct tvec_base *base, unsigned long now)
+{
+	unsigned long next, def;
+
+	next = next_wheel_expiry(base, 0);
+	def = next_wheel_expiry(base, WHEEL_DEFERRABLE);
+	if (time_before(def, next))
+		next = def;
+	if (time_after(next, now))
+		next = now;
+	if (time_after(next, base->clk))
+		base->clk = next;
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects and executes all expired timer buckets.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
 	struct timer_list *timer;
 
 	spin_lock_irq(&base->lock);
-	while (time_after_eq(jiffies, base->timer_jiffies)) {
+	while (time_after_eq(jiffies, base->clk)) {
 		struct list_head work_list;
 		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
+		unsigned long now = jiffies;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
+		if (now - base->clk > 1)
+			forward_timer_base(base, now);
+
+		INIT_LIST_HEAD(head);
+		collect_expired_timers(base, head);
+		++base->clk;
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -1009,75 +1168,14 @@ static inline void __run_timers(struct tvec_base *base)
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a cpus is idle.
  * This functions needs to be called disabled.
+ *
+ * Deferrable timers live in their own wheel and are not considered,
+ * so this is a few bitmap searches, independent of the number of
+ * queued timers.
  */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
+	return next_wheel_expiry(base, 0);
 }
 
 /*
@@ -1174,7 +1272,7 @@ static void run_timer_softirq(struct softirq_action *h)
 
 	hrtimer_run_pending();
 
-	if (time_after_eq(jiffies, base->timer_jiffies))
+	if (time_after_eq(jiffies, base->clk))
 		__run_timers(base);
 }
 
@@ -1513,16 +1611,12 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SLOTS; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SLOTS);
 
-	base->timer_jiffies = jiffies;
+	base->clk = jiffies;
+	base->cpu = cpu;
 	return 0;
 }
 
@@ -1557,14 +1651,9 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SLOTS; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SLOTS);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
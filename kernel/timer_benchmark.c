@@ -0,0 +1,120 @@
+/*
+ * timer wheel benchmark
+ *
+ * Arms a large number of timers with random timeouts, the way the
+ * networking code does with its retransmit and keepalive timers, and
+ * reports the average cost of add_timer(), mod_timer() and del_timer().
+ * A second pass lets a batch of short timers expire and reports how
+ * long it took until all of them had run.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+
+static int nr_timers = 100000;
+module_param(nr_timers, int, 0444);
+MODULE_PARM_DESC(nr_timers, "number of timers to arm");
+
+static int max_timeout = 120;
+module_param(max_timeout, int, 0444);
+MODULE_PARM_DESC(max_timeout, "maximum timeout in seconds");
+
+static int loops = 4;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "number of mod_timer() passes");
+
+static struct timer_list *timers;
+static atomic_t nr_expired;
+static DECLARE_WAIT_QUEUE_HEAD(expiry_wait);
+
+static void tb_timer_fn(unsigned long data)
+{
+	if (atomic_dec_and_test(&nr_expired))
+		wake_up(&expiry_wait);
+}
+
+static unsigned long tb_random_timeout(void)
+{
+	return 1 + random32() % ((unsigned long)max_timeout * HZ);
+}
+
+static void tb_report(const char *what, ktime_t start, unsigned long nr)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	do_div(ns, nr);
+	printk(KERN_INFO "timer_benchmark: %-10s %8llu ns/timer\n", what,
+	       (unsigned long long)ns);
+}
+
+static void tb_run(void)
+{
+	ktime_t start;
+	int i, l;
+
+	for (i = 0; i < nr_timers; i++)
+		setup_timer(timers + i, tb_timer_fn, i);
+
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++) {
+		timers[i].expires = jiffies + tb_random_timeout();
+		add_timer(timers + i);
+	}
+	tb_report("add_timer", start, nr_timers);
+
+	start = ktime_get();
+	for (l = 0; l < loops; l++) {
+		for (i = 0; i < nr_timers; i++)
+			mod_timer(timers + i, jiffies + tb_random_timeout());
+	}
+	tb_report("mod_timer", start, (unsigned long)nr_timers * loops);
+
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++)
+		del_timer(timers + i);
+	tb_report("del_timer", start, nr_timers);
+
+	/* Let a batch of short timers expire, spread over 1..64 jiffies */
+	atomic_set(&nr_expired, nr_timers);
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(timers + i, jiffies + 1 + (random32() & 63));
+	wait_event(expiry_wait, !atomic_read(&nr_expired));
+	printk(KERN_INFO "timer_benchmark: %d timers expired after %llu us\n",
+	       nr_timers,
+	       (unsigned long long)ktime_to_us(ktime_sub(ktime_get(), start)));
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(timers + i);
+}
+
+static int __init timer_benchmark_init(void)
+{
+	if (nr_timers <= 0 || max_timeout <= 0 || loops <= 0)
+		return -EINVAL;
+
+	timers = vmalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	tb_run();
+
+	vfree(timers);
+	return 0;
+}
+
+static void __exit timer_benchmark_exit(void)
+{
+}
+
+module_init(timer_benchmark_init);
+module_exit(timer_benchmark_exit);
+
+MODULE_DESCRIPTION("timer wheel benchmark");
+MODULE_LICENSE("GPL");
@@ -2800,6 +2800,27 @@ static int ftrace_convert_nops(struct module *mod,
 	return 0;
 }
 
+/*
+ * Check if the text range [start, end] overlaps an mcount call site.
+ * Used by code that rewrites kernel text (e.g. optimized kprobes) to
+ * stay off instructions that ftrace may patch behind its back.
+ */
+int ftrace_text_reserved(void *start, void *end)
+{
+	struct dyn_ftrace *rec;
+	struct ftrace_page *pg;
+
+	do_for_each_ftrace_rec(pg, rec) {
+		/* rec->ip of a freed record links the free list */
+		if (rec->flags & FTRACE_FL_FREE)
+			continue;
+		if (rec->ip <= (unsigned long)end &&
+		    rec->ip + MCOUNT_INSN_SIZE > (unsigned long)start)
+			return 1;
+	} while_for_each_ftrace_rec();
+	return 0;
+}
+
 #ifdef CONFIG_MODULES
 void ftrace_release(void *start, void *end)
 {
@@ -7,7 +7,10 @@
 #include <linux/completion.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/trace_clock.h>
+#include <linux/cpu.h>
 
 struct rb_page {
 	u64		ts;
@@ -35,6 +38,28 @@ static int disable_reader;
 module_param(disable_reader, uint, 0644);
 MODULE_PARM_DESC(disable_reader, "only run producer");
 
+static int writer_cpus;
+module_param(writer_cpus, uint, 0644);
+MODULE_PARM_DESC(writer_cpus, "run a writer on every online cpu");
+
+/*
+ * One writer hammering the buffer, either the producer thread itself
+ * or, with writer_cpus set, one thread bound to each online cpu.
+ */
+struct rb_writer {
+	struct task_struct	*task;
+	int			cpu;
+	unsigned long		hit;
+	unsigned long		missed;
+	unsigned long long	usecs;
+	u64			total_ns;
+	u64			max_ns;
+};
+
+static struct rb_writer *writers;
+static atomic_t writers_running;
+static struct completion writers_done;
+
 static int read_events;
 
 static int kill_test;
@@ -187,37 +212,50 @@ static void ring_buffer_consumer(void)
 	complete(&read_done);
 }
 
-static void ring_buffer_producer(void)
+static void wait_to_die(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static void ring_buffer_hammer(struct rb_writer *w)
 {
 	struct timeval start_tv;
 	struct timeval end_tv;
 	unsigned long long time;
-	unsigned long long entries;
-	unsigned long long overruns;
-	unsigned long missed = 0;
-	unsigned long hit = 0;
-	unsigned long avg;
 	int cnt = 0;
 
-	/*
-	 * Hammer the buffer for 10 secs (this may
-	 * make the system stall)
-	 */
-	trace_printk("Starting ring buffer hammer\n");
+	w->hit = w->missed = 0;
+	w->total_ns = w->max_ns = 0;
+
 	do_gettimeofday(&start_tv);
 	do {
 		struct ring_buffer_event *event;
 		int *entry;
+		u64 t0, t1;
 
+		preempt_disable();
+		t0 = trace_clock_local();
 		event = ring_buffer_lock_reserve(buffer, 10);
 		if (!event) {
-			missed++;
+			w->missed++;
 		} else {
-			hit++;
+			w->hit++;
 			entry = ring_buffer_event_data(event);
 			*entry = smp_processor_id();
 			ring_buffer_unlock_commit(buffer, event);
 		}
+		t1 = trace_clock_local() - t0;
+		preempt_enable();
+
+		w->total_ns += t1;
+		if (t1 > w->max_ns)
+			w->max_ns = t1;
+
 		do_gettimeofday(&end_tv);
 
 		cnt++;
@@ -239,6 +277,101 @@ static void ring_buffer_producer(void)
 #endif
 
 	} while (end_tv.tv_sec < (start_tv.tv_sec + RUN_TIME) && !kill_test);
+
+	time = end_tv.tv_sec - start_tv.tv_sec;
+	time *= USEC_PER_SEC;
+	time += (long long)((long)end_tv.tv_usec - (long)start_tv.tv_usec);
+	w->usecs = time;
+}
+
+static int ring_buffer_writer_thread(void *arg)
+{
+	struct rb_writer *w = arg;
+
+	ring_buffer_hammer(w);
+
+	if (atomic_dec_and_test(&writers_running))
+		complete(&writers_done);
+
+	wait_to_die();
+
+	return 0;
+}
+
+/* Run one writer per online cpu, returns the number that ran */
+static int ring_buffer_run_writers(void)
+{
+	struct rb_writer *w;
+	int nr = 0;
+	int cpu;
+
+	init_completion(&writers_done);
+	atomic_set(&writers_running, 1);
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		w = &writers[nr];
+		w->cpu = cpu;
+		w->task = kthread_create(ring_buffer_writer_thread, w,
+					 "rb_writer/%d", cpu);
+		if (IS_ERR(w->task))
+			continue;
+		kthread_bind(w->task, cpu);
+		atomic_inc(&writers_running);
+		wake_up_process(w->task);
+		nr++;
+	}
+	put_online_cpus();
+
+	/* drop our own reference, the last writer completes */
+	if (atomic_dec_and_test(&writers_running))
+		complete(&writers_done);
+	wait_for_completion(&writers_done);
+
+	for (cpu = 0; cpu < nr; cpu++)
+		kthread_stop(writers[cpu].task);
+
+	return nr;
+}
+
+static void ring_buffer_writer_stats(struct rb_writer *w)
+{
+	unsigned long long rate = 0;
+	u64 avg = 0;
+
+	if (w->usecs)
+		rate = div64_u64((u64)w->hit * USEC_PER_SEC, w->usecs);
+	if (w->hit + w->missed)
+		avg = div64_u64(w->total_ns, w->hit + w->missed);
+
+	trace_printk("CPU %d: %lld entries/sec, %lld ns avg, %lld ns max "
+		     "per write\n", w->cpu, rate,
+		     (unsigned long long)avg, (unsigned long long)w->max_ns);
+}
+
+static void ring_buffer_producer(void)
+{
+	struct rb_writer self;
+	unsigned long long time = 0;
+	unsigned long long entries;
+	unsigned long long overruns;
+	unsigned long missed = 0;
+	unsigned long hit = 0;
+	unsigned long avg;
+	int nr = 0;
+	int i;
+
+	/*
+	 * Hammer the buffer for 10 secs (this may
+	 * make the system stall)
+	 */
+	trace_printk("Starting ring buffer hammer\n");
+	if (writers) {
+		nr = ring_buffer_run_writers();
+	} else {
+		self.cpu = raw_smp_processor_id();
+		ring_buffer_hammer(&self);
+	}
 	trace_printk("End ring buffer hammer\n");
 
 	if (consumer) {
@@ -254,9 +387,18 @@ static void ring_buffer_producer(void)
 		wait_for_completion(&read_done);
 	}
 
-	time = end_tv.tv_sec - start_tv.tv_sec;
-	time *= USEC_PER_SEC;
-	time += (long long)((long)end_tv.tv_usec - (long)start_tv.tv_usec);
+	if (writers) {
+		for (i = 0; i < nr; i++) {
+			hit += writers[i].hit;
+			missed += writers[i].missed;
+			if (writers[i].usecs > time)
+				time = writers[i].usecs;
+		}
+	} else {
+		hit = self.hit;
+		missed = self.missed;
+		time = self.usecs;
+	}
 
 	entries = ring_buffer_entries(buffer);
 	overruns = ring_buffer_overruns(buffer);
@@ -275,6 +417,12 @@ static void ring_buffer_producer(void)
 	trace_printk("Missed:   %ld\n", missed);
 	trace_printk("Hit:      %ld\n", hit);
 
+	if (writers) {
+		for (i = 0; i < nr; i++)
+			ring_buffer_writer_stats(&writers[i]);
+	} else
+		ring_buffer_writer_stats(&self);
+
 	/* Convert time from usecs to millisecs */
 	do_div(time, USEC_PER_MSEC);
 	if (time)
@@ -309,16 +457,6 @@ static void ring_buffer_producer(void)
 	}
 }
 
-static void wait_to_die(void)
-{
-	set_current_state(TASK_INTERRUPTIBLE);
-	while (!kthread_should_stop()) {
-		schedule();
-		set_current_state(TASK_INTERRUPTIBLE);
-	}
-	__set_current_state(TASK_RUNNING);
-}
-
 static int ring_buffer_consumer_thread(void *arg)
 {
 	while (!kthread_should_stop() && !kill_test) {
@@ -377,6 +515,13 @@ static int __init ring_buffer_benchmark_init(void)
 	if (!buffer)
 		return -ENOMEM;
 
+	if (writer_cpus) {
+		writers = kcalloc(nr_cpu_ids, sizeof(*writers), GFP_KERNEL);
+		ret = -ENOMEM;
+		if (!writers)
+			goto out_fail;
+	}
+
 	if (!disable_reader) {
 		consumer = kthread_create(ring_buffer_consumer_thread,
 					  NULL, "rb_consumer");
@@ -399,6 +544,7 @@ static int __init ring_buffer_benchmark_init(void)
 		kthread_stop(consumer);
 
  out_fail:
+	kfree(writers);
 	ring_buffer_free(buffer);
 	return ret;
 }
@@ -408,6 +554,7 @@ static void __exit ring_buffer_benchmark_exit(void)
 	kthread_stop(producer);
 	if (consumer)
 		kthread_stop(consumer);
+	kfree(writers);
 	ring_buffer_free(buffer);
 }
 
@@ -2,6 +2,9 @@
 #include <linux/kernel.h>
 #include <asm/syscall.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/syscalls.h>
+
 #include "trace_output.h"
 #include "trace.h"
 
@@ -95,7 +98,12 @@ print_syscall_exit(struct trace_iterator *iter, int flags)
 	return TRACE_TYPE_HANDLED;
 }
 
-void start_ftrace_syscalls(void)
+/*
+ * The sys_enter and sys_exit tracepoints are only hit by the tasks that
+ * have TIF_SYSCALL_FTRACE set, so set it on all of them while there are
+ * probes registered.
+ */
+void syscall_regfunc(void)
 {
 	unsigned long flags;
 	struct task_struct *g, *t;
@@ -119,7 +127,7 @@ unlock:
 	mutex_unlock(&syscall_trace_lock);
 }
 
-void stop_ftrace_syscalls(void)
+void syscall_unregfunc(void)
 {
 	unsigned long flags;
 	struct task_struct *g, *t;
@@ -142,7 +150,7 @@ unlock:
 	mutex_unlock(&syscall_trace_lock);
 }
 
-void ftrace_syscall_enter(struct pt_regs *regs)
+void ftrace_syscall_enter(struct pt_regs *regs, long id)
 {
 	struct syscall_trace_enter *entry;
 	struct syscall_metadata *sys_data;
@@ -150,7 +158,7 @@ void ftrace_syscall_enter(struct pt_regs *regs)
 	int size;
 	int syscall_nr;
 
-	syscall_nr = syscall_get_nr(current, regs);
+	syscall_nr = id;
 
 	sys_data = syscall_nr_to_meta(syscall_nr);
 	if (!sys_data)
@@ -171,7 +179,7 @@ void ftrace_syscall_enter(struct pt_regs *regs)
 	trace_wake_up();
 }
 
-void ftrace_syscall_exit(struct pt_regs *regs)
+void ftrace_syscall_exit(struct pt_regs *regs, long ret)
 {
 	struct syscall_trace_exit *entry;
 	struct syscall_metadata *sys_data;
@@ -191,7 +199,7 @@ void ftrace_syscall_exit(struct pt_regs *regs)
 
 	entry = ring_buffer_event_data(event);
 	entry->nr = syscall_nr;
-	entry->ret = syscall_get_return_value(current, regs);
+	entry->ret = ret;
 
 	trace_current_buffer_unlock_commit(event, 0, 0);
 	trace_wake_up();
@@ -199,14 +207,23 @@ void ftrace_syscall_exit(struct pt_regs *regs)
 
 static int init_syscall_tracer(struct trace_array *tr)
 {
-	start_ftrace_syscalls();
+	int ret;
+
+	ret = register_trace_sys_enter(ftrace_syscall_enter);
+	if (ret)
+		return ret;
+
+	ret = register_trace_sys_exit(ftrace_syscall_exit);
+	if (ret)
+		unregister_trace_sys_enter(ftrace_syscall_enter);
 
-	return 0;
+	return ret;
 }
 
 static void reset_syscall_tracer(struct trace_array *tr)
 {
-	stop_ftrace_syscalls();
+	unregister_trace_sys_exit(ftrace_syscall_exit);
+	unregister_trace_sys_enter(ftrace_syscall_enter);
 	tracing_reset_online_cpus(tr);
 }
 
@@ -250,7 +250,10 @@ static void set_tracepoint(struct tracepoint_entry **entry,
 	 * is used.
 	 */
 	rcu_assign_pointer(elem->funcs, (*entry)->funcs);
-	elem->state = active;
+	if (active && !elem->state)
+		jump_label_enable(&elem->state);
+	else if (!active && elem->state)
+		jump_label_disable(&elem->state);
 }
 
 /*
@@ -261,7 +264,8 @@ static void set_tracepoint(struct tracepoint_entry **entry,
  */
 static void disable_tracepoint(struct tracepoint *elem)
 {
-	elem->state = 0;
+	if (elem->state)
+		jump_label_disable(&elem->state);
 	rcu_assign_pointer(elem->funcs, NULL);
 }
 
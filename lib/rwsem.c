@@ -7,6 +7,7 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/mcs_spinlock.h>
 
 /*
  * Initialize an rwsem:
@@ -24,6 +25,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->osq = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -198,6 +203,90 @@ rwsem_down_read_failed(struct rw_semaphore *sem)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to grab the write lock without queueing: succeeds whenever nobody
+ * holds the lock, even if there are sleeping waiters. Those are woken by
+ * our up_write(), exactly as if we had been granted the lock by
+ * __rwsem_do_wake().
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	signed long old, count = ACCESS_ONCE(sem->count);
+
+	while (!(count & RWSEM_ACTIVE_MASK)) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+static inline int rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	if (need_resched())
+		return 0;
+
+	/* Readers may hold the lock for long, don't spin on them */
+	return ACCESS_ONCE(sem->owner) != RWSEM_READER_OWNED;
+}
+
+/*
+ * Optimistic spinning: as long as the writer which owns the semaphore is
+ * running on another cpu it is likely to release it soon, so spin and
+ * try to take it instead of going to sleep. Only the spinner at the head
+ * of the MCS queue in sem->osq polls the count and the owner; the others
+ * spin on their own queue node.
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct thread_info *owner;
+	struct mcs_spinlock node;
+	int taken = 0;
+
+	preempt_disable();
+
+	if (!rwsem_can_spin_on_owner(sem))
+		goto done;
+
+	mcs_spin_lock(&sem->osq, &node);
+	for (;;) {
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+
+		/*
+		 * If there's an owner, wait for it to either
+		 * release the lock or go to sleep.
+		 */
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		cpu_relax();
+	}
+	mcs_spin_unlock(&sem->osq, &node);
+done:
+	preempt_enable();
+	return taken;
+}
+#endif
+
 /*
  * wait for the write lock to be granted
  */
@@ -205,9 +294,22 @@ asmregparm struct rw_semaphore __sched *
 rwsem_down_write_failed(struct rw_semaphore *sem)
 {
 	struct rwsem_waiter waiter;
+	signed long adjustment = -RWSEM_ACTIVE_BIAS;
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * Stop being an active locker while spinning. Should the lock
+	 * become free with sleepers queued, the spin loop either takes
+	 * it or rwsem_down_failed_common() wakes up the sleepers.
+	 */
+	rwsem_atomic_add(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+	if (rwsem_optimistic_spin(sem))
+		return sem;
+	adjustment = RWSEM_WAITING_BIAS;
+#endif
 
 	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	rwsem_down_failed_common(sem, &waiter, -RWSEM_ACTIVE_BIAS);
+	rwsem_down_failed_common(sem, &waiter, adjustment);
 
 	return sem;
 }
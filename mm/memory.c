@@ -55,6 +55,8 @@
 #include <linux/kallsyms.h>
 #include <linux/swapops.h>
 #include <linux/elf.h>
+#include <linux/mempolicy.h>
+#include <linux/migrate.h>
 
 #include <asm/pgalloc.h>
 #include <asm/uaccess.h>
@@ -2662,6 +2664,94 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ * The page reference is transferred to the new pte.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter(vma->vm_mm, anon_rss);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter(vma->vm_mm, file_rss);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, entry);
+}
+
+/*
+ * Number of pages around a read fault that ->map_pages may map if they
+ * are already in the page cache.  Rounded down to a power of two; 1
+ * disables fault-around.
+ */
+int sysctl_fault_around_pages __read_mostly = 16;
+
+/*
+ * Map the pages which are already cached around the faulting address,
+ * within the same page table, vma and fault-around window, so that
+ * sequential or clustered accesses to a cached file don't take a minor
+ * fault on every page.  Called with the pte lock held.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long nr_pages = rounddown_pow_of_two(sysctl_fault_around_pages);
+	unsigned long start_addr;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	start_addr = max(address & ~(nr_pages * PAGE_SIZE - 1), vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either end of page table or end of vma
+	 * or nr_pages from pgoff, depending what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1);
+	max_pgoff = min_t(pgoff_t, max_pgoff, pgoff + nr_pages - 1);
+
+	/* Check if it makes any sense to call ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -2682,7 +2772,6 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pte_t *page_table;
 	spinlock_t *ptl;
 	struct page *page;
-	pte_t entry;
 	int anon = 0;
 	int charged = 0;
 	struct page *dirty_page = NULL;
@@ -2690,6 +2779,22 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	int ret;
 	int page_mkwrite = 0;
 
+	/*
+	 * On a read fault, let ->map_pages() map whatever is already in
+	 * core around the address first, and only fall back to ->fault()
+	 * if the page we need was not ready to be mapped (cold cache etc).
+	 */
+	if (!(flags & (FAULT_FLAG_WRITE | FAULT_FLAG_NONLINEAR)) &&
+	    vma->vm_ops->map_pages && sysctl_fault_around_pages > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
 	vmf.pgoff = pgoff;
 	vmf.flags = flags;
@@ -2785,25 +2890,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter(mm, anon_rss);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter(mm, file_rss);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, entry);
 	} else {
 		if (charged)
 			mem_cgroup_uncharge_page(page);
@@ -2890,6 +2982,59 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault: task_numa_work() made the pte inaccessible to see
+ * where the page is used from.  Make it accessible again, move the page
+ * to the node the memory policy now wants it on, and account the fault
+ * to the task.
+ *
+ * We enter with non-exclusive mmap_sem, and the pte mapped and locked.
+ * We return with mmap_sem still held, but pte unmapped and unlocked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *page_table, spinlock_t *ptl,
+		pte_t orig_pte)
+{
+	struct page *page;
+	pte_t entry;
+	int page_nid, target_nid;
+	int migrated = 0;
+
+	entry = pte_mknonnuma(orig_pte);
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, entry);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	get_page(page);
+	page_nid = page_to_nid(page);
+	target_nid = mpol_misplaced(page, vma, address);
+	pte_unmap_unlock(page_table, ptl);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	if (page_nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	if (target_nid == -1)
+		put_page(page);
+	else if (migrate_misplaced_page(page, target_nid)) {
+		page_nid = target_nid;
+		migrated = 1;
+	}
+
+	/* Not ours when get_user_pages() faults in another mm */
+	if (current->mm == mm)
+		task_numa_fault(page_nid, 1, migrated);
+
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -2932,6 +3077,11 @@ static inline int handle_pte_fault(struct mm_struct *mm,
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
 		goto unlock;
+#ifdef CONFIG_NUMA_BALANCING
+	/* The ptes of PROT_NONE mappings look the same: leave them be */
+	if (pte_numa(entry) && (vma->vm_flags & (VM_READ|VM_WRITE|VM_EXEC)))
+		return do_numa_page(mm, vma, address, pte, ptl, entry);
+#endif
 	if (flags & FAULT_FLAG_WRITE) {
 		if (!pte_write(entry))
 			return do_wp_page(mm, vma, address,
@@ -2988,6 +3138,228 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * A multithreaded process faulting in fresh anonymous memory while other
+ * threads mmap and munmap spends most of its time waiting for mmap_sem.
+ * handle_speculative_fault() tries to handle the simplest and most common
+ * such fault - the first touch of a private anonymous page whose page
+ * tables already exist - without taking mmap_sem at all.
+ *
+ * Interrupts are disabled while the vma tree and page tables are walked
+ * (the page is allocated with GFP_KERNEL in between, so the caller must
+ * have them enabled to begin with):
+ * that holds off the RCU-sched grace period after which unlinked vmas are
+ * freed, and the TLB flush IPI after which page tables are freed.  Every
+ * change to the shape of the vma tree is bracketed by mm->mm_rb_seq, and
+ * every in-place change to a vma by vma->vm_sequence; both are checked
+ * again with the pte lock held just before the pte is set.  Anything
+ * unusual, or any change seen, returns VM_FAULT_RETRY and the caller
+ * takes the normal path under mmap_sem.
+ */
+
+/* Deeper than any rbtree of vmas we can have; bounds a torn walk. */
+#define SPECULATIVE_RB_DEPTH	64
+
+static struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+		unsigned long address)
+{
+	struct rb_node *node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	int depth = 0;
+
+	while (node && depth++ < SPECULATIVE_RB_DEPTH) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(node, struct vm_area_struct, vm_rb);
+		if (address < ACCESS_ONCE(vma->vm_start))
+			node = ACCESS_ONCE(node->rb_left);
+		else if (address >= ACCESS_ONCE(vma->vm_end))
+			node = ACCESS_ONCE(node->rb_right);
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/* Like read_seqcount_begin(), but report a writer rather than wait for it */
+static inline unsigned speculative_seq_begin(const seqcount_t *s)
+{
+	unsigned seq = ACCESS_ONCE(s->sequence);
+
+	smp_rmb();
+	return seq;
+}
+
+static inline int speculative_seq_retry(const seqcount_t *s, unsigned seq)
+{
+	return (seq & 1) || read_seqcount_retry(s, seq);
+}
+
+/*
+ * Walk the existing page tables down to the pte for @address; never
+ * allocates.  Called with interrupts disabled.
+ */
+static pmd_t *speculative_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return NULL;
+	return pmd;
+}
+
+#define VM_SPECULATIVE_EXCLUDE	(VM_SHARED | VM_LOCKED | VM_GROWSDOWN | \
+				 VM_GROWSUP | VM_PFNMAP | VM_MIXEDMAP | \
+				 VM_HUGETLB | VM_NONLINEAR | VM_IO | \
+				 VM_INSERTPAGE)
+
+/**
+ * handle_speculative_fault - try to handle a fault without mmap_sem
+ * @mm: the faulting mm, which must be current->mm
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx
+ *
+ * Returns 0 if the fault was handled, or VM_FAULT_RETRY if the caller
+ * must fall back to handle_mm_fault() under mmap_sem.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+		unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	unsigned long vm_flags, vm_start, vm_end;
+	unsigned mm_seq, vma_seq;
+	pgprot_t page_prot;
+	struct page *page;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pte_t *pte, entry;
+	unsigned long irqflags;
+
+	local_irq_save(irqflags);
+	mm_seq = speculative_seq_begin(&mm->mm_rb_seq);
+	if (mm_seq & 1)
+		goto out_irq;
+
+	vma = find_vma_speculative(mm, address);
+	if (!vma)
+		goto out_irq;
+
+	vma_seq = speculative_seq_begin(&vma->vm_sequence);
+	vm_start = vma->vm_start;
+	vm_end = vma->vm_end;
+	vm_flags = vma->vm_flags;
+	page_prot = vma->vm_page_prot;
+	if (vma->vm_ops || vma->vm_file || !vma->anon_vma ||
+	    vma_policy(vma))
+		goto out_irq;
+	if (speculative_seq_retry(&vma->vm_sequence, vma_seq) ||
+	    read_seqcount_retry(&mm->mm_rb_seq, mm_seq))
+		goto out_irq;
+
+	if (address < vm_start || address >= vm_end)
+		goto out_irq;
+	if (vm_flags & VM_SPECULATIVE_EXCLUDE)
+		goto out_irq;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			goto out_irq;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_irq;
+
+	/* Only first touch of a page whose page table already exists */
+	pmd = speculative_pmd(mm, address);
+	if (!pmd)
+		goto out_irq;
+	pte = pte_offset_map(pmd, address);
+	entry = *pte;
+	pte_unmap(pte);
+	if (!pte_none(entry))
+		goto out_irq;
+	local_irq_restore(irqflags);
+
+	page = alloc_zeroed_user_highpage_movable(NULL, address);
+	if (!page)
+		return VM_FAULT_RETRY;
+	__SetPageUptodate(page);
+
+	if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL))
+		goto out_free;
+
+	entry = mk_pte(page, page_prot);
+	if (vm_flags & VM_WRITE)
+		entry = pte_mkwrite(pte_mkdirty(entry));
+
+	/*
+	 * The vma may have gone while we were allocating: walk again, and
+	 * only trylock the pte lock, since its holder may be waiting for
+	 * us to take a TLB flush IPI.
+	 */
+	local_irq_save(irqflags);
+	if (read_seqcount_retry(&mm->mm_rb_seq, mm_seq))
+		goto out_uncharge_irq;
+	pmd = speculative_pmd(mm, address);
+	if (!pmd)
+		goto out_uncharge_irq;
+	ptl = pte_lockptr(mm, pmd);
+	pte = pte_offset_map(pmd, address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out_uncharge_irq;
+	}
+	if (read_seqcount_retry(&vma->vm_sequence, vma_seq) ||
+	    read_seqcount_retry(&mm->mm_rb_seq, mm_seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out_uncharge_irq;
+	}
+	/*
+	 * Unmapping the vma, or changing it, now has to wait for the pte
+	 * lock: so it is safe to let TLB flushes and RCU proceed.
+	 */
+	local_irq_restore(irqflags);
+
+	if (!pte_none(*pte)) {
+		/* Another thread got there first: nothing left to do */
+		pte_unmap_unlock(pte, ptl);
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return 0;
+	}
+	inc_mm_counter(mm, anon_rss);
+	page_add_new_anon_rmap(page, vma, address);
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, entry);
+	pte_unmap_unlock(pte, ptl);
+
+	count_vm_event(PGFAULT);
+	count_vm_event(PGFAULT_SPECULATIVE);
+	return 0;
+
+out_uncharge_irq:
+	local_irq_restore(irqflags);
+	mem_cgroup_uncharge_page(page);
+out_free:
+	page_cache_release(page);
+	return VM_FAULT_RETRY;
+
+out_irq:
+	local_irq_restore(irqflags);
+	return VM_FAULT_RETRY;
+}
+#endif
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -560,7 +560,9 @@ static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
 		err = vma->vm_ops->set_policy(vma, new);
 	if (!err) {
 		mpol_get(new);
+		vm_write_begin(vma);
 		vma->vm_policy = new;
+		vm_write_end(vma);
 		mpol_put(old);
 	}
 	return err;
@@ -1531,6 +1533,60 @@ static inline unsigned interleave_nid(struct mempolicy *pol,
 		return interleave_nodes(pol);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * mpol_misplaced - check whether a page is on a node its policy allows
+ * @page: page to be checked
+ * @vma: vm area where the page is mapped
+ * @addr: virtual address where the page is mapped
+ *
+ * Called from the NUMA hinting fault path, see do_numa_page(), with the
+ * page table lock held.  The node the policy would allocate the page on
+ * now, for the current task, is compared to the node of the page: for
+ * the default local policy, this is the node of the faulting CPU.
+ *
+ * Returns -1 if the page can stay where it is, or the node to move it to.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int polnid = curnid;
+
+	pol = get_vma_policy(current, vma, addr);
+
+	switch (pol->mode) {
+	case MPOL_INTERLEAVE:
+		polnid = interleave_nid(pol, vma, addr, PAGE_SHIFT);
+		break;
+
+	case MPOL_PREFERRED:
+		if (pol->flags & MPOL_F_LOCAL)
+			polnid = thisnid;
+		else
+			polnid = pol->v.preferred_node;
+		break;
+
+	case MPOL_BIND:
+		/*
+		 * Any node of the mask will do: only move the page if the
+		 * faulting node is one of them.
+		 */
+		if (node_isset(thisnid, pol->v.nodes))
+			polnid = thisnid;
+		break;
+
+	default:
+		BUG();
+	}
+	mpol_cond_put(pol);
+
+	return polnid == curnid ? -1 : polnid;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #ifdef CONFIG_HUGETLBFS
 /*
  * huge_zonelist(@vma, @addr, @gfp_flags, @mpol)
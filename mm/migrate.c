@@ -778,6 +778,55 @@ out:
 	return nr_failed + retry;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data, int **result)
+{
+	int nid = (int)data;
+
+	return alloc_pages_exact_node(nid,
+				GFP_HIGHUSER_MOVABLE | GFP_THISNODE, 0);
+}
+
+/*
+ * Move a page found on the wrong node by a NUMA hinting fault to @node.
+ * Consumes the reference the caller holds on the page.  Returns 1 if
+ * the page was migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+
+	/*
+	 * Pages mapped by several processes are left alone: their users
+	 * could disagree on where they belong, and bounce them around.
+	 */
+	if (page_mapcount(page) != 1)
+		goto out;
+
+	if (isolate_lru_page(page))
+		goto out;
+
+	/*
+	 * Isolation took a reference of its own. Drop the caller's, or
+	 * migrate_page_move_mapping() sees one reference too many and
+	 * keeps failing with -EAGAIN.
+	 */
+	put_page(page);
+
+	list_add(&page->lru, &migratepages);
+	if (migrate_pages(&migratepages, alloc_misplaced_dst_page, node))
+		return 0;
+
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #ifdef CONFIG_NUMA
 /*
  * Move a list of individual pages
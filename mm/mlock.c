@@ -400,7 +400,9 @@ success:
 	 * It's okay if try_to_unmap_one unmaps a page just after we
 	 * set VM_LOCKED, __mlock_vma_pages_range will bring it back.
 	 */
+	vm_write_begin(vma);
 	vma->vm_flags = newflags;
+	vm_write_end(vma);
 
 	if (lock) {
 		ret = __mlock_vma_pages_range(vma, start, end, 1);
@@ -0,0 +1,379 @@
+/*
+ *	linux/mm/process_vm_access.c
+ *
+ * Cross Memory Attach: copy data directly between the address spaces
+ * of two processes, without going through a shared bounce buffer.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+#include <asm/uaccess.h>
+
+/*
+ * Maximum number of remote pages pinned at once.  The array lives on
+ * the stack, so keep it small.
+ */
+#define PVM_MAX_PP_ARRAY_COUNT 16
+
+/* Position within the local iovec array */
+struct pvm_iter {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	unsigned long seg;
+	size_t offset;
+};
+
+static inline int pvm_iter_done(struct pvm_iter *iter)
+{
+	return iter->seg >= iter->nr_segs;
+}
+
+/**
+ * process_vm_rw_page - copy between one pinned remote page and local iovecs
+ * @page: the remote page, pinned by get_user_pages()
+ * @offset: offset of the data within @page
+ * @len: number of bytes to copy, at most up to the end of @page
+ * @iter: current position in the local iovecs, advanced by the copy
+ * @vm_write: 0 copies from @page to the local iovecs, 1 the other way
+ *
+ * Returns the number of bytes copied; a short count means that either
+ * the local iovecs are exhausted or a local address faulted.  A single
+ * kmap serves every local segment the page is copied to or from.
+ */
+static size_t process_vm_rw_page(struct page *page, unsigned int offset,
+				 size_t len, struct pvm_iter *iter,
+				 int vm_write)
+{
+	char *kaddr = kmap(page) + offset;
+	size_t copied = 0;
+
+	while (copied < len && !pvm_iter_done(iter)) {
+		const struct iovec *iov = &iter->iov[iter->seg];
+		void __user *uaddr = iov->iov_base + iter->offset;
+		size_t bytes = min(len - copied, iov->iov_len - iter->offset);
+		size_t left;
+
+		if (vm_write)
+			left = copy_from_user(kaddr + copied, uaddr, bytes);
+		else
+			left = copy_to_user(uaddr, kaddr + copied, bytes);
+
+		bytes -= left;
+		copied += bytes;
+		iter->offset += bytes;
+		if (left)
+			break;
+		if (iter->offset == iov->iov_len) {
+			iter->seg++;
+			iter->offset = 0;
+		}
+	}
+	kunmap(page);
+
+	if (vm_write && copied)
+		set_page_dirty_lock(page);
+	return copied;
+}
+
+/**
+ * process_vm_rw_single_vec - copy one remote iovec
+ * @addr: start address of the remote range
+ * @len: length of the remote range
+ * @iter: current position in the local iovecs
+ * @pages: scratch array of PVM_MAX_PP_ARRAY_COUNT page pointers
+ * @mm: the remote mm, with a reference held
+ * @task: the remote task
+ * @vm_write: 0 reads from the remote range, 1 writes to it
+ * @copied: incremented by the number of bytes transferred
+ *
+ * The remote pages are pinned in batches under mmap_sem, which is dropped
+ * again before copying: the local side may fault, and @mm may be our own.
+ */
+static int process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+				    struct pvm_iter *iter, struct page **pages,
+				    struct mm_struct *mm,
+				    struct task_struct *task,
+				    int vm_write, ssize_t *copied)
+{
+	unsigned long pa = addr & PAGE_MASK;
+	unsigned int offset = addr & ~PAGE_MASK;
+	unsigned long nr_pages;
+	int ret = 0;
+
+	if (len == 0)
+		return 0;
+	nr_pages = (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+
+	while (nr_pages && !pvm_iter_done(iter)) {
+		int nr = min_t(unsigned long, nr_pages, PVM_MAX_PP_ARRAY_COUNT);
+		int pinned, i;
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, pa, nr, vm_write, 0,
+					pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0)
+			return -EFAULT;
+
+		for (i = 0; i < pinned; i++) {
+			size_t bytes = min_t(unsigned long,
+					     PAGE_SIZE - offset, len);
+
+			if (!ret) {
+				size_t done = process_vm_rw_page(pages[i],
+						offset, bytes, iter, vm_write);
+
+				*copied += done;
+				len -= done;
+				if (done < bytes && !pvm_iter_done(iter))
+					ret = -EFAULT;
+			}
+			put_page(pages[i]);
+			offset = 0;
+		}
+		if (ret)
+			return ret;
+		if (pinned < nr)
+			return -EFAULT;
+
+		nr_pages -= pinned;
+		pa += pinned * PAGE_SIZE;
+	}
+	return 0;
+}
+
+/**
+ * process_vm_rw_core - core of reading/writing pages from task specified
+ * @pid: PID of process to read/write from/to
+ * @lvec: local iovecs, already checked
+ * @liovcnt: number of local iovecs
+ * @rvec: remote iovecs, already checked
+ * @riovcnt: number of remote iovecs
+ * @vm_write: 0 means copy from, 1 means copy to
+ *
+ * Returns the number of bytes copied, which may be short if a fault
+ * is hit part way through, or a negative error code if nothing was
+ * copied at all.
+ */
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt, int vm_write)
+{
+	struct page *pages[PVM_MAX_PP_ARRAY_COUNT];
+	struct pvm_iter iter = {
+		.iov		= lvec,
+		.nr_segs	= liovcnt,
+	};
+	struct task_struct *task;
+	struct mm_struct *mm;
+	ssize_t copied = 0;
+	unsigned long i;
+	int ret = 0;
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task)
+		return -ESRCH;
+
+	/*
+	 * Same rules as for attaching with ptrace, and like ptrace_attach()
+	 * hold off a concurrent exec: it installs the new mm before the new
+	 * creds, so we could otherwise pass the check against the old creds
+	 * and get hold of a setuid image.
+	 */
+	if (mutex_lock_interruptible(&task->cred_guard_mutex)) {
+		ret = -EINTR;
+		goto put_task_struct;
+	}
+	task_lock(task);
+	if (__ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		task_unlock(task);
+		mutex_unlock(&task->cred_guard_mutex);
+		ret = -EPERM;
+		goto put_task_struct;
+	}
+	mm = task->mm;
+	if (!mm || (task->flags & PF_KTHREAD)) {
+		task_unlock(task);
+		mutex_unlock(&task->cred_guard_mutex);
+		ret = -EINVAL;
+		goto put_task_struct;
+	}
+	atomic_inc(&mm->mm_users);
+	task_unlock(task);
+	mutex_unlock(&task->cred_guard_mutex);
+
+	for (i = 0; i < riovcnt && !pvm_iter_done(&iter); i++) {
+		ret = process_vm_rw_single_vec(
+				(unsigned long)rvec[i].iov_base,
+				rvec[i].iov_len, &iter, pages, mm, task,
+				vm_write, &copied);
+		if (ret < 0)
+			break;
+	}
+
+	mmput(mm);
+
+put_task_struct:
+	put_task_struct(task);
+
+	/* Partial transfers report how much was actually copied */
+	if (copied)
+		return copied;
+	return ret;
+}
+
+/**
+ * process_vm_rw - check iovecs before calling core routine
+ * @pid: PID of process to read/write from/to
+ * @lvec: iovec array specifying where to copy to/from locally
+ * @liovcnt: size of lvec array
+ * @rvec: iovec array specifying where to copy to/from in the other process
+ * @riovcnt: size of rvec array
+ * @flags: currently unused, must be 0
+ * @vm_write: 0 if reading from other process, 1 if writing to other process
+ */
+static ssize_t process_vm_rw(pid_t pid,
+			     const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t ret;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* A write to the remote side is a read of the local buffers */
+	ret = rw_copy_check_uvector(vm_write ? WRITE : READ, lvec, liovcnt,
+				    UIO_FASTIOV, iovstack_l, &iov_l);
+	if (ret <= 0)
+		goto free_iovecs;
+
+	/*
+	 * The remote addresses belong to the other mm, so they are only
+	 * length checked here; whether they are really mapped is found out
+	 * by get_user_pages() on the remote mm.
+	 */
+	ret = rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec, riovcnt,
+				    UIO_FASTIOV, iovstack_r, &iov_r);
+	if (ret <= 0)
+		goto free_iovecs;
+
+	ret = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt,
+				 vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+
+	return ret;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t ret;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	ret = compat_rw_copy_check_uvector(vm_write ? WRITE : READ, lvec,
+					   liovcnt, UIO_FASTIOV, iovstack_l,
+					   &iov_l);
+	if (ret <= 0)
+		goto free_iovecs;
+	ret = compat_rw_copy_check_uvector(CHECK_IOVEC_ONLY, rvec,
+					   riovcnt, UIO_FASTIOV, iovstack_r,
+					   &iov_r);
+	if (ret <= 0)
+		goto free_iovecs;
+
+	ret = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt,
+				 vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+	return ret;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
@@ -834,6 +834,19 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 				spin_unlock(&mmlist_lock);
 			}
 			dec_mm_counter(mm, anon_rss);
+		} else if (!PageSwapBacked(page) && !migration) {
+			/*
+			 * A clean MADV_FREE page can simply be dropped.  If it
+			 * was written to since, restore the pte and keep it.
+			 */
+			if (PageDirty(page)) {
+				set_pte_at(mm, address, pte, pteval);
+				SetPageSwapBacked(page);
+				ret = SWAP_FAIL;
+				goto out_unmap;
+			}
+			dec_mm_counter(mm, anon_rss);
+			goto discard;
 		} else if (PAGE_MIGRATION) {
 			/*
 			 * Store the pfn of the page in a special migration
@@ -853,7 +866,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, file_rss);
 
-
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
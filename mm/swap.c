@@ -38,6 +38,7 @@ int page_cluster;
 
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -151,6 +152,64 @@ void  rotate_reclaimable_page(struct page *page)
 	}
 }
 
+/*
+ * Move MADV_FREE'd anonymous pages to the inactive file list.  Clearing
+ * PG_swapbacked tells reclaim that they can be dropped without swapping
+ * them out, as long as they have not been dirtied again.
+ */
+static void pagevec_lru_lazyfree(struct pagevec *pvec)
+{
+	int i;
+	int pgmoved = 0;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+		    !PageSwapCache(page) && !PageUnevictable(page)) {
+			int active = PageActive(page);
+
+			del_page_from_lru_list(zone, page,
+					       LRU_INACTIVE_ANON + active);
+			ClearPageActive(page);
+			ClearPageReferenced(page);
+			ClearPageSwapBacked(page);
+			add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+			pgmoved++;
+		}
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	count_vm_events(PGLAZYFREE, pgmoved);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/*
+ * The application told us it does not need the contents of this clean,
+ * exclusively mapped anonymous page any more (MADV_FREE).
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+	    !PageSwapCache(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_lazyfree(pvec);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 static void update_page_reclaim_stat(struct zone *zone, struct page *page,
 				     int file, int rotated)
 {
@@ -207,6 +266,7 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -290,6 +350,10 @@ static void drain_cpu_pagevecs(int cpu)
 		pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
+
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_lazyfree(pvec);
 }
 
 void lru_add_drain(void)
@@ -0,0 +1,452 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection: tell a thrashing working set apart from pages
+ * that were used once, from how soon evicted pages are faulted back in.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/module.h>
+#include <linux/radix-tree.h>
+
+/*
+ *		Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the
+ * inactive and the active list.  Freshly faulted pages start out at
+ * the head of the inactive list and page reclaim scans pages from the
+ * tail.  Pages that are accessed multiple times on the inactive list
+ * are promoted to the active list, to protect them from reclaim,
+ * whereas active pages are demoted to the inactive list when the
+ * active list grows too big.
+ *
+ *   fault ------------------------+
+ *                                 |
+ *              +--------------+   |            +-------------+
+ *   reclaim <- |   inactive   | <-+-- demotion |    active   | <--+
+ *              +--------------+                +-------------+    |
+ *                     |                                           |
+ *                     +-------------- promotion ------------------+
+ *
+ *
+ *		Access frequency and refault distance
+ *
+ * A workload is thrashing when its pages are frequently used but they
+ * are evicted from the inactive list every time before another access
+ * would have promoted them to the active list.
+ *
+ * In cases where the average access distance between thrashing pages
+ * is bigger than the size of memory there is nothing that can be
+ * done - the thrashing set could never fit into memory under any
+ * circumstance.
+ *
+ * However, the average access distance could be bigger than the
+ * inactive list, yet smaller than the size of memory.  In this case,
+ * the set could fit into memory if it weren't for the currently
+ * active pages - which may be used more, hopefully less frequently:
+ *
+ *      +-memory available to cache-+
+ *      |                           |
+ *      +-inactive------+-active----+
+ *  a b | c d e f g h i | J K L M N |
+ *      +---------------+-----------+
+ *
+ * It is prohibitively expensive to accurately track access frequency
+ * of pages.  But a reasonable approximation can be made to measure
+ * thrashing on the inactive list, after which refaulting pages can be
+ * activated optimistically to compete with the existing active pages.
+ *
+ * Approximating inactive page access frequency - Observations:
+ *
+ * 1. When a page is accessed for the first time, it is added to the
+ *    head of the inactive list, slides every existing inactive page
+ *    towards the tail by one slot, and pushes the current tail page
+ *    out of memory.
+ *
+ * 2. When a page is accessed for the second time, it is promoted to
+ *    the active list, shrinking the inactive list by one slot.  This
+ *    also slides all inactive pages that were faulted into the cache
+ *    more recently than the activated page towards the tail of the
+ *    inactive list.
+ *
+ * Thus:
+ *
+ * 1. The sum of evictions and activations between any two points in
+ *    time indicate the minimum number of inactive pages accessed in
+ *    between.
+ *
+ * 2. Moving one inactive page N page slots towards the tail of the
+ *    list requires at least N inactive page accesses.
+ *
+ * Combining these:
+ *
+ * 1. When a page is finally evicted from memory, the number of
+ *    inactive pages accessed while the page was in cache is at least
+ *    the number of page slots on the inactive list.
+ *
+ * 2. In addition, measuring the sum of evictions and activations (E)
+ *    at the time of a page's eviction, and comparing it to another
+ *    reading (R) at the time the page faults back into memory tells
+ *    the minimum number of accesses while the page was not cached.
+ *    This is called the refault distance.
+ *
+ * Because the first access of the page was the fault and the second
+ * access the refault, we combine the in-cache distance with the
+ * out-of-cache distance to get the complete minimum access distance
+ * of this page:
+ *
+ *      NR_inactive + (R - E)
+ *
+ * And knowing the minimum access distance of a page, we can easily
+ * tell if the page would be able to stay in cache assuming all page
+ * slots in the cache were available:
+ *
+ *   NR_inactive + (R - E) <= NR_inactive + NR_active
+ *
+ * which can be further simplified to
+ *
+ *   (R - E) <= NR_active
+ *
+ * Put into words, the refault distance (out-of-cache) can be seen as
+ * a deficit in inactive list space (in-cache).  If the inactive list
+ * had (R - E) more page slots, the page would not have been evicted
+ * in between accesses, but activated instead.  And on a full system,
+ * the only thing eating into inactive list space is active pages.
+ *
+ *
+ *		Activating refaulting pages
+ *
+ * All that is known about the active list is that the pages have been
+ * accessed more than once in the past.  This means that at any given
+ * time there is actually a good chance that pages on the active list
+ * are no longer in active use.
+ *
+ * So when a refault distance of (R - E) is observed and there are at
+ * least (R - E) active pages, the refaulting page is activated
+ * optimistically in the hope that (R - E) active pages are actually
+ * used less frequently than the refaulting page - or even not used at
+ * all anymore.
+ *
+ * If this is wrong and demotion kicks in, the pages which are truly
+ * used more frequently will be reactivated while the less frequently
+ * used ones will be evicted from memory.
+ *
+ * But if this is right, the stale pages will be pushed out of memory
+ * and the used pages get to stay in cache.
+ *
+ *
+ *		Implementation
+ *
+ * For each zone's file LRU lists, a counter for inactive evictions
+ * and activations is maintained (zone->inactive_age).
+ *
+ * On eviction, a snapshot of this counter (along with some bits to
+ * identify the zone) is stored in the now empty page cache radix tree
+ * slot of the evicted page.  This is called a shadow entry.
+ *
+ * On cache misses for which there are shadow entries, an eligible
+ * refault distance will immediately activate the refaulting page.
+ *
+ *
+ *		Shadow entry limits
+ *
+ * Shadow entries are kept for as long as the inode is.  A mapping that
+ * keeps losing pages to reclaim would fill up with them, so the number
+ * of shadow entries in the system is capped at the number of file pages
+ * on the LRU lists - no refault distance can be meaningful beyond that.
+ * Under memory pressure, a shrinker prunes the shadow entries above the
+ * cap, a mapping at a time, starting with the mapping that acquired its
+ * first shadow entry the longest time ago.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+
+	/*
+	 * The unsigned subtraction here gives an accurate distance
+	 * across inactive_age overflows in most cases.
+	 *
+	 * There is a special case: usually, shadow entries have a
+	 * short lifetime and are either refaulted or reclaimed along
+	 * with the inode before they get too old.  But it is not
+	 * impossible for the inactive_age to lap a shadow entry in
+	 * the field, which can then result in a false small
+	 * refault distance, leading to a false activation should this
+	 * old entry actually refault again.  However, earlier kernels
+	 * used to deactivate unconditionally with *every* reclaim
+	 * invocation for the longest time, so the occasional
+	 * inappropriate activation leading to pressure on the active
+	 * list is not a problem.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected, or
+ * NULL if @mapping does not track shadow entries.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	/* Only inode mappings are on the shadow shrinker's list */
+	if (!mapping->host || mapping != &mapping->host->i_data)
+		return NULL;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Mappings holding shadow entries, oldest first.  A mapping is added
+ * with its tree_lock held and only taken off again with both its
+ * tree_lock and shadow_lock held: so either lock keeps it on the list.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_lock);
+static atomic_long_t nr_shadows = ATOMIC_LONG_INIT(0);
+
+/* Called with mapping->tree_lock held, after storing a shadow entry */
+void workingset_shadow_added(struct address_space *mapping)
+{
+	mapping->nrshadows++;
+	atomic_long_inc(&nr_shadows);
+	if (list_empty(&mapping->shadow_list)) {
+		spin_lock(&shadow_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_lock);
+	}
+}
+
+/* Called with mapping->tree_lock held, after dropping a shadow entry */
+void workingset_shadow_removed(struct address_space *mapping)
+{
+	mapping->nrshadows--;
+	atomic_long_dec(&nr_shadows);
+}
+
+#define SHADOW_BATCH	16
+
+/*
+ * Delete the shadow entries among the next SHADOW_BATCH slots from
+ * *@start on, up to @end, and advance *@start past them.  Called with
+ * mapping->tree_lock held; returns the number of slots looked at,
+ * which is 0 once there is nothing left to do.
+ */
+static unsigned int clear_shadow_batch(struct address_space *mapping,
+				       pgoff_t *start, pgoff_t end)
+{
+	void **slots[SHADOW_BATCH];
+	unsigned long indices[SHADOW_BATCH];
+	unsigned int nr, i;
+
+	if (!mapping->nrshadows || *start > end)
+		return 0;
+
+	nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots, indices,
+					 *start, SHADOW_BATCH);
+	for (i = 0; i < nr; i++) {
+		void *entry;
+
+		if (indices[i] > end)
+			break;
+		/*
+		 * Look the entry up afresh: deleting the one before may
+		 * have shrunk the tree and moved it to another slot.
+		 */
+		entry = radix_tree_lookup(&mapping->page_tree, indices[i]);
+		if (!radix_tree_exceptional_entry(entry))
+			continue;
+		radix_tree_delete(&mapping->page_tree, indices[i]);
+		workingset_shadow_removed(mapping);
+	}
+	if (!nr || i < nr)
+		return 0;
+	*start = indices[nr - 1] + 1;
+	if (!*start)
+		return 0;
+	return nr;
+}
+
+/**
+ * workingset_clear_shadows - delete shadow entries from a mapping
+ * @mapping: the address_space
+ * @start: first page index
+ * @end: last page index (inclusive)
+ *
+ * Used when truncating, where evicted pages must not be found to
+ * refault later.  May sleep.
+ */
+void workingset_clear_shadows(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end)
+{
+	unsigned int nr;
+
+	do {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = clear_shadow_batch(mapping, &start, end);
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+	} while (nr);
+}
+
+/**
+ * workingset_forget_mapping - prepare a mapping for being freed
+ * @mapping: the address_space of an inode about to be destroyed
+ *
+ * Deletes the mapping's remaining shadow entries and takes it off the
+ * shadow shrinker's list.
+ */
+void workingset_forget_mapping(struct address_space *mapping)
+{
+	if (mapping->nrshadows)
+		workingset_clear_shadows(mapping, 0, ~0UL);
+
+	/* Without pages, nothing can put the mapping back on the list */
+	if (!list_empty(&mapping->shadow_list)) {
+		spin_lock_irq(&mapping->tree_lock);
+		spin_lock(&shadow_lock);
+		list_del_init(&mapping->shadow_list);
+		spin_unlock(&shadow_lock);
+		spin_unlock_irq(&mapping->tree_lock);
+	}
+}
+
+static unsigned long shadows_over_limit(void)
+{
+	unsigned long limit, shadows;
+
+	limit = global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_FILE);
+	shadows = atomic_long_read(&nr_shadows);
+	return shadows > limit ? shadows - limit : 0;
+}
+
+#define SHADOW_SHRINK_TRIES	128
+
+static int shrink_shadows(int nr_to_scan, gfp_t gfp_mask)
+{
+	int tries = 0;
+
+	if (!nr_to_scan)
+		goto out;
+
+	/*
+	 * The lock order is tree_lock -> shadow_lock, hence the trylock.
+	 * Give up after SHADOW_SHRINK_TRIES mappings, whether they were
+	 * busy or had no shadow entries left.
+	 */
+	spin_lock_irq(&shadow_lock);
+	while (nr_to_scan > 0 && !list_empty(&shadow_mappings) &&
+	       tries++ < SHADOW_SHRINK_TRIES) {
+		struct address_space *mapping;
+		unsigned long before;
+		unsigned int scanned = 0;
+		pgoff_t index = 0;
+
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		list_move_tail(&mapping->shadow_list, &shadow_mappings);
+		if (!spin_trylock(&mapping->tree_lock))
+			continue;
+
+		before = mapping->nrshadows;
+		while (scanned < nr_to_scan * 4) {
+			unsigned int nr = clear_shadow_batch(mapping, &index,
+							     ~0UL);
+			if (!nr || before - mapping->nrshadows >= nr_to_scan)
+				break;
+			scanned += nr;
+		}
+		nr_to_scan -= before - mapping->nrshadows;
+		if (!mapping->nrshadows)
+			list_del_init(&mapping->shadow_list);
+		spin_unlock(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&shadow_lock);
+out:
+	return min_t(unsigned long, shadows_over_limit(), INT_MAX);
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
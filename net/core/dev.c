@@ -5174,11 +5174,16 @@ void free_netdev(struct net_device *dev)
  *
  *	Wait for packets currently being received to be done.
  *	Does not block later packets from starting.
+ *	Under the RTNL (device and namespace teardown), the grace period
+ *	is expedited so that the lock is not held for milliseconds.
  */
 void synchronize_net(void)
 {
 	might_sleep();
-	synchronize_rcu();
+	if (rtnl_is_locked())
+		synchronize_rcu_expedited();
+	else
+		synchronize_rcu();
 }
 
 /**
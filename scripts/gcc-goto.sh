@@ -0,0 +1,4 @@
+#!/bin/sh
+# Test for gcc 'asm goto' support, used by jump labels.
+
+echo "int main(void) { entry: asm goto (\"\"::::entry); return 0; }" | $@ -x c - -c -o /dev/null >/dev/null 2>&1 && echo "y"
@@ -0,0 +1,59 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <math.h>
+
+extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
+extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix);
+extern int bench_mem_memset(int argc, const char **argv, const char *prefix);
+extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
+extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix);
+extern int bench_sync_membarrier(int argc, const char **argv, const char *prefix);
+
+#define BENCH_FORMAT_DEFAULT_STR	"default"
+#define BENCH_FORMAT_DEFAULT		0
+#define BENCH_FORMAT_SIMPLE_STR		"simple"
+#define BENCH_FORMAT_SIMPLE		1
+
+#define BENCH_FORMAT_UNKNOWN		-1
+
+extern int bench_format;
+
+/*
+ * Running statistics over the iterations of a benchmark, so that
+ * results from different kernels can be compared with their noise.
+ */
+struct bench_stats {
+	double		n, mean, M2;
+};
+
+static inline void bench_update_stats(struct bench_stats *stats, double val)
+{
+	double delta;
+
+	stats->n++;
+	delta = val - stats->mean;
+	stats->mean += delta / stats->n;
+	stats->M2 += delta * (val - stats->mean);
+}
+
+static inline double bench_avg_stats(struct bench_stats *stats)
+{
+	return stats->mean;
+}
+
+/* Relative standard deviation of the mean, in percent. */
+static inline double bench_rel_stddev(struct bench_stats *stats)
+{
+	double variance;
+
+	if (stats->n < 2 || !stats->mean)
+		return 0.0;
+
+	variance = stats->M2 / (stats->n - 1);
+	return 100.0 * sqrt(variance / stats->n) / stats->mean;
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * epoll-wait.c
+ *
+ * wait: Benchmark for epoll_wait() event delivery over sockets
+ *
+ * A writer thread sends single bytes round-robin over a set of AF_UNIX
+ * socketpairs, while the main thread collects them through one epoll
+ * instance watching the other ends.  Each byte is one wakeup on the
+ * socket's wait queue, one epoll callback and, eventually, one event
+ * reported by epoll_wait(), so the result covers the whole socket to
+ * epoll path.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+static unsigned int nfds = 64;
+static unsigned int loops = 1000000;
+static int edge_triggered;
+
+static int (*socks)[2];
+
+static const struct option options[] = {
+	OPT_INTEGER('n', "nfds", &nfds,
+		    "Specify number of socket pairs to watch"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of bytes (events) to send"),
+	OPT_BOOLEAN('E', "edge", &edge_triggered,
+		    "Use edge-triggered instead of level-triggered events"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static void *writerfn(void *arg __used)
+{
+	unsigned int i;
+	char c = 0;
+
+	for (i = 0; i < loops; i++) {
+		if (write(socks[i % nfds][1], &c, 1) != 1)
+			die("writer: write: %s", strerror(errno));
+	}
+
+	return NULL;
+}
+
+/* Drain one socket, return the number of bytes read */
+static unsigned int consume(int fd)
+{
+	char buf[256];
+	unsigned int total = 0;
+	ssize_t ret;
+
+	do {
+		ret = read(fd, buf, sizeof(buf));
+		if (ret < 0) {
+			if (errno == EAGAIN)
+				break;
+			die("waiter: read: %s", strerror(errno));
+		}
+		total += ret;
+		/* Level-triggered: whatever is left is reported again */
+	} while (edge_triggered && ret == sizeof(buf));
+
+	return total;
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct epoll_event ev, *events;
+	struct timeval start, stop, diff;
+	unsigned long long nr_waits = 0, result_usec;
+	unsigned int i, received = 0;
+	pthread_t writer;
+	int epfd;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nfds || !loops) {
+		fprintf(stderr, "nfds and loop must be positive\n");
+		return 1;
+	}
+
+	socks = calloc(nfds, sizeof(*socks));
+	events = calloc(nfds, sizeof(*events));
+	if (!socks || !events)
+		die("calloc: %s", strerror(errno));
+
+	epfd = epoll_create(nfds);
+	if (epfd < 0)
+		die("epoll_create: %s", strerror(errno));
+
+	for (i = 0; i < nfds; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks[i]))
+			die("socketpair: %s", strerror(errno));
+
+		if (edge_triggered &&
+		    fcntl(socks[i][0], F_SETFL, O_NONBLOCK) < 0)
+			die("fcntl: %s", strerror(errno));
+
+		ev.events = EPOLLIN | (edge_triggered ? EPOLLET : 0);
+		ev.data.fd = socks[i][0];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, socks[i][0], &ev))
+			die("epoll_ctl: %s", strerror(errno));
+	}
+
+	gettimeofday(&start, NULL);
+
+	if (pthread_create(&writer, NULL, writerfn, NULL))
+		die("pthread_create: %s", strerror(errno));
+
+	while (received < loops) {
+		int n = epoll_wait(epfd, events, nfds, -1);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait: %s", strerror(errno));
+		}
+		nr_waits++;
+
+		for (i = 0; i < (unsigned int)n; i++)
+			received += consume(events[i].data.fd);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	pthread_join(writer, NULL);
+
+	for (i = 0; i < nfds; i++) {
+		close(socks[i][0]);
+		close(socks[i][1]);
+	}
+	close(epfd);
+	free(events);
+	free(socks);
+
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d bytes over %d socket pairs, %s-triggered\n\n",
+		       loops, nfds, edge_triggered ? "edge" : "level");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       (unsigned long)diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / 1000));
+		printf(" %14lf usecs/event\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14lf bytes/epoll_wait\n",
+		       (double)loops / (double)nr_waits);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n", (unsigned long)diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / 1000));
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * futex-requeue.c
+ *
+ * requeue: Block a number of threads on one futex and measure how long
+ * it takes to requeue all of them onto a second futex with
+ * FUTEX_CMP_REQUEUE, nrequeue at a time.  No task is woken while being
+ * requeued, so only the requeue path itself is timed.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+static u_int32_t futex1, futex2;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+/*
+ * How many tasks to requeue at a time.
+ * Default to 1 in order to make the kernel work more.
+ */
+static unsigned int nrequeue = 1;
+static unsigned int nthreads;
+static unsigned int repeat = 10;
+static int fshared;
+static int futex_flag;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify amount of threads (default: online cpus)"),
+	OPT_INTEGER('q', "nrequeue", &nrequeue,
+		    "Specify amount of threads to requeue at once"),
+	OPT_INTEGER('r', "repeat", &repeat,
+		    "Specify amount of times to repeat the run"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* Block on futex1, get requeued to futex2, and woken from there */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) && errno == EINTR)
+		;
+
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+
+	/* create and block all threads */
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create: %s", strerror(errno));
+	}
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct bench_stats requeuetime_stats = { 0, 0, 0 };
+	struct timeval start, end, runtime;
+	pthread_t *worker;
+	unsigned int i, j;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_requeue_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nrequeue)
+		nrequeue = 1;
+	if (nrequeue > nthreads)
+		nrequeue = nthreads;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc: %s", strerror(errno));
+
+	futex_flag = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Run summary [PID %d]: Requeuing %d threads "
+		       "(from [%s] %p to %p), %d at a time.\n\n",
+		       getpid(), nthreads, fshared ? "shared" : "private",
+		       &futex1, &futex2, nrequeue);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	for (j = 0; j < repeat; j++) {
+		unsigned int nrequeued = 0;
+		double usecs;
+		int ret;
+
+		/* create, launch & block all threads */
+		pthread_mutex_lock(&thread_lock);
+		block_threads(worker);
+		while (threads_starting)
+			pthread_cond_wait(&thread_parent, &thread_lock);
+		pthread_cond_broadcast(&thread_worker);
+		pthread_mutex_unlock(&thread_lock);
+
+		/* make sure all threads are already blocked */
+		usleep(100000);
+
+		/* Ok, all threads are patiently blocked, start requeueing */
+		gettimeofday(&start, NULL);
+		while (nrequeued < nthreads) {
+			/*
+			 * Do not wakeup any tasks blocked on futex1, allowing
+			 * us to really measure the requeue path.
+			 */
+			ret = futex_cmp_requeue(&futex1, 0, &futex2, 0,
+						nrequeue, futex_flag);
+			if (ret < 0)
+				die("futex_cmp_requeue: %s", strerror(errno));
+			nrequeued += ret;
+		}
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &runtime);
+
+		usecs = runtime.tv_sec * 1000000.0 + runtime.tv_usec;
+		bench_update_stats(&requeuetime_stats, usecs);
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf("[Run %d]: Requeued %d of %d threads in "
+			       "%.4f ms\n", j + 1, nrequeued, nthreads,
+			       usecs / 1000.0);
+
+		/* everybody should be blocked on futex2, wake'em up */
+		nrequeued = 0;
+		while (nrequeued < nthreads) {
+			ret = futex_wake(&futex2, nthreads, futex_flag);
+			if (ret < 0)
+				die("futex_wake: %s", strerror(errno));
+			nrequeued += ret;
+		}
+
+		for (i = 0; i < nthreads; i++) {
+			if (pthread_join(worker[i], NULL))
+				die("pthread_join: %s", strerror(errno));
+		}
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+	free(worker);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\nRequeued %d of %d threads in %.4f ms "
+		       "( +- %.2f%% )\n", nthreads, nthreads,
+		       bench_avg_stats(&requeuetime_stats) / 1000.0,
+		       bench_rel_stddev(&requeuetime_stats));
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", bench_avg_stats(&requeuetime_stats) / 1000.0);
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
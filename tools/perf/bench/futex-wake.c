@@ -0,0 +1,181 @@
+/*
+ * futex-wake.c
+ *
+ * wake: Block a number of threads on a futex and measure how long it
+ * takes to wake all of them up again, nwakes at a time.  Only the
+ * FUTEX_WAKE calls are timed; thread creation and blocking are not.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+/* all threads will block on the same futex */
+static u_int32_t futex1;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int repeat = 10;
+static int fshared;
+static int futex_flag;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify amount of threads (default: online cpus)"),
+	OPT_INTEGER('w', "nwakes", &nwakes,
+		    "Specify amount of threads to wake at once"),
+	OPT_INTEGER('r', "repeat", &repeat,
+		    "Specify amount of times to repeat the run"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* Only a FUTEX_WAKE may end the wait, retry on signals */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) && errno == EINTR)
+		;
+
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+
+	/* create and block all threads */
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create: %s", strerror(errno));
+	}
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct bench_stats waketime_stats = { 0, 0, 0 };
+	struct timeval start, end, runtime;
+	pthread_t *worker;
+	unsigned int i, j;
+
+	argc = parse_options(argc, argv, options, bench_futex_wake_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_wake_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes)
+		nwakes = 1;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc: %s", strerror(errno));
+
+	futex_flag = fshared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Run summary [PID %d]: blocking on %d threads "
+		       "(at [%s] futex %p), waking up %d at a time.\n\n",
+		       getpid(), nthreads, fshared ? "shared" : "private",
+		       &futex1, nwakes);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	for (j = 0; j < repeat; j++) {
+		unsigned int nwoken = 0;
+		double usecs;
+
+		/* create, launch & block all threads */
+		pthread_mutex_lock(&thread_lock);
+		block_threads(worker);
+		while (threads_starting)
+			pthread_cond_wait(&thread_parent, &thread_lock);
+		pthread_cond_broadcast(&thread_worker);
+		pthread_mutex_unlock(&thread_lock);
+
+		/* make sure all threads are already blocked */
+		usleep(100000);
+
+		/* Ok, all threads are patiently blocked, start waking folks up */
+		gettimeofday(&start, NULL);
+		while (nwoken != nthreads) {
+			int ret = futex_wake(&futex1, nwakes, futex_flag);
+
+			if (ret < 0)
+				die("futex_wake: %s", strerror(errno));
+			nwoken += ret;
+		}
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &runtime);
+
+		usecs = runtime.tv_sec * 1000000.0 + runtime.tv_usec;
+		bench_update_stats(&waketime_stats, usecs);
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf("[Run %d]: Woke up %d of %d threads in "
+			       "%.4f ms\n", j + 1, nwoken, nthreads,
+			       usecs / 1000.0);
+
+		for (i = 0; i < nthreads; i++) {
+			if (pthread_join(worker[i], NULL))
+				die("pthread_join: %s", strerror(errno));
+		}
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+	free(worker);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\nWoke up %d of %d threads in %.4f ms "
+		       "( +- %.2f%% )\n", nthreads, nthreads,
+		       bench_avg_stats(&waketime_stats) / 1000.0,
+		       bench_rel_stddev(&waketime_stats));
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", bench_avg_stats(&waketime_stats) / 1000.0);
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
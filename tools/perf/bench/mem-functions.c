@@ -0,0 +1,257 @@
+/*
+ * mem-functions.c
+ *
+ * memcpy/memset: Simple memory throughput tests
+ *
+ * Both suites share one driver: allocate the buffers, optionally touch
+ * them once so page faults are not part of the measurement, then time
+ * (or count the cycles of) a number of calls to the function.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../util/string.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#define K 1024
+
+static const char	*length_str	= "1MB";
+static int		iterations	= 1;
+static int		use_clock;
+static int		no_prefault;
+static int		clock_fd;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "1MB",
+		    "Specify length of memory to operate on. "
+		    "available units: B, KB, MB, GB"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "repeat the operation this many times"),
+	OPT_BOOLEAN('c', "clock", &use_clock,
+		    "Use CPU clock for measuring"),
+	OPT_BOOLEAN('n', "no-prefault", &no_prefault,
+		    "Include page faults of a fresh buffer in the result"),
+	OPT_END()
+};
+
+struct mem_function {
+	const char * const *usage;
+	/* Operate on len bytes; src is NULL for functions that only write */
+	void (*fn)(void *dst, const void *src, size_t len);
+	int needs_src;
+};
+
+static struct perf_counter_attr clock_attr = {
+	.type		= PERF_TYPE_HARDWARE,
+	.config		= PERF_COUNT_HW_CPU_CYCLES
+};
+
+static void init_clock(void)
+{
+	clock_fd = sys_perf_counter_open(&clock_attr, getpid(), -1, -1, 0);
+
+	if (clock_fd < 0 && errno == ENOSYS)
+		die("No CONFIG_PERF_COUNTERS=y kernel support configured?");
+	else if (clock_fd < 0)
+		die("cannot open cycle counter: %s", strerror(errno));
+}
+
+static u64 get_clock(void)
+{
+	int ret;
+	u64 clk;
+
+	ret = read(clock_fd, &clk, sizeof(u64));
+	if (ret != sizeof(u64))
+		die("cannot read cycle counter");
+
+	return clk;
+}
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+static void fn_memcpy(void *dst, const void *src, size_t len)
+{
+	memcpy(dst, src, len);
+}
+
+static void fn_memset(void *dst, const void *src __used, size_t len)
+{
+	memset(dst, 0, len);
+}
+
+static void alloc_mem(void **dst, void **src, size_t length, int needs_src)
+{
+	*dst = calloc(1, length);
+	if (!*dst)
+		die("memory allocation failed - maybe length is too large?");
+
+	*src = NULL;
+	if (!needs_src)
+		return;
+
+	*src = calloc(1, length);
+	if (!*src)
+		die("memory allocation failed - maybe length is too large?");
+}
+
+static void print_bytes_per_sec(double result, const char *unit_hint)
+{
+	if (bench_format == BENCH_FORMAT_SIMPLE) {
+		printf("%lf\n", result);
+		return;
+	}
+
+	if (result > (double)K * K * K)
+		printf(" %14lf GB/Sec", result / ((double)K * K * K));
+	else if (result > (double)K * K)
+		printf(" %14lf MB/Sec", result / ((double)K * K));
+	else if (result > (double)K)
+		printf(" %14lf KB/Sec", result / ((double)K));
+	else
+		printf(" %14lf B/Sec", result);
+	printf("%s\n", unit_hint);
+}
+
+static int bench_mem_common(int argc, const char **argv,
+			    struct mem_function *func)
+{
+	struct bench_stats stats = { 0, 0, 0 };
+	struct timeval tv_start, tv_end, tv_diff;
+	void *src = NULL, *dst = NULL;
+	size_t length;
+	s64 len;
+	u64 clock_start, clock_end;
+	double result;
+	int i;
+
+	argc = parse_options(argc, argv, options, func->usage, 0);
+
+	if (use_clock)
+		init_clock();
+
+	len = perf_atoll(length_str);
+	if (len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+	length = (size_t)len;
+
+	if (iterations < 1) {
+		fprintf(stderr, "Invalid iterations:%d\n", iterations);
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Operating %s bytes, %d time%s ...\n\n",
+		       length_str, iterations, iterations > 1 ? "s" : "");
+
+	for (i = 0; i < iterations; i++) {
+		alloc_mem(&dst, &src, length, func->needs_src);
+
+		/* Touch every page once so that page faults are excluded */
+		if (!no_prefault)
+			func->fn(dst, src, length);
+
+		if (use_clock) {
+			clock_start = get_clock();
+			func->fn(dst, src, length);
+			clock_end = get_clock();
+			result = (double)(clock_end - clock_start);
+		} else {
+			gettimeofday(&tv_start, NULL);
+			func->fn(dst, src, length);
+			gettimeofday(&tv_end, NULL);
+			timersub(&tv_end, &tv_start, &tv_diff);
+			result = timeval2double(&tv_diff);
+		}
+		bench_update_stats(&stats, result);
+
+		free(src);
+		free(dst);
+	}
+
+	result = bench_avg_stats(&stats);
+
+	if (use_clock) {
+		switch (bench_format) {
+		case BENCH_FORMAT_DEFAULT:
+			printf(" %14lf Clock/Byte", result / (double)length);
+			if (iterations > 1)
+				printf(" ( +- %5.2f%% )",
+				       bench_rel_stddev(&stats));
+			printf("\n");
+			break;
+		case BENCH_FORMAT_SIMPLE:
+			printf("%lf\n", result / (double)length);
+			break;
+		default:
+			/* reaching here is something disaster */
+			fprintf(stderr, "Unknown format:%d\n", bench_format);
+			exit(1);
+			break;
+		}
+		close(clock_fd);
+		return 0;
+	}
+
+	if (result == 0.0) {
+		fprintf(stderr, "Too short a run to measure, "
+			"try a larger --length\n");
+		return 1;
+	}
+
+	print_bytes_per_sec((double)length / result,
+			    no_prefault ? " (with page faults)" : "");
+	if (bench_format == BENCH_FORMAT_DEFAULT && iterations > 1)
+		printf(" %14s ( +- %5.2f%% )\n", "",
+		       bench_rel_stddev(&stats));
+
+	return 0;
+}
+
+static const char * const bench_mem_memcpy_usage[] = {
+	"perf bench mem memcpy <options>",
+	NULL
+};
+
+static const char * const bench_mem_memset_usage[] = {
+	"perf bench mem memset <options>",
+	NULL
+};
+
+static struct mem_function memcpy_function = {
+	.usage		= bench_mem_memcpy_usage,
+	.fn		= fn_memcpy,
+	.needs_src	= 1,
+};
+
+static struct mem_function memset_function = {
+	.usage		= bench_mem_memset_usage,
+	.fn		= fn_memset,
+	.needs_src	= 0,
+};
+
+int bench_mem_memcpy(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	return bench_mem_common(argc, argv, &memcpy_function);
+}
+
+int bench_mem_memset(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	return bench_mem_common(argc, argv, &memset_function);
+}
@@ -0,0 +1,122 @@
+/*
+ * sched-pipe.c
+ *
+ * pipe: Benchmark for pipe()
+ *
+ * Two tasks bounce an integer back and forth over a pair of pipes, so
+ * every operation is one wakeup and one context switch.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 1000000
+static int loops = LOOPS_DEFAULT;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops"),
+	OPT_END()
+};
+
+static const char * const bench_sched_pipe_usage[] = {
+	"perf bench sched pipe <options>",
+	NULL
+};
+
+int bench_sched_pipe(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	int pipe_1[2], pipe_2[2];
+	int m = 0, i;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	int wait_stat;
+	pid_t pid, retpid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_pipe_usage, 0);
+
+	if (pipe(pipe_1) || pipe(pipe_2))
+		die("pipe() failed: %s", strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		die("fork() failed: %s", strerror(errno));
+
+	gettimeofday(&start, NULL);
+
+	if (!pid) {
+		for (i = 0; i < loops; i++) {
+			if (read(pipe_1[0], &m, sizeof(int)) != sizeof(int) ||
+			    write(pipe_2[1], &m, sizeof(int)) != sizeof(int))
+				exit(1);
+		}
+		exit(0);
+	}
+
+	for (i = 0; i < loops; i++) {
+		if (write(pipe_1[1], &m, sizeof(int)) != sizeof(int) ||
+		    read(pipe_2[0], &m, sizeof(int)) != sizeof(int))
+			die("pipe ping-pong failed: %s", strerror(errno));
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	retpid = waitpid(pid, &wait_stat, 0);
+	if (retpid != pid || !WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+		die("pipe child did not exit cleanly");
+
+	close(pipe_1[0]);
+	close(pipe_1[1]);
+	close(pipe_2[0]);
+	close(pipe_2[1]);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d pipe operations between two tasks\n\n",
+			loops);
+
+		result_usec = diff.tv_sec * 1000000ULL;
+		result_usec += diff.tv_usec;
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       (unsigned long)diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / 1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14d ops/sec\n",
+		       (int)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       (unsigned long)diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * sync-membarrier.c
+ *
+ * membarrier: Reader throughput with and without read-side fences
+ *
+ * Reader threads run a minimal userspace RCU style read-side section:
+ * make their sequence count odd, load a shared word and make the count
+ * even again.  The main thread acts as the updater: it bumps the shared
+ * word, issues a barrier and waits until every reader has been seen
+ * outside the section it was in, i.e. a grace period.
+ *
+ * The run is done twice.  First the readers order their accesses with
+ * full memory barriers, pairing with an ordinary barrier in the updater.
+ * Then the readers only use compiler barriers and the updater calls
+ * membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) instead, moving the cost
+ * of ordering from the hot read side to the rare update side.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include "../../../include/linux/membarrier.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int runtime = 2;
+static unsigned int period = 1000;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify amount of reader threads (default: online cpus - 1)"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime of each run in seconds"),
+	OPT_INTEGER('p', "period", &period,
+		    "Specify usecs to sleep between two updates"),
+	OPT_END()
+};
+
+static const char * const bench_sync_membarrier_usage[] = {
+	"perf bench sync membarrier <options>",
+	NULL
+};
+
+#define CACHELINE_SIZE	64
+
+struct reader {
+	volatile unsigned long	seq;	/* odd while inside a section */
+	unsigned long		sum;
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+static struct reader *readers;
+static volatile unsigned long shared_word;
+static volatile int start, done;
+static int use_membarrier;
+
+#define compiler_barrier()	asm volatile("" ::: "memory")
+#define full_barrier()		__sync_synchronize()
+
+static int membarrier(int cmd, int flags)
+{
+#ifdef __NR_membarrier
+	return syscall(__NR_membarrier, cmd, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void *readerfn(void *arg)
+{
+	struct reader *r = arg;
+	unsigned long sum = 0;
+
+	while (!start)
+		cpu_relax();
+
+	if (use_membarrier) {
+		while (!done) {
+			r->seq++;
+			compiler_barrier();
+			sum += shared_word;
+			compiler_barrier();
+			r->seq++;
+		}
+	} else {
+		while (!done) {
+			r->seq++;
+			full_barrier();
+			sum += shared_word;
+			full_barrier();
+			r->seq++;
+		}
+	}
+
+	r->sum = sum;
+	return NULL;
+}
+
+static void update(void)
+{
+	unsigned int i;
+
+	shared_word++;
+	if (use_membarrier) {
+		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0))
+			die("membarrier: %s", strerror(errno));
+	} else
+		full_barrier();
+
+	/* wait for the readers that may still see the old value */
+	for (i = 0; i < nthreads; i++) {
+		unsigned long seq = readers[i].seq;
+
+		if (!(seq & 1))
+			continue;
+		while (readers[i].seq == seq)
+			cpu_relax();
+	}
+}
+
+struct run_result {
+	double	reads_per_sec;
+	double	updates_per_sec;
+};
+
+static void do_run(struct run_result *res)
+{
+	struct timeval now, end, diff;
+	unsigned long long nr_reads = 0, nr_updates = 0;
+	pthread_t *worker;
+	unsigned int i;
+	double secs;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc: %s", strerror(errno));
+	memset(readers, 0, nthreads * sizeof(*readers));
+	start = done = 0;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&worker[i], NULL, readerfn, &readers[i]))
+			die("pthread_create: %s", strerror(errno));
+	}
+
+	gettimeofday(&now, NULL);
+	end = now;
+	end.tv_sec += runtime;
+	start = 1;
+
+	while (timercmp(&now, &end, <)) {
+		update();
+		nr_updates++;
+		if (period)
+			usleep(period);
+		gettimeofday(&now, NULL);
+	}
+	done = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i], NULL))
+			die("pthread_join: %s", strerror(errno));
+		nr_reads += readers[i].seq / 2;
+	}
+	free(worker);
+
+	timersub(&now, &end, &diff);
+	secs = runtime + diff.tv_sec + diff.tv_usec / 1000000.0;
+	res->reads_per_sec = nr_reads / secs;
+	res->updates_per_sec = nr_updates / secs;
+}
+
+int bench_sync_membarrier(int argc, const char **argv,
+			  const char *prefix __used)
+{
+	struct run_result fence, mbsys;
+	int supported;
+
+	argc = parse_options(argc, argv, options, bench_sync_membarrier_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sync_membarrier_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+		if (!nthreads)
+			nthreads = 1;
+	}
+	if (!runtime)
+		runtime = 1;
+
+	readers = calloc(nthreads, sizeof(*readers));
+	if (!readers)
+		die("calloc: %s", strerror(errno));
+
+	supported = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	supported = supported > 0 &&
+		    (supported & MEMBARRIER_CMD_PRIVATE_EXPEDITED);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d reader threads, one update every %d usecs, "
+		       "%d secs per run\n\n", nthreads, period, runtime);
+
+	use_membarrier = 0;
+	do_run(&fence);
+
+	if (supported) {
+		use_membarrier = 1;
+		do_run(&mbsys);
+	}
+
+	free(readers);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14s: %14.0lf reads/sec %10.0lf updates/sec\n",
+		       "fences", fence.reads_per_sec, fence.updates_per_sec);
+		if (!supported) {
+			printf(" %14s: not supported by this kernel\n",
+			       "membarrier");
+			break;
+		}
+		printf(" %14s: %14.0lf reads/sec %10.0lf updates/sec\n",
+		       "membarrier", mbsys.reads_per_sec, mbsys.updates_per_sec);
+		printf("\n %14.2lfx reader speedup\n",
+		       mbsys.reads_per_sec / fence.reads_per_sec);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.2lf\n", supported ?
+		       mbsys.reads_per_sec / fence.reads_per_sec : 0.0);
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
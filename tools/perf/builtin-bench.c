@@ -0,0 +1,274 @@
+/*
+ * builtin-bench.c
+ *
+ * Builtin bench command: run in-tree benchmarks of kernel subsystems
+ *
+ * Each subsystem groups a few suites.  "perf bench <subsys> all" runs
+ * every suite of a subsystem with its default parameters, and
+ * "perf bench all" runs all of them, so that a complete set of numbers
+ * can be collected on one kernel and compared against another.
+ *
+ * Available subsystem list:
+ *  sched ... scheduler and IPC mechanism
+ *  mem   ... memory access performance
+ *  futex ... futex wakeup and requeue paths
+ *  epoll ... epoll and socket event delivery
+ *  sync  ... memory barriers between threads
+ */
+
+#include "perf.h"
+#include "util/util.h"
+#include "util/parse-options.h"
+#include "builtin.h"
+#include "bench/bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct bench_suite {
+	const char *name;
+	const char *summary;
+	int (*fn)(int, const char **, const char *);
+};
+
+static struct bench_suite sched_suites[] = {
+	{ "messaging",
+	  "Benchmark for scheduler and IPC mechanisms",
+	  bench_sched_messaging },
+	{ "pipe",
+	  "Flood of communication over pipe() between two processes",
+	  bench_sched_pipe },
+	{ NULL, NULL, NULL }
+};
+
+static struct bench_suite mem_suites[] = {
+	{ "memcpy",
+	  "Simple memory copy throughput",
+	  bench_mem_memcpy },
+	{ "memset",
+	  "Simple memory set throughput",
+	  bench_mem_memset },
+	{ NULL, NULL, NULL }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "wake",
+	  "Wake threads blocked on a futex, a few at a time",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Requeue threads blocked on one futex to another",
+	  bench_futex_requeue },
+	{ NULL, NULL, NULL }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Event delivery through epoll_wait() over socket pairs",
+	  bench_epoll_wait },
+	{ NULL, NULL, NULL }
+};
+
+static struct bench_suite sync_suites[] = {
+	{ "membarrier",
+	  "Reader throughput with fences vs. membarrier()",
+	  bench_sync_membarrier },
+	{ NULL, NULL, NULL }
+};
+
+struct bench_subsys {
+	const char *name;
+	const char *summary;
+	struct bench_suite *suites;
+};
+
+static struct bench_subsys subsystems[] = {
+	{ "sched",
+	  "scheduler and IPC mechanism",
+	  sched_suites },
+	{ "mem",
+	  "memory access performance",
+	  mem_suites },
+	{ "futex",
+	  "futex wakeup and requeue paths",
+	  futex_suites },
+	{ "epoll",
+	  "epoll and socket event delivery",
+	  epoll_suites },
+	{ "sync",
+	  "memory barriers between threads",
+	  sync_suites },
+	{ NULL, NULL, NULL }
+};
+
+static void dump_suites(int subsys_index)
+{
+	struct bench_subsys *subsys = &subsystems[subsys_index];
+	int i;
+
+	printf("List of available suites for %s...\n\n", subsys->name);
+
+	for (i = 0; subsys->suites[i].name; i++)
+		printf("\t%s: %s\n",
+		       subsys->suites[i].name, subsys->suites[i].summary);
+	printf("\t%s: %s\n", "all", "Run all suites of this subsystem");
+
+	printf("\n");
+}
+
+static const char *bench_format_str;
+int bench_format = BENCH_FORMAT_DEFAULT;
+
+static const struct option bench_options[] = {
+	OPT_STRING('f', "format", &bench_format_str, "default",
+		    "Specify format style: default or simple"),
+	OPT_END()
+};
+
+static const char * const bench_usage[] = {
+	"perf bench [<common options>] <subsystem> <suite> [<options>]",
+	NULL
+};
+
+static void print_usage(void)
+{
+	int i;
+
+	printf("Usage: \n");
+	for (i = 0; bench_usage[i]; i++)
+		printf("\t%s\n", bench_usage[i]);
+	printf("\n");
+
+	printf("List of available subsystems...\n\n");
+
+	for (i = 0; subsystems[i].name; i++)
+		printf("\t%s: %s\n",
+		       subsystems[i].name, subsystems[i].summary);
+	printf("\t%s: %s\n", "all", "Run all benchmarks");
+	printf("\n");
+}
+
+static int bench_str2int(const char *str)
+{
+	if (!str)
+		return BENCH_FORMAT_DEFAULT;
+
+	if (!strcmp(str, BENCH_FORMAT_DEFAULT_STR))
+		return BENCH_FORMAT_DEFAULT;
+	else if (!strcmp(str, BENCH_FORMAT_SIMPLE_STR))
+		return BENCH_FORMAT_SIMPLE;
+
+	return BENCH_FORMAT_UNKNOWN;
+}
+
+static int run_bench(const char *subsys_name, struct bench_suite *suite,
+		     int argc, const char **argv, const char *prefix)
+{
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Running %s/%s benchmark...\n",
+		       subsys_name, suite->name);
+	else
+		printf("%s/%s: ", subsys_name, suite->name);
+	fflush(stdout);
+
+	return suite->fn(argc, argv, prefix);
+}
+
+static int run_collection(struct bench_subsys *subsys, const char *prefix)
+{
+	struct bench_suite *suite;
+	int status = 0;
+
+	for (suite = subsys->suites; suite->name; suite++) {
+		const char *argv[] = { suite->name, NULL };
+
+		status |= run_bench(subsys->name, suite, 1, argv, prefix);
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf("\n");
+	}
+
+	return status;
+}
+
+static int run_all_subsystems(const char *prefix)
+{
+	int i, status = 0;
+
+	for (i = 0; subsystems[i].name; i++)
+		status |= run_collection(&subsystems[i], prefix);
+
+	return status;
+}
+
+int cmd_bench(int argc, const char **argv, const char *prefix)
+{
+	int i, j, status = 0;
+
+	if (argc < 2) {
+		/* No subsystem specified. */
+		print_usage();
+		goto end;
+	}
+
+	argc = parse_options(argc, argv, bench_options, bench_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+
+	bench_format = bench_str2int(bench_format_str);
+	if (bench_format == BENCH_FORMAT_UNKNOWN) {
+		fprintf(stderr, "Unknown format descriptor:%s\n",
+			bench_format_str);
+		status = 1;
+		goto end;
+	}
+
+	if (argc < 1) {
+		print_usage();
+		goto end;
+	}
+
+	if (!strcmp(argv[0], "all")) {
+		status = run_all_subsystems(prefix);
+		goto end;
+	}
+
+	for (i = 0; subsystems[i].name; i++) {
+		if (strcmp(subsystems[i].name, argv[0]))
+			continue;
+
+		if (argc < 2) {
+			/* No suite specified. */
+			dump_suites(i);
+			goto end;
+		}
+
+		if (!strcmp(argv[1], "all")) {
+			status = run_collection(&subsystems[i], prefix);
+			goto end;
+		}
+
+		for (j = 0; subsystems[i].suites[j].name; j++) {
+			if (strcmp(subsystems[i].suites[j].name, argv[1]))
+				continue;
+
+			status = run_bench(subsystems[i].name,
+					   &subsystems[i].suites[j],
+					   argc - 1, argv + 1, prefix);
+			goto end;
+		}
+
+		if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+			dump_suites(i);
+			goto end;
+		}
+
+		fprintf(stderr, "Unknown suite:%s for %s\n", argv[1], argv[0]);
+		status = 1;
+		goto end;
+	}
+
+	fprintf(stderr, "Unknown subsystem:%s\n", argv[0]);
+	status = 1;
+
+end:
+	return status;
+}
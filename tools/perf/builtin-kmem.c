@@ -0,0 +1,610 @@
+/*
+ * builtin-kmem.c
+ *
+ * Builtin kmem command: Record the slab allocator tracepoints of the
+ * system into perf.data, and analyze them:
+ *
+ *  perf kmem record - record kmalloc/kmem_cache_alloc/kfree events
+ *  perf kmem stat   - per callsite and per allocation statistics:
+ *                     bytes requested and allocated, internal
+ *                     fragmentation, cross cpu frees and allocations
+ *                     from a remote node
+ */
+#include "builtin.h"
+
+#include "util/util.h"
+#include "util/cache.h"
+#include "util/symbol.h"
+#include "util/trace-event.h"
+
+#include "perf.h"
+#include "util/data_map.h"
+
+#include "util/parse-options.h"
+#include "util/parse-events.h"
+
+static char		const *input_name = "perf.data";
+
+static int		force;
+static int		verbose;
+static int		dump_trace;
+
+static int		alloc_flag;
+static int		caller_flag;
+static int		raw_ip;
+
+static int		nr_lines = -1;
+
+#define STAT_HASH_BITS		12
+#define STAT_HASH_SIZE		(1 << STAT_HASH_BITS)
+#define MAX_CPUS		4096
+
+/*
+ * Statistics of one allocation callsite, or of one object address.
+ * For an object, call_site is the callsite of its last allocation.
+ */
+struct alloc_stat {
+	struct alloc_stat	*hash_next;
+	struct alloc_stat	*next;
+	u64			key;	/* ptr or call_site */
+	u64			call_site;
+	u64			bytes_req;
+	u64			bytes_alloc;
+	u32			hit;
+	u32			pingpong;
+	short			alloc_cpu;
+};
+
+struct stat_table {
+	struct alloc_stat	*hash[STAT_HASH_SIZE];
+	struct alloc_stat	*list;
+	unsigned long		nr_entries;
+};
+
+static struct stat_table	ptr_stats;
+static struct stat_table	callsite_stats;
+
+static u64			total_requested, total_allocated;
+static unsigned long		nr_allocs, nr_frees, nr_cross_allocs;
+static unsigned long		nr_node_allocs;
+
+static int			cpunode_map[MAX_CPUS];
+static int			have_cpunode_map;
+
+static struct alloc_stat *stat_find(struct stat_table *table, u64 key,
+				    int create)
+{
+	struct alloc_stat **p, *stat;
+
+	p = &table->hash[(key >> 4) & (STAT_HASH_SIZE - 1)];
+	for (stat = *p; stat; stat = stat->hash_next)
+		if (stat->key == key)
+			return stat;
+
+	if (!create)
+		return NULL;
+
+	stat = calloc(1, sizeof(*stat));
+	if (!stat)
+		die("not enough memory for allocation statistics");
+
+	stat->key = key;
+	stat->alloc_cpu = -1;
+	stat->hash_next = *p;
+	*p = stat;
+	stat->next = table->list;
+	table->list = stat;
+	table->nr_entries++;
+
+	return stat;
+}
+
+/*
+ * Map cpus to nodes from sysfs, to tell allocations that asked for
+ * memory of a remote node.  Without NUMA there is nothing to compare.
+ */
+static void setup_cpunode_map(void)
+{
+	char path[PATH_MAX];
+	struct dirent *dent1, *dent2;
+	DIR *dir1, *dir2;
+	unsigned int cpu, node;
+	int i;
+
+	for (i = 0; i < MAX_CPUS; i++)
+		cpunode_map[i] = -1;
+
+	dir1 = opendir("/sys/devices/system/node");
+	if (!dir1)
+		return;
+
+	while ((dent1 = readdir(dir1)) != NULL) {
+		if (sscanf(dent1->d_name, "node%u", &node) != 1)
+			continue;
+
+		snprintf(path, PATH_MAX, "/sys/devices/system/node/%s",
+			 dent1->d_name);
+		dir2 = opendir(path);
+		if (!dir2)
+			continue;
+		while ((dent2 = readdir(dir2)) != NULL) {
+			if (sscanf(dent2->d_name, "cpu%u", &cpu) != 1)
+				continue;
+			if (cpu < MAX_CPUS)
+				cpunode_map[cpu] = node;
+		}
+		closedir(dir2);
+	}
+	closedir(dir1);
+
+	have_cpunode_map = 1;
+}
+
+static void insert_alloc_stat(u64 call_site, u64 ptr, u64 bytes_req,
+			      u64 bytes_alloc, int cpu)
+{
+	struct alloc_stat *stat;
+
+	stat = stat_find(&ptr_stats, ptr, 1);
+	stat->call_site = call_site;
+	stat->hit++;
+	stat->bytes_req += bytes_req;
+	stat->bytes_alloc += bytes_alloc;
+	stat->alloc_cpu = cpu;
+
+	stat = stat_find(&callsite_stats, call_site, 1);
+	stat->call_site = call_site;
+	stat->hit++;
+	stat->bytes_req += bytes_req;
+	stat->bytes_alloc += bytes_alloc;
+}
+
+static void process_alloc_event(struct event *event, void *data, int cpu,
+				int node)
+{
+	u64 call_site, ptr, bytes_req, bytes_alloc;
+	int node1, node2;
+
+	call_site = raw_field_value(event, "call_site", data);
+	ptr = raw_field_value(event, "ptr", data);
+	bytes_req = raw_field_value(event, "bytes_req", data);
+	bytes_alloc = raw_field_value(event, "bytes_alloc", data);
+
+	insert_alloc_stat(call_site, ptr, bytes_req, bytes_alloc, cpu);
+
+	total_requested += bytes_req;
+	total_allocated += bytes_alloc;
+	nr_allocs++;
+
+	if (!node || !have_cpunode_map)
+		return;
+
+	/* -1 lets the allocator pick the node, that is never remote */
+	node1 = (int)raw_field_value(event, "node", data);
+	if (node1 < 0 || cpu >= MAX_CPUS)
+		return;
+
+	node2 = cpunode_map[cpu];
+	nr_node_allocs++;
+	if (node1 != node2)
+		nr_cross_allocs++;
+}
+
+/*
+ * An object freed on another cpu than the one that allocated it moves
+ * its cachelines between cpus: count those frees as ping-pongs, for the
+ * object and for the callsite that allocated it.
+ */
+static void process_free_event(struct event *event, void *data, int cpu)
+{
+	struct alloc_stat *ptr_stat, *call_stat;
+	u64 ptr;
+
+	ptr = raw_field_value(event, "ptr", data);
+	nr_frees++;
+
+	ptr_stat = stat_find(&ptr_stats, ptr, 0);
+	if (!ptr_stat || ptr_stat->alloc_cpu < 0)
+		return;
+
+	if (ptr_stat->alloc_cpu != cpu) {
+		ptr_stat->pingpong++;
+
+		call_stat = stat_find(&callsite_stats, ptr_stat->call_site, 0);
+		if (call_stat)
+			call_stat->pingpong++;
+	}
+	ptr_stat->alloc_cpu = -1;
+}
+
+static int process_sample_event(struct sample_data *data)
+{
+	struct event *event;
+	void *raw = data->raw_data;
+	int type;
+
+	if (!data->raw_size)
+		return -1;
+
+	type = trace_parse_common_type(raw);
+	event = trace_find_event(type);
+	if (!event)
+		return -1;
+
+	if (strcmp(event->system, "kmem"))
+		return 0;
+
+	if (!strcmp(event->name, "kmalloc") ||
+	    !strcmp(event->name, "kmem_cache_alloc"))
+		process_alloc_event(event, raw, data->cpu, 0);
+	else if (!strcmp(event->name, "kmalloc_node") ||
+		 !strcmp(event->name, "kmem_cache_alloc_node"))
+		process_alloc_event(event, raw, data->cpu, 1);
+	else if (!strcmp(event->name, "kfree") ||
+		 !strcmp(event->name, "kmem_cache_free"))
+		process_free_event(event, raw, data->cpu);
+
+	return 0;
+}
+
+static int sample_type_check(u64 type)
+{
+	if (!(type & PERF_SAMPLE_RAW) || !(type & PERF_SAMPLE_CPU)) {
+		fprintf(stderr, "%s has no raw or cpu sample data, "
+			"was it recorded with 'perf kmem record'?\n",
+			input_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct perf_file_handler file_handler = {
+	.sample_type_check	= sample_type_check,
+	.process_sample_event	= process_sample_event,
+};
+
+/*
+ * Sorting:
+ */
+typedef int (*sort_fn_t)(struct alloc_stat *, struct alloc_stat *);
+
+struct sort_dimension {
+	const char	*name;
+	sort_fn_t	cmp;
+};
+
+static int u64_cmp_desc(u64 l, u64 r)
+{
+	if (l > r)
+		return -1;
+	if (l < r)
+		return 1;
+	return 0;
+}
+
+static int key_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	if (l->key < r->key)
+		return -1;
+	if (l->key > r->key)
+		return 1;
+	return 0;
+}
+
+static int callsite_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	if (l->call_site < r->call_site)
+		return -1;
+	if (l->call_site > r->call_site)
+		return 1;
+	return 0;
+}
+
+static int hit_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	return u64_cmp_desc(l->hit, r->hit);
+}
+
+static int bytes_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	return u64_cmp_desc(l->bytes_alloc, r->bytes_alloc);
+}
+
+/* Wasted bytes, in 1/1000 of the allocated bytes */
+static u64 frag(struct alloc_stat *stat)
+{
+	if (!stat->bytes_alloc)
+		return 0;
+	return (stat->bytes_alloc - stat->bytes_req) * 1000 /
+		stat->bytes_alloc;
+}
+
+static int frag_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	return u64_cmp_desc(frag(l), frag(r));
+}
+
+static int pingpong_cmp(struct alloc_stat *l, struct alloc_stat *r)
+{
+	return u64_cmp_desc(l->pingpong, r->pingpong);
+}
+
+static struct sort_dimension sort_dimensions[] = {
+	{ "ptr",	key_cmp		},
+	{ "callsite",	callsite_cmp	},
+	{ "hit",	hit_cmp		},
+	{ "bytes",	bytes_cmp	},
+	{ "frag",	frag_cmp	},
+	{ "pingpong",	pingpong_cmp	},
+};
+
+#define MAX_SORT_KEYS	ARRAY_SIZE(sort_dimensions)
+
+static sort_fn_t	sort_keys[MAX_SORT_KEYS];
+static unsigned int	nr_sort_keys;
+
+static const char	default_sort_order[] = "frag, hit, bytes";
+static const char	*sort_order = default_sort_order;
+
+static int sort_dimension__add(const char *tok)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sort_dimensions); i++) {
+		if (strcmp(sort_dimensions[i].name, tok))
+			continue;
+		if (nr_sort_keys == MAX_SORT_KEYS)
+			return -1;
+		sort_keys[nr_sort_keys++] = sort_dimensions[i].cmp;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int stat_sort_cmp(const void *a, const void *b)
+{
+	struct alloc_stat *l = *(struct alloc_stat **)a;
+	struct alloc_stat *r = *(struct alloc_stat **)b;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < nr_sort_keys; i++) {
+		ret = sort_keys[i](l, r);
+		if (ret)
+			return ret;
+	}
+
+	return key_cmp(l, r);
+}
+
+static void setup_sorting(const struct option *options,
+			  const char * const *usage_msg)
+{
+	char *tmp, *tok, *str = strdup(sort_order);
+
+	for (tok = strtok_r(str, ", ", &tmp);
+			tok; tok = strtok_r(NULL, ", ", &tmp)) {
+		if (sort_dimension__add(tok) < 0) {
+			error("Unknown --sort key: `%s'", tok);
+			usage_with_options(usage_msg, options);
+		}
+	}
+
+	free(str);
+}
+
+/*
+ * Output:
+ */
+static struct dso *kernel_dso;
+
+static void load_kernel_symbols(void)
+{
+	symbol__init();
+
+	kernel_dso = dso__new("[kernel]", 0);
+	if (!kernel_dso)
+		return;
+
+	if (dso__load_kernel(kernel_dso, NULL, NULL, verbose, 0) <= 0) {
+		dso__delete(kernel_dso);
+		kernel_dso = NULL;
+	}
+}
+
+static void format_callsite(char *buf, size_t len, u64 call_site)
+{
+	struct symbol *sym = NULL;
+
+	if (kernel_dso && !raw_ip)
+		sym = kernel_dso->find_symbol(kernel_dso, call_site);
+
+	if (sym)
+		snprintf(buf, len, "%s+%Lx", sym->name,
+			 call_site - sym->start);
+	else
+		snprintf(buf, len, "%#Lx", call_site);
+}
+
+static const char dashed_line[] =
+	"---------------------------------------------------------------------"
+	"------------------------------------";
+
+static void print_result(struct stat_table *table, int is_caller)
+{
+	struct alloc_stat **sorted, *stat;
+	unsigned long i, n = 0;
+	char buf[BUFSIZ];
+
+	sorted = calloc(table->nr_entries, sizeof(*sorted));
+	if (!sorted && table->nr_entries)
+		die("not enough memory to sort %lu entries",
+		    table->nr_entries);
+
+	for (stat = table->list; stat; stat = stat->next)
+		sorted[n++] = stat;
+
+	qsort(sorted, n, sizeof(*sorted), stat_sort_cmp);
+
+	printf("%.105s\n", dashed_line);
+	printf(" %-34s |",  is_caller ? "Callsite": "Alloc Ptr");
+	printf(" Total_alloc/Per | Total_req/Per   | Hit      | Ping-pong | Frag\n");
+	printf("%.105s\n", dashed_line);
+
+	for (i = 0; i < n && (nr_lines < 0 || i < (unsigned long)nr_lines);
+	     i++) {
+		stat = sorted[i];
+
+		if (is_caller)
+			format_callsite(buf, sizeof(buf), stat->key);
+		else
+			snprintf(buf, sizeof(buf), "%#Lx", stat->key);
+
+		printf(" %-34s | %9Lu/%-5Lu | %9Lu/%-5Lu | %8lu | %9lu | %6.3f%%\n",
+		       buf,
+		       (unsigned long long)stat->bytes_alloc,
+		       (unsigned long long)stat->bytes_alloc / stat->hit,
+		       (unsigned long long)stat->bytes_req,
+		       (unsigned long long)stat->bytes_req / stat->hit,
+		       (unsigned long)stat->hit,
+		       (unsigned long)stat->pingpong,
+		       (double)frag(stat) / 10.0);
+	}
+
+	if (nr_lines >= 0 && i < n)
+		printf(" ...                                | ...             | ...             | ...      | ...       | ...   \n");
+
+	printf("%.105s\n", dashed_line);
+
+	free(sorted);
+}
+
+static void print_summary(void)
+{
+	printf("\nSUMMARY\n=======\n");
+	printf("Total bytes requested: %Lu\n",
+	       (unsigned long long)total_requested);
+	printf("Total bytes allocated: %Lu\n",
+	       (unsigned long long)total_allocated);
+	printf("Total bytes wasted on internal fragmentation: %Lu\n",
+	       (unsigned long long)(total_allocated - total_requested));
+	printf("Internal fragmentation: %f%%\n",
+	       total_allocated ? 100.0 - 100.0 * total_requested /
+				 total_allocated : 0.0);
+	printf("Allocations / frees: %lu / %lu\n", nr_allocs, nr_frees);
+	if (have_cpunode_map)
+		printf("Cross node allocations: %lu/%lu\n",
+		       nr_cross_allocs, nr_node_allocs);
+
+	perf_file_handler__print_bad_events(&file_handler);
+}
+
+static void print_results(void)
+{
+	if (caller_flag)
+		print_result(&callsite_stats, 1);
+	if (alloc_flag)
+		print_result(&ptr_stats, 0);
+	print_summary();
+}
+
+static void __cmd_kmem(void)
+{
+	setup_cpunode_map();
+
+	file_handler.dump_trace = dump_trace;
+	mmap_dispatch_perf_file(&file_handler, input_name, force,
+				"perf kmem record");
+
+	if (caller_flag && !raw_ip)
+		load_kernel_symbols();
+
+	setup_pager();
+	print_results();
+}
+
+static const char * const kmem_usage[] = {
+	"perf kmem [<options>] {record|stat}",
+	NULL
+};
+
+static const struct option kmem_options[] = {
+	OPT_STRING('i', "input", &input_name, "file",
+		   "input file name"),
+	OPT_BOOLEAN(0, "caller", &caller_flag,
+		    "show per-callsite statistics"),
+	OPT_BOOLEAN(0, "alloc", &alloc_flag,
+		    "show per-allocation statistics"),
+	OPT_STRING('s', "sort", &sort_order, "key[,key2...]",
+		   "sort by keys: ptr, callsite, bytes, hit, pingpong, frag"),
+	OPT_INTEGER('l', "line", &nr_lines,
+		    "show only the first n lines of each table"),
+	OPT_BOOLEAN(0, "raw-ip", &raw_ip, "show raw ip instead of symbol"),
+	OPT_BOOLEAN('v', "verbose", &verbose,
+		    "be more verbose (show symbol loading, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('f', "force", &force,
+		    "don't complain, do it"),
+	OPT_END()
+};
+
+static const char *record_args[] = {
+	"record",
+	"-a",
+	"-R",
+	"-f",
+	"-m", "1024",
+	"-c", "1",
+	"-e", "kmem:kmalloc:r",
+	"-e", "kmem:kmalloc_node:r",
+	"-e", "kmem:kfree:r",
+	"-e", "kmem:kmem_cache_alloc:r",
+	"-e", "kmem:kmem_cache_alloc_node:r",
+	"-e", "kmem:kmem_cache_free:r",
+};
+
+static int __cmd_record(int argc, const char **argv)
+{
+	unsigned int rec_argc, i, j;
+	const char **rec_argv;
+
+	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	rec_argv = calloc(rec_argc + 1, sizeof(char *));
+	if (!rec_argv)
+		die("not enough memory for the record arguments");
+
+	/* parse_events() modifies the event strings, hand it copies */
+	for (i = 0; i < ARRAY_SIZE(record_args); i++)
+		rec_argv[i] = strdup(record_args[i]);
+
+	for (j = 1; j < (unsigned int)argc; j++, i++)
+		rec_argv[i] = argv[j];
+
+	return cmd_record(i, rec_argv, NULL);
+}
+
+int cmd_kmem(int argc, const char **argv, const char *prefix __used)
+{
+	argc = parse_options(argc, argv, kmem_options, kmem_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (!argc)
+		usage_with_options(kmem_usage, kmem_options);
+
+	if (!strncmp(argv[0], "rec", 3))
+		return __cmd_record(argc, argv);
+
+	if (strcmp(argv[0], "stat"))
+		usage_with_options(kmem_usage, kmem_options);
+
+	if (!caller_flag && !alloc_flag)
+		caller_flag = 1;
+
+	setup_sorting(kmem_options, kmem_usage);
+
+	__cmd_kmem();
+
+	return 0;
+}
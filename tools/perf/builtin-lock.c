@@ -0,0 +1,767 @@
+/*
+ * builtin-lock.c
+ *
+ * Builtin lock command: Record the lockdep tracepoints of the system
+ * into perf.data, and analyze them:
+ *
+ *  perf lock record - record lock_acquire/acquired/contended/release
+ *  perf lock report - per lock acquisition and contention counts, and
+ *                     wait and hold time statistics and distributions
+ *
+ * The events need a kernel with CONFIG_LOCKDEP, and CONFIG_LOCK_STAT
+ * for the contention events.
+ */
+#include "builtin.h"
+
+#include "util/util.h"
+#include "util/cache.h"
+#include "util/trace-event.h"
+
+#include "perf.h"
+#include "util/data_map.h"
+
+#include "util/parse-options.h"
+#include "util/parse-events.h"
+
+static char		const *input_name = "perf.data";
+
+static int		force;
+static int		verbose;
+static int		dump_trace;
+#define dprintf(x...)	do { if (dump_trace) printf(x); } while (0)
+
+static int		show_histogram;
+static int		nr_lines = -1;
+
+#define LOCK_HASH_BITS		12
+#define LOCK_HASH_SIZE		(1 << LOCK_HASH_BITS)
+#define THREAD_HASH_BITS	10
+#define THREAD_HASH_SIZE	(1 << THREAD_HASH_BITS)
+#define NR_HIST_BUCKETS		64
+
+/* lock_acquire flags */
+#define LOCK_FLAG_TRY		1
+#define LOCK_FLAG_READ		2
+
+struct lock_stat {
+	struct lock_stat	*hash_next;
+	struct lock_stat	*next;
+	u64			addr;
+	char			*name;
+
+	unsigned long		nr_acquire;
+	unsigned long		nr_acquired;
+	unsigned long		nr_contended;
+	unsigned long		nr_release;
+	unsigned long		nr_trylock;
+	unsigned long		nr_readlock;
+
+	unsigned long		nr_wait;
+	u64			wait_time_total;
+	u64			wait_time_min;
+	u64			wait_time_max;
+
+	unsigned long		nr_hold;
+	u64			hold_time_total;
+	u64			hold_time_min;
+	u64			hold_time_max;
+
+	/* log2 buckets of nanoseconds */
+	unsigned long		wait_hist[NR_HIST_BUCKETS];
+	unsigned long		hold_hist[NR_HIST_BUCKETS];
+};
+
+static struct lock_stat		*lock_hash[LOCK_HASH_SIZE];
+static struct lock_stat		*lock_list;
+static unsigned long		nr_locks;
+
+/*
+ * A lock held (or being acquired) by a thread: nesting counts recursive
+ * read acquisitions, the hold time is measured from the outermost one.
+ */
+struct lock_seq {
+	struct lock_seq		*next;
+	struct lock_stat	*lock;
+	int			nesting;
+	int			contended;
+	u64			hold_start;
+};
+
+struct thread_stat {
+	struct thread_stat	*hash_next;
+	u32			tid;
+	struct lock_seq		*seqs;
+};
+
+static struct thread_stat	*thread_hash[THREAD_HASH_SIZE];
+
+static unsigned long		nr_unmatched_release;
+
+/*
+ * One lock event, decoded out of the raw sample: like in perf sched,
+ * the events are sorted by time before the hold times are computed.
+ */
+enum lock_record_type {
+	LOCK_ACQUIRE,
+	LOCK_ACQUIRED,
+	LOCK_CONTENDED,
+	LOCK_RELEASE,
+};
+
+struct lock_record {
+	u64			timestamp;
+	unsigned long		seq;
+	u64			wait;		/* lock_acquired only */
+	struct lock_stat	*lock;
+	u32			tid;
+	u32			flags;		/* lock_acquire only */
+	enum lock_record_type	type;
+};
+
+static struct lock_record	*records;
+static unsigned long		nr_records;
+static unsigned long		alloc_records;
+
+static struct lock_stat *lock_stat_find(u64 addr, const char *name)
+{
+	struct lock_stat **p = &lock_hash[(addr >> 4) & (LOCK_HASH_SIZE - 1)];
+	struct lock_stat *lock;
+
+	for (lock = *p; lock; lock = lock->hash_next)
+		if (lock->addr == addr)
+			return lock;
+
+	lock = calloc(1, sizeof(*lock));
+	if (!lock)
+		die("not enough memory for a lock");
+
+	lock->addr = addr;
+	lock->name = strdup(name ? name : "<unknown>");
+	lock->wait_time_min = ULLONG_MAX;
+	lock->hold_time_min = ULLONG_MAX;
+	lock->hash_next = *p;
+	*p = lock;
+	lock->next = lock_list;
+	lock_list = lock;
+	nr_locks++;
+
+	return lock;
+}
+
+static struct thread_stat *thread_stat_find(u32 tid)
+{
+	struct thread_stat **p = &thread_hash[tid & (THREAD_HASH_SIZE - 1)];
+	struct thread_stat *thread;
+
+	for (thread = *p; thread; thread = thread->hash_next)
+		if (thread->tid == tid)
+			return thread;
+
+	thread = calloc(1, sizeof(*thread));
+	if (!thread)
+		die("not enough memory for a thread");
+
+	thread->tid = tid;
+	thread->hash_next = *p;
+	*p = thread;
+
+	return thread;
+}
+
+static struct lock_seq *lock_seq_find(struct thread_stat *thread,
+				      struct lock_stat *lock, int create)
+{
+	struct lock_seq *seq;
+
+	for (seq = thread->seqs; seq; seq = seq->next)
+		if (seq->lock == lock)
+			return seq;
+
+	if (!create)
+		return NULL;
+
+	seq = calloc(1, sizeof(*seq));
+	if (!seq)
+		die("not enough memory for a lock sequence");
+
+	seq->lock = lock;
+	seq->next = thread->seqs;
+	thread->seqs = seq;
+
+	return seq;
+}
+
+static void lock_seq_free(struct thread_stat *thread, struct lock_seq *seq)
+{
+	struct lock_seq **p;
+
+	for (p = &thread->seqs; *p; p = &(*p)->next) {
+		if (*p == seq) {
+			*p = seq->next;
+			free(seq);
+			return;
+		}
+	}
+}
+
+static int ilog2_u64(u64 v)
+{
+	int l = 0;
+
+	while (v >>= 1)
+		l++;
+	return l;
+}
+
+static struct lock_record *new_record(void)
+{
+	if (nr_records == alloc_records) {
+		alloc_records = alloc_records ? alloc_records * 2 : 65536;
+		records = realloc(records, alloc_records * sizeof(*records));
+		if (!records)
+			die("not enough memory for %lu lock records",
+			    alloc_records);
+	}
+
+	memset(&records[nr_records], 0, sizeof(*records));
+	records[nr_records].seq = nr_records;
+
+	return &records[nr_records++];
+}
+
+static int decode_raw_sample(void *raw_data, u32 tid, u64 timestamp)
+{
+	struct lock_record *rec;
+	struct event *event;
+	u64 addr;
+	int type;
+
+	type = trace_parse_common_type(raw_data);
+	event = trace_find_event(type);
+	if (!event) {
+		dprintf("  ... no format for event id %d\n", type);
+		return -1;
+	}
+
+	if (strcmp(event->system, "lockdep"))
+		return 0;
+
+	rec = new_record();
+	rec->timestamp = timestamp;
+	rec->tid = tid;
+
+	if (!strcmp(event->name, "lock_acquire")) {
+		rec->type = LOCK_ACQUIRE;
+		rec->flags = raw_field_value(event, "flags", raw_data);
+	} else if (!strcmp(event->name, "lock_acquired")) {
+		rec->type = LOCK_ACQUIRED;
+		rec->wait = raw_field_value(event, "wait_usec", raw_data) *
+			1000 + raw_field_value(event, "wait_nsec_rem", raw_data);
+	} else if (!strcmp(event->name, "lock_contended")) {
+		rec->type = LOCK_CONTENDED;
+	} else if (!strcmp(event->name, "lock_release")) {
+		rec->type = LOCK_RELEASE;
+	} else {
+		/* Not an event we analyze, drop it again */
+		nr_records--;
+		return 0;
+	}
+
+	addr = raw_field_value(event, "lockdep_addr", raw_data);
+	rec->lock = lock_stat_find(addr, raw_field_ptr(event, "name",
+						      raw_data));
+
+	return 0;
+}
+
+static int process_sample_event(struct sample_data *data)
+{
+	if (!data->raw_size)
+		return -1;
+
+	return decode_raw_sample(data->raw_data, data->tid, data->time);
+}
+
+static int sample_type_check(u64 type)
+{
+	if (!(type & PERF_SAMPLE_RAW) ||
+	    !(type & PERF_SAMPLE_TIME) ||
+	    !(type & PERF_SAMPLE_TID)) {
+		fprintf(stderr, "%s has no raw, time or tid sample data, "
+			"was it recorded with 'perf lock record'?\n",
+			input_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct perf_file_handler file_handler = {
+	.sample_type_check	= sample_type_check,
+	.process_sample_event	= process_sample_event,
+};
+
+static int compare_records(const void *a, const void *b)
+{
+	const struct lock_record *l = a, *r = b;
+
+	if (l->timestamp != r->timestamp)
+		return l->timestamp < r->timestamp ? -1 : 1;
+
+	/* keep the file order of events with the same timestamp */
+	return l->seq < r->seq ? -1 : l->seq > r->seq;
+}
+
+static void read_events(void)
+{
+	file_handler.dump_trace = dump_trace;
+	mmap_dispatch_perf_file(&file_handler, input_name, force,
+				"perf lock record");
+
+	qsort(records, nr_records, sizeof(*records), compare_records);
+}
+
+static void account_wait(struct lock_stat *lock, u64 wait)
+{
+	lock->nr_wait++;
+	lock->wait_time_total += wait;
+	if (wait < lock->wait_time_min)
+		lock->wait_time_min = wait;
+	if (wait > lock->wait_time_max)
+		lock->wait_time_max = wait;
+	lock->wait_hist[ilog2_u64(wait)]++;
+}
+
+static void account_hold(struct lock_stat *lock, u64 hold)
+{
+	lock->nr_hold++;
+	lock->hold_time_total += hold;
+	if (hold < lock->hold_time_min)
+		lock->hold_time_min = hold;
+	if (hold > lock->hold_time_max)
+		lock->hold_time_max = hold;
+	lock->hold_hist[ilog2_u64(hold)]++;
+}
+
+static void process_acquire(struct lock_record *rec)
+{
+	struct thread_stat *thread = thread_stat_find(rec->tid);
+	struct lock_stat *lock = rec->lock;
+	struct lock_seq *seq;
+
+	lock->nr_acquire++;
+	if (rec->flags & LOCK_FLAG_TRY)
+		lock->nr_trylock++;
+	if (rec->flags & LOCK_FLAG_READ)
+		lock->nr_readlock++;
+
+	seq = lock_seq_find(thread, lock, 1);
+	if (!seq->nesting++) {
+		/* lock_acquired moves this to when the lock was taken */
+		seq->hold_start = rec->timestamp;
+		seq->contended = 0;
+	}
+}
+
+static void process_contended(struct lock_record *rec)
+{
+	struct thread_stat *thread = thread_stat_find(rec->tid);
+	struct lock_seq *seq;
+
+	rec->lock->nr_contended++;
+
+	seq = lock_seq_find(thread, rec->lock, 0);
+	if (seq)
+		seq->contended = 1;
+}
+
+static void process_acquired(struct lock_record *rec)
+{
+	struct thread_stat *thread = thread_stat_find(rec->tid);
+	struct lock_seq *seq;
+
+	rec->lock->nr_acquired++;
+
+	seq = lock_seq_find(thread, rec->lock, 0);
+	if (seq) {
+		if (seq->nesting == 1)
+			seq->hold_start = rec->timestamp;
+		if (!seq->contended)
+			return;
+		seq->contended = 0;
+	} else if (!rec->wait)
+		return;
+
+	/* lockdep measured the wait from lock_contended on */
+	account_wait(rec->lock, rec->wait);
+}
+
+static void process_release(struct lock_record *rec)
+{
+	struct thread_stat *thread = thread_stat_find(rec->tid);
+	struct lock_seq *seq;
+
+	rec->lock->nr_release++;
+
+	seq = lock_seq_find(thread, rec->lock, 0);
+	if (!seq) {
+		/* acquired before the recording started, or by another task */
+		nr_unmatched_release++;
+		return;
+	}
+
+	if (--seq->nesting > 0)
+		return;
+
+	if (rec->timestamp >= seq->hold_start)
+		account_hold(rec->lock, rec->timestamp - seq->hold_start);
+	lock_seq_free(thread, seq);
+}
+
+static const char *record_type_name[] = {
+	[LOCK_ACQUIRE]		= "lock_acquire",
+	[LOCK_ACQUIRED]		= "lock_acquired",
+	[LOCK_CONTENDED]	= "lock_contended",
+	[LOCK_RELEASE]		= "lock_release",
+};
+
+static void process_records(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr_records; i++) {
+		struct lock_record *rec = &records[i];
+
+		dprintf("%13.6f %6d %-14s %#Lx %s\n",
+			(double)rec->timestamp / 1e9, rec->tid,
+			record_type_name[rec->type],
+			(unsigned long long)rec->lock->addr, rec->lock->name);
+
+		switch (rec->type) {
+		case LOCK_ACQUIRE:
+			process_acquire(rec);
+			break;
+		case LOCK_CONTENDED:
+			process_contended(rec);
+			break;
+		case LOCK_ACQUIRED:
+			process_acquired(rec);
+			break;
+		case LOCK_RELEASE:
+			process_release(rec);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Sorting:
+ */
+typedef int (*sort_fn_t)(struct lock_stat *, struct lock_stat *);
+
+struct sort_dimension {
+	const char	*name;
+	sort_fn_t	cmp;
+};
+
+static int u64_cmp_desc(u64 l, u64 r)
+{
+	if (l > r)
+		return -1;
+	if (l < r)
+		return 1;
+	return 0;
+}
+
+static int name_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return strcmp(l->name, r->name);
+}
+
+static int acquired_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->nr_acquired, r->nr_acquired);
+}
+
+static int contended_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->nr_contended, r->nr_contended);
+}
+
+static int wait_total_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->wait_time_total, r->wait_time_total);
+}
+
+static int wait_max_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->wait_time_max, r->wait_time_max);
+}
+
+static u64 avg_hold(struct lock_stat *lock)
+{
+	return lock->nr_hold ? lock->hold_time_total / lock->nr_hold : 0;
+}
+
+static int hold_avg_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(avg_hold(l), avg_hold(r));
+}
+
+static int hold_total_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->hold_time_total, r->hold_time_total);
+}
+
+static int hold_max_cmp(struct lock_stat *l, struct lock_stat *r)
+{
+	return u64_cmp_desc(l->hold_time_max, r->hold_time_max);
+}
+
+static struct sort_dimension sort_dimensions[] = {
+	{ "name",		name_cmp		},
+	{ "acquired",		acquired_cmp		},
+	{ "contended",		contended_cmp		},
+	{ "wait_total",		wait_total_cmp		},
+	{ "wait_max",		wait_max_cmp		},
+	{ "hold_avg",		hold_avg_cmp		},
+	{ "hold_total",		hold_total_cmp		},
+	{ "hold_max",		hold_max_cmp		},
+};
+
+#define MAX_SORT_KEYS	ARRAY_SIZE(sort_dimensions)
+
+static sort_fn_t	sort_keys[MAX_SORT_KEYS];
+static unsigned int	nr_sort_keys;
+
+static const char	default_sort_order[] = "wait_total, contended, acquired";
+static const char	*sort_order = default_sort_order;
+
+static int sort_dimension__add(const char *tok)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sort_dimensions); i++) {
+		if (strcmp(sort_dimensions[i].name, tok))
+			continue;
+		if (nr_sort_keys == MAX_SORT_KEYS)
+			return -1;
+		sort_keys[nr_sort_keys++] = sort_dimensions[i].cmp;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int lock_sort_cmp(const void *a, const void *b)
+{
+	struct lock_stat *l = *(struct lock_stat **)a;
+	struct lock_stat *r = *(struct lock_stat **)b;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < nr_sort_keys; i++) {
+		ret = sort_keys[i](l, r);
+		if (ret)
+			return ret;
+	}
+
+	if (l->addr != r->addr)
+		return l->addr < r->addr ? -1 : 1;
+	return 0;
+}
+
+static void setup_sorting(const struct option *options,
+			  const char * const *usage_msg)
+{
+	char *tmp, *tok, *str = strdup(sort_order);
+
+	for (tok = strtok_r(str, ", ", &tmp);
+			tok; tok = strtok_r(NULL, ", ", &tmp)) {
+		if (sort_dimension__add(tok) < 0) {
+			error("Unknown --sort key: `%s'", tok);
+			usage_with_options(usage_msg, options);
+		}
+	}
+
+	free(str);
+}
+
+/*
+ * Output:
+ */
+static void print_histogram(struct lock_stat *lock)
+{
+	int i, lo = NR_HIST_BUCKETS, hi = -1;
+
+	for (i = 0; i < NR_HIST_BUCKETS; i++) {
+		if (!lock->wait_hist[i] && !lock->hold_hist[i])
+			continue;
+		if (i < lo)
+			lo = i;
+		hi = i;
+	}
+
+	if (hi < 0)
+		return;
+
+	printf("      %-27s %12s %12s\n", "time (ns)", "wait", "hold");
+	for (i = lo; i <= hi; i++)
+		printf("      [%11Lu, %11Lu) %12lu %12lu\n",
+		       i ? 1ULL << i : 0ULL, 1ULL << (i + 1),
+		       lock->wait_hist[i], lock->hold_hist[i]);
+	printf("\n");
+}
+
+static void output_lock(struct lock_stat *lock)
+{
+	char name[32];
+
+	if (strlen(lock->name) < sizeof(name))
+		snprintf(name, sizeof(name), "%s", lock->name);
+	else
+		snprintf(name, sizeof(name), "%.27s...", lock->name);
+
+	printf(" %-31s %10lu %10lu %14Lu %12Lu %12Lu %12Lu %12Lu\n",
+	       name, lock->nr_acquired, lock->nr_contended,
+	       (unsigned long long)lock->wait_time_total,
+	       (unsigned long long)lock->wait_time_max,
+	       (unsigned long long)(lock->nr_wait ? lock->wait_time_min : 0),
+	       (unsigned long long)avg_hold(lock),
+	       (unsigned long long)lock->hold_time_max);
+
+	if (show_histogram)
+		print_histogram(lock);
+}
+
+static void __cmd_report(void)
+{
+	struct lock_stat **sorted, *lock;
+	unsigned long i, n = 0;
+
+	read_events();
+	process_records();
+
+	sorted = calloc(nr_locks, sizeof(*sorted));
+	if (!sorted && nr_locks)
+		die("not enough memory to sort %lu locks", nr_locks);
+
+	for (lock = lock_list; lock; lock = lock->next)
+		sorted[n++] = lock;
+	qsort(sorted, n, sizeof(*sorted), lock_sort_cmp);
+
+	setup_pager();
+
+	printf(" %-31s %10s %10s %14s %12s %12s %12s %12s\n",
+	       "Name", "acquired", "contended", "total wait ns",
+	       "max wait ns", "min wait ns", "avg hold ns", "max hold ns");
+	printf("\n");
+
+	for (i = 0; i < n && (nr_lines < 0 || i < (unsigned long)nr_lines);
+	     i++)
+		output_lock(sorted[i]);
+
+	printf("\n");
+	if (nr_unmatched_release)
+		printf("  INFO: %lu releases of locks not acquired "
+		       "in the trace\n", nr_unmatched_release);
+	perf_file_handler__print_bad_events(&file_handler);
+
+	free(sorted);
+}
+
+static const char * const lock_usage[] = {
+	"perf lock [<options>] {record|report}",
+	NULL
+};
+
+static const struct option lock_options[] = {
+	OPT_STRING('i', "input", &input_name, "file",
+		   "input file name"),
+	OPT_BOOLEAN('v', "verbose", &verbose,
+		    "be more verbose (show counter open errors, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('f', "force", &force,
+		    "don't complain, do it"),
+	OPT_END()
+};
+
+static const char * const report_usage[] = {
+	"perf lock report [<options>]",
+	NULL
+};
+
+static const struct option report_options[] = {
+	OPT_STRING('k', "key", &sort_order, "key[,key2...]",
+		   "sort by key(s): wait_total, wait_max, contended, "
+		   "acquired, hold_avg, hold_total, hold_max, name"),
+	OPT_BOOLEAN('H', "histogram", &show_histogram,
+		    "show the wait and hold time distribution of each lock"),
+	OPT_INTEGER('l', "line", &nr_lines,
+		    "show only the first n locks"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+};
+
+static const char *record_args[] = {
+	"record",
+	"-a",
+	"-R",
+	"-f",
+	"-m", "1024",
+	"-c", "1",
+	"-e", "lockdep:lock_acquire:r",
+	"-e", "lockdep:lock_acquired:r",
+	"-e", "lockdep:lock_contended:r",
+	"-e", "lockdep:lock_release:r",
+};
+
+static int __cmd_record(int argc, const char **argv)
+{
+	unsigned int rec_argc, i, j;
+	const char **rec_argv;
+
+	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	rec_argv = calloc(rec_argc + 1, sizeof(char *));
+	if (!rec_argv)
+		die("not enough memory for the record arguments");
+
+	/* parse_events() modifies the event strings, hand it copies */
+	for (i = 0; i < ARRAY_SIZE(record_args); i++)
+		rec_argv[i] = strdup(record_args[i]);
+
+	for (j = 1; j < (unsigned int)argc; j++, i++)
+		rec_argv[i] = argv[j];
+
+	return cmd_record(i, rec_argv, NULL);
+}
+
+int cmd_lock(int argc, const char **argv, const char *prefix __used)
+{
+	argc = parse_options(argc, argv, lock_options, lock_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (!argc)
+		usage_with_options(lock_usage, lock_options);
+
+	if (!strncmp(argv[0], "rec", 3)) {
+		return __cmd_record(argc, argv);
+	} else if (!strncmp(argv[0], "report", 6)) {
+		if (argc > 1) {
+			argc = parse_options(argc, argv, report_options,
+					     report_usage, 0);
+			if (argc)
+				usage_with_options(report_usage,
+						   report_options);
+		}
+		setup_sorting(report_options, report_usage);
+		__cmd_report();
+	} else {
+		usage_with_options(lock_usage, lock_options);
+	}
+
+	return 0;
+}
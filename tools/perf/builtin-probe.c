@@ -0,0 +1,648 @@
+/*
+ * builtin-probe.c
+ *
+ * Builtin probe command: Set up probe events by C expression
+ *
+ * Probe points are given as a function, a function relative line or a
+ * source line, optionally with the names of the local variables and
+ * arguments to record.  They are resolved with the DWARF debuginfo of
+ * the running kernel and handed to the kprobe-based event tracer, which
+ * makes them available as tracepoint events to perf record and ftrace.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include "builtin.h"
+
+#include "perf.h"
+#include "util/util.h"
+#include "util/strlist.h"
+#include "util/parse-options.h"
+#include "util/parse-events.h"	/* For debugfs_path */
+#include "util/probe-finder.h"
+
+#include <sys/utsname.h>
+
+#define MAX_EVENT_NAME_LEN	64
+#define PERFPROBE_GROUP		"probe"
+
+#define semantic_error(msg ...) die("Semantic error :" msg)
+
+/* Session management structure */
+static struct {
+	char			*vmlinux;
+	int			verbose;
+	int			list_events;
+	int			need_dwarf;
+	int			nr_probe;
+	struct probe_point	probes[MAX_PROBES];
+	struct strlist		*dellist;
+} session;
+
+static const char * const probe_usage[] = {
+	"perf probe [<options>] 'PROBEDEF' ['PROBEDEF' ...]",
+	"perf probe [<options>] --add 'PROBEDEF' [--add 'PROBEDEF' ...]",
+	"perf probe [<options>] --del '[GROUP:]EVENT' ...",
+	"perf probe --list",
+	NULL
+};
+
+/* Split a string into space separated words */
+static char **argv_split(const char *str, int *argcp)
+{
+	char **argv;
+	char *s, *p;
+	int argc = 0;
+
+	s = strdup(str);
+	argv = calloc(strlen(str) / 2 + 2, sizeof(char *));
+	if (!s || !argv)
+		die("Not enough memory.");
+
+	for (p = strtok(s, " \t"); p; p = strtok(NULL, " \t"))
+		argv[argc++] = strdup(p);
+	argv[argc] = NULL;
+	free(s);
+
+	*argcp = argc;
+	return argv;
+}
+
+static void argv_free(char **argv)
+{
+	char **p;
+
+	for (p = argv; *p; p++)
+		free(*p);
+	free(argv);
+}
+
+static int is_good_event_name(const char *name)
+{
+	if (!isalpha(*name) && *name != '_')
+		return 0;
+	while (*++name != '\0') {
+		if (!isalpha(*name) && !isdigit(*name) && *name != '_')
+			return 0;
+	}
+	return 1;
+}
+
+/* Parse probepoint definition. */
+static void parse_probe_point(char *arg, struct probe_point *pp)
+{
+	char *ptr, *tmp;
+	char c, nc = 0;
+	/*
+	 * <Syntax>
+	 * perf probe [EVENT=]SRC:LN
+	 * perf probe [EVENT=]FUNC[+OFFS|%return|:RLN][@SRC]
+	 */
+
+	ptr = strchr(arg, '=');
+	if (ptr) {
+		*ptr = '\0';
+		if (!is_good_event_name(arg))
+			semantic_error("%s is bad for event name - it must "
+				       "follow C symbol-naming rule.", arg);
+		pp->event = strdup(arg);
+		arg = ptr + 1;
+	}
+
+	ptr = strpbrk(arg, ":+@%");
+	if (ptr) {
+		nc = *ptr;
+		*ptr++ = '\0';
+	}
+
+	/* Check arg is function or file and copy it */
+	if (strchr(arg, '.'))	/* File */
+		pp->file = strdup(arg);
+	else			/* Function */
+		pp->function = strdup(arg);
+
+	/* Parse other options */
+	while (ptr) {
+		arg = ptr;
+		c = nc;
+		ptr = strpbrk(arg, ":+@%");
+		if (ptr) {
+			nc = *ptr;
+			*ptr++ = '\0';
+		}
+		switch (c) {
+		case ':':	/* Line number */
+			pp->line = strtoul(arg, &tmp, 0);
+			if (*tmp != '\0')
+				semantic_error("There is non-digit character"
+					       " in line number.");
+			break;
+		case '+':	/* Byte offset from a symbol */
+			pp->offset = strtoul(arg, &tmp, 0);
+			if (*tmp != '\0')
+				semantic_error("There is non-digit character"
+					       " in offset.");
+			break;
+		case '@':	/* File name */
+			if (pp->file)
+				semantic_error("SRC@SRC is not allowed.");
+			pp->file = strdup(arg);
+			break;
+		case '%':	/* Probe places */
+			if (strcmp(arg, "return") == 0)
+				pp->retprobe = 1;
+			else	/* Others not supported yet */
+				semantic_error("%%%s is not supported.", arg);
+			break;
+		default:
+			die("Program has a bug: unknown separator '%c'.", c);
+		}
+	}
+
+	/* Exclusion check */
+	if (pp->line && pp->offset)
+		semantic_error("Offset can't be used with line number.");
+
+	if (!pp->line && pp->file && !pp->function)
+		semantic_error("File always requires line number.");
+
+	if (pp->offset && !pp->function)
+		semantic_error("Offset requires an entry function.");
+
+	if (pp->retprobe && !pp->function)
+		semantic_error("Return probe requires an entry function.");
+
+	if ((pp->offset || pp->line) && pp->retprobe)
+		semantic_error("Offset/Line can't be used with return probe.");
+}
+
+/* Parse an event definition. Note that any error must die. */
+static void parse_probe_event(const char *str)
+{
+	struct probe_point *pp;
+	char **argv;
+	int argc, i;
+
+	if (session.nr_probe == MAX_PROBES)
+		die("Too many probes (> %d) are specified.", MAX_PROBES);
+	pp = &session.probes[session.nr_probe++];
+
+	argv = argv_split(str, &argc);
+	if (argc == 0)
+		semantic_error("An empty probe definition.");
+	if (argc - 1 > MAX_PROBE_ARGS)
+		semantic_error("Too many arguments (> %d).", MAX_PROBE_ARGS);
+
+	/* Parse probe point */
+	parse_probe_point(argv[0], pp);
+	if (pp->file || pp->line)
+		session.need_dwarf = 1;
+
+	/* Copy arguments, C variable names need debuginfo */
+	pp->nr_args = argc - 1;
+	if (pp->nr_args > 0) {
+		pp->args = calloc(pp->nr_args, sizeof(char *));
+		if (!pp->args)
+			die("Not enough memory.");
+		for (i = 0; i < pp->nr_args; i++) {
+			pp->args[i] = strdup(argv[i + 1]);
+			if (is_c_varname(pp->args[i]))
+				session.need_dwarf = 1;
+		}
+	}
+
+	argv_free(argv);
+}
+
+static int opt_add_probe_event(const struct option *opt __used,
+			      const char *str, int unset __used)
+{
+	if (str)
+		parse_probe_event(str);
+	return 0;
+}
+
+static int opt_del_probe_event(const struct option *opt __used,
+			       const char *str, int unset __used)
+{
+	if (str) {
+		if (!session.dellist)
+			session.dellist = strlist__new(true, NULL);
+		strlist__add(session.dellist, str);
+	}
+	return 0;
+}
+
+/*
+ * kprobe_events interface
+ */
+
+static int open_kprobe_events(int flags)
+{
+	char buf[MAX_PATH_LEN];
+	int ret;
+
+	/* debugfs_path points at the tracing/events directory */
+	ret = snprintf(buf, MAX_PATH_LEN, "%s/../kprobe_events",
+		       debugfs_path);
+	if (ret < 0 || ret >= MAX_PATH_LEN)
+		die("Failed to make kprobe_events path.");
+
+	ret = open(buf, flags, 0);
+	if (ret < 0) {
+		if (errno == ENOENT)
+			die("kprobe_events file does not exist -"
+			    " please rebuild with CONFIG_KPROBE_EVENT.");
+		else
+			die("Could not open kprobe_events file: %s",
+			    strerror(errno));
+	}
+	return ret;
+}
+
+/*
+ * Get current probe events as "GROUP:EVENT" in @names, and the whole
+ * definitions as "GROUP:EVENT DEFINITION" in @defs if it is not NULL.
+ */
+static struct strlist *get_trace_kprobe_event_names(int fd,
+						    struct strlist *defs)
+{
+	struct strlist *names;
+	char buf[MAX_PROBE_BUFFER], *p, *ev;
+	FILE *fp;
+
+	names = strlist__new(true, NULL);
+	fp = fdopen(dup(fd), "r");
+	if (!names || !fp)
+		die("Failed to read kprobe_events.");
+
+	while (fgets(buf, MAX_PROBE_BUFFER, fp)) {
+		p = strchr(buf, '\n');
+		if (p)
+			*p = '\0';
+		/* "p:GROUP/EVENT DEFINITION" */
+		ev = strchr(buf, ':');
+		if (!ev)
+			continue;
+		ev++;
+		p = strchr(ev, '/');
+		if (!p)
+			continue;
+		*p = ':';
+		if (defs)
+			strlist__add(defs, ev);
+		p = strchr(ev, ' ');
+		if (p)
+			*p = '\0';
+		strlist__add(names, ev);
+	}
+	fclose(fp);
+
+	return names;
+}
+
+static void write_trace_kprobe_event(int fd, const char *buf)
+{
+	int ret;
+
+	if (session.verbose)
+		printf("Writing event: %s\n", buf);
+	ret = write(fd, buf, strlen(buf));
+	if (ret <= 0)
+		die("Failed to write event: %s", strerror(errno));
+}
+
+/* Make a unique event name in the group from @base */
+static void get_new_event_name(char *buf, size_t len, const char *base,
+			       struct strlist *namelist)
+{
+	char name[MAX_EVENT_NAME_LEN * 2];
+	int i, ret;
+
+	for (i = 0; i < MAX_PROBES * 16; i++) {
+		if (i == 0)
+			ret = snprintf(buf, len, "%s", base);
+		else
+			ret = snprintf(buf, len, "%s_%d", base, i);
+		if (ret < 0 || (size_t)ret >= len)
+			die("Too long event name.");
+		snprintf(name, sizeof(name), "%s:%s", PERFPROBE_GROUP, buf);
+		if (!strlist__has_entry(namelist, name))
+			return;
+	}
+	die("Too many events are on the same name: %s", base);
+}
+
+/* Default event name: the function name, or "FILE_LINE" */
+static void get_base_event_name(char *buf, size_t len,
+				struct probe_point *pp)
+{
+	const char *file;
+	char *p;
+
+	if (pp->event) {
+		snprintf(buf, len, "%s", pp->event);
+		return;
+	}
+	if (pp->function) {
+		snprintf(buf, len, "%s", pp->function);
+		return;
+	}
+
+	file = strrchr(pp->file, '/');
+	file = file ? file + 1 : pp->file;
+	snprintf(buf, len, "%s", file);
+	p = strchr(buf, '.');
+	if (p)
+		*p = '\0';
+	snprintf(buf + strlen(buf), len - strlen(buf), "_%d", pp->line);
+
+	for (p = buf; *p; p++)
+		if (!isalnum(*p))
+			*p = '_';
+	if (isdigit(*buf))
+		*buf = '_';
+}
+
+static void add_trace_kprobe_events(void)
+{
+	struct probe_point *pp;
+	struct strlist *namelist;
+	char buf[MAX_PROBE_BUFFER];
+	char base[MAX_EVENT_NAME_LEN], event[MAX_EVENT_NAME_LEN];
+	int fd, i, j;
+
+	fd = open_kprobe_events(O_RDWR | O_APPEND);
+	namelist = get_trace_kprobe_event_names(fd, NULL);
+
+	printf("Added new event%s:\n", session.nr_probe > 1 ||
+	       session.probes[0].found > 1 ? "s" : "");
+
+	for (j = 0; j < session.nr_probe; j++) {
+		pp = &session.probes[j];
+		get_base_event_name(base, MAX_EVENT_NAME_LEN, pp);
+		for (i = 0; i < pp->found; i++) {
+			get_new_event_name(event, MAX_EVENT_NAME_LEN, base,
+					   namelist);
+			snprintf(buf, MAX_PROBE_BUFFER, "%c:%s/%s %s\n",
+				 pp->retprobe ? 'r' : 'p', PERFPROBE_GROUP,
+				 event, pp->probes[i]);
+			write_trace_kprobe_event(fd, buf);
+
+			/* Keep the name reserved for the next probes */
+			snprintf(buf, MAX_PROBE_BUFFER, "%s:%s",
+				 PERFPROBE_GROUP, event);
+			strlist__add(namelist, buf);
+
+			printf("  %s:%-20s (on %s)\n", PERFPROBE_GROUP, event,
+			       pp->probes[i]);
+		}
+	}
+
+	printf("\nYou can now use it on all perf tools, such as:\n\n");
+	printf("\tperf record -e %s:%s -a sleep 1\n\n", PERFPROBE_GROUP,
+	       event);
+
+	strlist__delete(namelist);
+	close(fd);
+}
+
+static void del_trace_kprobe_events(void)
+{
+	struct strlist *namelist;
+	struct str_node *ent;
+	char buf[MAX_PROBE_BUFFER], name[MAX_EVENT_NAME_LEN * 2];
+	const char *group, *event;
+	unsigned int i;
+	char *p;
+	int fd;
+
+	fd = open_kprobe_events(O_WRONLY | O_APPEND);
+	namelist = get_trace_kprobe_event_names(fd, NULL);
+
+	for (i = 0; i < strlist__nr_entries(session.dellist); i++) {
+		ent = strlist__entry(session.dellist, i);
+		snprintf(name, sizeof(name), "%s", ent->s);
+		p = strchr(name, ':');
+		if (p) {
+			*p = '\0';
+			group = name;
+			event = p + 1;
+		} else {
+			group = PERFPROBE_GROUP;
+			event = name;
+		}
+
+		snprintf(buf, MAX_PROBE_BUFFER, "%s:%s", group, event);
+		if (!strlist__has_entry(namelist, buf)) {
+			fprintf(stderr, "Info: event \"%s\" does not exist, "
+				"could not remove it.\n", buf);
+			continue;
+		}
+
+		snprintf(buf, MAX_PROBE_BUFFER, "-:%s/%s\n", group, event);
+		write_trace_kprobe_event(fd, buf);
+		printf("Remove event: %s:%s\n", group, event);
+	}
+
+	strlist__delete(namelist);
+	close(fd);
+}
+
+static void show_trace_kprobe_events(void)
+{
+	struct strlist *defs, *namelist;
+	struct str_node *ent;
+	unsigned int i;
+	char *def;
+	int fd;
+
+	defs = strlist__new(true, NULL);
+	if (!defs)
+		die("Not enough memory.");
+
+	fd = open_kprobe_events(O_RDONLY);
+	namelist = get_trace_kprobe_event_names(fd, defs);
+	close(fd);
+
+	for (i = 0; i < strlist__nr_entries(defs); i++) {
+		ent = strlist__entry(defs, i);
+		def = strchr(ent->s, ' ');
+		if (!def)
+			continue;
+		*def++ = '\0';
+		printf("  %-30s (on %s)\n", ent->s, def);
+	}
+
+	strlist__delete(namelist);
+	strlist__delete(defs);
+}
+
+#ifdef DWARF_SUPPORT
+static const char *default_search_path[] = {
+	"/lib/modules/%s/build/vmlinux",		/* Custom build kernel */
+	"/usr/lib/debug/lib/modules/%s/vmlinux",	/* Red Hat debuginfo */
+	"/boot/vmlinux-debug-%s",			/* Ubuntu */
+	"/boot/vmlinux-%s",
+	"./vmlinux",				/* CWD */
+	NULL,
+};
+
+static int open_default_vmlinux(void)
+{
+	struct utsname uts;
+	char fname[MAX_PATH_LEN];
+	int fd, ret, i;
+
+	ret = uname(&uts);
+	if (ret) {
+		if (session.verbose)
+			fprintf(stderr, "uname() failed.\n");
+		return -errno;
+	}
+	for (i = 0; default_search_path[i]; i++) {
+		ret = snprintf(fname, MAX_PATH_LEN, default_search_path[i],
+			       uts.release);
+		if (ret < 0 || ret >= MAX_PATH_LEN)
+			continue;
+		if (session.verbose)
+			printf("try to open %s\n", fname);
+		fd = open(fname, O_RDONLY);
+		if (fd >= 0)
+			return fd;
+	}
+	return -ENOENT;
+}
+
+static void find_probe_points_by_dwarf(void)
+{
+	struct probe_point *pp;
+	int fd, i, ret;
+
+	if (session.vmlinux)
+		fd = open(session.vmlinux, O_RDONLY);
+	else
+		fd = open_default_vmlinux();
+	if (fd < 0)
+		die("Could not open vmlinux file.");
+
+	for (i = 0; i < session.nr_probe; i++) {
+		pp = &session.probes[i];
+		ret = find_probepoint(fd, pp);
+		if (ret < 0)
+			die("No dwarf info found in the vmlinux - please "
+			    "rebuild with CONFIG_DEBUG_INFO.");
+		if (ret == 0)
+			die("No probe point found.");
+	}
+	close(fd);
+}
+#endif /* DWARF_SUPPORT */
+
+/* Probe points by symbol, for kernels without debuginfo */
+static void synthesize_probe_points(void)
+{
+	struct probe_point *pp;
+	char buf[MAX_PROBE_BUFFER];
+	int i, j, len;
+
+	for (i = 0; i < session.nr_probe; i++) {
+		pp = &session.probes[i];
+		len = snprintf(buf, MAX_PROBE_BUFFER, "%s+%d", pp->function,
+			       pp->offset);
+		if (len >= MAX_PROBE_BUFFER)
+			die("Too long probe definition.");
+		for (j = 0; j < pp->nr_args; j++) {
+			len += snprintf(buf + len, MAX_PROBE_BUFFER - len,
+					" %s", pp->args[j]);
+			if (len >= MAX_PROBE_BUFFER)
+				die("Too long probe definition.");
+		}
+		pp->probes[0] = strdup(buf);
+		pp->found = 1;
+	}
+}
+
+static const struct option options[] = {
+	OPT_BOOLEAN('v', "verbose", &session.verbose,
+		    "be more verbose (show parsed arguments, etc)"),
+#ifdef DWARF_SUPPORT
+	OPT_STRING('k', "vmlinux", &session.vmlinux, "file",
+		"vmlinux pathname"),
+#endif
+	OPT_BOOLEAN('l', "list", &session.list_events,
+		    "list up current probe events"),
+	OPT_CALLBACK('d', "del", NULL, "[GROUP:]EVENT", "delete a probe event.",
+		opt_del_probe_event),
+	OPT_CALLBACK('a', "add", NULL,
+#ifdef DWARF_SUPPORT
+		"[EVENT=]FUNC[+OFFS|%return|:RLN][@SRC]|SRC:ALN [ARG ...]",
+#else
+		"[EVENT=]FUNC[+OFFS|%return] [ARG ...]",
+#endif
+		"probe point definition, where\n"
+		"\t\tEVENT:\tEvent name\n"
+		"\t\tFUNC:\tFunction name\n"
+		"\t\tOFFS:\tOffset from function entry (in byte)\n"
+		"\t\t%return:\tPut the probe at function return\n"
+#ifdef DWARF_SUPPORT
+		"\t\tSRC:\tSource code path\n"
+		"\t\tRLN:\tRelative line number from function entry.\n"
+		"\t\tALN:\tAbsolute line number in file.\n"
+		"\t\tARG:\tProbe argument (local variable name or\n"
+#else
+		"\t\tARG:\tProbe argument (\n"
+#endif
+		"\t\t\tkprobe-tracer argument format.)\n",
+		opt_add_probe_event),
+	OPT_END()
+};
+
+int cmd_probe(int argc, const char **argv, const char *prefix __used)
+{
+	int i;
+
+	argc = parse_options(argc, argv, options, probe_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	for (i = 0; i < argc; i++)
+		parse_probe_event(argv[i]);
+
+	if ((session.nr_probe == 0 && !session.dellist &&
+	     !session.list_events))
+		usage_with_options(probe_usage, options);
+
+	if (session.list_events) {
+		if (session.nr_probe != 0 || session.dellist)
+			die("Don't use --list with --add/--del.");
+		show_trace_kprobe_events();
+		return 0;
+	}
+
+	if (session.dellist) {
+		del_trace_kprobe_events();
+		strlist__delete(session.dellist);
+		if (session.nr_probe == 0)
+			return 0;
+	}
+
+	if (session.need_dwarf) {
+#ifdef DWARF_SUPPORT
+		find_probe_points_by_dwarf();
+#else
+		die("Debuginfo-analysis is not supported, a probe by line "
+		    "or by variable name needs perf to be built with libdw.");
+#endif
+	} else
+		synthesize_probe_points();
+
+	/* Setting up probe points */
+	add_trace_kprobe_events();
+	return 0;
+}
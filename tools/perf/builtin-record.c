@@ -15,6 +15,7 @@
 #include "util/string.h"
 
 #include "util/header.h"
+#include "util/perf_regs.h"
 
 #include <unistd.h>
 #include <sched.h>
@@ -42,6 +43,8 @@ static int			inherit				= 1;
 static int			force				= 0;
 static int			append_file			= 0;
 static int			call_graph			= 0;
+static int			call_graph_dwarf		= 0;
+static unsigned int		dump_stack_size			= 8192;
 static int			verbose				= 0;
 static int			inherit_stat			= 0;
 static int			no_samples			= 0;
@@ -419,8 +422,18 @@ static void create_counter(int counter, int cpu, pid_t pid)
 	if (call_graph)
 		attr->sample_type	|= PERF_SAMPLE_CALLCHAIN;
 
-	if (raw_samples)
+	if (call_graph_dwarf) {
+		attr->sample_type	|= PERF_SAMPLE_REGS_USER;
+		attr->sample_type	|= PERF_SAMPLE_STACK_USER;
+		attr->sample_regs_user	= PERF_REGS_MASK;
+		attr->sample_stack_user	= dump_stack_size;
+	}
+
+	if (raw_samples) {
+		attr->sample_type	|= PERF_SAMPLE_TIME;
 		attr->sample_type	|= PERF_SAMPLE_RAW;
+		attr->sample_type	|= PERF_SAMPLE_CPU;
+	}
 
 	attr->mmap		= track;
 	attr->comm		= track;
@@ -639,6 +652,61 @@ static int __cmd_record(int argc, const char **argv)
 	return 0;
 }
 
+/*
+ * --call-graph-mode=fp|dwarf[,size]: with 'dwarf' the user registers
+ * and the top of the user stack are dumped with each sample, for perf
+ * report to unwind the user part of the callchain with the debug info
+ * of the binaries.  This works without frame pointers.
+ */
+static int
+parse_callchain_mode(const struct option *opt __used, const char *arg,
+		     int unset __used)
+{
+	char *buf, *tok, *endptr;
+	unsigned long size;
+	int ret = -1;
+
+	call_graph = 1;
+
+	buf = strdup(arg);
+	if (!buf)
+		return -1;
+
+	tok = strtok(buf, ",");
+	if (!tok)
+		goto out;
+
+	if (!strcmp(tok, "fp")) {
+		if (strtok(NULL, ","))
+			goto out;
+		call_graph_dwarf = 0;
+		ret = 0;
+	} else if (!strcmp(tok, "dwarf")) {
+		if (!PERF_REGS_MASK) {
+			fprintf(stderr, "dwarf unwinding is not supported"
+					" on this architecture\n");
+			goto out;
+		}
+
+		tok = strtok(NULL, ",");
+		if (tok) {
+			/* the kernel wants a multiple of u64 */
+			size = ALIGN(strtoul(tok, &endptr, 0), sizeof(u64));
+			if (*endptr || !size || size > USHRT_MAX) {
+				fprintf(stderr, "invalid stack dump size: %s\n",
+					tok);
+				goto out;
+			}
+			dump_stack_size = size;
+		}
+		call_graph_dwarf = 1;
+		ret = 0;
+	}
+out:
+	free(buf);
+	return ret;
+}
+
 static const char * const record_usage[] = {
 	"perf record [<options>] [<command>]",
 	"perf record [<options>] -- <command> [<options>]",
@@ -675,6 +743,10 @@ static const struct option options[] = {
 		    "number of mmap data pages"),
 	OPT_BOOLEAN('g', "call-graph", &call_graph,
 		    "do call-graph (stack chain/backtrace) recording"),
+	OPT_CALLBACK(0, "call-graph-mode", NULL, "fp|dwarf[,size]",
+		     "call-graph recording method, implies -g."
+		     " Default: fp, dwarf stack dump size 8192",
+		     parse_callchain_mode),
 	OPT_BOOLEAN('v', "verbose", &verbose,
 		    "be more verbose (show counter open errors, etc)"),
 	OPT_BOOLEAN('s', "stat", &inherit_stat,
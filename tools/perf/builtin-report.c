@@ -20,6 +20,8 @@
 
 #include "perf.h"
 #include "util/header.h"
+#include "util/data_map.h"
+#include "util/unwind.h"
 
 #include "util/parse-options.h"
 #include "util/parse-events.h"
@@ -74,6 +76,7 @@ struct callchain_param	callchain_param = {
 };
 
 static u64		sample_type;
+static u64		sample_regs_user;
 
 struct ip_event {
 	struct perf_event_header header;
@@ -1508,6 +1511,77 @@ static int validate_chain(struct ip_callchain *chain, event_t *event)
 	return 0;
 }
 
+/*
+ * User callchains of samples recorded with --call-graph-mode=dwarf are
+ * unwound from the stack dump and replace the user part of the chain
+ * the kernel walked, which needs frame pointers.
+ */
+#define UNWIND_CHAIN_MAX	256
+
+struct unwind_chain {
+	struct thread		*thread;
+	struct ip_callchain	*chain;
+};
+
+static int unwind__find_map(u64 ip, struct unwind_map *umap, void *arg)
+{
+	struct unwind_chain *uc = arg;
+	struct map *map = thread__find_map(uc->thread, ip);
+
+	if (!map || map->map_ip != map__map_ip)
+		return -1;
+
+	umap->start	= map->start;
+	umap->end	= map->end;
+	umap->pgoff	= map->pgoff;
+	umap->filename	= map->dso->name;
+
+	return 0;
+}
+
+static int unwind__add_entry(u64 ip, void *arg)
+{
+	struct unwind_chain *uc = arg;
+
+	if (uc->chain->nr >= UNWIND_CHAIN_MAX)
+		return -1;
+
+	uc->chain->ips[uc->chain->nr++] = ip;
+	return 0;
+}
+
+static struct ip_callchain *
+unwind_callchain(struct thread *thread, struct ip_callchain *chain,
+		 struct sample_data *data)
+{
+	static u64 buf[UNWIND_CHAIN_MAX + 1];
+	struct unwind_chain uc = {
+		.thread	= thread,
+		.chain	= (struct ip_callchain *)buf,
+	};
+	unsigned int i;
+	int nr;
+
+	uc.chain->nr = 0;
+
+	/* keep the kernel part */
+	for (i = 0; i < chain->nr && i < UNWIND_CHAIN_MAX - 1; i++) {
+		if (chain->ips[i] == PERF_CONTEXT_USER)
+			break;
+		uc.chain->ips[uc.chain->nr++] = chain->ips[i];
+	}
+	uc.chain->ips[uc.chain->nr++] = PERF_CONTEXT_USER;
+
+	nr = unwind__get_entries(unwind__add_entry, unwind__find_map, &uc,
+				 data, UNWIND_CHAIN_MAX - uc.chain->nr);
+	if (nr <= 0)
+		return chain;
+
+	dprintf("... unwound chain: nr:%Lu\n", uc.chain->nr);
+
+	return uc.chain;
+}
+
 static int
 process_sample_event(event_t *event, unsigned long offset, unsigned long head)
 {
@@ -1518,14 +1592,15 @@ process_sample_event(event_t *event, unsigned long offset, unsigned long head)
 	u64 ip = event->ip.ip;
 	u64 period = 1;
 	struct map *map = NULL;
-	void *more_data = event->ip.__more_data;
 	struct ip_callchain *chain = NULL;
+	struct sample_data data;
 	int cpumode;
 
-	if (sample_type & PERF_SAMPLE_PERIOD) {
-		period = *(u64 *)more_data;
-		more_data += sizeof(u64);
-	}
+	perf_sample__parse(&event->header, sample_type, sample_regs_user,
+			   &data);
+
+	if (sample_type & PERF_SAMPLE_PERIOD)
+		period = data.period;
 
 	dprintf("%p [%p]: PERF_EVENT_SAMPLE (IP, %d): %d/%d: %p period: %Ld\n",
 		(void *)(offset + head),
@@ -1538,7 +1613,7 @@ process_sample_event(event_t *event, unsigned long offset, unsigned long head)
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
 		unsigned int i;
 
-		chain = (void *)more_data;
+		chain = data.callchain;
 
 		dprintf("... chain: nr:%Lu\n", chain->nr);
 
@@ -1561,6 +1636,9 @@ process_sample_event(event_t *event, unsigned long offset, unsigned long head)
 		return -1;
 	}
 
+	if (chain && callchain && data.user_stack.size)
+		chain = unwind_callchain(thread, chain, &data);
+
 	if (comm_list && !strlist__has_entry(comm_list, thread->comm))
 		return 0;
 
@@ -1871,6 +1949,8 @@ static int __cmd_report(void)
 	head = header->data_offset;
 
 	sample_type = perf_header__sample_type();
+	if (header->attrs)
+		sample_regs_user = header->attr[0]->attr.sample_regs_user;
 
 	if (!(sample_type & PERF_SAMPLE_CALLCHAIN)) {
 		if (sort__has_parent) {
@@ -0,0 +1,1135 @@
+/*
+ * builtin-sched.c
+ *
+ * Builtin sched command: Record the scheduler tracepoints of the
+ * system into perf.data, and analyze them:
+ *
+ *  perf sched record  - record sched_switch/wakeup/migrate events
+ *  perf sched latency - per task runtime and wakeup-to-run latencies
+ *  perf sched map     - per cpu timeline of context switches
+ *  perf sched replay  - replay the recorded run/sleep/wakeup pattern
+ *                       of every task with threads, as a benchmark
+ */
+#include "builtin.h"
+
+#include "util/util.h"
+#include "util/cache.h"
+#include "util/string.h"
+#include "util/trace-event.h"
+
+#include "perf.h"
+#include "util/data_map.h"
+
+#include "util/parse-options.h"
+#include "util/parse-events.h"
+
+#include <sys/types.h>
+#include <sys/prctl.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include <math.h>
+
+static char		const *input_name = "perf.data";
+
+static int		force;
+static int		verbose;
+static int		dump_trace;
+#define dprintf(x...)	do { if (dump_trace) printf(x); } while (0)
+
+#define BUG_ON(x)	assert(!(x))
+
+#define COMM_LEN		16
+#define PID_HASH_BITS		10
+#define PID_HASH_SIZE		(1 << PID_HASH_BITS)
+#define MAX_CPUS		4096
+
+/*
+ * One scheduler tracepoint hit, decoded out of the raw sample so that
+ * all events can be sorted by time before they are analyzed: the
+ * per-cpu buffers are written out in chunks, so perf.data is not in
+ * global time order.
+ */
+enum sched_record_type {
+	SCHED_SWITCH,
+	SCHED_WAKEUP,
+	SCHED_MIGRATE_TASK,
+	SCHED_PROCESS_FORK,
+	SCHED_PROCESS_EXIT,
+};
+
+struct trace_switch_event {
+	char	prev_comm[COMM_LEN];
+	u32	prev_pid;
+	long	prev_state;
+	char	next_comm[COMM_LEN];
+	u32	next_pid;
+};
+
+struct trace_wakeup_event {
+	char	comm[COMM_LEN];
+	u32	pid;
+	u32	success;
+};
+
+struct trace_migrate_task_event {
+	char	comm[COMM_LEN];
+	u32	pid;
+	u32	cpu;
+};
+
+struct trace_fork_event {
+	char	parent_comm[COMM_LEN];
+	u32	parent_pid;
+	char	child_comm[COMM_LEN];
+	u32	child_pid;
+};
+
+struct trace_exit_event {
+	char	comm[COMM_LEN];
+	u32	pid;
+};
+
+struct sched_record {
+	u64			timestamp;
+	unsigned long		seq;
+	u32			cpu;
+	u32			pid;	/* task running when the event hit */
+	enum sched_record_type	type;
+	union {
+		struct trace_switch_event	sw;
+		struct trace_wakeup_event	wakeup;
+		struct trace_migrate_task_event	migrate;
+		struct trace_fork_event		fork;
+		struct trace_exit_event		exit;
+	} ev;
+};
+
+static struct sched_record	*records;
+static unsigned long		nr_records;
+static unsigned long		alloc_records;
+
+/*
+ * Replay atoms: what a task did, in the order it did it.
+ */
+enum sched_event_type {
+	SCHED_EVENT_RUN,
+	SCHED_EVENT_SLEEP,
+	SCHED_EVENT_WAKEUP,
+};
+
+struct sched_atom {
+	enum sched_event_type	type;
+	u64			duration;
+	sem_t			*wait_sem;
+};
+
+struct task_desc {
+	struct task_desc	*hash_next;
+	struct task_desc	*next;
+	u32			pid;
+	char			comm[COMM_LEN];
+
+	/* latency */
+	u64			sched_in_time;
+	u64			ready_time;
+	u64			total_runtime;
+	u64			total_lat;
+	u64			max_lat;
+	u64			max_lat_at;
+	unsigned long		nr_switches;
+	unsigned long		nr_lat;
+
+	/* map */
+	char			shortname[3];
+
+	/* replay */
+	struct sched_atom	**atoms;
+	unsigned long		nr_atoms;
+	struct sched_atom	*pending_sleep;
+	u64			replay_in;
+	pthread_t		thread;
+	sem_t			ready_for_work;
+	u64			cpu_usage;
+};
+
+static struct task_desc		*pid_hash[PID_HASH_SIZE];
+static struct task_desc		*task_list;
+static struct task_desc		**task_tail = &task_list;
+static unsigned long		nr_tasks;
+
+static struct task_desc *find_task(u32 pid, const char *comm)
+{
+	struct task_desc **p = &pid_hash[pid & (PID_HASH_SIZE - 1)];
+	struct task_desc *task;
+
+	for (task = *p; task; task = task->hash_next)
+		if (task->pid == pid)
+			goto found;
+
+	task = calloc(1, sizeof(*task));
+	if (!task)
+		die("not enough memory for a task");
+
+	task->pid = pid;
+	strcpy(task->comm, "<unknown>");
+	task->hash_next = *p;
+	*p = task;
+	*task_tail = task;
+	task_tail = &task->next;
+	nr_tasks++;
+found:
+	if (comm && comm[0]) {
+		strncpy(task->comm, comm, COMM_LEN - 1);
+		task->comm[COMM_LEN - 1] = '\0';
+	}
+
+	return task;
+}
+
+static void fill_comm(char *dst, struct event *event, const char *name,
+		      void *data)
+{
+	char *src = raw_field_ptr(event, name, data);
+
+	if (src)
+		strncpy(dst, src, COMM_LEN - 1);
+	dst[COMM_LEN - 1] = '\0';
+}
+
+#define FILL_FIELD(ptr, field, event, data)	\
+	ptr.field = (typeof(ptr.field)) raw_field_value(event, #field, data)
+
+static struct sched_record *new_record(void)
+{
+	if (nr_records == alloc_records) {
+		alloc_records = alloc_records ? alloc_records * 2 : 65536;
+		records = realloc(records, alloc_records * sizeof(*records));
+		if (!records)
+			die("not enough memory for %lu sched records",
+			    alloc_records);
+	}
+
+	memset(&records[nr_records], 0, sizeof(*records));
+	records[nr_records].seq = nr_records;
+
+	return &records[nr_records++];
+}
+
+static int decode_raw_sample(void *raw_data, u32 cpu, u32 pid, u64 timestamp)
+{
+	struct sched_record *rec;
+	struct event *event;
+	int type;
+
+	type = trace_parse_common_type(raw_data);
+	event = trace_find_event(type);
+	if (!event) {
+		dprintf("  ... no format for event id %d\n", type);
+		return -1;
+	}
+
+	if (strcmp(event->system, "sched"))
+		return 0;
+
+	rec = new_record();
+	rec->timestamp = timestamp;
+	rec->cpu = cpu;
+	rec->pid = pid;
+
+	if (!strcmp(event->name, "sched_switch")) {
+		rec->type = SCHED_SWITCH;
+		fill_comm(rec->ev.sw.prev_comm, event, "prev_comm", raw_data);
+		FILL_FIELD(rec->ev.sw, prev_pid, event, raw_data);
+		FILL_FIELD(rec->ev.sw, prev_state, event, raw_data);
+		fill_comm(rec->ev.sw.next_comm, event, "next_comm", raw_data);
+		FILL_FIELD(rec->ev.sw, next_pid, event, raw_data);
+	} else if (!strcmp(event->name, "sched_wakeup") ||
+		   !strcmp(event->name, "sched_wakeup_new")) {
+		rec->type = SCHED_WAKEUP;
+		fill_comm(rec->ev.wakeup.comm, event, "comm", raw_data);
+		FILL_FIELD(rec->ev.wakeup, pid, event, raw_data);
+		FILL_FIELD(rec->ev.wakeup, success, event, raw_data);
+	} else if (!strcmp(event->name, "sched_migrate_task")) {
+		rec->type = SCHED_MIGRATE_TASK;
+		fill_comm(rec->ev.migrate.comm, event, "comm", raw_data);
+		FILL_FIELD(rec->ev.migrate, pid, event, raw_data);
+		rec->ev.migrate.cpu =
+			raw_field_value(event, "dest_cpu", raw_data);
+	} else if (!strcmp(event->name, "sched_process_fork")) {
+		rec->type = SCHED_PROCESS_FORK;
+		fill_comm(rec->ev.fork.parent_comm, event, "parent_comm",
+			  raw_data);
+		FILL_FIELD(rec->ev.fork, parent_pid, event, raw_data);
+		fill_comm(rec->ev.fork.child_comm, event, "child_comm",
+			  raw_data);
+		FILL_FIELD(rec->ev.fork, child_pid, event, raw_data);
+	} else if (!strcmp(event->name, "sched_process_exit")) {
+		rec->type = SCHED_PROCESS_EXIT;
+		fill_comm(rec->ev.exit.comm, event, "comm", raw_data);
+		FILL_FIELD(rec->ev.exit, pid, event, raw_data);
+	} else {
+		/* Not an event we analyze, drop it again */
+		nr_records--;
+	}
+
+	return 0;
+}
+
+static int process_sample_event(struct sample_data *data)
+{
+	if (!data->raw_size)
+		return -1;
+
+	return decode_raw_sample(data->raw_data, data->cpu, data->tid,
+				 data->time);
+}
+
+static int sample_type_check(u64 type)
+{
+	if (!(type & PERF_SAMPLE_RAW) ||
+	    !(type & PERF_SAMPLE_TIME) ||
+	    !(type & PERF_SAMPLE_CPU)) {
+		fprintf(stderr, "%s has no raw, time or cpu sample data, "
+			"was it recorded with 'perf sched record'?\n",
+			input_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct perf_file_handler file_handler = {
+	.sample_type_check	= sample_type_check,
+	.process_sample_event	= process_sample_event,
+};
+
+static int compare_records(const void *a, const void *b)
+{
+	const struct sched_record *l = a, *r = b;
+
+	if (l->timestamp != r->timestamp)
+		return l->timestamp < r->timestamp ? -1 : 1;
+
+	/* keep the file order of events with the same timestamp */
+	return l->seq < r->seq ? -1 : l->seq > r->seq;
+}
+
+static void read_events(void)
+{
+	file_handler.dump_trace = dump_trace;
+	mmap_dispatch_perf_file(&file_handler, input_name, force,
+				"perf sched record");
+
+	qsort(records, nr_records, sizeof(*records), compare_records);
+}
+
+static void print_bad_events(void)
+{
+	perf_file_handler__print_bad_events(&file_handler);
+}
+
+/*
+ * Per-subcommand handlers of the decoded, time ordered events:
+ */
+struct trace_sched_handler {
+	void (*switch_event)(struct sched_record *rec);
+	void (*wakeup_event)(struct sched_record *rec);
+	void (*migrate_task_event)(struct sched_record *rec);
+	void (*fork_event)(struct sched_record *rec);
+	void (*exit_event)(struct sched_record *rec);
+};
+
+static struct trace_sched_handler *trace_handler;
+
+static void process_records(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr_records; i++) {
+		struct sched_record *rec = &records[i];
+
+		switch (rec->type) {
+		case SCHED_SWITCH:
+			dprintf("%13.6f [%03d] sched_switch: %s:%d "
+				"(state %ld) => %s:%d\n",
+				(double)rec->timestamp / 1e9, rec->cpu,
+				rec->ev.sw.prev_comm, rec->ev.sw.prev_pid,
+				rec->ev.sw.prev_state,
+				rec->ev.sw.next_comm, rec->ev.sw.next_pid);
+			if (trace_handler->switch_event)
+				trace_handler->switch_event(rec);
+			break;
+		case SCHED_WAKEUP:
+			dprintf("%13.6f [%03d] sched_wakeup: %s:%d "
+				"(success %d) by %d\n",
+				(double)rec->timestamp / 1e9, rec->cpu,
+				rec->ev.wakeup.comm, rec->ev.wakeup.pid,
+				rec->ev.wakeup.success, rec->pid);
+			if (trace_handler->wakeup_event)
+				trace_handler->wakeup_event(rec);
+			break;
+		case SCHED_MIGRATE_TASK:
+			if (trace_handler->migrate_task_event)
+				trace_handler->migrate_task_event(rec);
+			break;
+		case SCHED_PROCESS_FORK:
+			if (trace_handler->fork_event)
+				trace_handler->fork_event(rec);
+			break;
+		case SCHED_PROCESS_EXIT:
+			if (trace_handler->exit_event)
+				trace_handler->exit_event(rec);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * latency: wakeup-to-run delay and runtime of every task.
+ *
+ * A task becomes ready when it is woken up, or when it is preempted
+ * while still runnable; the delay is the time from there until it is
+ * switched in again.
+ */
+static void latency_switch_event(struct sched_record *rec)
+{
+	struct trace_switch_event *sw = &rec->ev.sw;
+	struct task_desc *prev, *next;
+	u64 now = rec->timestamp;
+
+	if (sw->prev_pid) {
+		prev = find_task(sw->prev_pid, sw->prev_comm);
+		if (prev->sched_in_time && now > prev->sched_in_time)
+			prev->total_runtime += now - prev->sched_in_time;
+		prev->sched_in_time = 0;
+
+		/* preempted while runnable: it is waiting for the cpu */
+		prev->ready_time = sw->prev_state ? 0 : now;
+	}
+
+	if (sw->next_pid) {
+		next = find_task(sw->next_pid, sw->next_comm);
+		if (next->ready_time && now >= next->ready_time) {
+			u64 delta = now - next->ready_time;
+
+			next->total_lat += delta;
+			next->nr_lat++;
+			if (delta > next->max_lat) {
+				next->max_lat = delta;
+				next->max_lat_at = now;
+			}
+		}
+		next->ready_time = 0;
+		next->sched_in_time = now;
+		next->nr_switches++;
+	}
+}
+
+static void latency_wakeup_event(struct sched_record *rec)
+{
+	struct trace_wakeup_event *wakeup = &rec->ev.wakeup;
+	struct task_desc *task;
+
+	if (!wakeup->success || !wakeup->pid)
+		return;
+
+	task = find_task(wakeup->pid, wakeup->comm);
+
+	/* Already running or already waiting for the cpu */
+	if (task->sched_in_time || task->ready_time)
+		return;
+
+	task->ready_time = rec->timestamp;
+}
+
+static void latency_fork_event(struct sched_record *rec)
+{
+	find_task(rec->ev.fork.child_pid, rec->ev.fork.child_comm);
+}
+
+static struct trace_sched_handler lat_ops = {
+	.switch_event		= latency_switch_event,
+	.wakeup_event		= latency_wakeup_event,
+	.fork_event		= latency_fork_event,
+};
+
+typedef int (*sort_fn_t)(struct task_desc *, struct task_desc *);
+
+struct sort_dimension {
+	const char	*name;
+	sort_fn_t	cmp;
+};
+
+static int pid_cmp(struct task_desc *l, struct task_desc *r)
+{
+	if (l->pid < r->pid)
+		return -1;
+	if (l->pid > r->pid)
+		return 1;
+	return 0;
+}
+
+static int comm_cmp(struct task_desc *l, struct task_desc *r)
+{
+	return strcmp(l->comm, r->comm);
+}
+
+static int u64_cmp_desc(u64 l, u64 r)
+{
+	if (l > r)
+		return -1;
+	if (l < r)
+		return 1;
+	return 0;
+}
+
+static u64 avg_lat(struct task_desc *task)
+{
+	return task->nr_lat ? task->total_lat / task->nr_lat : 0;
+}
+
+static int avg_cmp(struct task_desc *l, struct task_desc *r)
+{
+	return u64_cmp_desc(avg_lat(l), avg_lat(r));
+}
+
+static int max_cmp(struct task_desc *l, struct task_desc *r)
+{
+	return u64_cmp_desc(l->max_lat, r->max_lat);
+}
+
+static int switch_cmp(struct task_desc *l, struct task_desc *r)
+{
+	return u64_cmp_desc(l->nr_switches, r->nr_switches);
+}
+
+static int runtime_cmp(struct task_desc *l, struct task_desc *r)
+{
+	return u64_cmp_desc(l->total_runtime, r->total_runtime);
+}
+
+static struct sort_dimension sort_dimensions[] = {
+	{ "pid",	pid_cmp		},
+	{ "comm",	comm_cmp	},
+	{ "avg",	avg_cmp		},
+	{ "max",	max_cmp		},
+	{ "switch",	switch_cmp	},
+	{ "runtime",	runtime_cmp	},
+};
+
+#define MAX_SORT_KEYS	ARRAY_SIZE(sort_dimensions)
+
+static sort_fn_t	sort_keys[MAX_SORT_KEYS];
+static unsigned int	nr_sort_keys;
+
+static const char	default_sort_order[] = "avg, max, switch, runtime";
+static const char	*sort_order = default_sort_order;
+
+static int sort_dimension__add(const char *tok)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sort_dimensions); i++) {
+		if (strcmp(sort_dimensions[i].name, tok))
+			continue;
+		if (nr_sort_keys == MAX_SORT_KEYS)
+			return -1;
+		sort_keys[nr_sort_keys++] = sort_dimensions[i].cmp;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int task_sort_cmp(const void *a, const void *b)
+{
+	struct task_desc *l = *(struct task_desc **)a;
+	struct task_desc *r = *(struct task_desc **)b;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < nr_sort_keys; i++) {
+		ret = sort_keys[i](l, r);
+		if (ret)
+			return ret;
+	}
+
+	return pid_cmp(l, r);
+}
+
+static void setup_sorting(const struct option *options,
+			  const char * const *usage_msg)
+{
+	char *tmp, *tok, *str = strdup(sort_order);
+
+	for (tok = strtok_r(str, ", ", &tmp);
+			tok; tok = strtok_r(NULL, ", ", &tmp)) {
+		if (sort_dimension__add(tok) < 0) {
+			error("Unknown --sort key: `%s'", tok);
+			usage_with_options(usage_msg, options);
+		}
+	}
+
+	free(str);
+}
+
+static void output_lat_thread(struct task_desc *task)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s:%d", task->comm, task->pid);
+	printf("  %-22s", name);
+
+	printf("|%11.3f ms |%9lu | avg:%9.3f ms | max:%9.3f ms "
+	       "| max at: %13.6f s\n",
+	       (double)task->total_runtime / 1e6,
+	       task->nr_switches,
+	       (double)avg_lat(task) / 1e6,
+	       (double)task->max_lat / 1e6,
+	       (double)task->max_lat_at / 1e9);
+}
+
+static void __cmd_lat(void)
+{
+	struct task_desc **sorted, *task;
+	u64 all_runtime = 0;
+	unsigned long all_count = 0, i, n = 0;
+
+	trace_handler = &lat_ops;
+	read_events();
+	process_records();
+
+	sorted = calloc(nr_tasks, sizeof(*sorted));
+	if (!sorted && nr_tasks)
+		die("not enough memory to sort %lu tasks", nr_tasks);
+
+	for (task = task_list; task; task = task->next) {
+		if (!task->nr_switches)
+			continue;
+		sorted[n++] = task;
+	}
+	qsort(sorted, n, sizeof(*sorted), task_sort_cmp);
+
+	printf("\n -----------------------------------------------------------------------------------------------------------------\n");
+	printf("  Task                  |   Runtime ms  | Switches | Average delay ms | Maximum delay ms | Maximum delay at     |\n");
+	printf(" -----------------------------------------------------------------------------------------------------------------\n");
+
+	for (i = 0; i < n; i++) {
+		output_lat_thread(sorted[i]);
+		all_runtime += sorted[i]->total_runtime;
+		all_count += sorted[i]->nr_switches;
+	}
+
+	printf(" -----------------------------------------------------------------------------------------------------------------\n");
+
+	printf("  TOTAL:                |%11.3f ms |%9lu |\n",
+	       (double)all_runtime / 1e6, all_count);
+
+	printf(" ---------------------------------------------------\n");
+
+	print_bad_events();
+	printf("\n");
+
+	free(sorted);
+}
+
+/*
+ * map: one line per context switch, one column per cpu, showing which
+ * task runs where.  Tasks get a two character short name the first
+ * time they are seen, '*' marks the cpu that switched.
+ */
+static struct task_desc		*curr_task[MAX_CPUS];
+static int			max_cpu;
+static char			next_shortname1 = 'A';
+static char			next_shortname2 = '0';
+
+static void map_switch_event(struct sched_record *rec)
+{
+	struct trace_switch_event *sw = &rec->ev.sw;
+	struct task_desc *next = NULL;
+	int new_shortname = 0;
+	int cpu, this_cpu = rec->cpu;
+
+	if (this_cpu >= MAX_CPUS)
+		return;
+	if (this_cpu > max_cpu)
+		max_cpu = this_cpu;
+
+	if (sw->next_pid) {
+		next = find_task(sw->next_pid, sw->next_comm);
+		if (!next->shortname[0]) {
+			next->shortname[0] = next_shortname1;
+			next->shortname[1] = next_shortname2;
+
+			if (next_shortname1 < 'Z') {
+				next_shortname1++;
+			} else {
+				next_shortname1 = 'A';
+				if (next_shortname2 < '9')
+					next_shortname2++;
+				else
+					next_shortname2 = '0';
+			}
+			new_shortname = 1;
+		}
+	}
+	curr_task[this_cpu] = next;
+
+	printf("  ");
+	for (cpu = 0; cpu <= max_cpu; cpu++) {
+		if (cpu != this_cpu)
+			printf(" ");
+		else
+			printf("*");
+
+		if (curr_task[cpu])
+			printf("%2s ", curr_task[cpu]->shortname);
+		else
+			printf("   ");
+	}
+
+	printf("  %12.6f secs ", (double)rec->timestamp / 1e9);
+	if (new_shortname)
+		printf("%s => %s:%d", next->shortname, next->comm, next->pid);
+	printf("\n");
+}
+
+static struct trace_sched_handler map_ops = {
+	.switch_event		= map_switch_event,
+};
+
+static void __cmd_map(void)
+{
+	unsigned long i;
+
+	trace_handler = &map_ops;
+	read_events();
+
+	/* Size the map by the cpus present in the trace up front */
+	for (i = 0; i < nr_records; i++)
+		if ((int)records[i].cpu > max_cpu &&
+		    records[i].cpu < MAX_CPUS)
+			max_cpu = records[i].cpu;
+
+	setup_pager();
+	process_records();
+	print_bad_events();
+}
+
+/*
+ * replay: turn the recorded events into a list of run, sleep and
+ * wakeup atoms per task, then run one thread per task that burns the
+ * cpu for each run, blocks for each sleep and posts the semaphore of
+ * the sleep it ended for each wakeup.  Sleeps whose wakeup was not
+ * seen (interrupts on an idle cpu, timers) do not block.
+ */
+static int			replay_repeat = 10;
+static u64			run_measurement_overhead;
+static u64			recorded_runtime;
+static unsigned long		nr_run_events, nr_sleep_events,
+				nr_wakeup_events, nr_lost_wakeups;
+
+static pthread_mutex_t		start_work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t		work_done_wait_mutex =
+					PTHREAD_MUTEX_INITIALIZER;
+
+static struct sched_atom *add_atom(struct task_desc *task,
+				   enum sched_event_type type)
+{
+	struct sched_atom *atom = calloc(1, sizeof(*atom));
+	unsigned long size = sizeof(struct sched_atom *) * (task->nr_atoms + 1);
+
+	if (!atom)
+		die("not enough memory for a sched atom");
+
+	task->atoms = realloc(task->atoms, size);
+	if (!task->atoms)
+		die("not enough memory for %lu sched atoms", task->nr_atoms);
+
+	atom->type = type;
+	task->atoms[task->nr_atoms++] = atom;
+
+	return atom;
+}
+
+static void replay_switch_event(struct sched_record *rec)
+{
+	struct trace_switch_event *sw = &rec->ev.sw;
+	struct task_desc *prev, *next;
+	struct sched_atom *atom;
+	u64 now = rec->timestamp;
+
+	if (sw->prev_pid) {
+		prev = find_task(sw->prev_pid, sw->prev_comm);
+		if (prev->replay_in && now > prev->replay_in) {
+			atom = add_atom(prev, SCHED_EVENT_RUN);
+			atom->duration = now - prev->replay_in;
+			recorded_runtime += atom->duration;
+			nr_run_events++;
+		}
+		prev->replay_in = 0;
+
+		if (sw->prev_state) {
+			prev->pending_sleep = add_atom(prev, SCHED_EVENT_SLEEP);
+			nr_sleep_events++;
+		}
+	}
+
+	if (sw->next_pid) {
+		next = find_task(sw->next_pid, sw->next_comm);
+		next->replay_in = now;
+		/* whatever woke it was not seen, don't wait for it */
+		next->pending_sleep = NULL;
+	}
+}
+
+static void replay_wakeup_event(struct sched_record *rec)
+{
+	struct trace_wakeup_event *wakeup = &rec->ev.wakeup;
+	struct task_desc *waker, *wakee;
+	struct sched_atom *sleep, *atom;
+
+	if (!wakeup->success || !wakeup->pid)
+		return;
+
+	wakee = find_task(wakeup->pid, wakeup->comm);
+	sleep = wakee->pending_sleep;
+
+	/* Wakeups from interrupts on an idle cpu can not be replayed */
+	if (!sleep || !rec->pid || rec->pid == wakeup->pid) {
+		nr_lost_wakeups++;
+		return;
+	}
+
+	waker = find_task(rec->pid, NULL);
+
+	sleep->wait_sem = malloc(sizeof(*sleep->wait_sem));
+	if (!sleep->wait_sem)
+		die("not enough memory for a semaphore");
+	sem_init(sleep->wait_sem, 0, 0);
+	wakee->pending_sleep = NULL;
+
+	atom = add_atom(waker, SCHED_EVENT_WAKEUP);
+	atom->wait_sem = sleep->wait_sem;
+	nr_wakeup_events++;
+}
+
+static void replay_fork_event(struct sched_record *rec)
+{
+	find_task(rec->ev.fork.child_pid, rec->ev.fork.child_comm);
+}
+
+static struct trace_sched_handler replay_ops = {
+	.switch_event		= replay_switch_event,
+	.wakeup_event		= replay_wakeup_event,
+	.fork_event		= replay_fork_event,
+};
+
+static u64 get_nsecs(void)
+{
+	return rdclock();
+}
+
+static u64 get_cpu_usage_nsec_self(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void burn_nsecs(u64 nsecs)
+{
+	u64 T0 = get_nsecs(), T1;
+
+	do {
+		T1 = get_nsecs();
+	} while (T1 + run_measurement_overhead < T0 + nsecs);
+}
+
+static void calibrate_run_measurement_overhead(void)
+{
+	u64 T0, T1, delta, min_delta = 1000000000ULL;
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		T0 = get_nsecs();
+		burn_nsecs(0);
+		T1 = get_nsecs();
+		delta = T1 - T0;
+		min_delta = min(min_delta, delta);
+	}
+	run_measurement_overhead = min_delta;
+
+	printf("run measurement overhead: %Lu nsecs\n",
+	       (unsigned long long)min_delta);
+}
+
+static void perform_sched_event(struct sched_atom *atom)
+{
+	switch (atom->type) {
+	case SCHED_EVENT_RUN:
+		burn_nsecs(atom->duration);
+		break;
+	case SCHED_EVENT_SLEEP:
+		if (atom->wait_sem)
+			while (sem_wait(atom->wait_sem) && errno == EINTR)
+				;
+		break;
+	case SCHED_EVENT_WAKEUP:
+		sem_post(atom->wait_sem);
+		break;
+	default:
+		BUG_ON(1);
+	}
+}
+
+static void *thread_func(void *ctx)
+{
+	struct task_desc *this_task = ctx;
+	u64 cpu_usage_0, cpu_usage_1;
+	unsigned long i;
+	char comm2[22];
+
+	sprintf(comm2, ":%s", this_task->comm);
+	prctl(PR_SET_NAME, comm2);
+
+	sem_post(&this_task->ready_for_work);
+
+	/* Wait for the go signal */
+	pthread_mutex_lock(&start_work_mutex);
+	pthread_mutex_unlock(&start_work_mutex);
+
+	cpu_usage_0 = get_cpu_usage_nsec_self();
+
+	for (i = 0; i < this_task->nr_atoms; i++)
+		perform_sched_event(this_task->atoms[i]);
+
+	cpu_usage_1 = get_cpu_usage_nsec_self();
+	this_task->cpu_usage = cpu_usage_1 - cpu_usage_0;
+
+	return NULL;
+}
+
+static void reset_semaphores(void)
+{
+	struct task_desc *task;
+	unsigned long i;
+
+	for (task = task_list; task; task = task->next) {
+		for (i = 0; i < task->nr_atoms; i++) {
+			struct sched_atom *atom = task->atoms[i];
+
+			if (atom->type != SCHED_EVENT_SLEEP || !atom->wait_sem)
+				continue;
+			sem_destroy(atom->wait_sem);
+			sem_init(atom->wait_sem, 0, 0);
+		}
+	}
+}
+
+static void run_one_test(int run, double *sum_runtime)
+{
+	u64 T0, T1, delta, cpu_usage = 0;
+	struct task_desc *task;
+	pthread_attr_t attr;
+	int err;
+
+	reset_semaphores();
+
+	err = pthread_attr_init(&attr);
+	BUG_ON(err);
+	err = pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN < 16 * 1024 ?
+					16 * 1024 : PTHREAD_STACK_MIN);
+	BUG_ON(err);
+
+	pthread_mutex_lock(&start_work_mutex);
+
+	for (task = task_list; task; task = task->next) {
+		if (!task->nr_atoms)
+			continue;
+		sem_init(&task->ready_for_work, 0, 0);
+		err = pthread_create(&task->thread, &attr, thread_func, task);
+		if (err)
+			die("cannot create replay thread: %s", strerror(err));
+	}
+
+	for (task = task_list; task; task = task->next) {
+		if (!task->nr_atoms)
+			continue;
+		while (sem_wait(&task->ready_for_work) && errno == EINTR)
+			;
+	}
+
+	pthread_mutex_lock(&work_done_wait_mutex);
+	T0 = get_nsecs();
+	pthread_mutex_unlock(&start_work_mutex);
+
+	for (task = task_list; task; task = task->next) {
+		if (!task->nr_atoms)
+			continue;
+		pthread_join(task->thread, NULL);
+		sem_destroy(&task->ready_for_work);
+		cpu_usage += task->cpu_usage;
+	}
+
+	T1 = get_nsecs();
+	pthread_mutex_unlock(&work_done_wait_mutex);
+	pthread_attr_destroy(&attr);
+
+	delta = T1 - T0;
+	*sum_runtime += delta;
+
+	printf("#%-3d: %0.3f ms, ravg: %0.2f ms, cpu: %0.2f / %0.2f ms\n",
+	       run + 1, (double)delta / 1e6,
+	       *sum_runtime / (run + 1) / 1e6,
+	       (double)cpu_usage / 1e6,
+	       (double)recorded_runtime / 1e6);
+}
+
+static void __cmd_replay(void)
+{
+	double sum_runtime = 0;
+	int i;
+
+	calibrate_run_measurement_overhead();
+
+	trace_handler = &replay_ops;
+	read_events();
+	process_records();
+
+	printf("nr_run_events:        %lu\n", nr_run_events);
+	printf("nr_sleep_events:      %lu\n", nr_sleep_events);
+	printf("nr_wakeup_events:     %lu\n", nr_wakeup_events);
+	if (verbose)
+		printf("nr_lost_wakeups:      %lu\n", nr_lost_wakeups);
+
+	print_bad_events();
+
+	printf("------------------------------------------------------------\n");
+	for (i = 0; i < replay_repeat; i++)
+		run_one_test(i, &sum_runtime);
+}
+
+static const char * const sched_usage[] = {
+	"perf sched [<options>] {record|latency|map|replay}",
+	NULL
+};
+
+static const struct option sched_options[] = {
+	OPT_STRING('i', "input", &input_name, "file",
+		    "input file name"),
+	OPT_BOOLEAN('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('f', "force", &force,
+		    "don't complain, do it"),
+	OPT_END()
+};
+
+static const char * const latency_usage[] = {
+	"perf sched latency [<options>]",
+	NULL
+};
+
+static const struct option latency_options[] = {
+	OPT_STRING('s', "sort", &sort_order, "key[,key2...]",
+		   "sort by key(s): runtime, switch, avg, max, pid, comm"),
+	OPT_BOOLEAN('v', "verbose", &verbose,
+		    "be more verbose (show counter open errors, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+};
+
+static const char * const replay_usage[] = {
+	"perf sched replay [<options>]",
+	NULL
+};
+
+static const struct option replay_options[] = {
+	OPT_INTEGER('r', "repeat", &replay_repeat,
+		    "repeat the workload replay N times"),
+	OPT_BOOLEAN('v', "verbose", &verbose,
+		    "be more verbose (show counter open errors, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+};
+
+static const char *record_args[] = {
+	"record",
+	"-a",
+	"-R",
+	"-f",
+	"-m", "1024",
+	"-c", "1",
+	"-e", "sched:sched_switch:r",
+	"-e", "sched:sched_wakeup:r",
+	"-e", "sched:sched_wakeup_new:r",
+	"-e", "sched:sched_migrate_task:r",
+	"-e", "sched:sched_process_fork:r",
+	"-e", "sched:sched_process_exit:r",
+};
+
+static int __cmd_record(int argc, const char **argv)
+{
+	unsigned int rec_argc, i, j;
+	const char **rec_argv;
+
+	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	rec_argv = calloc(rec_argc + 1, sizeof(char *));
+	if (!rec_argv)
+		die("not enough memory for the record arguments");
+
+	/* parse_events() modifies the event strings, hand it copies */
+	for (i = 0; i < ARRAY_SIZE(record_args); i++)
+		rec_argv[i] = strdup(record_args[i]);
+
+	for (j = 1; j < (unsigned int)argc; j++, i++)
+		rec_argv[i] = argv[j];
+
+	BUG_ON(i != rec_argc);
+
+	return cmd_record(i, rec_argv, NULL);
+}
+
+int cmd_sched(int argc, const char **argv, const char *prefix __used)
+{
+	argc = parse_options(argc, argv, sched_options, sched_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (!argc)
+		usage_with_options(sched_usage, sched_options);
+
+	if (!strncmp(argv[0], "rec", 3)) {
+		return __cmd_record(argc, argv);
+	} else if (!strncmp(argv[0], "lat", 3)) {
+		if (argc > 1) {
+			argc = parse_options(argc, argv, latency_options,
+					     latency_usage, 0);
+			if (argc)
+				usage_with_options(latency_usage,
+						   latency_options);
+		}
+		setup_sorting(latency_options, latency_usage);
+		__cmd_lat();
+	} else if (!strcmp(argv[0], "map")) {
+		__cmd_map();
+	} else if (!strncmp(argv[0], "rep", 3)) {
+		if (argc > 1) {
+			argc = parse_options(argc, argv, replay_options,
+					     replay_usage, 0);
+			if (argc)
+				usage_with_options(replay_usage,
+						   replay_options);
+		}
+		__cmd_replay();
+	} else {
+		usage_with_options(sched_usage, sched_options);
+	}
+
+	return 0;
+}
@@ -0,0 +1,1049 @@
+/*
+ * builtin-trace.c
+ *
+ * Builtin trace command: show the system calls of a workload, like
+ * strace, but from the raw_syscalls:sys_enter/sys_exit tracepoints
+ * instead of ptrace.  The traced tasks never stop: the events go into
+ * the perf counter mmap buffers and are decoded from there, so this
+ * can be used on live hosts.
+ *
+ *  perf trace <command>   - trace a new command and its children
+ *  perf trace -p <pid>    - attach to a running task
+ *  perf trace -a          - trace every task in the system
+ *
+ * Page faults and context switches of the traced tasks can be shown
+ * interleaved with the system calls, and a per thread summary of the
+ * system call latencies is printed at the end with -s/-S.
+ */
+#include "builtin.h"
+
+#include "util/util.h"
+#include "util/cache.h"
+#include "util/strlist.h"
+#include "util/syscall-names.h"
+#include "util/trace-event.h"
+
+#include "perf.h"
+#include "util/data_map.h"
+
+#include "util/parse-options.h"
+#include "util/parse-events.h"
+
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/wait.h>
+
+static int		target_pid			= -1;
+static int		system_wide;
+static int		summary_only;
+static int		with_summary;
+static int		trace_pgfaults;
+static int		trace_sched;
+static int		mmap_pages			= 128;
+static const char	*duration_str;
+static const char	*syscall_list_str;
+static const char	*output_name;
+
+static u64		duration_filter;
+static struct strlist	*syscall_list;
+static FILE		*output;
+
+static pid_t		self_pid;
+static long		page_size;
+static int		nr_cpus;
+static volatile int	done;
+
+#define COMM_LEN		16
+#define PID_HASH_BITS		8
+#define PID_HASH_SIZE		(1 << PID_HASH_BITS)
+#define MAX_SYSCALLS		1024
+
+/*
+ * How to show a system call argument.  Arguments without a formatter
+ * are shown in hex.
+ */
+enum arg_fmt {
+	ARG_HEX = 0,
+	ARG_INT,
+	ARG_UINT,
+	ARG_OCT,
+	ARG_FD,
+	ARG_OPEN_FLAGS,
+	ARG_MMAP_PROT,
+	ARG_MMAP_FLAGS,
+};
+
+struct syscall_fmt {
+	const char	*name;
+	int		nr_args;
+	enum arg_fmt	arg[6];
+	int		hexret;		/* returns an address */
+	int		noreturn;
+};
+
+/* Sorted by name, for bsearch() */
+static struct syscall_fmt syscall_fmts[] = {
+	{ .name = "access",		.nr_args = 2, .arg = { ARG_HEX, ARG_OCT } },
+	{ .name = "arch_prctl",		.nr_args = 2, .arg = { ARG_HEX, ARG_HEX } },
+	{ .name = "brk",		.nr_args = 1, .arg = { ARG_HEX }, .hexret = 1 },
+	{ .name = "chdir",		.nr_args = 1, .arg = { ARG_HEX } },
+	{ .name = "clone",		.nr_args = 5, .arg = { ARG_HEX, ARG_HEX, ARG_HEX, ARG_HEX, ARG_HEX } },
+	{ .name = "close",		.nr_args = 1, .arg = { ARG_FD } },
+	{ .name = "connect",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_UINT } },
+	{ .name = "dup",		.nr_args = 1, .arg = { ARG_FD } },
+	{ .name = "dup2",		.nr_args = 2, .arg = { ARG_FD, ARG_FD } },
+	{ .name = "epoll_wait",		.nr_args = 4, .arg = { ARG_FD, ARG_HEX, ARG_INT, ARG_INT } },
+	{ .name = "execve",		.nr_args = 3, .arg = { ARG_HEX, ARG_HEX, ARG_HEX } },
+	{ .name = "exit",		.nr_args = 1, .arg = { ARG_INT }, .noreturn = 1 },
+	{ .name = "exit_group",		.nr_args = 1, .arg = { ARG_INT }, .noreturn = 1 },
+	{ .name = "fcntl",		.nr_args = 3, .arg = { ARG_FD, ARG_INT, ARG_HEX } },
+	{ .name = "fstat",		.nr_args = 2, .arg = { ARG_FD, ARG_HEX } },
+	{ .name = "futex",		.nr_args = 6, .arg = { ARG_HEX, ARG_INT, ARG_INT, ARG_HEX, ARG_HEX, ARG_INT } },
+	{ .name = "getdents",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_UINT } },
+	{ .name = "ioctl",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_HEX } },
+	{ .name = "kill",		.nr_args = 2, .arg = { ARG_INT, ARG_INT } },
+	{ .name = "lseek",		.nr_args = 3, .arg = { ARG_FD, ARG_INT, ARG_INT } },
+	{ .name = "lstat",		.nr_args = 2, .arg = { ARG_HEX, ARG_HEX } },
+	{ .name = "madvise",		.nr_args = 3, .arg = { ARG_HEX, ARG_UINT, ARG_INT } },
+	{ .name = "mmap",		.nr_args = 6, .arg = { ARG_HEX, ARG_UINT, ARG_MMAP_PROT, ARG_MMAP_FLAGS, ARG_FD, ARG_HEX }, .hexret = 1 },
+	{ .name = "mprotect",		.nr_args = 3, .arg = { ARG_HEX, ARG_UINT, ARG_MMAP_PROT } },
+	{ .name = "munmap",		.nr_args = 2, .arg = { ARG_HEX, ARG_UINT } },
+	{ .name = "nanosleep",		.nr_args = 2, .arg = { ARG_HEX, ARG_HEX } },
+	{ .name = "open",		.nr_args = 3, .arg = { ARG_HEX, ARG_OPEN_FLAGS, ARG_OCT } },
+	{ .name = "openat",		.nr_args = 4, .arg = { ARG_FD, ARG_HEX, ARG_OPEN_FLAGS, ARG_OCT } },
+	{ .name = "pipe",		.nr_args = 1, .arg = { ARG_HEX } },
+	{ .name = "poll",		.nr_args = 3, .arg = { ARG_HEX, ARG_UINT, ARG_INT } },
+	{ .name = "pread64",		.nr_args = 4, .arg = { ARG_FD, ARG_HEX, ARG_UINT, ARG_INT } },
+	{ .name = "pwrite64",		.nr_args = 4, .arg = { ARG_FD, ARG_HEX, ARG_UINT, ARG_INT } },
+	{ .name = "read",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_UINT } },
+	{ .name = "readlink",		.nr_args = 3, .arg = { ARG_HEX, ARG_HEX, ARG_UINT } },
+	{ .name = "recvfrom",		.nr_args = 6, .arg = { ARG_FD, ARG_HEX, ARG_UINT, ARG_HEX, ARG_HEX, ARG_HEX } },
+	{ .name = "rt_sigaction",	.nr_args = 4, .arg = { ARG_INT, ARG_HEX, ARG_HEX, ARG_UINT } },
+	{ .name = "rt_sigprocmask",	.nr_args = 4, .arg = { ARG_INT, ARG_HEX, ARG_HEX, ARG_UINT } },
+	{ .name = "select",		.nr_args = 5, .arg = { ARG_INT, ARG_HEX, ARG_HEX, ARG_HEX, ARG_HEX } },
+	{ .name = "sendto",		.nr_args = 6, .arg = { ARG_FD, ARG_HEX, ARG_UINT, ARG_HEX, ARG_HEX, ARG_UINT } },
+	{ .name = "set_robust_list",	.nr_args = 2, .arg = { ARG_HEX, ARG_UINT } },
+	{ .name = "set_tid_address",	.nr_args = 1, .arg = { ARG_HEX } },
+	{ .name = "socket",		.nr_args = 3, .arg = { ARG_INT, ARG_INT, ARG_INT } },
+	{ .name = "stat",		.nr_args = 2, .arg = { ARG_HEX, ARG_HEX } },
+	{ .name = "wait4",		.nr_args = 4, .arg = { ARG_INT, ARG_HEX, ARG_HEX, ARG_HEX } },
+	{ .name = "write",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_UINT } },
+	{ .name = "writev",		.nr_args = 3, .arg = { ARG_FD, ARG_HEX, ARG_UINT } },
+};
+
+struct syscall {
+	const char		*name;
+	struct syscall_fmt	*fmt;
+	int			filtered;	/* not in the -e list */
+};
+
+static struct syscall	syscalls[MAX_SYSCALLS];
+
+static int syscall_fmt__cmp(const void *name, const void *fmt)
+{
+	return strcmp(name, ((const struct syscall_fmt *)fmt)->name);
+}
+
+static struct syscall *syscall__find(long id)
+{
+	static char name_buf[MAX_SYSCALLS][16];
+	struct syscall *sc;
+
+	if (id < 0 || id >= MAX_SYSCALLS)
+		return NULL;
+
+	sc = &syscalls[id];
+	if (sc->name)
+		return sc;
+
+	if (id < nr_syscall_names && syscall_names[id]) {
+		sc->name = syscall_names[id];
+		sc->fmt = bsearch(sc->name, syscall_fmts,
+				  ARRAY_SIZE(syscall_fmts),
+				  sizeof(struct syscall_fmt),
+				  syscall_fmt__cmp);
+	} else {
+		snprintf(name_buf[id], sizeof(name_buf[id]), "syscall_%ld", id);
+		sc->name = name_buf[id];
+	}
+
+	if (syscall_list && !strlist__has_entry(syscall_list, sc->name))
+		sc->filtered = 1;
+
+	return sc;
+}
+
+/*
+ * Latency statistics of one system call, in one thread:
+ */
+struct syscall_stats {
+	u64		nr;
+	u64		nr_errors;
+	u64		total;
+	u64		min;
+	u64		max;
+};
+
+struct thread_trace {
+	struct thread_trace	*next;
+	pid_t			tid;
+	char			comm[COMM_LEN];
+
+	/* The system call the thread is in, if any */
+	int			entry_pending;
+	long			entry_id;
+	u64			entry_time;
+	unsigned long		entry_args[6];
+
+	u64			nr_events;
+	u64			nr_pgfaults;
+	struct syscall_stats	*stats;
+};
+
+static struct thread_trace	*threads[PID_HASH_SIZE];
+
+static void thread__comm_from_proc(struct thread_trace *thread)
+{
+	char path[64], buf[128], *start, *end;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", thread->tid);
+	file = fopen(path, "r");
+	if (!file)
+		return;
+
+	if (fgets(buf, sizeof(buf), file)) {
+		start = strchr(buf, '(');
+		end = strrchr(buf, ')');
+		if (start && end && end > start) {
+			*end = '\0';
+			strncpy(thread->comm, start + 1, COMM_LEN - 1);
+		}
+	}
+	fclose(file);
+}
+
+static struct thread_trace *thread__findnew(pid_t tid)
+{
+	struct thread_trace **p = &threads[tid & (PID_HASH_SIZE - 1)];
+	struct thread_trace *thread;
+
+	for (thread = *p; thread; thread = thread->next)
+		if (thread->tid == tid)
+			return thread;
+
+	thread = calloc(1, sizeof(*thread));
+	if (!thread)
+		die("not enough memory for a thread");
+
+	thread->tid = tid;
+	strcpy(thread->comm, ":?");
+	thread__comm_from_proc(thread);
+
+	thread->next = *p;
+	*p = thread;
+
+	return thread;
+}
+
+/*
+ * The counters, and how to decode what they sample:
+ */
+enum trace_counter_type {
+	TRACE_SYS_ENTER,
+	TRACE_SYS_EXIT,
+	TRACE_MAJ_FAULT,
+	TRACE_MIN_FAULT,
+	TRACE_SCHED_SWITCH,
+};
+
+static const char *trace_counter_events[] = {
+	[TRACE_SYS_ENTER]	= "raw_syscalls:sys_enter",
+	[TRACE_SYS_EXIT]	= "raw_syscalls:sys_exit",
+	[TRACE_MAJ_FAULT]	= "major-faults",
+	[TRACE_MIN_FAULT]	= "minor-faults",
+	[TRACE_SCHED_SWITCH]	= "sched:sched_switch",
+};
+
+static enum trace_counter_type	counter_type[MAX_COUNTERS];
+static struct event		*counter_format[MAX_COUNTERS];
+
+static int			fd[MAX_NR_CPUS][MAX_COUNTERS];
+static struct pollfd		event_array[MAX_NR_CPUS * MAX_COUNTERS];
+static int			nr_poll;
+
+static void add_counter(enum trace_counter_type type)
+{
+	struct perf_counter_attr *attr;
+	int counter = nr_counters;
+
+	if (parse_events(NULL, trace_counter_events[type], 0))
+		die("%s is not available, is debugfs mounted and "
+		    "CONFIG_FTRACE_SYSCALLS enabled?\n",
+		    trace_counter_events[type]);
+
+	attr = &attrs[counter];
+	attr->sample_type	= PERF_SAMPLE_IP | PERF_SAMPLE_TID |
+				  PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+	attr->sample_period	= 1;
+
+	if (attr->type == PERF_TYPE_TRACEPOINT) {
+		attr->sample_type |= PERF_SAMPLE_RAW;
+		counter_format[counter] = trace_find_event(attr->config);
+		if (!counter_format[counter])
+			die("no format for %s\n", trace_counter_events[type]);
+	} else {
+		attr->sample_type |= PERF_SAMPLE_ADDR;
+	}
+
+	/* The first counter reports the comm changes of the tasks */
+	attr->comm = !counter;
+	attr->inherit = !system_wide;
+
+	counter_type[counter] = type;
+}
+
+struct mmap_data {
+	int			counter;
+	void			*base;
+	unsigned int		mask;
+	unsigned int		prev;
+};
+
+static struct mmap_data		mmap_array[MAX_NR_CPUS][MAX_COUNTERS];
+
+static void open_counters(int nr_cpu, int cpu, pid_t pid)
+{
+	struct mmap_data *md;
+	int counter;
+
+	for (counter = 0; counter < nr_counters; counter++) {
+		fd[nr_cpu][counter] = sys_perf_counter_open(&attrs[counter],
+							    pid, cpu, -1, 0);
+		if (fd[nr_cpu][counter] < 0) {
+			int err = errno;
+
+			if (err == EPERM)
+				die("Permission error - are you root?\n");
+			die("perfcounter syscall returned with %d (%s)\n",
+			    fd[nr_cpu][counter], strerror(err));
+		}
+		fcntl(fd[nr_cpu][counter], F_SETFL, O_NONBLOCK);
+
+		event_array[nr_poll].fd = fd[nr_cpu][counter];
+		event_array[nr_poll].events = POLLIN;
+		nr_poll++;
+
+		md = &mmap_array[nr_cpu][counter];
+		md->counter = counter;
+		md->prev = 0;
+		md->mask = mmap_pages * page_size - 1;
+		md->base = mmap(NULL, (mmap_pages + 1) * page_size,
+				PROT_READ, MAP_SHARED, fd[nr_cpu][counter], 0);
+		if (md->base == MAP_FAILED)
+			die("failed to mmap with %d (%s)\n",
+			    errno, strerror(errno));
+	}
+}
+
+/*
+ * The events of a round of reading all the buffers are copied out and
+ * sorted by time before they are processed: with -a every cpu has its
+ * own buffer.
+ */
+struct batch_entry {
+	u64			time;
+	unsigned int		offset;
+	int			counter;
+};
+
+static char			*batch_buf;
+static unsigned int		batch_size, batch_alloc;
+static struct batch_entry	*batch;
+static unsigned int		nr_batch, batch_entries_alloc;
+
+static u64			nr_events, nr_lost;
+static u64			first_time;
+
+struct comm_event {
+	struct perf_event_header	header;
+	u32				pid, tid;
+	char				comm[COMM_LEN];
+};
+
+struct lost_event {
+	struct perf_event_header	header;
+	u64				id;
+	u64				lost;
+};
+
+static void *batch__alloc(int counter, unsigned int size)
+{
+	struct batch_entry *entry;
+
+	if (batch_size + size > batch_alloc) {
+		batch_alloc = (batch_alloc + size) * 2;
+		batch_buf = realloc(batch_buf, batch_alloc);
+		if (!batch_buf)
+			die("not enough memory for the events");
+	}
+
+	if (nr_batch == batch_entries_alloc) {
+		batch_entries_alloc = (batch_entries_alloc + 64) * 2;
+		batch = realloc(batch, batch_entries_alloc * sizeof(*batch));
+		if (!batch)
+			die("not enough memory for the events");
+	}
+
+	entry = &batch[nr_batch++];
+	entry->offset = batch_size;
+	entry->counter = counter;
+	batch_size += size;
+
+	return batch_buf + entry->offset;
+}
+
+static unsigned int mmap_read_head(struct mmap_data *md)
+{
+	struct perf_counter_mmap_page *pc = md->base;
+	int head;
+
+	head = pc->data_head;
+	rmb();
+
+	return head;
+}
+
+static void mmap_read(struct mmap_data *md)
+{
+	unsigned int head = mmap_read_head(md);
+	unsigned int old = md->prev;
+	unsigned char *data = md->base + page_size;
+	struct perf_event_header *event;
+	struct sample_data sample;
+	unsigned int size, offset, len, cpy;
+	char *dst;
+	int diff;
+
+	/*
+	 * If we're further behind than half the buffer, there's a chance
+	 * the writer will bite our tail and mess up the samples under us:
+	 * restart at head.
+	 */
+	diff = head - old;
+	if (diff > (int)md->mask / 2 || diff < 0) {
+		fprintf(stderr, "WARNING: failed to keep up with mmap data.\n");
+		old = head;
+	}
+
+	while (old != head) {
+		event = (struct perf_event_header *)&data[old & md->mask];
+		size = event->size;
+		if (!size)
+			break;
+
+		dst = batch__alloc(md->counter, size);
+
+		/* The event may straddle the end of the buffer */
+		offset = old;
+		len = size;
+		do {
+			cpy = min(md->mask + 1 - (offset & md->mask), len);
+			memcpy(dst, &data[offset & md->mask], cpy);
+			offset += cpy;
+			dst += cpy;
+			len -= cpy;
+		} while (len);
+
+		old += size;
+
+		event = (void *)batch_buf + batch[nr_batch - 1].offset;
+
+		switch (event->type) {
+		case PERF_EVENT_SAMPLE:
+			perf_sample__parse(event,
+					   attrs[md->counter].sample_type, 0,
+					   &sample);
+			batch[nr_batch - 1].time = sample.time;
+			break;
+
+		case PERF_EVENT_COMM: {
+			struct comm_event *comm = (void *)event;
+			struct thread_trace *thread;
+
+			thread = thread__findnew(comm->tid);
+			strncpy(thread->comm, comm->comm, COMM_LEN);
+			thread->comm[COMM_LEN - 1] = '\0';
+			nr_batch--;
+			batch_size -= size;
+			break;
+		}
+
+		case PERF_EVENT_LOST:
+			nr_lost += ((struct lost_event *)event)->lost;
+			/* fall through */
+		default:
+			nr_batch--;
+			batch_size -= size;
+			break;
+		}
+	}
+
+	md->prev = old;
+}
+
+static void print_ts(struct thread_trace *thread, u64 time, u64 duration)
+{
+	if (!first_time)
+		first_time = time;
+
+	fprintf(output, "%10.3f (%7.3f ms): %s/%d ",
+		(double)(time - first_time) / 1e6,
+		(double)duration / 1e6, thread->comm, thread->tid);
+}
+
+struct flag_name {
+	unsigned long	flag;
+	const char	*name;
+};
+
+#define F(x)	{ x, #x }
+
+static struct flag_name open_flags[] = {
+	F(O_CREAT), F(O_EXCL), F(O_NOCTTY), F(O_TRUNC), F(O_APPEND),
+	F(O_NONBLOCK), F(O_SYNC), F(O_DIRECT), F(O_LARGEFILE),
+	F(O_DIRECTORY), F(O_NOFOLLOW), F(O_NOATIME), F(O_CLOEXEC),
+};
+
+static struct flag_name mmap_prot[] = {
+	F(PROT_READ), F(PROT_WRITE), F(PROT_EXEC),
+};
+
+static struct flag_name mmap_flags[] = {
+	F(MAP_SHARED), F(MAP_PRIVATE), F(MAP_FIXED), F(MAP_ANONYMOUS),
+	F(MAP_GROWSDOWN), F(MAP_DENYWRITE), F(MAP_EXECUTABLE),
+	F(MAP_LOCKED), F(MAP_NORESERVE), F(MAP_POPULATE),
+	F(MAP_NONBLOCK), F(MAP_STACK),
+};
+
+#undef F
+
+static void print_flags(unsigned long val, struct flag_name *names, int nr,
+			int printed)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!(val & names[i].flag))
+			continue;
+		fprintf(output, "%s%s", printed++ ? "|" : "", names[i].name);
+		val &= ~names[i].flag;
+	}
+
+	if (val || !printed)
+		fprintf(output, "%s%#lx", printed ? "|" : "", val);
+}
+
+static void print_arg(enum arg_fmt fmt, unsigned long val)
+{
+	switch (fmt) {
+	case ARG_INT:
+		fprintf(output, "%ld", (long)val);
+		break;
+	case ARG_UINT:
+		fprintf(output, "%lu", val);
+		break;
+	case ARG_OCT:
+		fprintf(output, "%#lo", val);
+		break;
+	case ARG_FD:
+		if ((int)val == AT_FDCWD)
+			fprintf(output, "AT_FDCWD");
+		else
+			fprintf(output, "%d", (int)val);
+		break;
+	case ARG_OPEN_FLAGS:
+		switch (val & O_ACCMODE) {
+		case O_RDONLY:
+			fprintf(output, "O_RDONLY");
+			break;
+		case O_WRONLY:
+			fprintf(output, "O_WRONLY");
+			break;
+		default:
+			fprintf(output, "O_RDWR");
+			break;
+		}
+		val &= ~(unsigned long)O_ACCMODE;
+		if (val)
+			print_flags(val, open_flags, ARRAY_SIZE(open_flags), 1);
+		break;
+	case ARG_MMAP_PROT:
+		if (!val)
+			fprintf(output, "PROT_NONE");
+		else
+			print_flags(val, mmap_prot, ARRAY_SIZE(mmap_prot), 0);
+		break;
+	case ARG_MMAP_FLAGS:
+		print_flags(val, mmap_flags, ARRAY_SIZE(mmap_flags), 0);
+		break;
+	case ARG_HEX:
+	default:
+		fprintf(output, "%#lx", val);
+		break;
+	}
+}
+
+static void print_syscall(struct syscall *sc, unsigned long *args)
+{
+	int i, nr_args = sc->fmt ? sc->fmt->nr_args : 6;
+
+	fprintf(output, "%s(", sc->name);
+	for (i = 0; i < nr_args; i++) {
+		if (i)
+			fprintf(output, ", ");
+		print_arg(sc->fmt ? sc->fmt->arg[i] : ARG_HEX, args[i]);
+	}
+	fprintf(output, ")");
+}
+
+static void print_ret(struct syscall *sc, long ret)
+{
+	if (ret < 0 && ret >= -4095)
+		fprintf(output, " = -1 (%s)\n", strerror(-ret));
+	else if (sc->fmt && sc->fmt->hexret)
+		fprintf(output, " = %#lx\n", ret);
+	else
+		fprintf(output, " = %ld\n", ret);
+}
+
+static struct syscall_stats *thread__stats(struct thread_trace *thread,
+					   long id)
+{
+	if (!thread->stats) {
+		thread->stats = calloc(MAX_SYSCALLS, sizeof(*thread->stats));
+		if (!thread->stats)
+			die("not enough memory for the syscall statistics");
+	}
+
+	return &thread->stats[id];
+}
+
+static void update_stats(struct thread_trace *thread, long id, long ret,
+			 u64 duration)
+{
+	struct syscall_stats *stats = thread__stats(thread, id);
+
+	stats->nr++;
+	if (ret < 0 && ret >= -4095)
+		stats->nr_errors++;
+	stats->total += duration;
+	if (!stats->min || duration < stats->min)
+		stats->min = duration;
+	if (duration > stats->max)
+		stats->max = duration;
+}
+
+/*
+ * The kernel's args[] is an array of unsigned long, which need not be
+ * the size of ours:
+ */
+static void read_args(struct event *format, void *raw, unsigned long *args)
+{
+	struct format_field *field = trace_find_field(format, "args");
+	int i, size;
+
+	memset(args, 0, 6 * sizeof(*args));
+	if (!field)
+		return;
+
+	size = field->size / 6;
+	for (i = 0; i < 6; i++) {
+		void *p = raw + field->offset + i * size;
+
+		if (size == sizeof(u64))
+			args[i] = *(u64 *)p;
+		else
+			args[i] = *(u32 *)p;
+	}
+}
+
+static void process_sys_enter(struct thread_trace *thread, struct event *format,
+			      struct sample_data *sample)
+{
+	long id = raw_field_value(format, "id", sample->raw_data);
+	struct syscall *sc = syscall__find(id);
+
+	if (!sc)
+		return;
+
+	thread->entry_pending = 1;
+	thread->entry_id = id;
+	thread->entry_time = sample->time;
+	read_args(format, sample->raw_data, thread->entry_args);
+
+	/* There will be no sys_exit to print it from */
+	if (sc->fmt && sc->fmt->noreturn) {
+		thread->entry_pending = 0;
+		update_stats(thread, id, 0, 0);
+		if (summary_only || sc->filtered)
+			return;
+		print_ts(thread, sample->time, 0);
+		print_syscall(sc, thread->entry_args);
+		fprintf(output, " = ?\n");
+	}
+}
+
+static void process_sys_exit(struct thread_trace *thread, struct event *format,
+			     struct sample_data *sample)
+{
+	long id = raw_field_value(format, "id", sample->raw_data);
+	long ret = raw_field_value(format, "ret", sample->raw_data);
+	struct syscall *sc = syscall__find(id);
+	u64 duration = 0;
+	int resumed;
+
+	if (!sc)
+		return;
+
+	resumed = !thread->entry_pending || thread->entry_id != id;
+	if (!resumed) {
+		duration = sample->time - thread->entry_time;
+		update_stats(thread, id, ret, duration);
+	}
+	thread->entry_pending = 0;
+
+	if (summary_only || sc->filtered || duration < duration_filter)
+		return;
+
+	print_ts(thread, sample->time, duration);
+	if (resumed)
+		fprintf(output, "... [continued]: %s()", sc->name);
+	else
+		print_syscall(sc, thread->entry_args);
+	print_ret(sc, ret);
+}
+
+static void process_pgfault(struct thread_trace *thread, int major,
+			    struct sample_data *sample)
+{
+	thread->nr_pgfaults++;
+
+	if (summary_only)
+		return;
+
+	print_ts(thread, sample->time, 0);
+	fprintf(output, "%sfault [%#Lx] => %#Lx\n", major ? "maj" : "min",
+		(unsigned long long)sample->ip,
+		(unsigned long long)sample->addr);
+}
+
+static char task_state_char(long state)
+{
+	static const char states[] = "RSDTtZX";
+	int bit = state ? __builtin_ffsl(state) : 0;
+
+	return bit < (int)sizeof(states) - 1 ? states[bit] : '?';
+}
+
+static void process_sched_switch(struct thread_trace *thread,
+				 struct event *format,
+				 struct sample_data *sample)
+{
+	void *raw = sample->raw_data;
+
+	if (summary_only)
+		return;
+
+	print_ts(thread, sample->time, 0);
+	fprintf(output, "sched_switch [%c] => %s/%Ld\n",
+		task_state_char(raw_field_value(format, "prev_state", raw)),
+		(char *)raw_field_ptr(format, "next_comm", raw),
+		(long long)raw_field_value(format, "next_pid", raw));
+}
+
+static int batch_entry__cmp(const void *a, const void *b)
+{
+	const struct batch_entry *l = a, *r = b;
+
+	if (l->time < r->time)
+		return -1;
+	if (l->time > r->time)
+		return 1;
+
+	return (int)l->offset - (int)r->offset;
+}
+
+static void process_batch(void)
+{
+	struct perf_event_header *event;
+	struct thread_trace *thread;
+	struct sample_data sample;
+	unsigned int i;
+	int counter;
+
+	qsort(batch, nr_batch, sizeof(*batch), batch_entry__cmp);
+
+	for (i = 0; i < nr_batch; i++) {
+		counter = batch[i].counter;
+		event = (void *)batch_buf + batch[i].offset;
+
+		perf_sample__parse(event, attrs[counter].sample_type, 0,
+				   &sample);
+
+		/* Don't show ourselves with -a */
+		if (system_wide && sample.pid == (u32)self_pid)
+			continue;
+
+		nr_events++;
+		thread = thread__findnew(sample.tid);
+		thread->nr_events++;
+
+		switch (counter_type[counter]) {
+		case TRACE_SYS_ENTER:
+			process_sys_enter(thread, counter_format[counter],
+					  &sample);
+			break;
+		case TRACE_SYS_EXIT:
+			process_sys_exit(thread, counter_format[counter],
+					 &sample);
+			break;
+		case TRACE_MAJ_FAULT:
+		case TRACE_MIN_FAULT:
+			process_pgfault(thread,
+					counter_type[counter] == TRACE_MAJ_FAULT,
+					&sample);
+			break;
+		case TRACE_SCHED_SWITCH:
+			process_sched_switch(thread, counter_format[counter],
+					     &sample);
+			break;
+		default:
+			break;
+		}
+	}
+
+	nr_batch = 0;
+	batch_size = 0;
+}
+
+static void mmap_read_all(void)
+{
+	int i, counter;
+	int nr = system_wide ? nr_cpus : 1;
+
+	for (i = 0; i < nr; i++)
+		for (counter = 0; counter < nr_counters; counter++)
+			mmap_read(&mmap_array[i][counter]);
+
+	process_batch();
+}
+
+static void print_thread_summary(struct thread_trace *thread)
+{
+	struct syscall_stats *stats;
+	struct syscall *sc;
+	long id;
+
+	if (!thread->stats && !thread->nr_pgfaults)
+		return;
+
+	fprintf(output, "\n %s (%d), %Lu events", thread->comm, thread->tid,
+		(unsigned long long)thread->nr_events);
+	if (thread->nr_pgfaults)
+		fprintf(output, ", %Lu page faults",
+			(unsigned long long)thread->nr_pgfaults);
+	fprintf(output, "\n\n");
+
+	if (!thread->stats)
+		return;
+
+	fprintf(output, "   %-20s %8s %8s %10s %10s %10s %10s\n",
+		"syscall", "calls", "errors", "total", "min", "avg", "max");
+	fprintf(output, "   %-20s %8s %8s %10s %10s %10s %10s\n",
+		"", "", "", "(msec)", "(msec)", "(msec)", "(msec)");
+	fprintf(output, "   -------------------- -------- -------- "
+		"---------- ---------- ---------- ----------\n");
+
+	for (id = 0; id < MAX_SYSCALLS; id++) {
+		stats = &thread->stats[id];
+		if (!stats->nr)
+			continue;
+
+		sc = syscall__find(id);
+		if (sc->filtered)
+			continue;
+
+		fprintf(output, "   %-20s %8Lu %8Lu %10.3f %10.3f %10.3f %10.3f\n",
+			sc->name, (unsigned long long)stats->nr,
+			(unsigned long long)stats->nr_errors,
+			(double)stats->total / 1e6, (double)stats->min / 1e6,
+			(double)stats->total / stats->nr / 1e6,
+			(double)stats->max / 1e6);
+	}
+}
+
+static void print_summary(void)
+{
+	struct thread_trace *thread;
+	int i;
+
+	fprintf(output, "\n Summary of events:\n");
+
+	for (i = 0; i < PID_HASH_SIZE; i++)
+		for (thread = threads[i]; thread; thread = thread->next)
+			print_thread_summary(thread);
+
+	fprintf(output, "\n");
+}
+
+static void sig_handler(int sig __used)
+{
+	done = 1;
+}
+
+static int __cmd_trace(int argc, const char **argv)
+{
+	int go_pipe[2];
+	pid_t child_pid = -1;
+	char bf;
+	int i;
+
+	self_pid = getpid();
+	page_size = sysconf(_SC_PAGE_SIZE);
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	assert(nr_cpus <= MAX_NR_CPUS);
+	assert(nr_cpus >= 0);
+
+	add_counter(TRACE_SYS_ENTER);
+	add_counter(TRACE_SYS_EXIT);
+	if (trace_pgfaults) {
+		add_counter(TRACE_MAJ_FAULT);
+		add_counter(TRACE_MIN_FAULT);
+	}
+	if (trace_sched)
+		add_counter(TRACE_SCHED_SWITCH);
+
+	signal(SIGCHLD, sig_handler);
+	signal(SIGINT, sig_handler);
+
+	/*
+	 * Start the workload stopped on a pipe, so that the counters can
+	 * be attached to it (and be inherited by its children) before it
+	 * runs.
+	 */
+	if (argc) {
+		if (pipe(go_pipe) < 0)
+			die("failed to create pipe");
+
+		child_pid = fork();
+		if (child_pid < 0)
+			die("failed to fork");
+
+		if (!child_pid) {
+			close(go_pipe[1]);
+			if (read(go_pipe[0], &bf, 1) != 1)
+				exit(-1);
+			execvp(argv[0], (char **)argv);
+			perror(argv[0]);
+			exit(-1);
+		}
+		close(go_pipe[0]);
+		target_pid = child_pid;
+	}
+
+	if (system_wide) {
+		for (i = 0; i < nr_cpus; i++)
+			open_counters(i, i, -1);
+	} else {
+		open_counters(0, -1, target_pid);
+	}
+
+	if (child_pid > 0) {
+		bf = 0;
+		if (write(go_pipe[1], &bf, 1) != 1)
+			die("failed to start the workload");
+		close(go_pipe[1]);
+	}
+
+	while (!done) {
+		u64 before = nr_events;
+
+		mmap_read_all();
+		if (nr_events == before)
+			poll(event_array, nr_poll, 100);
+	}
+	mmap_read_all();
+
+	if (child_pid > 0)
+		waitpid(child_pid, NULL, 0);
+
+	if (summary_only || with_summary)
+		print_summary();
+
+	if (nr_lost)
+		fprintf(stderr, "  INFO: %Lu events lost\n",
+			(unsigned long long)nr_lost);
+
+	return 0;
+}
+
+static const char * const trace_usage[] = {
+	"perf trace [<options>] [<command>]",
+	"perf trace [<options>] -- <command> [<options>]",
+	NULL
+};
+
+static const struct option options[] = {
+	OPT_STRING('e', "expr", &syscall_list_str, "syscall[,syscall...]",
+		    "only show these system calls"),
+	OPT_STRING('o', "output", &output_name, "file",
+		    "output file name (default: stderr)"),
+	OPT_INTEGER('p', "pid", &target_pid,
+		    "trace events on existing process id"),
+	OPT_BOOLEAN('a', "all-cpus", &system_wide,
+		    "system-wide collection from all CPUs"),
+	OPT_INTEGER('m', "mmap-pages", &mmap_pages,
+		    "number of mmap data pages"),
+	OPT_STRING(0, "duration", &duration_str, "msec",
+		    "show only events with duration > N.M ms"),
+	OPT_BOOLEAN('s', "summary", &summary_only,
+		    "show only the syscall summary with statistics"),
+	OPT_BOOLEAN('S', "with-summary", &with_summary,
+		    "show all syscalls and the summary with statistics"),
+	OPT_BOOLEAN('F', "pf", &trace_pgfaults,
+		    "show major and minor page faults"),
+	OPT_BOOLEAN(0, "sched", &trace_sched,
+		    "show the context switches of the traced tasks"),
+	OPT_END()
+};
+
+int cmd_trace(int argc, const char **argv, const char *prefix __used)
+{
+	argc = parse_options(argc, argv, options, trace_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (!argc && target_pid == -1 && !system_wide)
+		usage_with_options(trace_usage, options);
+
+	if (mmap_pages <= 0 || (mmap_pages & (mmap_pages - 1)))
+		die("--mmap-pages must be a power of two\n");
+
+	if (duration_str)
+		duration_filter = atof(duration_str) * 1e6;
+
+	if (syscall_list_str) {
+		syscall_list = strlist__new(true, syscall_list_str);
+		if (!syscall_list)
+			die("not enough memory for the syscall list");
+	}
+
+	output = stderr;
+	if (output_name) {
+		output = fopen(output_name, "w");
+		if (!output)
+			die("failed to create %s: %s\n", output_name,
+			    strerror(errno));
+	}
+
+	return __cmd_trace(argc, argv);
+}
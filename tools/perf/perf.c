@@ -288,9 +288,15 @@ static void handle_internal_command(int argc, const char **argv)
 		{ "list", cmd_list, 0 },
 		{ "record", cmd_record, 0 },
 		{ "report", cmd_report, 0 },
+		{ "sched", cmd_sched, 0 },
+		{ "probe", cmd_probe, 0 },
+		{ "kmem", cmd_kmem, 0 },
+		{ "lock", cmd_lock, 0 },
 		{ "stat", cmd_stat, 0 },
 		{ "top", cmd_top, 0 },
+		{ "trace", cmd_trace, 0 },
 		{ "annotate", cmd_annotate, 0 },
+		{ "bench", cmd_bench, 0 },
 		{ "version", cmd_version, 0 },
 	};
 	unsigned int i;
@@ -0,0 +1,329 @@
+/*
+ * Reading of perf.data files for the tools that analyze recorded
+ * samples: the file is mmap()ed a window at a time and every sample
+ * record is decoded and handed to the tool.
+ */
+
+#include "util.h"
+#include "data_map.h"
+
+static unsigned long	mmap_window = 32;
+
+#define dprintf(x...)	do { if (handler->dump_trace) printf(x); } while (0)
+
+struct lost_event {
+	struct perf_event_header header;
+	u64 id;
+	u64 lost;
+};
+
+/*
+ * @regs_user is the attr.sample_regs_user of the counter, it gives the
+ * number of registers in a PERF_SAMPLE_REGS_USER dump.
+ */
+void perf_sample__parse(struct perf_event_header *header, u64 sample_type,
+			u64 regs_user, struct sample_data *data)
+{
+	u64 *array = (u64 *)(header + 1);
+
+	memset(data, 0, sizeof(*data));
+
+	if (sample_type & PERF_SAMPLE_IP) {
+		data->ip = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_TID) {
+		u32 *p = (u32 *)array;
+
+		data->pid = p[0];
+		data->tid = p[1];
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_TIME) {
+		data->time = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_ADDR) {
+		data->addr = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_ID) {
+		data->id = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_STREAM_ID) {
+		data->stream_id = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_CPU) {
+		u32 *p = (u32 *)array;
+
+		data->cpu = *p;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_PERIOD) {
+		data->period = *array;
+		array++;
+	}
+
+	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+		data->callchain = (struct ip_callchain *)array;
+		array += data->callchain->nr + 1;
+	}
+
+	if (sample_type & PERF_SAMPLE_RAW) {
+		u32 *p = (u32 *)array;
+
+		data->raw_size = *p;
+		data->raw_data = p + 1;
+		array = (void *)p + sizeof(u32) + data->raw_size;
+	}
+
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		data->user_regs.abi = *array;
+		array++;
+
+		if (data->user_regs.abi) {
+			data->user_regs.mask = regs_user;
+			data->user_regs.regs = array;
+			array += __builtin_popcountll(regs_user);
+		}
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER) {
+		void *end = (void *)header + header->size;
+		u64 size = *array;
+
+		array++;
+
+		/* Don't trust the file: the dump must fit in the record */
+		if (size && (void *)array + sizeof(u64) <= end &&
+		    size <= (u64)(end - (void *)array) - sizeof(u64)) {
+			data->user_stack.size = size;
+			data->user_stack.data = (char *)array;
+			array += size / sizeof(u64);
+			data->user_stack.dyn_size = *array;
+			if (data->user_stack.dyn_size > size)
+				data->user_stack.dyn_size = size;
+		}
+	}
+}
+
+static int process_sample_event(struct perf_file_handler *handler,
+				struct perf_event_header *event,
+				unsigned long offset, unsigned long head)
+{
+	struct sample_data data;
+
+	perf_sample__parse(event, handler->sample_type,
+			   handler->sample_regs_user, &data);
+
+	dprintf("%p [%p]: PERF_EVENT_SAMPLE: cpu %d pid %d time %Lu\n",
+		(void *)(offset + head), (void *)(long)event->size,
+		data.cpu, data.tid, (unsigned long long)data.time);
+
+	handler->nr_events++;
+
+	if (!handler->process_sample_event)
+		return 0;
+
+	return handler->process_sample_event(&data);
+}
+
+static int process_lost_event(struct perf_file_handler *handler,
+			      struct perf_event_header *event,
+			      unsigned long offset, unsigned long head)
+{
+	struct lost_event *lost = (struct lost_event *)event;
+
+	dprintf("%p [%p]: PERF_EVENT_LOST: id:%Ld: lost:%Ld\n",
+		(void *)(offset + head), (void *)(long)event->size,
+		lost->id, lost->lost);
+
+	handler->nr_lost_chunks++;
+	handler->nr_lost_events += lost->lost;
+
+	return 0;
+}
+
+static int process_event(struct perf_file_handler *handler,
+			 struct perf_event_header *event,
+			 unsigned long offset, unsigned long head)
+{
+	switch (event->type) {
+	case PERF_EVENT_SAMPLE:
+		return process_sample_event(handler, event, offset, head);
+
+	case PERF_EVENT_LOST:
+		return process_lost_event(handler, event, offset, head);
+
+	/* mmap, comm, fork and exit records carry nothing we need */
+	case PERF_EVENT_MMAP:
+	case PERF_EVENT_COMM:
+	case PERF_EVENT_FORK:
+	case PERF_EVENT_EXIT:
+	case PERF_EVENT_READ:
+	case PERF_EVENT_THROTTLE:
+	case PERF_EVENT_UNTHROTTLE:
+		return 0;
+
+	default:
+		return -1;
+	}
+}
+
+static u64 perf_header__sample_type(struct perf_header *header)
+{
+	u64 type = 0;
+	int i;
+
+	for (i = 0; i < header->attrs; i++) {
+		struct perf_header_attr *attr = header->attr[i];
+
+		if (!type)
+			type = attr->attr.sample_type;
+		else if (type != attr->attr.sample_type)
+			die("non matching sample_type");
+	}
+
+	return type;
+}
+
+/*
+ * Read all records of @input_name and pass the samples to @handler.
+ * @record_cmd is suggested to the user when the file does not exist.
+ */
+int mmap_dispatch_perf_file(struct perf_file_handler *handler,
+			    const char *input_name, int force,
+			    const char *record_cmd)
+{
+	struct perf_event_header *event;
+	struct perf_header *header;
+	unsigned long offset = 0;
+	unsigned long head, shift;
+	unsigned long page_size = getpagesize();
+	struct stat stat;
+	uint32_t size;
+	char *buf;
+	int input, ret;
+
+	input = open(input_name, O_RDONLY);
+	if (input < 0) {
+		fprintf(stderr, " failed to open file: %s", input_name);
+		if (!strcmp(input_name, "perf.data") && record_cmd)
+			fprintf(stderr, "  (try '%s' first)", record_cmd);
+		fprintf(stderr, "\n");
+		exit(-1);
+	}
+
+	ret = fstat(input, &stat);
+	if (ret < 0) {
+		perror("failed to stat file");
+		exit(-1);
+	}
+
+	if (!force && (stat.st_uid != geteuid())) {
+		fprintf(stderr, "file: %s not owned by current user\n",
+			input_name);
+		exit(-1);
+	}
+
+	if (!stat.st_size) {
+		fprintf(stderr, "zero-sized file, nothing to do!\n");
+		exit(0);
+	}
+
+	header = perf_header__read(input);
+	head = header->data_offset;
+
+	handler->sample_type = perf_header__sample_type(header);
+	if (header->attrs)
+		handler->sample_regs_user =
+			header->attr[0]->attr.sample_regs_user;
+	if (handler->sample_type_check &&
+	    handler->sample_type_check(handler->sample_type) < 0)
+		exit(-1);
+
+	shift = page_size * (head / page_size);
+	offset += shift;
+	head -= shift;
+
+remap:
+	buf = (char *)mmap(NULL, page_size * mmap_window, PROT_READ,
+			   MAP_SHARED, input, offset);
+	if (buf == MAP_FAILED) {
+		perror("failed to mmap file");
+		exit(-1);
+	}
+
+more:
+	event = (struct perf_event_header *)(buf + head);
+
+	if (head + event->size >= page_size * mmap_window) {
+		shift = page_size * (head / page_size);
+
+		ret = munmap(buf, page_size * mmap_window);
+		assert(ret == 0);
+
+		offset += shift;
+		head -= shift;
+		goto remap;
+	}
+
+	size = event->size;
+
+	if (!size || process_event(handler, event, offset, head) < 0) {
+
+		dprintf("%p [%p]: skipping unknown header type: %d\n",
+			(void *)(offset + head),
+			(void *)(long)(event->size),
+			event->type);
+
+		handler->nr_unknown_events++;
+
+		/*
+		 * assume we lost track of the stream, check alignment, and
+		 * increment a single u64 in the hope to catch on again 'soon'.
+		 */
+
+		if (unlikely(head & 7))
+			head &= ~7ULL;
+
+		size = 8;
+	}
+
+	head += size;
+
+	if (offset + head >= header->data_offset + header->data_size)
+		goto done;
+
+	if (offset + head < (unsigned long)stat.st_size)
+		goto more;
+
+done:
+	munmap(buf, page_size * mmap_window);
+	close(input);
+
+	return 0;
+}
+
+void perf_file_handler__print_bad_events(struct perf_file_handler *handler)
+{
+	if (handler->nr_unknown_events)
+		printf("  INFO: %lu unknown or undecodable events\n",
+		       handler->nr_unknown_events);
+	if (handler->nr_lost_events)
+		printf("  INFO: %.3f%% lost events (%lu out of %lu, "
+		       "in %lu chunks)\n",
+		       (double)handler->nr_lost_events /
+		       (double)handler->nr_events * 100.0,
+		       handler->nr_lost_events, handler->nr_events,
+		       handler->nr_lost_chunks);
+}
@@ -0,0 +1,76 @@
+#ifndef __PERF_DATAMAP_H
+#define __PERF_DATAMAP_H
+
+#include "../perf.h"
+#include "header.h"
+
+/*
+ * PERF_SAMPLE_REGS_USER: regs[] holds the registers of mask, in
+ * ascending order of their number (util/perf_regs.h).  abi is
+ * PERF_SAMPLE_REGS_ABI_NONE when the sample had no user context.
+ */
+struct regs_dump {
+	u64			abi;
+	u64			mask;
+	u64			*regs;
+};
+
+/*
+ * PERF_SAMPLE_STACK_USER: the stack from the user stack pointer on,
+ * of which the first dyn_size bytes were actually read.
+ */
+struct stack_dump {
+	u64			size;
+	char			*data;
+	u64			dyn_size;
+};
+
+/*
+ * The fields of a PERF_EVENT_SAMPLE record, as selected by the
+ * sample_type of the file.  Fields that were not sampled are zero.
+ */
+struct sample_data {
+	u64			ip;
+	u32			pid, tid;
+	u64			time;
+	u64			addr;
+	u64			id;
+	u64			stream_id;
+	u32			cpu;
+	u64			period;
+	struct ip_callchain	*callchain;
+	u32			raw_size;
+	void			*raw_data;
+	struct regs_dump	user_regs;
+	struct stack_dump	user_stack;
+};
+
+struct perf_file_handler {
+	/*
+	 * Check the sample_type of the file before any record is read,
+	 * return a negative value to refuse the file.
+	 */
+	int	(*sample_type_check)(u64 sample_type);
+	int	(*process_sample_event)(struct sample_data *data);
+
+	int			dump_trace;
+
+	/* Filled in while the file is read */
+	u64			sample_type;
+	u64			sample_regs_user;
+	unsigned long		nr_events;
+	unsigned long		nr_lost_chunks;
+	unsigned long		nr_lost_events;
+	unsigned long		nr_unknown_events;
+};
+
+void perf_sample__parse(struct perf_event_header *header, u64 sample_type,
+			u64 regs_user, struct sample_data *data);
+
+int mmap_dispatch_perf_file(struct perf_file_handler *handler,
+			    const char *input_name, int force,
+			    const char *record_cmd);
+
+void perf_file_handler__print_bad_events(struct perf_file_handler *handler);
+
+#endif /* __PERF_DATAMAP_H */
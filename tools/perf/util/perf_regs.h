@@ -0,0 +1,32 @@
+#ifndef __PERF_REGS_H
+#define __PERF_REGS_H
+
+/*
+ * The registers perf record asks for with --call-graph=dwarf, and the
+ * ones the unwinder starts from.  The numbers are those of the kernel's
+ * asm/perf_regs.h.
+ */
+
+#if defined(__i386__) || defined(__x86_64__)
+#include "../../../arch/x86/include/asm/perf_regs.h"
+
+#define HAVE_PERF_REGS
+
+#ifdef __x86_64__
+/* ds, es, fs and gs are not saved by a 64-bit kernel */
+#define PERF_REGS_MASK	(((1ULL << PERF_REG_X86_64_MAX) - 1) & \
+			 ~((1ULL << PERF_REG_X86_DS) | \
+			   (1ULL << PERF_REG_X86_ES) | \
+			   (1ULL << PERF_REG_X86_FS) | \
+			   (1ULL << PERF_REG_X86_GS)))
+#else
+#define PERF_REGS_MASK	((1ULL << PERF_REG_X86_32_MAX) - 1)
+#endif
+
+#define PERF_REG_IP	PERF_REG_X86_IP
+#define PERF_REG_SP	PERF_REG_X86_SP
+#else
+#define PERF_REGS_MASK	0
+#endif
+
+#endif /* __PERF_REGS_H */
@@ -0,0 +1,463 @@
+/*
+ * probe-finder.c : C expression to kprobe event converter
+ *
+ * Walks the DWARF debuginfo of the kernel image to turn a source level
+ * probe point (a function, a line relative to a function or a line in
+ * a source file) into kprobe-tracer "SYMBOL+OFFSET" definitions, and
+ * the names of local variables and arguments into fetch arguments
+ * such as "%ax" or "-20(%bp)".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "util.h"
+#include "types.h"
+#include "probe-finder.h"
+
+/*
+ * DWARF register number to the register names used by the kprobe
+ * tracer, which are the field names of struct pt_regs.
+ */
+#ifdef __x86_64__
+static const char *arch_regs_table[] = {
+	"%ax",
+	"%dx",
+	"%cx",
+	"%bx",
+	"%si",
+	"%di",
+	"%bp",
+	"%sp",
+	"%r8",
+	"%r9",
+	"%r10",
+	"%r11",
+	"%r12",
+	"%r13",
+	"%r14",
+	"%r15",
+};
+#else
+static const char *arch_regs_table[] = {
+	"%ax",
+	"%cx",
+	"%dx",
+	"%bx",
+	"%sp",
+	"%bp",
+	"%si",
+	"%di",
+};
+#endif
+
+/* Return architecture dependent register string (for kprobe-tracer) */
+static const char *get_arch_regstr(unsigned int n)
+{
+	return (n < ARRAY_SIZE(arch_regs_table)) ? arch_regs_table[n] : NULL;
+}
+
+/*
+ * Compare the tail of two strings.
+ * Return 0 if whole of either string is same as another's tail part.
+ */
+static int strtailcmp(const char *s1, const char *s2)
+{
+	int i1 = strlen(s1);
+	int i2 = strlen(s2);
+
+	while (--i1 >= 0 && --i2 >= 0) {
+		if (s1[i1] != s2[i2])
+			return s1[i1] - s2[i2];
+	}
+	return 0;
+}
+
+/* Find the real name of the file @fname in the files of @cu_die */
+static const char *cu_find_realpath(Dwarf_Die *cu_die, const char *fname)
+{
+	Dwarf_Files *files;
+	size_t nfiles, i;
+	const char *src;
+
+	if (dwarf_getsrcfiles(cu_die, &files, &nfiles) != 0)
+		return NULL;
+
+	for (i = 0; i < nfiles; i++) {
+		src = dwarf_filesrc(files, i, NULL, NULL);
+		if (src && strtailcmp(src, fname) == 0)
+			return src;
+	}
+	return NULL;
+}
+
+/* Name of a function, including out-of-line copies of inline functions */
+static const char *die_get_name(Dwarf_Die *die)
+{
+	Dwarf_Attribute attr;
+
+	return dwarf_formstring(dwarf_attr_integrate(die, DW_AT_name, &attr));
+}
+
+/*
+ * Probe finder related functions
+ */
+
+static void __attribute__((format(printf, 2, 3)))
+buf_printf(struct probe_finder *pf, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(pf->buf, pf->len, fmt, ap);
+	va_end(ap);
+	if (ret < 0 || ret >= pf->len)
+		die("The probe definition is too long.");
+	pf->buf += ret;
+	pf->len -= ret;
+}
+
+/* Show a location */
+static void show_location(Dwarf_Op *op, struct probe_finder *pf)
+{
+	unsigned int regn;
+	Dwarf_Word offs = 0;
+	int deref = 0;
+	const char *regs;
+
+	/* Static variables on memory (not stack), make @varname */
+	if (op->atom == DW_OP_addr) {
+		buf_printf(pf, " %s=@0x%Lx", pf->var, (u64)op->number);
+		return;
+	}
+
+	/* If this is based on frame buffer, set the offset */
+	if (op->atom == DW_OP_fbreg) {
+		if (pf->fb_ops == NULL)
+			die("The attribute of frame base is not supported.");
+		deref = 1;
+		offs = op->number;
+		op = &pf->fb_ops[0];
+	}
+
+	if (op->atom >= DW_OP_breg0 && op->atom <= DW_OP_breg31) {
+		regn = op->atom - DW_OP_breg0;
+		offs += op->number;
+		deref = 1;
+	} else if (op->atom >= DW_OP_reg0 && op->atom <= DW_OP_reg31) {
+		regn = op->atom - DW_OP_reg0;
+	} else if (op->atom == DW_OP_bregx) {
+		regn = op->number;
+		offs += op->number2;
+		deref = 1;
+	} else if (op->atom == DW_OP_regx) {
+		regn = op->number;
+	} else
+		die("DW_OP %d is not supported.", op->atom);
+
+	regs = get_arch_regstr(regn);
+	if (!regs)
+		die("%u exceeds max register number.", regn);
+
+	if (deref)
+		buf_printf(pf, " %s=%+Ld(%s)",
+			   pf->var, (s64)offs, regs);
+	else
+		buf_printf(pf, " %s=%s", pf->var, regs);
+}
+
+/* Show a variables in kprobe event format */
+static void show_variable(Dwarf_Die *vr_die, struct probe_finder *pf)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Op *expr;
+	size_t nexpr;
+	int ret;
+
+	if (dwarf_attr(vr_die, DW_AT_location, &attr) == NULL)
+		goto error;
+	ret = dwarf_getlocation_addr(&attr, pf->addr, &expr, &nexpr, 1);
+	if (ret <= 0 || nexpr == 0)
+		goto error;
+	if (nexpr > 1)
+		die("Location of %s is too complex to fetch.", pf->var);
+
+	show_location(expr, pf);
+	return;
+error:
+	die("Failed to find the location of %s at this address.\n"
+	    " Perhaps, it has been optimized out.", pf->var);
+}
+
+/* Find a variable in a subprogram die */
+static void find_variable(Dwarf_Die *scopes, int nscopes,
+			  struct probe_finder *pf)
+{
+	Dwarf_Die vr_die;
+
+	if (!is_c_varname(pf->var)) {
+		/* Raw kprobe-tracer arguments: %REG, $stackN, @ADDR, ... */
+		buf_printf(pf, " %s", pf->var);
+		return;
+	}
+
+	if (dwarf_getscopevar(scopes, nscopes, pf->var, 0, NULL, 0, 0,
+			      &vr_die) < 0)
+		die("Failed to find '%s' in this function.", pf->var);
+
+	show_variable(&vr_die, pf);
+}
+
+/* Get the frame base of the function containing the probe address */
+static void get_frame_base(Dwarf_Die *sp_die, struct probe_finder *pf,
+			   Dwarf_Frame **frame)
+{
+	Dwarf_Attribute fb_attr;
+	int ret;
+
+	pf->fb_ops = NULL;
+	if (dwarf_attr(sp_die, DW_AT_frame_base, &fb_attr) == NULL)
+		return;
+
+	ret = dwarf_getlocation_addr(&fb_attr, pf->addr, &pf->fb_ops,
+				     &pf->nr_fb_ops, 1);
+	if (ret <= 0 || pf->nr_fb_ops != 1) {
+		pf->fb_ops = NULL;
+		return;
+	}
+
+	/*
+	 * Newer compilers describe the frame base as the canonical frame
+	 * address, which only the call frame information can resolve into
+	 * a register and an offset at this address.
+	 */
+	if (pf->fb_ops[0].atom == DW_OP_call_frame_cfa) {
+		if (pf->cfi == NULL ||
+		    dwarf_cfi_addrframe(pf->cfi, pf->addr, frame) != 0 ||
+		    dwarf_frame_cfa(*frame, &pf->fb_ops, &pf->nr_fb_ops) != 0 ||
+		    pf->nr_fb_ops != 1)
+			pf->fb_ops = NULL;
+	}
+}
+
+/* Show a probe point to output buffer */
+static void show_probe_point(struct probe_finder *pf)
+{
+	struct probe_point *pp = pf->pp;
+	Dwarf_Die *scopes, *sp_die = NULL;
+	Dwarf_Frame *frame = NULL;
+	Dwarf_Addr eaddr;
+	char tmp[MAX_PROBE_BUFFER];
+	const char *name;
+	int nscopes, i;
+
+	if (pp->found == MAX_PROBES)
+		die("Too many( > %d) probe points found.", MAX_PROBES);
+
+	nscopes = dwarf_getscopes(&pf->cu_die, pf->addr, &scopes);
+	if (nscopes <= 0)
+		die("Probe point 0x%Lx is not in any function.",
+		    (u64)pf->addr);
+
+	/* The outermost subprogram is the function that has a symbol */
+	for (i = nscopes - 1; i >= 0; i--)
+		if (dwarf_tag(&scopes[i]) == DW_TAG_subprogram) {
+			sp_die = &scopes[i];
+			break;
+		}
+	if (!sp_die)
+		die("Probe point 0x%Lx is not in any function.",
+		    (u64)pf->addr);
+
+	name = die_get_name(sp_die);
+	if (!name || dwarf_entrypc(sp_die, &eaddr) != 0)
+		die("Failed to get the function at 0x%Lx.",
+		    (u64)pf->addr);
+
+	if (pp->retprobe && pf->addr != eaddr)
+		die("Return probe must be on the head of a real function.");
+
+	pf->buf = tmp;
+	pf->len = MAX_PROBE_BUFFER;
+	buf_printf(pf, "%s+%u", name, (unsigned int)(pf->addr - eaddr));
+
+	if (pp->nr_args > 0) {
+		get_frame_base(sp_die, pf, &frame);
+		for (i = 0; i < pp->nr_args; i++) {
+			pf->var = pp->args[i];
+			find_variable(scopes, nscopes, pf);
+		}
+		free(frame);
+	}
+	free(scopes);
+
+	/* The same address may be reached from more than one line entry */
+	for (i = 0; i < pp->found; i++)
+		if (!strcmp(pp->probes[i], tmp))
+			return;
+
+	pp->probes[pp->found] = strdup(tmp);
+	if (!pp->probes[pp->found])
+		die("Not enough memory.");
+	pp->found++;
+}
+
+/* Find probe points on lines */
+static void find_by_line(struct probe_finder *pf)
+{
+	Dwarf_Lines *lines;
+	Dwarf_Line *line;
+	size_t nlines, i;
+	Dwarf_Addr addr;
+	const char *src, *prev_src = NULL;
+	int lineno, prev_lineno = -1;
+	bool is_stmt;
+
+	if (dwarf_getsrclines(&pf->cu_die, &lines, &nlines) != 0)
+		return;
+
+	for (i = 0; i < nlines; i++) {
+		line = dwarf_onesrcline(lines, i);
+		if (dwarf_lineno(line, &lineno) != 0)
+			continue;
+		src = dwarf_linesrc(line, NULL, NULL);
+
+		/* Only the first entry of a run of the same line */
+		if (lineno == prev_lineno && src == prev_src)
+			continue;
+		prev_lineno = lineno;
+		prev_src = src;
+
+		if (lineno != pf->lno || !src || strtailcmp(src, pf->fname))
+			continue;
+		if (dwarf_linebeginstatement(line, &is_stmt) != 0 || !is_stmt)
+			continue;
+		if (dwarf_lineaddr(line, &addr) != 0)
+			continue;
+		/* Function relative lines must be in that function */
+		if (pf->sp_die && dwarf_haspc(pf->sp_die, addr) <= 0)
+			continue;
+
+		pf->addr = addr;
+		show_probe_point(pf);
+	}
+}
+
+static int probe_point_inline_cb(Dwarf_Die *in_die, void *data)
+{
+	struct probe_finder *pf = data;
+
+	/* Get probe address */
+	if (dwarf_entrypc(in_die, &pf->addr) != 0)
+		return DWARF_CB_OK;
+
+	pf->addr += pf->pp->offset;
+	show_probe_point(pf);
+	return DWARF_CB_OK;
+}
+
+/* Search function from function name */
+static int probe_point_search_cb(Dwarf_Die *sp_die, void *data)
+{
+	struct probe_finder *pf = data;
+	struct probe_point *pp = pf->pp;
+	const char *name;
+	int lno;
+
+	name = die_get_name(sp_die);
+	if (!name || strcmp(name, pp->function) != 0)
+		return DWARF_CB_OK;
+
+	if (pp->file) {
+		const char *file = dwarf_decl_file(sp_die);
+
+		if (!file || strtailcmp(file, pp->file) != 0)
+			return DWARF_CB_OK;
+	}
+
+	if (pp->line) {
+		/* Function relative line */
+		pf->fname = dwarf_decl_file(sp_die);
+		if (!pf->fname || dwarf_decl_line(sp_die, &lno) != 0)
+			return DWARF_CB_OK;
+		pf->lno = lno + pp->line;
+		/* Inlined code is spread over its callers, don't filter it */
+		pf->sp_die = dwarf_func_inline(sp_die) ? NULL : sp_die;
+		find_by_line(pf);
+		pf->sp_die = NULL;
+	} else if (!dwarf_func_inline(sp_die)) {
+		/* Real function, a declaration has no entry pc */
+		if (dwarf_entrypc(sp_die, &pf->addr) != 0)
+			return DWARF_CB_OK;
+		pf->addr += pp->offset;
+		show_probe_point(pf);
+	} else {
+		/* Inlined function: search instances */
+		if (pp->retprobe)
+			die("Return probe can not be put on the inline "
+			    "function %s.", name);
+		dwarf_func_inline_instances(sp_die, probe_point_inline_cb, pf);
+	}
+
+	return DWARF_CB_OK;
+}
+
+/* Find probe points from debuginfo */
+int find_probepoint(int fd, struct probe_point *pp)
+{
+	struct probe_finder pf = {.pp = pp};
+	Dwarf_CFI *elf_cfi = NULL;
+	Dwarf_Off off, noff;
+	size_t cuhl;
+	Dwarf *dbg;
+
+	dbg = dwarf_begin(fd, DWARF_C_READ);
+	if (!dbg)
+		return -ENOENT;
+
+	/* Prefer .debug_frame, fall back to .eh_frame */
+	pf.cfi = dwarf_getcfi(dbg);
+	if (!pf.cfi)
+		pf.cfi = elf_cfi = dwarf_getcfi_elf(dwarf_getelf(dbg));
+
+	pp->found = 0;
+	off = 0;
+	/* Loop on CUs (Compilation Unit) */
+	while (!dwarf_nextcu(dbg, off, &noff, &cuhl, NULL, NULL, NULL)) {
+		/* Get the DIE(Debugging Information Entry) of this CU */
+		if (!dwarf_offdie(dbg, off + cuhl, &pf.cu_die))
+			goto next;
+
+		/* Check if target file is included. */
+		if (pp->file)
+			pf.fname = cu_find_realpath(&pf.cu_die, pp->file);
+		else
+			pf.fname = NULL;
+
+		if (!pp->file || pf.fname) {
+			if (pp->function)
+				dwarf_getfuncs(&pf.cu_die, probe_point_search_cb,
+					       &pf, 0);
+			else {
+				pf.lno = pp->line;
+				find_by_line(&pf);
+			}
+		}
+next:
+		off = noff;
+	}
+
+	if (elf_cfi)
+		dwarf_cfi_end(elf_cfi);
+	dwarf_end(dbg);
+
+	return pp->found;
+}
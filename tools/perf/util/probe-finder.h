@@ -0,0 +1,60 @@
+#ifndef _PROBE_FINDER_H
+#define _PROBE_FINDER_H
+
+#define MAX_PATH_LEN		 256
+#define MAX_PROBE_BUFFER	1024
+#define MAX_PROBES		 128
+#define MAX_PROBE_ARGS		 128
+
+static inline int is_c_varname(const char *name)
+{
+	return isalpha(name[0]) || name[0] == '_';
+}
+
+struct probe_point {
+	char	*event;			/* Event name, NULL if not given */
+
+	/* Inputs */
+	char	*file;			/* File name */
+	int	line;			/* Line number */
+
+	char	*function;		/* Function name */
+	int	offset;			/* Offset bytes */
+
+	int	retprobe;		/* Return probe */
+
+	int	nr_args;		/* Number of arguments */
+	char	**args;			/* Arguments */
+
+	/* Output */
+	int	found;			/* Number of found probe points */
+	char	*probes[MAX_PROBES];	/* "SYM+OFFS ARGS..", allocated */
+};
+
+#ifdef DWARF_SUPPORT
+extern int find_probepoint(int fd, struct probe_point *pp);
+
+#include <dwarf.h>
+#include <libdw.h>
+
+struct probe_finder {
+	struct probe_point	*pp;		/* Target probe point */
+
+	/* For function searching */
+	Dwarf_Addr		addr;		/* Address */
+	const char		*fname;		/* File name */
+	int			lno;		/* Line number */
+	Dwarf_Die		cu_die;		/* Current CU */
+	Dwarf_Die		*sp_die;	/* Function for FUNC:RLN */
+
+	/* For variable searching */
+	Dwarf_CFI		*cfi;		/* Call frame information */
+	Dwarf_Op		*fb_ops;	/* Frame base expression */
+	size_t			nr_fb_ops;
+	const char		*var;		/* Current variable name */
+	char			*buf;		/* Current output buffer */
+	int			len;		/* Length of output buffer */
+};
+#endif /* DWARF_SUPPORT */
+
+#endif /* _PROBE_FINDER_H */
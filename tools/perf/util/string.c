@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "string.h"
 
 static int hex(char ch)
@@ -32,3 +33,54 @@ int hex2u64(const char *ptr, u64 *long_val)
 
 	return p - ptr;
 }
+
+/*
+ * perf_atoll()
+ * Parse (\d+)(b|B|kb|KB|mb|MB|gb|GB) (e.g. "256MB")
+ * and return its numeric value
+ */
+s64 perf_atoll(const char *str)
+{
+	char *p;
+	s64 length;
+	s64 unit = 1;
+
+	length = strtoll(str, &p, 10);
+	if (p == str || length < 0)
+		return -1;
+
+	switch (*p) {
+	case '\0':
+		return length;
+	case 'b':
+	case 'B':
+		unit = 1;
+		p++;
+		break;
+	case 'k':
+	case 'K':
+		unit = 1 << 10;
+		p++;
+		break;
+	case 'm':
+	case 'M':
+		unit = 1 << 20;
+		p++;
+		break;
+	case 'g':
+	case 'G':
+		unit = 1 << 30;
+		p++;
+		break;
+	default:
+		return -1;
+	}
+
+	/* Accept an optional trailing b/B after the multiplier: "4K", "4KB" */
+	if (unit != 1 && (*p == 'b' || *p == 'B'))
+		p++;
+	if (*p != '\0')
+		return -1;
+
+	return length * unit;
+}
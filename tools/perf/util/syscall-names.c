@@ -0,0 +1,27 @@
+/*
+ * System call names, generated from the kernel's own unistd header.
+ *
+ * This file must not include the libc headers: they carry the __NR_
+ * numbers of the installed kernel headers, which need not match the
+ * ones of this tree.
+ */
+#include "syscall-names.h"
+
+#if defined(__x86_64__)
+/*
+ * Every __NR_ constant is stringified without its prefix, so the names
+ * are the ones user space knows (stat, not sys_newstat).
+ */
+#define __SYSCALL(nr, sym)	[nr] = #nr + 5,
+
+const char *syscall_names[] = {
+#include "../../../arch/x86/include/asm/unistd_64.h"
+};
+
+#undef __SYSCALL
+
+const int nr_syscall_names = sizeof(syscall_names) / sizeof(syscall_names[0]);
+#else
+const char *syscall_names[] = { 0 };
+const int nr_syscall_names = 0;
+#endif
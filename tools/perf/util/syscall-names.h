@@ -0,0 +1,11 @@
+#ifndef __PERF_SYSCALL_NAMES_H
+#define __PERF_SYSCALL_NAMES_H
+
+/*
+ * The names of the system calls of the kernel perf is built with,
+ * indexed by number.  Empty on architectures without a table.
+ */
+extern const char *syscall_names[];
+extern const int nr_syscall_names;
+
+#endif /* __PERF_SYSCALL_NAMES_H */
@@ -0,0 +1,315 @@
+/*
+ * Minimal parser for the tracepoint format files exported through
+ * debugfs, so that raw tracepoint samples can be decoded by field name.
+ *
+ * Events are looked up by their id, which is the common_type field at
+ * the start of every raw record, and parsed on first use.
+ */
+
+#include "../perf.h"
+#include "util.h"
+#include "parse-events.h"
+#include "trace-event.h"
+
+static struct event *event_list;
+
+static int read_event_id(const char *path)
+{
+	char buf[32];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	return atoi(buf);
+}
+
+/*
+ * Work out the signedness of a field from its C type, for kernels whose
+ * format files do not say so themselves.
+ */
+static int type_is_signed(const char *type)
+{
+	if (strstr(type, "unsigned") || strchr(type, '*'))
+		return 0;
+	if (type[0] == 'u' && isdigit(type[1]))
+		return 0;
+	if (!strcmp(type, "size_t") || !strcmp(type, "bool"))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Parse one line of the form:
+ *
+ *	field:unsigned short common_type;	offset:0;	size:2;
+ */
+static struct format_field *parse_field(char *line)
+{
+	struct format_field *field;
+	char *decl, *end, *name, *p;
+
+	decl = strchr(line, ':');
+	if (!decl)
+		return NULL;
+	decl++;
+
+	end = strchr(decl, ';');
+	if (!end)
+		return NULL;
+	*end = '\0';
+
+	/* Drop an array suffix: "char comm[16]" */
+	p = strchr(decl, '[');
+	if (p)
+		*p = '\0';
+
+	/* The name is the last word of the declaration */
+	p = decl + strlen(decl);
+	while (p > decl && isspace(p[-1]))
+		*--p = '\0';
+	name = p;
+	while (name > decl && !isspace(name[-1]) && name[-1] != '*')
+		name--;
+	if (!*name)
+		return NULL;
+
+	field = calloc(1, sizeof(*field));
+	if (!field)
+		die("not enough memory for a format field");
+
+	field->name = strdup(name);
+	*name = '\0';
+	while (isspace(*decl))
+		decl++;
+	p = decl + strlen(decl);
+	while (p > decl && isspace(p[-1]))
+		*--p = '\0';
+	field->type = strdup(decl);
+
+	p = strstr(end + 1, "offset:");
+	if (p)
+		field->offset = atoi(p + strlen("offset:"));
+	p = strstr(end + 1, "size:");
+	if (p)
+		field->size = atoi(p + strlen("size:"));
+
+	p = strstr(end + 1, "signed:");
+	if (p)
+		field->is_signed = atoi(p + strlen("signed:"));
+	else
+		field->is_signed = type_is_signed(field->type);
+
+	return field;
+}
+
+static struct event *parse_format(const char *path, const char *system,
+				  const char *name, int id)
+{
+	struct format_field **tail;
+	struct event *event;
+	char line[BUFSIZ];
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file)
+		return NULL;
+
+	event = calloc(1, sizeof(*event));
+	if (!event)
+		die("not enough memory for an event format");
+
+	event->system = strdup(system);
+	event->name = strdup(name);
+	event->id = id;
+	tail = &event->fields;
+
+	while (fgets(line, sizeof(line), file)) {
+		char *p = line;
+
+		while (isspace(*p))
+			p++;
+		if (strncmp(p, "field", 5))
+			continue;
+
+		*tail = parse_field(p);
+		if (*tail)
+			tail = &(*tail)->next;
+	}
+
+	fclose(file);
+
+	return event;
+}
+
+static struct event *load_event(int id)
+{
+	struct dirent *sys_dirent, *evt_dirent;
+	DIR *sys_dir, *evt_dir;
+	char path[MAXPATHLEN];
+	struct event *event = NULL;
+
+	if (valid_debugfs_mount(debugfs_path))
+		return NULL;
+
+	sys_dir = opendir(debugfs_path);
+	if (!sys_dir)
+		return NULL;
+
+	while (!event && (sys_dirent = readdir(sys_dir))) {
+		if (sys_dirent->d_name[0] == '.')
+			continue;
+
+		snprintf(path, MAXPATHLEN, "%s/%s", debugfs_path,
+			 sys_dirent->d_name);
+		evt_dir = opendir(path);
+		if (!evt_dir)
+			continue;
+
+		while ((evt_dirent = readdir(evt_dir))) {
+			if (evt_dirent->d_name[0] == '.')
+				continue;
+
+			snprintf(path, MAXPATHLEN, "%s/%s/%s/id",
+				 debugfs_path, sys_dirent->d_name,
+				 evt_dirent->d_name);
+			if (read_event_id(path) != id)
+				continue;
+
+			snprintf(path, MAXPATHLEN, "%s/%s/%s/format",
+				 debugfs_path, sys_dirent->d_name,
+				 evt_dirent->d_name);
+			event = parse_format(path, sys_dirent->d_name,
+					     evt_dirent->d_name, id);
+			break;
+		}
+		closedir(evt_dir);
+	}
+	closedir(sys_dir);
+
+	return event;
+}
+
+struct event *trace_find_event(int id)
+{
+	struct event *event;
+
+	for (event = event_list; event; event = event->next)
+		if (event->id == id)
+			return event;
+
+	event = load_event(id);
+	if (event) {
+		event->next = event_list;
+		event_list = event;
+	}
+
+	return event;
+}
+
+struct format_field *trace_find_field(struct event *event, const char *name)
+{
+	struct format_field *field;
+
+	for (field = event->fields; field; field = field->next)
+		if (!strcmp(field->name, name))
+			return field;
+
+	return NULL;
+}
+
+/*
+ * Every raw record starts with struct trace_entry:
+ *
+ *	unsigned short	common_type;
+ *	unsigned char	common_flags;
+ *	unsigned char	common_preempt_count;
+ *	int		common_pid;
+ */
+int trace_parse_common_type(void *data)
+{
+	unsigned short type;
+
+	memcpy(&type, data, sizeof(type));
+	return type;
+}
+
+int trace_parse_common_pid(void *data)
+{
+	int pid;
+
+	memcpy(&pid, (char *)data + 4, sizeof(pid));
+	return pid;
+}
+
+u64 raw_field_value(struct event *event, const char *name, void *data)
+{
+	struct format_field *field = trace_find_field(event, name);
+	void *ptr;
+
+	if (!field)
+		return 0;
+
+	ptr = (char *)data + field->offset;
+
+	/* Raw records are only 4 byte aligned, copy instead of casting */
+	switch (field->size) {
+	case 1: {
+		u8 val;
+
+		memcpy(&val, ptr, 1);
+		return field->is_signed ? (u64)(s8)val : val;
+	}
+	case 2: {
+		u16 val;
+
+		memcpy(&val, ptr, 2);
+		return field->is_signed ? (u64)(s16)val : val;
+	}
+	case 4: {
+		u32 val;
+
+		memcpy(&val, ptr, 4);
+		return field->is_signed ? (u64)(s32)val : val;
+	}
+	case 8: {
+		u64 val;
+
+		memcpy(&val, ptr, 8);
+		return val;
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Dynamic arrays and strings (__string() in TRACE_EVENT) are stored
+ * after the fixed fields: the field itself only holds the offset of
+ * the data from the start of the record.
+ */
+void *raw_field_ptr(struct event *event, const char *name, void *data)
+{
+	struct format_field *field = trace_find_field(event, name);
+
+	if (!field)
+		return NULL;
+
+	if (!strncmp(field->type, "__data_loc", strlen("__data_loc"))) {
+		u16 loc;
+
+		memcpy(&loc, (char *)data + field->offset, sizeof(loc));
+		return (char *)data + loc;
+	}
+
+	return (char *)data + field->offset;
+}
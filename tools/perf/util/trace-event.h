@@ -0,0 +1,41 @@
+#ifndef _PERF_TRACE_EVENT_H
+#define _PERF_TRACE_EVENT_H
+
+#include "types.h"
+
+/*
+ * Tracepoint samples (PERF_SAMPLE_RAW) carry the binary record of the
+ * event, laid out as described by the event's format file in debugfs:
+ *
+ *	<debugfs>/<system>/<event>/format
+ *
+ * The layout is not an ABI, so fields are looked up by name.
+ */
+
+struct format_field {
+	struct format_field	*next;
+	char			*type;
+	char			*name;
+	int			offset;
+	int			size;
+	int			is_signed;
+};
+
+struct event {
+	struct event		*next;
+	char			*system;
+	char			*name;
+	int			id;
+	struct format_field	*fields;
+};
+
+struct event *trace_find_event(int id);
+struct format_field *trace_find_field(struct event *event, const char *name);
+
+int trace_parse_common_type(void *data);
+int trace_parse_common_pid(void *data);
+
+u64 raw_field_value(struct event *event, const char *name, void *data);
+void *raw_field_ptr(struct event *event, const char *name, void *data);
+
+#endif /* _PERF_TRACE_EVENT_H */
@@ -0,0 +1,598 @@
+/*
+ * unwind.c: DWARF unwinding of the user stack dumped with a sample
+ *
+ * With perf record --call-graph-mode=dwarf the kernel puts the user
+ * registers and a copy of the top of the user stack in every sample
+ * (PERF_SAMPLE_REGS_USER, PERF_SAMPLE_STACK_USER).  This walks the
+ * frames of that copy with the call frame information of the mapped
+ * binaries (.eh_frame, or .debug_frame if there is none), so that user
+ * callchains can be had without frame pointers.
+ *
+ * The CFI tables are read with libdw, the rules are evaluated here:
+ * memory can only be read from the stack dump.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "util.h"
+#include "perf_regs.h"
+#include "unwind.h"
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <dwarf.h>
+#include <libdw.h>
+
+#define UNWIND_REGS_MAX		17
+#define UNWIND_EXPR_STACK	16
+
+/*
+ * The registers of an ABI in DWARF numbering, with the perf register
+ * that holds each of them.
+ */
+struct unwind_arch {
+	int		nr_regs;
+	const int	*perf_regs;
+	int		sp;		/* DWARF number of the stack pointer */
+	int		ip;		/* and of the return address column */
+	int		addr_size;
+};
+
+#ifdef HAVE_PERF_REGS
+static const int x86_64_perf_regs[] = {
+	PERF_REG_X86_AX,
+	PERF_REG_X86_DX,
+	PERF_REG_X86_CX,
+	PERF_REG_X86_BX,
+	PERF_REG_X86_SI,
+	PERF_REG_X86_DI,
+	PERF_REG_X86_BP,
+	PERF_REG_X86_SP,
+	PERF_REG_X86_R8,
+	PERF_REG_X86_R9,
+	PERF_REG_X86_R10,
+	PERF_REG_X86_R11,
+	PERF_REG_X86_R12,
+	PERF_REG_X86_R13,
+	PERF_REG_X86_R14,
+	PERF_REG_X86_R15,
+	PERF_REG_X86_IP,
+};
+
+static const int x86_32_perf_regs[] = {
+	PERF_REG_X86_AX,
+	PERF_REG_X86_CX,
+	PERF_REG_X86_DX,
+	PERF_REG_X86_BX,
+	PERF_REG_X86_SP,
+	PERF_REG_X86_BP,
+	PERF_REG_X86_SI,
+	PERF_REG_X86_DI,
+	PERF_REG_X86_IP,
+};
+
+static const struct unwind_arch unwind_x86_64 = {
+	.nr_regs	= ARRAY_SIZE(x86_64_perf_regs),
+	.perf_regs	= x86_64_perf_regs,
+	.sp		= 7,
+	.ip		= 16,
+	.addr_size	= 8,
+};
+
+static const struct unwind_arch unwind_x86_32 = {
+	.nr_regs	= ARRAY_SIZE(x86_32_perf_regs),
+	.perf_regs	= x86_32_perf_regs,
+	.sp		= 4,
+	.ip		= 8,
+	.addr_size	= 4,
+};
+#endif
+
+static const struct unwind_arch *unwind_arch(u64 abi)
+{
+#ifdef HAVE_PERF_REGS
+	switch (abi) {
+	case PERF_SAMPLE_REGS_ABI_64:
+		return &unwind_x86_64;
+	case PERF_SAMPLE_REGS_ABI_32:
+		return &unwind_x86_32;
+	default:
+		break;
+	}
+#endif
+	return NULL;
+}
+
+/*
+ * The binaries whose CFI was looked at, kept open for the next samples.
+ * Files that could not be read stay on the list with no CFI.
+ */
+struct unwind_dso {
+	struct list_head	node;
+	char			*filename;
+	int			fd;
+	Elf			*elf;
+	Dwarf			*dwarf;
+	Dwarf_CFI		*eh_cfi;
+	Dwarf_CFI		*debug_cfi;
+	size_t			nr_loads;
+	GElf_Phdr		*loads;
+};
+
+static LIST_HEAD(unwind_dsos);
+
+static void unwind_dso__load(struct unwind_dso *self)
+{
+	size_t i, nr_phdrs;
+
+	self->fd = open(self->filename, O_RDONLY);
+	if (self->fd < 0)
+		return;
+
+	self->elf = elf_begin(self->fd, ELF_C_READ_MMAP, NULL);
+	if (!self->elf)
+		return;
+
+	if (elf_getphdrnum(self->elf, &nr_phdrs) || !nr_phdrs)
+		return;
+
+	self->loads = calloc(nr_phdrs, sizeof(*self->loads));
+	if (!self->loads)
+		return;
+
+	for (i = 0; i < nr_phdrs; i++) {
+		GElf_Phdr *phdr = &self->loads[self->nr_loads];
+
+		if (gelf_getphdr(self->elf, i, phdr) && phdr->p_type == PT_LOAD)
+			self->nr_loads++;
+	}
+
+	self->eh_cfi = dwarf_getcfi_elf(self->elf);
+
+	self->dwarf = dwarf_begin_elf(self->elf, DWARF_C_READ, NULL);
+	if (self->dwarf)
+		self->debug_cfi = dwarf_getcfi(self->dwarf);
+}
+
+static struct unwind_dso *unwind_dso__findnew(const char *filename)
+{
+	struct unwind_dso *pos;
+
+	list_for_each_entry(pos, &unwind_dsos, node)
+		if (!strcmp(pos->filename, filename))
+			return pos;
+
+	pos = calloc(1, sizeof(*pos));
+	if (!pos)
+		return NULL;
+
+	pos->filename = strdup(filename);
+	if (!pos->filename) {
+		free(pos);
+		return NULL;
+	}
+
+	unwind_dso__load(pos);
+	list_add(&pos->node, &unwind_dsos);
+
+	return pos;
+}
+
+/* The link time address of the byte at @offset in the file */
+static int unwind_dso__vaddr(struct unwind_dso *self, u64 offset, u64 *vaddr)
+{
+	size_t i;
+
+	for (i = 0; i < self->nr_loads; i++) {
+		GElf_Phdr *phdr = &self->loads[i];
+
+		if (offset >= phdr->p_offset &&
+		    offset < phdr->p_offset + phdr->p_filesz) {
+			*vaddr = offset - phdr->p_offset + phdr->p_vaddr;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+struct unwind_regs {
+	u64		val[UNWIND_REGS_MAX];
+	u64		valid;
+};
+
+struct unwind_info {
+	struct sample_data		*sample;
+	const struct unwind_arch	*arch;
+	u64				stack_start;
+	unwind_find_map_t		find_map;
+	void				*arg;
+};
+
+static int reg_get(struct unwind_regs *regs, unsigned int regno, u64 *val)
+{
+	if (regno >= UNWIND_REGS_MAX || !(regs->valid & (1ULL << regno)))
+		return -1;
+
+	*val = regs->val[regno];
+	return 0;
+}
+
+static void reg_set(struct unwind_regs *regs, unsigned int regno, u64 val)
+{
+	regs->val[regno] = val;
+	regs->valid |= 1ULL << regno;
+}
+
+/* Only what the kernel copied into the sample can be read */
+static int access_mem(struct unwind_info *ui, u64 addr, u64 *val)
+{
+	struct stack_dump *stack = &ui->sample->user_stack;
+	int size = ui->arch->addr_size;
+	u32 val32;
+
+	/* written so that a bogus addr can't wrap around */
+	if (addr < ui->stack_start || stack->dyn_size < (u64)size ||
+	    addr - ui->stack_start > stack->dyn_size - size)
+		return -1;
+
+	if (size == sizeof(u32)) {
+		memcpy(&val32, stack->data + addr - ui->stack_start, size);
+		*val = val32;
+	} else
+		memcpy(val, stack->data + addr - ui->stack_start, size);
+
+	return 0;
+}
+
+/* The sampled value of perf register @id */
+static int sample_reg(struct regs_dump *regs, int id, u64 *val)
+{
+	u64 mask = regs->mask;
+
+	if (!(mask & (1ULL << id)))
+		return -1;
+
+	*val = regs->regs[__builtin_popcountll(mask & ((1ULL << id) - 1))];
+	return 0;
+}
+
+/*
+ * Evaluate the DWARF expression of a CFA or register rule.  @value is
+ * set if the result is the value of the register rather than the
+ * address it was saved at.
+ */
+static int eval_expr(struct unwind_info *ui, struct unwind_regs *regs,
+		     u64 *cfa, Dwarf_Op *ops, size_t nops,
+		     u64 *result, int *value)
+{
+	u64 stack[UNWIND_EXPR_STACK];
+	int sp = 0;
+	size_t i;
+	u64 val;
+
+#define PUSH(x)	do {						\
+		u64 __x = (x);					\
+								\
+		if (sp >= UNWIND_EXPR_STACK)			\
+			return -1;				\
+		stack[sp++] = __x;				\
+	} while (0)
+#define NEED(n)	do {						\
+		if (sp < (n))					\
+			return -1;				\
+	} while (0)
+#define BINOP(op) do {						\
+		NEED(2);					\
+		stack[sp - 2] = stack[sp - 2] op stack[sp - 1];	\
+		sp--;						\
+	} while (0)
+#define CMPOP(op) do {						\
+		NEED(2);					\
+		stack[sp - 2] = (s64)stack[sp - 2] op		\
+				(s64)stack[sp - 1];		\
+		sp--;						\
+	} while (0)
+
+	*value = 0;
+
+	for (i = 0; i < nops; i++) {
+		Dwarf_Op *op = &ops[i];
+		unsigned int atom = op->atom;
+
+		if (atom >= DW_OP_lit0 && atom <= DW_OP_lit31) {
+			PUSH(atom - DW_OP_lit0);
+			continue;
+		}
+
+		if (atom >= DW_OP_breg0 && atom <= DW_OP_breg31) {
+			if (reg_get(regs, atom - DW_OP_breg0, &val))
+				return -1;
+			PUSH(val + (s64)op->number);
+			continue;
+		}
+
+		switch (atom) {
+		case DW_OP_const1u:
+		case DW_OP_const1s:
+		case DW_OP_const2u:
+		case DW_OP_const2s:
+		case DW_OP_const4u:
+		case DW_OP_const4s:
+		case DW_OP_const8u:
+		case DW_OP_const8s:
+		case DW_OP_constu:
+		case DW_OP_consts:
+			PUSH(op->number);
+			break;
+		case DW_OP_bregx:
+			if (reg_get(regs, op->number, &val))
+				return -1;
+			PUSH(val + (s64)op->number2);
+			break;
+		case DW_OP_call_frame_cfa:
+			if (!cfa)
+				return -1;
+			PUSH(*cfa);
+			break;
+		case DW_OP_dup:
+			NEED(1);
+			PUSH(stack[sp - 1]);
+			break;
+		case DW_OP_over:
+			NEED(2);
+			PUSH(stack[sp - 2]);
+			break;
+		case DW_OP_drop:
+			NEED(1);
+			sp--;
+			break;
+		case DW_OP_swap:
+			NEED(2);
+			val = stack[sp - 1];
+			stack[sp - 1] = stack[sp - 2];
+			stack[sp - 2] = val;
+			break;
+		case DW_OP_deref:
+			NEED(1);
+			if (access_mem(ui, stack[sp - 1], &stack[sp - 1]))
+				return -1;
+			break;
+		case DW_OP_plus_uconst:
+			NEED(1);
+			stack[sp - 1] += op->number;
+			break;
+		case DW_OP_neg:
+			NEED(1);
+			stack[sp - 1] = -stack[sp - 1];
+			break;
+		case DW_OP_not:
+			NEED(1);
+			stack[sp - 1] = ~stack[sp - 1];
+			break;
+		case DW_OP_plus:
+			BINOP(+);
+			break;
+		case DW_OP_minus:
+			BINOP(-);
+			break;
+		case DW_OP_mul:
+			BINOP(*);
+			break;
+		case DW_OP_and:
+			BINOP(&);
+			break;
+		case DW_OP_or:
+			BINOP(|);
+			break;
+		case DW_OP_xor:
+			BINOP(^);
+			break;
+		case DW_OP_shl:
+			BINOP(<<);
+			break;
+		case DW_OP_shr:
+			BINOP(>>);
+			break;
+		case DW_OP_lt:
+			CMPOP(<);
+			break;
+		case DW_OP_le:
+			CMPOP(<=);
+			break;
+		case DW_OP_gt:
+			CMPOP(>);
+			break;
+		case DW_OP_ge:
+			CMPOP(>=);
+			break;
+		case DW_OP_eq:
+			CMPOP(==);
+			break;
+		case DW_OP_ne:
+			CMPOP(!=);
+			break;
+		case DW_OP_stack_value:
+			*value = 1;
+			break;
+		case DW_OP_nop:
+			break;
+		default:
+			return -1;
+		}
+	}
+
+#undef PUSH
+#undef NEED
+#undef BINOP
+#undef CMPOP
+
+	if (!sp)
+		return -1;
+
+	*result = stack[sp - 1];
+	if (ui->arch->addr_size == sizeof(u32))
+		*result &= 0xffffffffULL;
+
+	return 0;
+}
+
+static Dwarf_Frame *unwind__find_frame(struct unwind_info *ui, u64 pc)
+{
+	struct unwind_map map;
+	struct unwind_dso *dso;
+	Dwarf_Frame *frame;
+	u64 addr;
+
+	if (ui->find_map(pc, &map, ui->arg))
+		return NULL;
+
+	dso = unwind_dso__findnew(map.filename);
+	if (!dso)
+		return NULL;
+
+	if (unwind_dso__vaddr(dso, pc - map.start + map.pgoff, &addr))
+		return NULL;
+
+	if (dso->eh_cfi && !dwarf_cfi_addrframe(dso->eh_cfi, addr, &frame))
+		return frame;
+
+	if (dso->debug_cfi &&
+	    !dwarf_cfi_addrframe(dso->debug_cfi, addr, &frame))
+		return frame;
+
+	return NULL;
+}
+
+/*
+ * Compute the registers of the caller of the frame in @regs.  The pc of
+ * a caller is a return address, it is looked up one byte earlier to stay
+ * within the call instruction, which may be the last of the function.
+ */
+static int unwind_step(struct unwind_info *ui, struct unwind_regs *regs,
+		       int first)
+{
+	const struct unwind_arch *arch = ui->arch;
+	struct unwind_regs caller = { .valid = 0 };
+	Dwarf_Op ops_mem[3], *ops;
+	Dwarf_Addr start, end;
+	Dwarf_Frame *frame;
+	u64 pc, sp, cfa, val;
+	size_t nops;
+	int regno, ra, value, ret = -1;
+
+	if (reg_get(regs, arch->ip, &pc) || reg_get(regs, arch->sp, &sp))
+		return -1;
+
+	frame = unwind__find_frame(ui, first ? pc : pc - 1);
+	if (!frame)
+		return -1;
+
+	if (dwarf_frame_cfa(frame, &ops, &nops) ||
+	    eval_expr(ui, regs, NULL, ops, nops, &cfa, &value))
+		goto out;
+
+	ra = dwarf_frame_info(frame, &start, &end, NULL);
+	if (ra < 0 || ra >= arch->nr_regs)
+		goto out;
+
+	for (regno = 0; regno < arch->nr_regs; regno++) {
+		if (dwarf_frame_register(frame, regno, ops_mem, &ops, &nops))
+			continue;
+
+		/* same value */
+		if (!ops) {
+			if (!reg_get(regs, regno, &val))
+				reg_set(&caller, regno, val);
+			continue;
+		}
+
+		/* undefined */
+		if (!nops)
+			continue;
+
+		if (eval_expr(ui, regs, &cfa, ops, nops, &val, &value))
+			continue;
+
+		if (!value && access_mem(ui, val, &val))
+			continue;
+
+		reg_set(&caller, regno, val);
+	}
+
+	/* The CFA is the stack pointer of the caller by definition */
+	reg_set(&caller, arch->sp, cfa);
+
+	if (reg_get(&caller, ra, &val) || !val)
+		goto out;
+	reg_set(&caller, arch->ip, val);
+
+	/* The stack has to unwind towards higher addresses */
+	if (cfa <= sp)
+		goto out;
+
+	*regs = caller;
+	ret = 0;
+out:
+	free(frame);
+	return ret;
+}
+
+int unwind__get_entries(unwind_entry_cb_t cb, unwind_find_map_t find_map,
+			void *arg, struct sample_data *data, int max_stack)
+{
+	static int elf_initialized;
+	struct unwind_info ui = {
+		.sample		= data,
+		.find_map	= find_map,
+		.arg		= arg,
+	};
+	struct unwind_regs regs = { .valid = 0 };
+	int regno, nr = 0;
+	u64 ip, val;
+
+	if (!data->user_regs.regs || !data->user_stack.size)
+		return 0;
+
+	ui.arch = unwind_arch(data->user_regs.abi);
+	if (!ui.arch)
+		return 0;
+
+	for (regno = 0; regno < ui.arch->nr_regs; regno++) {
+		int id = ui.arch->perf_regs[regno];
+
+		if (sample_reg(&data->user_regs, id, &val))
+			continue;
+		if (ui.arch->addr_size == sizeof(u32))
+			val &= 0xffffffffULL;
+		reg_set(&regs, regno, val);
+	}
+
+	if (reg_get(&regs, ui.arch->sp, &ui.stack_start))
+		return 0;
+
+	if (!elf_initialized) {
+		elf_version(EV_CURRENT);
+		elf_initialized = 1;
+	}
+
+	while (nr < max_stack) {
+		if (reg_get(&regs, ui.arch->ip, &ip) || !ip)
+			break;
+
+		if (cb(ip, arg))
+			break;
+		nr++;
+
+		if (unwind_step(&ui, &regs, nr == 1))
+			break;
+	}
+
+	return nr;
+}
@@ -0,0 +1,43 @@
+#ifndef __PERF_UNWIND_H
+#define __PERF_UNWIND_H
+
+#include "../perf.h"
+#include "data_map.h"
+
+/*
+ * The part of a mapping of the sampled task the unwinder needs to find
+ * the call frame information of an address.
+ */
+struct unwind_map {
+	u64		start;
+	u64		end;
+	u64		pgoff;
+	const char	*filename;
+};
+
+/* Look up the mapping of @ip, return 0 if found */
+typedef int (*unwind_find_map_t)(u64 ip, struct unwind_map *map, void *arg);
+
+/* Called with each return address, innermost first */
+typedef int (*unwind_entry_cb_t)(u64 ip, void *arg);
+
+#ifdef DWARF_SUPPORT
+/*
+ * Unwind the user stack dumped with the sample, starting at the sampled
+ * user registers.  Returns the number of entries passed to @cb.
+ */
+extern int unwind__get_entries(unwind_entry_cb_t cb,
+			       unwind_find_map_t find_map, void *arg,
+			       struct sample_data *data, int max_stack);
+#else
+static inline int unwind__get_entries(unwind_entry_cb_t cb __used,
+				      unwind_find_map_t find_map __used,
+				      void *arg __used,
+				      struct sample_data *data __used,
+				      int max_stack __used)
+{
+	return 0;
+}
+#endif /* DWARF_SUPPORT */
+
+#endif /* __PERF_UNWIND_H */